@@ -20,6 +20,10 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
 /*! \brief Maximal length of binary input to Base32hex encoding. */
 #define MAX_BIN_DATA_LEN	((INT32_MAX / 8) * 5)
 
@@ -193,6 +197,115 @@ int32_t knot_base32hex_encode_alloc(const uint8_t  *in,
 	return ret;
 }
 
+#ifdef HAVE_X86_SIMD
+/*
+ * Vectorized decoding of Base32hex blocks without padding. Characters are
+ * validated and translated to 5-bit values using range comparisons on
+ * the digits and the letters converted to lower case. The 5-bit values are
+ * merged into 20-bit words using multiply-add instructions, pairs of the words
+ * are merged into 40-bit blocks, and the output bytes are reordered.
+ */
+
+/*! \brief Output bytes order within two 64-bit words. */
+#define SIMD_PACK_LUT	4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1
+
+__attribute__((target("sse4.1")))
+static const uint8_t *decode_sse41(const uint8_t *in, const uint8_t *stop,
+                                   uint8_t **out)
+{
+	const __m128i pack_lut = _mm_setr_epi8(SIMD_PACK_LUT);
+
+	uint8_t *bin = *out;
+
+	// 16 characters are decoded into 10 bytes, 16 bytes are stored.
+	while (stop - in >= 32) {
+		__m128i str = _mm_loadu_si128((const __m128i *)in);
+		__m128i lower = _mm_or_si128(str, _mm_set1_epi8(0x20));
+		__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(str, _mm_set1_epi8('0' - 1)),
+		                              _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), str));
+		__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+		                              _mm_cmpgt_epi8(_mm_set1_epi8('v' + 1), lower));
+		if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xFFFF) {
+			break;
+		}
+
+		__m128i shift = _mm_blendv_epi8(_mm_set1_epi8('a' - 10),
+		                                _mm_set1_epi8('0'), digit);
+		str = _mm_sub_epi8(lower, shift);
+		str = _mm_maddubs_epi16(str, _mm_set1_epi16(0x0120));
+		str = _mm_madd_epi16(str, _mm_set1_epi32(0x00010400));
+		str = _mm_or_si128(_mm_and_si128(_mm_slli_epi64(str, 20),
+		                                 _mm_set1_epi64x(0xFFFFF00000)),
+		                   _mm_srli_epi64(str, 32));
+		_mm_storeu_si128((__m128i *)bin, _mm_shuffle_epi8(str, pack_lut));
+
+		in += 16;
+		bin += 10;
+	}
+
+	*out = bin;
+	return in;
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *decode_avx2(const uint8_t *in, const uint8_t *stop,
+                                  uint8_t **out)
+{
+	const __m256i pack_lut = _mm256_setr_epi8(SIMD_PACK_LUT, SIMD_PACK_LUT);
+
+	uint8_t *bin = *out;
+
+	// 32 characters are decoded into 20 bytes, 26 bytes are stored.
+	while (stop - in >= 48) {
+		__m256i str = _mm256_loadu_si256((const __m256i *)in);
+		__m256i lower = _mm256_or_si256(str, _mm256_set1_epi8(0x20));
+		__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(str, _mm256_set1_epi8('0' - 1)),
+		                                 _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), str));
+		__m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+		                                 _mm256_cmpgt_epi8(_mm256_set1_epi8('v' + 1), lower));
+		if (_mm256_movemask_epi8(_mm256_or_si256(digit, alpha)) != -1) {
+			break;
+		}
+
+		__m256i shift = _mm256_blendv_epi8(_mm256_set1_epi8('a' - 10),
+		                                   _mm256_set1_epi8('0'), digit);
+		str = _mm256_sub_epi8(lower, shift);
+		str = _mm256_maddubs_epi16(str, _mm256_set1_epi16(0x0120));
+		str = _mm256_madd_epi16(str, _mm256_set1_epi32(0x00010400));
+		str = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi64(str, 20),
+		                                       _mm256_set1_epi64x(0xFFFFF00000)),
+		                      _mm256_srli_epi64(str, 32));
+		str = _mm256_shuffle_epi8(str, pack_lut);
+		_mm_storeu_si128((__m128i *)bin, _mm256_castsi256_si128(str));
+		_mm_storeu_si128((__m128i *)(bin + 10), _mm256_extracti128_si256(str, 1));
+
+		in += 32;
+		bin += 20;
+	}
+
+	*out = bin;
+	return in;
+}
+
+/*!
+ * \brief Decodes the leading Base32hex blocks without padding.
+ *
+ * \return Position of the first character which hasn't been decoded.
+ */
+static const uint8_t *decode_simd(const uint8_t *in, const uint8_t *stop,
+                                  uint8_t **out)
+{
+	if (__builtin_cpu_supports("avx2")) {
+		in = decode_avx2(in, stop, out);
+	}
+	if (__builtin_cpu_supports("sse4.1")) {
+		in = decode_sse41(in, stop, out);
+	}
+
+	return in;
+}
+#endif
+
 int32_t knot_base32hex_decode(const uint8_t  *in,
                               const uint32_t in_len,
                               uint8_t        *out,
@@ -214,6 +327,11 @@ int32_t knot_base32hex_decode(const uint8_t  *in,
 	uint8_t		pad_len = 0;
 	uint8_t		c1, c2, c3, c4, c5, c6, c7, c8;
 
+#ifdef HAVE_X86_SIMD
+	// Vectorized decoding of the data before the padding or a bad character.
+	in = decode_simd(in, stop, &bin);
+#endif
+
 	// Decoding loop takes 8 characters and creates 5 bytes.
 	while (in < stop) {
 		// Filling and transforming 8 Base32hex chars.
@@ -20,6 +20,10 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
 /*! \brief Maximal length of binary input to Base64 encoding. */
 #define MAX_BIN_DATA_LEN	((INT32_MAX / 4) * 3)
 
@@ -160,6 +164,127 @@ int32_t knot_base64_encode_alloc(const uint8_t  *in,
 	return ret;
 }
 
+#ifdef HAVE_X86_SIMD
+/*
+ * Vectorized decoding of Base64 blocks without padding (W. Mula, D. Lemire:
+ * Faster Base64 Encoding and Decoding Using AVX2 Instructions). Characters are
+ * validated using a bitmask indexed by both nibbles and translated using
+ * an offset indexed by the higher nibble. The resulting 6-bit values are
+ * merged using multiply-add instructions and the output bytes are reordered.
+ */
+
+/*! \brief Offsets to 6-bit values indexed by the higher nibble ('/' excluded). */
+#define SIMD_SHIFT_LUT	0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+/*! \brief Valid higher nibbles bitmasks indexed by the lower nibble. */
+#define SIMD_MASK_LUT	0xA8, 0xF8, 0xF8, 0xF8, 0xF8, 0xF8, 0xF8, 0xF8, \
+			0xF8, 0xF8, 0xF0, 0x54, 0x50, 0x50, 0x50, 0x54
+/*! \brief Higher nibble bits. */
+#define SIMD_BIT_LUT	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, \
+			0, 0, 0, 0, 0, 0, 0, 0
+/*! \brief Output bytes order within four 32-bit words. */
+#define SIMD_PACK_LUT	2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+
+__attribute__((target("sse4.1")))
+static const uint8_t *decode_sse41(const uint8_t *in, const uint8_t *stop,
+                                   uint8_t **out)
+{
+	const __m128i shift_lut = _mm_setr_epi8(SIMD_SHIFT_LUT);
+	const __m128i mask_lut = _mm_setr_epi8(SIMD_MASK_LUT);
+	const __m128i bit_lut = _mm_setr_epi8(SIMD_BIT_LUT);
+	const __m128i pack_lut = _mm_setr_epi8(SIMD_PACK_LUT);
+
+	uint8_t *bin = *out;
+
+	// 16 characters are decoded into 12 bytes, 16 bytes are stored.
+	while (stop - in >= 24) {
+		__m128i str = _mm_loadu_si128((const __m128i *)in);
+		__m128i hi = _mm_and_si128(_mm_srli_epi32(str, 4), _mm_set1_epi8(0x0F));
+		__m128i lo = _mm_and_si128(str, _mm_set1_epi8(0x0F));
+
+		__m128i mask = _mm_shuffle_epi8(mask_lut, lo);
+		__m128i bit = _mm_shuffle_epi8(bit_lut, hi);
+		__m128i bad = _mm_cmpeq_epi8(_mm_and_si128(mask, bit), _mm_setzero_si128());
+		if (_mm_movemask_epi8(bad) != 0) {
+			break;
+		}
+
+		__m128i shift = _mm_blendv_epi8(_mm_shuffle_epi8(shift_lut, hi),
+		                                _mm_set1_epi8(16),
+		                                _mm_cmpeq_epi8(str, _mm_set1_epi8('/')));
+		str = _mm_add_epi8(str, shift);
+		str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+		str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+		_mm_storeu_si128((__m128i *)bin, _mm_shuffle_epi8(str, pack_lut));
+
+		in += 16;
+		bin += 12;
+	}
+
+	*out = bin;
+	return in;
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *decode_avx2(const uint8_t *in, const uint8_t *stop,
+                                  uint8_t **out)
+{
+	const __m256i shift_lut = _mm256_setr_epi8(SIMD_SHIFT_LUT, SIMD_SHIFT_LUT);
+	const __m256i mask_lut = _mm256_setr_epi8(SIMD_MASK_LUT, SIMD_MASK_LUT);
+	const __m256i bit_lut = _mm256_setr_epi8(SIMD_BIT_LUT, SIMD_BIT_LUT);
+	const __m256i pack_lut = _mm256_setr_epi8(SIMD_PACK_LUT, SIMD_PACK_LUT);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+	uint8_t *bin = *out;
+
+	// 32 characters are decoded into 24 bytes, 32 bytes are stored.
+	while (stop - in >= 48) {
+		__m256i str = _mm256_loadu_si256((const __m256i *)in);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi32(str, 4), _mm256_set1_epi8(0x0F));
+		__m256i lo = _mm256_and_si256(str, _mm256_set1_epi8(0x0F));
+
+		__m256i mask = _mm256_shuffle_epi8(mask_lut, lo);
+		__m256i bit = _mm256_shuffle_epi8(bit_lut, hi);
+		__m256i bad = _mm256_cmpeq_epi8(_mm256_and_si256(mask, bit), _mm256_setzero_si256());
+		if (_mm256_movemask_epi8(bad) != 0) {
+			break;
+		}
+
+		__m256i shift = _mm256_blendv_epi8(_mm256_shuffle_epi8(shift_lut, hi),
+		                                   _mm256_set1_epi8(16),
+		                                   _mm256_cmpeq_epi8(str, _mm256_set1_epi8('/')));
+		str = _mm256_add_epi8(str, shift);
+		str = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+		str = _mm256_madd_epi16(str, _mm256_set1_epi32(0x00011000));
+		str = _mm256_shuffle_epi8(str, pack_lut);
+		_mm256_storeu_si256((__m256i *)bin, _mm256_permutevar8x32_epi32(str, lanes));
+
+		in += 32;
+		bin += 24;
+	}
+
+	*out = bin;
+	return in;
+}
+
+/*!
+ * \brief Decodes the leading Base64 blocks without padding.
+ *
+ * \return Position of the first character which hasn't been decoded.
+ */
+static const uint8_t *decode_simd(const uint8_t *in, const uint8_t *stop,
+                                  uint8_t **out)
+{
+	if (__builtin_cpu_supports("avx2")) {
+		in = decode_avx2(in, stop, out);
+	}
+	if (__builtin_cpu_supports("sse4.1")) {
+		in = decode_sse41(in, stop, out);
+	}
+
+	return in;
+}
+#endif
+
 int32_t knot_base64_decode(const uint8_t  *in,
                            const uint32_t in_len,
                            uint8_t        *out,
@@ -181,6 +306,11 @@ int32_t knot_base64_decode(const uint8_t  *in,
 	uint8_t		pad_len = 0;
 	uint8_t		c1, c2, c3, c4;
 
+#ifdef HAVE_X86_SIMD
+	// Vectorized decoding of the data before the padding or a bad character.
+	in = decode_simd(in, stop, &bin);
+#endif
+
 	// Decoding loop takes 4 characters and creates 3 bytes.
 	while (in < stop) {
 		// Filling and transforming 4 Base64 chars.
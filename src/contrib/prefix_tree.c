@@ -0,0 +1,285 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "contrib/prefix_tree.h"
+#include "contrib/macros.h"
+#include "contrib/sockaddr.h"
+#include "libknot/errcode.h"
+
+/*! \brief Maximal address length (IPv6). */
+#define ADDR_MAX_SIZE 16
+
+/*! \brief Index of no node. */
+#define NONE 0
+
+typedef struct {
+	uint32_t child[2]; /*!< Subtrees for the next bit 0 and 1. */
+	uint32_t value;    /*!< Value of the network, 0 if not inserted. */
+} node_t;
+
+struct prefix_tree {
+	node_t *nodes;     /*!< Node array, nodes are referenced by index. */
+	uint32_t count;    /*!< Number of used nodes. */
+	uint32_t capacity; /*!< Number of allocated nodes. */
+	uint32_t root[2];  /*!< IPv4 and IPv6 roots. */
+};
+
+static int root_index(int family)
+{
+	switch (family) {
+	case AF_INET:  return 0;
+	case AF_INET6: return 1;
+	default:       return -1;
+	}
+}
+
+static unsigned get_bit(const uint8_t *raw, unsigned pos)
+{
+	return (raw[pos / 8] >> (7 - pos % 8)) & 1;
+}
+
+static bool tail_is(const uint8_t *raw, unsigned pos, unsigned bits, unsigned bit)
+{
+	for (; pos < bits; pos++) {
+		if (get_bit(raw, pos) != bit) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static uint32_t node_new(prefix_tree_t *tree)
+{
+	if (tree->count == tree->capacity) {
+		uint32_t capacity = MAX(2 * tree->capacity, 16);
+		node_t *nodes = realloc(tree->nodes, capacity * sizeof(*nodes));
+		if (nodes == NULL) {
+			return NONE;
+		}
+		tree->nodes = nodes;
+		tree->capacity = capacity;
+	}
+
+	memset(&tree->nodes[tree->count], 0, sizeof(node_t));
+	return tree->count++;
+}
+
+/*! \brief Get the child node, create it if it doesn't exist. */
+static uint32_t node_child(prefix_tree_t *tree, uint32_t idx, unsigned bit)
+{
+	uint32_t child = tree->nodes[idx].child[bit];
+	if (child == NONE) {
+		child = node_new(tree);
+		if (child != NONE) {
+			tree->nodes[idx].child[bit] = child;
+		}
+	}
+
+	return child;
+}
+
+prefix_tree_t *prefix_tree_new(void)
+{
+	prefix_tree_t *tree = calloc(1, sizeof(*tree));
+	if (tree == NULL) {
+		return NULL;
+	}
+
+	// The first node is a placeholder so that index 0 means no node.
+	tree->capacity = 16;
+	tree->nodes = calloc(tree->capacity, sizeof(node_t));
+	if (tree->nodes == NULL) {
+		free(tree);
+		return NULL;
+	}
+	tree->root[0] = 1;
+	tree->root[1] = 2;
+	tree->count = 3;
+
+	return tree;
+}
+
+void prefix_tree_free(prefix_tree_t *tree)
+{
+	if (tree != NULL) {
+		free(tree->nodes);
+		free(tree);
+	}
+}
+
+/*!
+ * \brief Insert the smallest set of networks in the subtree exactly covering
+ *        the part of the range <lo, hi> which falls into the subtree.
+ *
+ * \param depth     Depth of the subtree root (its prefix length).
+ * \param lo_tight  The range starts after the first address of the subtree.
+ * \param hi_tight  The range ends before the last address of the subtree.
+ */
+static int add_range(prefix_tree_t *tree, uint32_t idx, unsigned depth, unsigned bits,
+                     const uint8_t *lo, const uint8_t *hi, bool lo_tight, bool hi_tight,
+                     prefix_tree_set_t set, void *ctx)
+{
+	if (set == NULL && tree->nodes[idx].value != 0) {
+		return KNOT_EOK; // Already covered by a shorter prefix.
+	}
+
+	lo_tight = lo_tight && !tail_is(lo, depth, bits, 0);
+	hi_tight = hi_tight && !tail_is(hi, depth, bits, 1);
+
+	if (!lo_tight && !hi_tight) {
+		if (set == NULL) {
+			tree->nodes[idx].value = 1;
+			return KNOT_EOK;
+		}
+		return set(&tree->nodes[idx].value, ctx);
+	}
+
+	// Partial overlap implies the subtree has more than one address.
+	assert(depth < bits);
+
+	unsigned lo_bit = get_bit(lo, depth);
+	unsigned hi_bit = get_bit(hi, depth);
+	for (unsigned bit = 0; bit <= 1; bit++) {
+		if ((lo_tight && bit < lo_bit) || (hi_tight && bit > hi_bit)) {
+			continue; // Disjoint.
+		}
+
+		uint32_t child = node_child(tree, idx, bit);
+		if (child == NONE) {
+			return KNOT_ENOMEM;
+		}
+		int ret = add_range(tree, child, depth + 1, bits, lo, hi,
+		                    lo_tight && bit == lo_bit, hi_tight && bit == hi_bit,
+		                    set, ctx);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	return KNOT_EOK;
+}
+
+int prefix_tree_add_net(prefix_tree_t *tree, const struct sockaddr_storage *addr,
+                        unsigned prefix, prefix_tree_set_t set, void *ctx)
+{
+	if (tree == NULL || addr == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	int root = root_index(addr->ss_family);
+	if (root < 0) {
+		return KNOT_EINVAL;
+	}
+
+	size_t len = 0;
+	const uint8_t *raw = sockaddr_raw(addr, &len);
+	unsigned bits = len * 8;
+	prefix = MIN(prefix, bits);
+
+	// The network as the range of its first and last address.
+	uint8_t lo[ADDR_MAX_SIZE], hi[ADDR_MAX_SIZE];
+	memcpy(lo, raw, len);
+	memcpy(hi, raw, len);
+	for (unsigned i = prefix; i < bits; i++) {
+		lo[i / 8] &= ~(1 << (7 - i % 8));
+		hi[i / 8] |= (1 << (7 - i % 8));
+	}
+
+	return add_range(tree, tree->root[root], 0, bits, lo, hi, true, true, set, ctx);
+}
+
+int prefix_tree_add_range(prefix_tree_t *tree, const struct sockaddr_storage *min,
+                          const struct sockaddr_storage *max,
+                          prefix_tree_set_t set, void *ctx)
+{
+	if (tree == NULL || min == NULL || max == NULL ||
+	    min->ss_family != max->ss_family) {
+		return KNOT_EINVAL;
+	}
+
+	int root = root_index(min->ss_family);
+	if (root < 0) {
+		return KNOT_EINVAL;
+	}
+
+	size_t len = 0;
+	const uint8_t *raw_min = sockaddr_raw(min, &len);
+	const uint8_t *raw_max = sockaddr_raw(max, &len);
+	if (memcmp(raw_min, raw_max, len) > 0) {
+		return KNOT_EOK; // Empty range.
+	}
+
+	return add_range(tree, tree->root[root], 0, len * 8, raw_min, raw_max,
+	                 true, true, set, ctx);
+}
+
+void prefix_tree_lookup(const prefix_tree_t *tree, const struct sockaddr_storage *addr,
+                        prefix_tree_get_t get, void *ctx)
+{
+	if (tree == NULL || addr == NULL || get == NULL) {
+		return;
+	}
+
+	int root = root_index(addr->ss_family);
+	if (root < 0) {
+		return;
+	}
+
+	size_t len = 0;
+	const uint8_t *raw = sockaddr_raw(addr, &len);
+
+	uint32_t idx = tree->root[root];
+	for (unsigned depth = 0; ; depth++) {
+		const node_t *node = &tree->nodes[idx];
+		if (node->value != 0) {
+			get(node->value, ctx);
+		}
+		if (depth == len * 8 || (idx = node->child[get_bit(raw, depth)]) == NONE) {
+			break;
+		}
+	}
+}
+
+bool prefix_tree_match(const prefix_tree_t *tree, const struct sockaddr_storage *addr)
+{
+	if (tree == NULL || addr == NULL) {
+		return false;
+	}
+
+	int root = root_index(addr->ss_family);
+	if (root < 0) {
+		return false;
+	}
+
+	size_t len = 0;
+	const uint8_t *raw = sockaddr_raw(addr, &len);
+
+	uint32_t idx = tree->root[root];
+	for (unsigned depth = 0; ; depth++) {
+		const node_t *node = &tree->nodes[idx];
+		if (node->value != 0) {
+			return true;
+		}
+		if (depth == len * 8 || (idx = node->child[get_bit(raw, depth)]) == NONE) {
+			return false;
+		}
+	}
+}
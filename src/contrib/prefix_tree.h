@@ -0,0 +1,109 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Binary prefix tree of IPv4 and IPv6 networks.
+ *
+ * Address ranges are decomposed into networks when inserted, so a lookup
+ * walks at most one path of the address length regardless of the number
+ * of inserted networks and ranges. Each network carries a value, which
+ * the user can use e.g. as an index to own data.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+struct prefix_tree;
+typedef struct prefix_tree prefix_tree_t;
+
+/*!
+ * \brief Callback updating the value of a network covering (a part of)
+ *        the inserted network or range.
+ *
+ * \param value  Network value, 0 if the network hasn't been inserted yet.
+ * \param ctx    Callback context.
+ *
+ * \return KNOT_E*
+ */
+typedef int (*prefix_tree_set_t)(uint32_t *value, void *ctx);
+
+/*!
+ * \brief Callback for a non-zero value of a network containing the address.
+ */
+typedef void (*prefix_tree_get_t)(uint32_t value, void *ctx);
+
+/*!
+ * \brief Create an empty prefix tree.
+ *
+ * \return Prefix tree or NULL.
+ */
+prefix_tree_t *prefix_tree_new(void);
+
+/*!
+ * \brief Free the prefix tree.
+ */
+void prefix_tree_free(prefix_tree_t *tree);
+
+/*!
+ * \brief Insert a network.
+ *
+ * If no callback is given, the network value is set to 1 and networks already
+ * covered by an inserted network aren't inserted.
+ *
+ * \param tree    Prefix tree.
+ * \param addr    Network address (IPv4 or IPv6).
+ * \param prefix  Network prefix length (longer value means the whole address).
+ * \param set     Callback setting the network value (optional).
+ * \param ctx     Callback context.
+ *
+ * \return KNOT_EOK, KNOT_EINVAL, KNOT_ENOMEM, or the callback error.
+ */
+int prefix_tree_add_net(prefix_tree_t *tree, const struct sockaddr_storage *addr,
+                        unsigned prefix, prefix_tree_set_t set, void *ctx);
+
+/*!
+ * \brief Insert an address range.
+ *
+ * The range is inserted as the smallest set of networks covering it exactly,
+ * the callback is called for each of them.
+ *
+ * \param tree  Prefix tree.
+ * \param min   First address of the range.
+ * \param max   Last address of the range (same family as \a min).
+ * \param set   Callback setting the network value (optional).
+ * \param ctx   Callback context.
+ *
+ * \return KNOT_EOK, KNOT_EINVAL, KNOT_ENOMEM, or the callback error.
+ */
+int prefix_tree_add_range(prefix_tree_t *tree, const struct sockaddr_storage *min,
+                          const struct sockaddr_storage *max,
+                          prefix_tree_set_t set, void *ctx);
+
+/*!
+ * \brief Call the callback for the values of all inserted networks containing
+ *        the address, from the shortest prefix.
+ */
+void prefix_tree_lookup(const prefix_tree_t *tree, const struct sockaddr_storage *addr,
+                        prefix_tree_get_t get, void *ctx);
+
+/*!
+ * \brief Check if the address is covered by an inserted network or range
+ *        with a non-zero value.
+ */
+bool prefix_tree_match(const prefix_tree_t *tree, const struct sockaddr_storage *addr);
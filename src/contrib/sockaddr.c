@@ -45,9 +45,12 @@ int sockaddr_len(const struct sockaddr_storage *ss)
 static int cmp_ipv4(const struct sockaddr_in *a, const struct sockaddr_in *b,
                     bool ignore_port)
 {
-	if (a->sin_addr.s_addr < b->sin_addr.s_addr) {
+	uint32_t addr_a = ntohl(a->sin_addr.s_addr);
+	uint32_t addr_b = ntohl(b->sin_addr.s_addr);
+
+	if (addr_a < addr_b) {
 		return -1;
-	} else if (a->sin_addr.s_addr > b->sin_addr.s_addr) {
+	} else if (addr_a > addr_b) {
 		return 1;
 	} else {
 		return ignore_port ? 0 : a->sin_port - b->sin_port;
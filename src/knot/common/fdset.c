@@ -1,4 +1,4 @@
-/*  Copyright (C) 2011 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -14,14 +14,20 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
 #include "knot/common/fdset.h"
+#include "contrib/macros.h"
 #include "contrib/time.h"
 #include "libknot/errcode.h"
 
+/* Invalid fd index (end of timer wheel slot list). */
+#define FDSET_NONE UINT_MAX
+
 /* Realloc memory or return error (part of fdset_resize). */
 #define MEM_RESIZE(tmp, p, n) \
 	if ((tmp = realloc((p), (n) * sizeof(*p))) == NULL) \
@@ -33,11 +39,112 @@ static int fdset_resize(fdset_t *set, unsigned size)
 	void *tmp = NULL;
 	MEM_RESIZE(tmp, set->ctx, size);
 	MEM_RESIZE(tmp, set->pfd, size);
-	MEM_RESIZE(tmp, set->timeout, size);
+	MEM_RESIZE(tmp, set->timer, size);
+	MEM_RESIZE(tmp, set->removed, size);
+#ifdef HAVE_EPOLL
+	MEM_RESIZE(tmp, set->ev, size);
+#endif
 	set->size = size;
 	return KNOT_EOK;
 }
 
+#ifdef HAVE_EPOLL
+static int epoll_update(fdset_t *set, unsigned i, int op)
+{
+	struct epoll_event ev = {
+		/* Fds below the offset are registered, but not polled. */
+		.events = (i < set->offset) ? 0 : set->pfd[i].events,
+		.data.u64 = i
+	};
+
+	return epoll_ctl(set->epfd, op, set->pfd[i].fd, &ev);
+}
+#endif
+
+static void timer_unlink(fdset_t *set, unsigned i)
+{
+	fdset_timer_t *timer = &set->timer[i];
+	if (timer->timeout == 0) {
+		return;
+	}
+
+	if (timer->prev == FDSET_NONE) {
+		set->wheel[timer->slot] = timer->next;
+	} else {
+		set->timer[timer->prev].next = timer->next;
+	}
+	if (timer->next != FDSET_NONE) {
+		set->timer[timer->next].prev = timer->prev;
+	}
+	timer->timeout = 0;
+}
+
+static void timer_link(fdset_t *set, unsigned i, time_t timeout)
+{
+	assert(timeout > 0);
+
+	fdset_timer_t *timer = &set->timer[i];
+	timer->timeout = timeout;
+	/* Already swept slots are visited in the next sweep at the earliest. */
+	timer->slot = MAX(timeout, set->swept + 1) % FDSET_WHEEL_SIZE;
+	timer->prev = FDSET_NONE;
+	timer->next = set->wheel[timer->slot];
+	if (timer->next != FDSET_NONE) {
+		set->timer[timer->next].prev = i;
+	}
+	set->wheel[timer->slot] = i;
+}
+
+/*! \brief Move fd data from one index to another (free) one. */
+static void fdset_move(fdset_t *set, unsigned from, unsigned to)
+{
+	set->pfd[to] = set->pfd[from];
+	set->ctx[to] = set->ctx[from];
+
+	/* Relink the timer. */
+	fdset_timer_t *timer = &set->timer[from];
+	set->timer[to] = *timer;
+	if (timer->timeout != 0) {
+		if (timer->prev == FDSET_NONE) {
+			set->wheel[timer->slot] = to;
+		} else {
+			set->timer[timer->prev].next = to;
+		}
+		if (timer->next != FDSET_NONE) {
+			set->timer[timer->next].prev = to;
+		}
+	}
+
+#ifdef HAVE_EPOLL
+	/* Update the index in the registration. */
+	(void)epoll_update(set, to, EPOLL_CTL_MOD);
+#endif
+}
+
+static int fdset_remove_idx(fdset_t *set, unsigned i, bool unregister)
+{
+#ifdef HAVE_EPOLL
+	if (unregister) {
+		(void)epoll_ctl(set->epfd, EPOLL_CTL_DEL, set->pfd[i].fd, NULL);
+	}
+#else
+	UNUSED(unregister);
+#endif
+	timer_unlink(set, i);
+
+	/* Decrement number of elms. */
+	--set->n;
+
+	/* Nothing else if it is the last one.
+	 * Move last -> i if some remain. */
+	unsigned last = set->n; /* Already decremented */
+	if (i < last) {
+		fdset_move(set, last, i);
+	}
+
+	return KNOT_EOK;
+}
+
 int fdset_init(fdset_t *set, unsigned size)
 {
 	if (set == NULL) {
@@ -45,7 +152,23 @@ int fdset_init(fdset_t *set, unsigned size)
 	}
 
 	memset(set, 0, sizeof(fdset_t));
-	return fdset_resize(set, size);
+	for (unsigned i = 0; i < FDSET_WHEEL_SIZE; i++) {
+		set->wheel[i] = FDSET_NONE;
+	}
+	set->swept = time_now().tv_sec;
+
+#ifdef HAVE_EPOLL
+	set->epfd = epoll_create1(0);
+	if (set->epfd < 0) {
+		return knot_map_errno();
+	}
+#endif
+
+	int ret = fdset_resize(set, size);
+	if (ret != KNOT_EOK) {
+		fdset_clear(set);
+	}
+	return ret;
 }
 
 int fdset_clear(fdset_t* set)
@@ -56,8 +179,18 @@ int fdset_clear(fdset_t* set)
 
 	free(set->ctx);
 	free(set->pfd);
-	free(set->timeout);
+	free(set->timer);
+	free(set->removed);
+#ifdef HAVE_EPOLL
+	free(set->ev);
+	if (set->epfd >= 0) {
+		close(set->epfd);
+	}
+#endif
 	memset(set, 0, sizeof(fdset_t));
+#ifdef HAVE_EPOLL
+	set->epfd = -1;
+#endif
 	return KNOT_EOK;
 }
 
@@ -72,12 +205,19 @@ int fdset_add(fdset_t *set, int fd, unsigned events, void *ctx)
 		return KNOT_ENOMEM;
 
 	/* Initialize. */
-	int i = set->n++;
+	int i = set->n;
 	set->pfd[i].fd = fd;
 	set->pfd[i].events = events;
 	set->pfd[i].revents = 0;
 	set->ctx[i] = ctx;
-	set->timeout[i] = 0;
+	set->timer[i].timeout = 0;
+
+#ifdef HAVE_EPOLL
+	if (epoll_update(set, i, EPOLL_CTL_ADD) != 0) {
+		return knot_map_errno();
+	}
+#endif
+	set->n++;
 
 	/* Return index to this descriptor. */
 	return i;
@@ -89,37 +229,150 @@ int fdset_remove(fdset_t *set, unsigned i)
 		return KNOT_EINVAL;
 	}
 
-	/* Decrement number of elms. */
-	--set->n;
+	return fdset_remove_idx(set, i, true);
+}
 
-	/* Nothing else if it is the last one.
-	 * Move last -> i if some remain. */
-	unsigned last = set->n; /* Already decremented */
-	if (i < last) {
-		set->pfd[i] = set->pfd[last];
-		set->timeout[i] = set->timeout[last];
-		set->ctx[i] = set->ctx[last];
+int fdset_set_events(fdset_t *set, unsigned i, unsigned events)
+{
+	if (set == NULL || i >= set->n) {
+		return KNOT_EINVAL;
+	}
+
+	if (set->pfd[i].events == events) {
+		return KNOT_EOK;
 	}
+	set->pfd[i].events = events;
 
+#ifdef HAVE_EPOLL
+	if (epoll_update(set, i, EPOLL_CTL_MOD) != 0) {
+		return knot_map_errno();
+	}
+#endif
 	return KNOT_EOK;
 }
 
+#ifdef HAVE_EPOLL
+static void fdset_set_offset(fdset_t *set, unsigned offset)
+{
+	unsigned changed = MAX(set->offset, offset);
+	set->offset = offset;
+	changed = MIN(changed, set->n);
+	for (unsigned i = 0; i < changed; i++) {
+		(void)epoll_update(set, i, EPOLL_CTL_MOD);
+	}
+}
+#endif
+
+/*! \brief Load the fd with received events at the iterator position or after it. */
+static void fdset_it_load(fdset_it_t *it)
+{
+	fdset_t *set = it->set;
+
+#ifdef HAVE_EPOLL
+	struct epoll_event *ev = &set->ev[it->pos];
+	it->idx = ev->data.u64;
+	it->revents = ev->events;
+#else
+	while (it->pos < set->n && set->pfd[it->pos].revents == 0) {
+		it->pos++;
+	}
+	if (it->pos >= set->n) {
+		it->unprocessed = 0;
+		return;
+	}
+	it->idx = it->pos;
+	it->revents = set->pfd[it->pos].revents;
+#endif
+}
+
+int fdset_poll(fdset_t *set, fdset_it_t *it, unsigned offset, int timeout_ms)
+{
+	if (set == NULL || it == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	memset(it, 0, sizeof(*it));
+	it->set = set;
+	set->removed_n = 0;
+
+#ifdef HAVE_EPOLL
+	if (offset != set->offset) {
+		fdset_set_offset(set, offset);
+	}
+	int ret = epoll_wait(set->epfd, set->ev, set->size, timeout_ms);
+#else
+	set->offset = offset;
+	int ret = (offset < set->n) ?
+	          poll(&set->pfd[offset], set->n - offset, timeout_ms) : 0;
+	it->pos = offset;
+#endif
+	if (ret > 0) {
+		it->unprocessed = ret;
+		fdset_it_load(it);
+	}
+
+	return ret;
+}
+
+void fdset_it_next(fdset_it_t *it)
+{
+	assert(it != NULL && it->set != NULL);
+
+	if (--it->unprocessed > 0) {
+		it->pos++;
+		fdset_it_load(it);
+	}
+}
+
+void fdset_it_remove(fdset_it_t *it)
+{
+	assert(it != NULL && it->set != NULL);
+	fdset_t *set = it->set;
+
+#ifdef HAVE_EPOLL
+	(void)epoll_ctl(set->epfd, EPOLL_CTL_DEL, set->pfd[it->idx].fd, NULL);
+#endif
+	set->removed[set->removed_n++] = it->idx;
+}
+
+static int cmp_idx_desc(const void *a, const void *b)
+{
+	unsigned x = *(const unsigned *)a;
+	unsigned y = *(const unsigned *)b;
+	return (x < y) - (x > y);
+}
+
+void fdset_it_commit(fdset_it_t *it)
+{
+	assert(it != NULL && it->set != NULL);
+	fdset_t *set = it->set;
+
+	/* Removing from the highest index ensures that only kept fds are moved. */
+	qsort(set->removed, set->removed_n, sizeof(*set->removed), cmp_idx_desc);
+	for (unsigned i = 0; i < set->removed_n; i++) {
+		(void)fdset_remove_idx(set, set->removed[i], false);
+	}
+	set->removed_n = 0;
+	it->unprocessed = 0;
+}
+
 int fdset_set_watchdog(fdset_t* set, int i, int interval)
 {
 	if (set == NULL || i >= set->n) {
 		return KNOT_EINVAL;
 	}
 
+	timer_unlink(set, i);
+
 	/* Lift watchdog if interval is negative. */
 	if (interval < 0) {
-		set->timeout[i] = 0;
 		return KNOT_EOK;
 	}
 
 	/* Update clock. */
 	struct timespec now = time_now();
 
-	set->timeout[i] = now.tv_sec + interval; /* Only seconds precision. */
+	timer_link(set, i, now.tv_sec + interval); /* Only seconds precision. */
 	return KNOT_EOK;
 }
 
@@ -130,22 +383,44 @@ int fdset_sweep(fdset_t* set, fdset_sweep_cb_t cb, void *data)
 	}
 
 	/* Get time threshold. */
-	struct timespec now = time_now();
+	time_t now = time_now().tv_sec;
+	if (now <= set->swept) {
+		return 0;
+	}
+
+	/* Visit slots elapsed since the last sweep (each at most once). */
+	int sweeped = 0;
+	time_t slots = MIN(now - set->swept, FDSET_WHEEL_SIZE);
+	for (time_t t = set->swept + 1; t <= set->swept + slots; t++) {
+		unsigned slot = t % FDSET_WHEEL_SIZE;
+		unsigned i = set->wheel[slot];
+		while (i != FDSET_NONE) {
+			unsigned next = set->timer[i].next;
 
-	unsigned i = 0;
-	while (i < set->n) {
+			/* Skip fds expiring in one of the next wheel turns. */
+			if (set->timer[i].timeout > now) {
+				i = next;
+				continue;
+			}
 
-		/* Check sweep state, remove if requested. */
-		if (set->timeout[i] > 0 && set->timeout[i] <= now.tv_sec) {
+			/* Check sweep state, remove if requested. */
 			if (cb(set, i, data) == FDSET_SWEEP) {
-				if (fdset_remove(set, i) == KNOT_EOK)
-					continue; /* Stay on the index. */
+				/* The last fd is moved to the removed index. */
+				if (next == set->n - 1) {
+					next = i;
+				}
+				(void)fdset_remove_idx(set, i, true);
+				sweeped++;
+			} else {
+				/* Check again during the next sweep. */
+				timer_unlink(set, i);
+				timer_link(set, i, now + 1);
 			}
-		}
 
-		/* Next descriptor. */
-		++i;
+			i = next;
+		}
 	}
+	set->swept = now;
 
-	return KNOT_EOK;
+	return sweeped;
 }
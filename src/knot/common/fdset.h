@@ -1,4 +1,4 @@
-/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -16,26 +16,65 @@
 
 /*!
  * \brief I/O multiplexing with context and timeouts for each fd.
+ *
+ * The set is backed by epoll if available (see --with-socket-polling),
+ * otherwise by poll. Events are always specified using POLL* flags.
+ *
+ * Watchdog timeouts are kept in a hashed timer wheel with one-second slots,
+ * so sweeping visits only descriptors whose timeout falls into the elapsed
+ * slots instead of the whole set.
  */
 
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <poll.h>
 #include <sys/time.h>
 #include <signal.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 #define FDSET_INIT_SIZE 256 /* Resize step. */
 
+#define FDSET_WHEEL_SIZE 64 /* Number of timer wheel slots (seconds). */
+
+/*! \brief Watchdog timer of one fd. */
+typedef struct {
+	time_t timeout;  /*!< Timeout (seconds precision), 0 if disabled. */
+	unsigned slot;   /*!< Timer wheel slot. */
+	unsigned prev;   /*!< Previous fd in the slot. */
+	unsigned next;   /*!< Next fd in the slot. */
+} fdset_timer_t;
+
 /*! \brief Set of filedescriptors with associated context and timeouts. */
 typedef struct fdset {
-	unsigned n;          /*!< Active fds. */
-	unsigned size;       /*!< Array size (allocated). */
-	void* *ctx;          /*!< Context for each fd. */
-	struct pollfd *pfd;  /*!< poll state for each fd */
-	time_t *timeout;     /*!< Timeout for each fd (seconds precision). */
+	unsigned n;             /*!< Active fds. */
+	unsigned size;          /*!< Array size (allocated). */
+	void* *ctx;             /*!< Context for each fd. */
+	struct pollfd *pfd;     /*!< Descriptor and watched events for each fd. */
+	fdset_timer_t *timer;   /*!< Watchdog timer for each fd. */
+	unsigned wheel[FDSET_WHEEL_SIZE]; /*!< First fd in each timer wheel slot. */
+	time_t swept;           /*!< Time of the last sweep. */
+	unsigned *removed;      /*!< Fds removed during event processing. */
+	unsigned removed_n;     /*!< Number of removed fds. */
+	unsigned offset;        /*!< Index of the first polled fd. */
+#ifdef HAVE_EPOLL
+	int epfd;               /*!< Epoll instance. */
+	struct epoll_event *ev; /*!< Received events. */
+#endif
 } fdset_t;
 
+/*! \brief Iterator over fds with received events. */
+typedef struct {
+	fdset_t *set;        /*!< Iterated set. */
+	unsigned pos;        /*!< Position in the received events. */
+	unsigned idx;        /*!< Index of the current fd. */
+	unsigned revents;    /*!< Received events of the current fd. */
+	int unprocessed;     /*!< Number of remaining events. */
+} fdset_it_t;
+
 /*! \brief Mark-and-sweep state. */
 enum fdset_sweep_state {
 	FDSET_KEEP,
@@ -74,6 +113,9 @@ int fdset_add(fdset_t *set, int fd, unsigned events, void *ctx);
 /*!
  * \brief Remove file descriptor from watched set.
  *
+ * The last fd is moved to the freed index. Must not be called while
+ * iterating over received events, use fdset_it_remove() instead.
+ *
  * \param set Target set.
  * \param i Index of the removed fd.
  *
@@ -82,6 +124,106 @@ int fdset_add(fdset_t *set, int fd, unsigned events, void *ctx);
  */
 int fdset_remove(fdset_t *set, unsigned i);
 
+/*!
+ * \brief Change watched events of a file descriptor.
+ *
+ * \param set Target set.
+ * \param i Index of the fd.
+ * \param events Mask of watched events.
+ *
+ * \retval 0 if successful.
+ * \retval -1 on errors.
+ */
+int fdset_set_events(fdset_t *set, unsigned i, unsigned events);
+
+/*!
+ * \brief Wait for events.
+ *
+ * \param set Target set.
+ * \param it Output iterator over fds with received events.
+ * \param offset Index of the first fd to be polled, fds with a lower index
+ *               are temporarily ignored.
+ * \param timeout_ms Timeout of the operation (-1 for infinity).
+ *
+ * \retval number of fds with received events.
+ * \retval -1 on errors.
+ */
+int fdset_poll(fdset_t *set, fdset_it_t *it, unsigned offset, int timeout_ms);
+
+/*!
+ * \brief Check if all received events were processed.
+ */
+inline static bool fdset_it_is_done(const fdset_it_t *it)
+{
+	return it->unprocessed <= 0;
+}
+
+/*!
+ * \brief Move the iterator to the next fd with received events.
+ */
+void fdset_it_next(fdset_it_t *it);
+
+/*!
+ * \brief Get index of the current fd.
+ */
+inline static unsigned fdset_it_get_idx(const fdset_it_t *it)
+{
+	return it->idx;
+}
+
+/*!
+ * \brief Check if the current fd is readable.
+ */
+inline static bool fdset_it_is_pollin(const fdset_it_t *it)
+{
+	return it->revents & POLLIN;
+}
+
+/*!
+ * \brief Check if the current fd is writable.
+ */
+inline static bool fdset_it_is_pollout(const fdset_it_t *it)
+{
+	return it->revents & POLLOUT;
+}
+
+/*!
+ * \brief Check if an error or hangup occured on the current fd.
+ */
+inline static bool fdset_it_is_error(const fdset_it_t *it)
+{
+	return it->revents & (POLLERR | POLLHUP | POLLNVAL);
+}
+
+/*!
+ * \brief Remove the current fd from the set.
+ *
+ * The fd is no longer watched, but indices of other fds are kept until
+ * fdset_it_commit() is called. The fd should be closed after this call.
+ */
+void fdset_it_remove(fdset_it_t *it);
+
+/*!
+ * \brief Finish the iteration, compact the set after removals.
+ */
+void fdset_it_commit(fdset_it_t *it);
+
+/*!
+ * \brief Get file descriptor on a given index.
+ */
+inline static int fdset_get_fd(const fdset_t *set, unsigned i)
+{
+	return set->pfd[i].fd;
+}
+
+/*!
+ * \brief Get context of a file descriptor on a given index.
+ */
+inline static void *fdset_get_ctx(const fdset_t *set, unsigned i)
+{
+	return set->ctx[i];
+}
+
 /*!
  * \brief Set file descriptor watchdog interval.
  *
@@ -103,6 +245,8 @@ int fdset_set_watchdog(fdset_t* set, int i, int interval);
 /*!
  * \brief Sweep file descriptors with exceeding inactivity period.
  *
+ * Descriptors kept by the callback are checked again during the next sweep.
+ *
  * \param set Target set.
  * \param cb Callback for sweeped descriptors.
  * \param data Pointer to extra data.
@@ -23,6 +23,7 @@
 #include "contrib/files.h"
 #include "knot/common/stats.h"
 #include "knot/common/log.h"
+#include "knot/nameserver/answer_cache.h"
 #include "knot/nameserver/query_module.h"
 
 struct {
@@ -51,15 +52,41 @@ uint64_t server_zone_count(server_t *server)
 	return knot_zonedb_size(server->zone_db);
 }
 
+static void answer_cache_sum(zone_t *zone, uint64_t *sum,
+                             uint64_t (*get)(const answer_cache_t *))
+{
+	*sum += get(zone->answer_cache);
+}
+
+static uint64_t server_answer_cache_hit(server_t *server)
+{
+	uint64_t sum = 0;
+	rcu_read_lock();
+	knot_zonedb_foreach(server->zone_db, answer_cache_sum, &sum, answer_cache_hits);
+	rcu_read_unlock();
+	return sum;
+}
+
+static uint64_t server_answer_cache_miss(server_t *server)
+{
+	uint64_t sum = 0;
+	rcu_read_lock();
+	knot_zonedb_foreach(server->zone_db, answer_cache_sum, &sum, answer_cache_misses);
+	rcu_read_unlock();
+	return sum;
+}
+
 const stats_item_t server_stats[] = {
 	{ "zone-count", server_zone_count },
+	{ "answer-cache-hit", server_answer_cache_hit },
+	{ "answer-cache-miss", server_answer_cache_miss },
 	{ 0 }
 };
 
-static void dump_counters(FILE *fd, int level, mod_ctr_t *ctr)
+static void dump_counters(FILE *fd, int level, knotd_mod_t *mod, mod_ctr_t *ctr)
 {
 	for (uint32_t j = 0; j < ctr->count; j++) {
-		uint64_t counter = ATOMIC_GET(ctr->counters[j]);
+		uint64_t counter = mod_stats_get(mod, ctr, j);
 
 		// Skip empty counters.
 		if (counter == 0) {
@@ -109,19 +136,19 @@ static void dump_modules(dump_ctx_t *ctx)
 		// Dump module counters.
 		DUMP_STR(ctx->fd, level, "%s", mod->id->name + 1, "");
 		for (int i = 0; i < mod->stats_count; i++) {
-			mod_ctr_t *ctr = mod->stats + i;
+			mod_ctr_t *ctr = mod->stats_info + i;
 			if (ctr->name == NULL) {
 				// Empty counter.
 				continue;
 			}
 			if (ctr->count == 1) {
 				// Simple counter.
-				uint64_t counter = ATOMIC_GET(ctr->counter);
+				uint64_t counter = mod_stats_get(mod, ctr, 0);
 				DUMP_CTR(ctx->fd, level + 1, "%s", ctr->name, counter);
 			} else {
 				// Array of counters.
 				DUMP_STR(ctx->fd, level + 1, "%s", ctr->name, "");
-				dump_counters(ctx->fd, level + 2, ctr);
+				dump_counters(ctx->fd, level + 2, mod, ctr);
 			}
 		}
 	}
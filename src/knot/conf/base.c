@@ -180,6 +180,12 @@ static void init_cache(
 
 	conf->cache.srv_tcp_reuseport = running_tcp_reuseport;
 
+	val = conf_get(conf, C_SRV, C_UDP_BATCH_SIZE);
+	conf->cache.srv_udp_batch_size = conf_int(&val);
+
+	val = conf_get(conf, C_SRV, C_UDP_BUSY_POLL);
+	conf->cache.srv_udp_busy_poll = conf_int(&val);
+
 	conf->cache.srv_udp_threads = running_udp_threads;
 
 	conf->cache.srv_tcp_threads = running_tcp_threads;
@@ -112,6 +112,8 @@ typedef struct {
 		int srv_tcp_io_timeout;
 		int srv_tcp_remote_io_timeout;
 		bool srv_tcp_reuseport;
+		unsigned srv_udp_batch_size;
+		int srv_udp_busy_poll;
 		size_t srv_udp_threads;
 		size_t srv_tcp_threads;
 		size_t srv_bg_threads;
@@ -1057,6 +1057,26 @@ char* conf_zonefile_txn(
 	return get_filename(conf, txn, zone, file);
 }
 
+char* conf_zonefile_image_txn(
+	conf_t *conf,
+	knot_db_txn_t *txn,
+	const knot_dname_t *zone)
+{
+	if (zone == NULL) {
+		return NULL;
+	}
+
+	conf_val_t val = conf_zone_get_txn(conf, txn, C_ZONEFILE_IMAGE, zone);
+	const char *file = conf_str(&val);
+
+	// Zone image is disabled if not specified.
+	if (file == NULL) {
+		return NULL;
+	}
+
+	return get_filename(conf, txn, zone, file);
+}
+
 char* conf_db_txn(
 	conf_t *conf,
 	knot_db_txn_t *txn,
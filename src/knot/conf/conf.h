@@ -592,6 +592,29 @@ static inline char* conf_zonefile(
 	return conf_zonefile_txn(conf, &conf->read_txn, zone);
 }
 
+/*!
+ * Gets the absolute compiled zone image path.
+ *
+ * \note The result must be explicitly deallocated.
+ *
+ * \param[in] conf  Configuration.
+ * \param[in] txn   Configuration DB transaction.
+ * \param[in] zone  Zone name.
+ *
+ * \return Absolute zone image path string pointer or NULL if not configured.
+ */
+char* conf_zonefile_image_txn(
+	conf_t *conf,
+	knot_db_txn_t *txn,
+	const knot_dname_t *zone
+);
+static inline char* conf_zonefile_image(
+	conf_t *conf,
+	const knot_dname_t *zone)
+{
+	return conf_zonefile_image_txn(conf, &conf->read_txn, zone);
+}
+
 /*!
  * Gets the absolute directory path for a database.
  *
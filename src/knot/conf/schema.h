@@ -23,10 +23,12 @@
 #define C_ACTION		"\x06""action"
 #define C_ADDR			"\x07""address"
 #define C_ALG			"\x09""algorithm"
+#define C_ANS_CACHE		"\x0C""answer-cache"
 #define C_ANS_ROTATION		"\x0F""answer-rotation"
 #define C_ANY			"\x03""any"
 #define C_APPEND		"\x06""append"
 #define C_ASYNC_START		"\x0B""async-start"
+#define C_AXFR_SNAPSHOT		"\x0D""axfr-snapshot"
 #define C_BACKEND		"\x07""backend"
 #define C_BG_WORKERS		"\x12""background-workers"
 #define C_BLOCK_NOTIFY_XFR	"\x1B""block-notify-after-transfer"
@@ -65,6 +67,7 @@
 #define C_KSK_SHARED		"\x0a""ksk-shared"
 #define C_KSK_SIZE		"\x08""ksk-size"
 #define C_LISTEN		"\x06""listen"
+#define C_LISTEN_XDP		"\x0A""listen-xdp"
 #define C_LOG			"\x03""log"
 #define C_MANUAL		"\x06""manual"
 #define C_MASTER		"\x06""master"
@@ -110,6 +113,8 @@
 #define C_TIMER_DB		"\x08""timer-db"
 #define C_TIMER_DB_MAX_SIZE	"\x11""timer-db-max-size"
 #define C_TPL			"\x08""template"
+#define C_UDP_BATCH_SIZE	"\x0E""udp-batch-size"
+#define C_UDP_BUSY_POLL		"\x0D""udp-busy-poll"
 #define C_UDP_MAX_PAYLOAD	"\x0F""udp-max-payload"
 #define C_UDP_MAX_PAYLOAD_IPV4	"\x14""udp-max-payload-ipv4"
 #define C_UDP_MAX_PAYLOAD_IPV6	"\x14""udp-max-payload-ipv6"
@@ -122,6 +127,7 @@
 #define C_VERSION		"\x07""version"
 #define C_VIA			"\x03""via"
 #define C_ZONE			"\x04""zone"
+#define C_ZONEFILE_IMAGE	"\x0E""zonefile-image"
 #define C_ZONEFILE_LOAD		"\x0D""zonefile-load"
 #define C_ZONEFILE_SYNC		"\x0D""zonefile-sync"
 #define C_ZONE_MAX_SIZE		"\x0D""zone-max-size"
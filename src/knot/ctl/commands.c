@@ -30,6 +30,7 @@
 #include "knot/nameserver/query_module.h"
 #include "knot/updates/zone-update.h"
 #include "knot/zone/timers.h"
+#include "knot/zone/zone-dump.h"
 #include "knot/zone/zonefile.h"
 #include "libknot/libknot.h"
 #include "libknot/yparser/yptrafo.h"
@@ -192,6 +193,7 @@ static int zone_status(zone_t *zone, ctl_args_t *args)
 	if (MATCH_OR_FILTER(args, CTL_FILTER_STATUS_SERIAL)) {
 		data[KNOT_CTL_IDX_TYPE] = "serial";
 
+		rcu_read_lock();
 		if (zone->contents != NULL) {
 			knot_rdataset_t *soa = node_rdataset(zone->contents->apex,
 			                                     KNOT_RRTYPE_SOA);
@@ -199,6 +201,7 @@ static int zone_status(zone_t *zone, ctl_args_t *args)
 		} else {
 			ret = snprintf(buff, sizeof(buff), "none");
 		}
+		rcu_read_unlock();
 		if (ret < 0 || ret >= sizeof(buff)) {
 			return KNOT_ESPACE;
 		}
@@ -515,16 +518,23 @@ static int zone_txn_abort(zone_t *zone, ctl_args_t *args)
 	return KNOT_EOK;
 }
 
+/*! \brief Text record buffer sizes. */
+#define TXT_TTL_LEN	16
+#define TXT_TYPE_LEN	32
+#define TXT_RDATA_LEN	(2 * 65536)
+#define TXT_RR_LEN	(sizeof(knot_dname_txt_storage_t) + TXT_TTL_LEN + \
+			 TXT_TYPE_LEN + TXT_RDATA_LEN)
+
+/*! \brief Number of zone nodes formatted at once by zone-read. */
+#define READ_CHUNK_NODES	(16 * 1024)
+
 typedef struct {
 	ctl_args_t *args;
 	int type_filter; // -1: no specific type, [0, 2^16]: specific type.
 	knot_dump_style_t style;
 	knot_ctl_data_t data;
 	knot_dname_txt_storage_t zone;
-	knot_dname_txt_storage_t owner;
-	char ttl[16];
-	char type[32];
-	char rdata[2 * 65536];
+	zone_dump_block_t block;
 } send_ctx_t;
 
 static int create_send_ctx(send_ctx_t **out, const knot_dname_t *zone_name,
@@ -544,10 +554,6 @@ static int create_send_ctx(send_ctx_t **out, const knot_dname_t *zone_name,
 
 	// Set the output data buffers.
 	ctx->data[KNOT_CTL_IDX_ZONE]  = ctx->zone;
-	ctx->data[KNOT_CTL_IDX_OWNER] = ctx->owner;
-	ctx->data[KNOT_CTL_IDX_TTL]   = ctx->ttl;
-	ctx->data[KNOT_CTL_IDX_TYPE]  = ctx->type;
-	ctx->data[KNOT_CTL_IDX_DATA]  = ctx->rdata;
 
 	// Set the ZONE.
 	if (knot_dname_to_str(ctx->zone, zone_name, sizeof(ctx->zone)) == NULL) {
@@ -572,49 +578,73 @@ static int create_send_ctx(send_ctx_t **out, const knot_dname_t *zone_name,
 	return KNOT_EOK;
 }
 
-static int send_rrset(knot_rrset_t *rrset, send_ctx_t *ctx)
+static void free_send_ctx(send_ctx_t *ctx)
 {
-	if (rrset->type != KNOT_RRTYPE_RRSIG) {
-		int ret = snprintf(ctx->ttl, sizeof(ctx->ttl), "%u", rrset->ttl);
-		if (ret <= 0 || ret >= sizeof(ctx->ttl)) {
-			return KNOT_ESPACE;
-		}
+	free(ctx->block.text);
+	mm_free(&ctx->args->mm, ctx);
+}
+
+/*!
+ * Formats each RR as a sequence of the owner, TTL, type, and rdata strings.
+ */
+static int format_rrset(const knot_rrset_t *rrset, zone_dump_block_t *block,
+                        const knot_dump_style_t *style)
+{
+	knot_dname_txt_storage_t owner;
+	if (knot_dname_to_str(owner, rrset->owner, sizeof(owner)) == NULL) {
+		return KNOT_EINVAL;
 	}
+	size_t owner_len = strlen(owner) + 1;
 
-	if (knot_rrtype_to_string(rrset->type, ctx->type, sizeof(ctx->type)) < 0) {
+	char type[TXT_TYPE_LEN];
+	int ret = knot_rrtype_to_string(rrset->type, type, sizeof(type));
+	if (ret < 0) {
 		return KNOT_ESPACE;
 	}
+	size_t type_len = ret + 1;
 
+	// Dump each RR as a single-RR set to avoid seeking to its position.
+	knot_rrset_t rr_view = *rrset;
+	knot_rdata_t *rr = rrset->rrs.rdata;
 	for (size_t i = 0; i < rrset->rrs.count; ++i) {
-		if (rrset->type == KNOT_RRTYPE_RRSIG) {
-			int ret = snprintf(ctx->ttl, sizeof(ctx->ttl), "%u",
-			                   knot_rrsig_original_ttl(knot_rdataset_at(&rrset->rrs, i)));
-			if (ret <= 0 || ret >= sizeof(ctx->ttl)) {
-				return KNOT_ESPACE;
-			}
+		char *pos = zone_dump_block_reserve(block, TXT_RR_LEN);
+		if (pos == NULL) {
+			return KNOT_ENOMEM;
 		}
 
-		int ret = knot_rrset_txt_dump_data(rrset, i, ctx->rdata,
-		                                   sizeof(ctx->rdata), &ctx->style);
-		if (ret < 0) {
-			return ret;
+		memcpy(pos, owner, owner_len);
+		pos += owner_len;
+
+		uint32_t ttl = (rrset->type == KNOT_RRTYPE_RRSIG) ?
+		               knot_rrsig_original_ttl(rr) : rrset->ttl;
+		ret = snprintf(pos, TXT_TTL_LEN, "%u", ttl);
+		if (ret <= 0 || ret >= TXT_TTL_LEN) {
+			return KNOT_ESPACE;
 		}
+		pos += ret + 1;
 
-		ret = knot_ctl_send(ctx->args->ctl, KNOT_CTL_TYPE_DATA, &ctx->data);
-		if (ret != KNOT_EOK) {
+		memcpy(pos, type, type_len);
+		pos += type_len;
+
+		rr_view.rrs = (knot_rdataset_t){ 1, knot_rdata_size(rr->len), rr };
+		ret = knot_rrset_txt_dump_data(&rr_view, 0, pos, TXT_RDATA_LEN, style);
+		if (ret < 0) {
 			return ret;
 		}
+		pos += ret + 1;
+
+		block->len = pos - block->text;
+		block->items++;
+
+		rr = knot_rdataset_next(rr);
 	}
 
 	return KNOT_EOK;
 }
 
-static int send_node(zone_node_t *node, void *ctx_void)
+static int format_node(zone_node_t *node, zone_dump_block_t *block, void *ctx_void)
 {
 	send_ctx_t *ctx = ctx_void;
-	if (knot_dname_to_str(ctx->owner, node->owner, sizeof(ctx->owner)) == NULL) {
-		return KNOT_EINVAL;
-	}
 
 	for (size_t i = 0; i < node->rrset_count; ++i) {
 		knot_rrset_t rrset = node_rrset_at(node, i);
@@ -624,7 +654,31 @@ static int send_node(zone_node_t *node, void *ctx_void)
 			continue;
 		}
 
-		int ret = send_rrset(&rrset, ctx);
+		int ret = format_rrset(&rrset, block, &ctx->style);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	return KNOT_EOK;
+}
+
+static int send_block_rrs(zone_dump_block_t *block, void *ctx_void)
+{
+	send_ctx_t *ctx = ctx_void;
+
+	const char *pos = block->text;
+	for (uint64_t i = 0; i < block->items; i++) {
+		const knot_ctl_idx_t idx[] = {
+			KNOT_CTL_IDX_OWNER, KNOT_CTL_IDX_TTL, KNOT_CTL_IDX_TYPE,
+			KNOT_CTL_IDX_DATA
+		};
+		for (size_t j = 0; j < sizeof(idx) / sizeof(*idx); j++) {
+			ctx->data[idx[j]] = pos;
+			pos += strlen(pos) + 1;
+		}
+
+		int ret = knot_ctl_send(ctx->args->ctl, KNOT_CTL_TYPE_DATA, &ctx->data);
 		if (ret != KNOT_EOK) {
 			return ret;
 		}
@@ -633,6 +687,111 @@ static int send_node(zone_node_t *node, void *ctx_void)
 	return KNOT_EOK;
 }
 
+static int send_rrset(knot_rrset_t *rrset, send_ctx_t *ctx)
+{
+	ctx->block.len = 0;
+	ctx->block.items = 0;
+
+	int ret = format_rrset(rrset, &ctx->block, &ctx->style);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	return send_block_rrs(&ctx->block, ctx);
+}
+
+static int format_single_node(const zone_node_t *node, send_ctx_t *ctx)
+{
+	ctx->block.len = 0;
+	ctx->block.items = 0;
+
+	return format_node((zone_node_t *)node, &ctx->block, ctx);
+}
+
+static int send_node(zone_node_t *node, void *ctx_void)
+{
+	send_ctx_t *ctx = ctx_void;
+
+	int ret = format_single_node(node, ctx);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	return send_block_rrs(&ctx->block, ctx);
+}
+
+static int append_block_rrs(zone_dump_block_t *block, void *ctx_void)
+{
+	send_ctx_t *ctx = ctx_void;
+
+	char *pos = zone_dump_block_reserve(&ctx->block, block->len);
+	if (pos == NULL) {
+		return KNOT_ENOMEM;
+	}
+	memcpy(pos, block->text, block->len);
+	ctx->block.len += block->len;
+	ctx->block.items += block->items;
+
+	return KNOT_EOK;
+}
+
+static int send_contents(zone_contents_t *contents, send_ctx_t *ctx)
+{
+	unsigned threads = conf()->cache.srv_bg_threads;
+
+	int ret = zone_dump_tree(contents->nodes, format_node, send_block_rrs,
+	                         ctx, threads);
+	if (ret == KNOT_EOK) {
+		ret = zone_dump_tree(contents->nsec3_nodes, format_node, send_block_rrs,
+		                     ctx, threads);
+	}
+
+	return ret;
+}
+
+static int send_zone_contents(zone_t *zone, send_ctx_t *ctx)
+{
+	unsigned threads = conf()->cache.srv_bg_threads;
+
+	// The zone contents can be replaced anytime, so they are formatted in
+	// chunks under RCU and the output is sent outside it. Each chunk continues
+	// from the next owner in the current contents.
+	knot_dname_t *from = NULL;
+	bool nsec3 = false;
+	int ret = KNOT_EOK;
+	while (ret == KNOT_EOK) {
+		knot_dname_t *next = NULL;
+		ctx->block.len = 0;
+		ctx->block.items = 0;
+
+		rcu_read_lock();
+		zone_contents_t *contents = zone->contents;
+		bool empty = (contents == NULL);
+		if (!empty) {
+			zone_tree_t *tree = nsec3 ? contents->nsec3_nodes : contents->nodes;
+			ret = zone_dump_tree_part(tree, from, READ_CHUNK_NODES, format_node,
+			                          append_block_rrs, ctx, threads, &next);
+		}
+		rcu_read_unlock();
+
+		knot_dname_free(from, NULL);
+		from = next;
+
+		if (ret == KNOT_EOK) {
+			ret = send_block_rrs(&ctx->block, ctx);
+		}
+		if (next == NULL) {
+			if (nsec3 || empty) {
+				break;
+			}
+			nsec3 = true;
+		}
+	}
+	knot_dname_free(from, NULL);
+
+	return ret;
+}
+
 static int get_owner(uint8_t *out, size_t out_len, knot_dname_t *origin,
                      ctl_args_t *args)
 {
@@ -691,22 +850,20 @@ static int zone_read(zone_t *zone, ctl_args_t *args)
 			goto zone_read_failed;
 		}
 
+		rcu_read_lock();
 		const zone_node_t *node = zone_contents_node_or_nsec3(zone->contents, owner);
-		if (node == NULL) {
-			ret = KNOT_ENONODE;
-			goto zone_read_failed;
-		}
+		ret = (node != NULL) ? format_single_node(node, ctx) : KNOT_ENONODE;
+		rcu_read_unlock();
 
-		ret = send_node((zone_node_t *)node, ctx);
-	} else if (zone->contents != NULL) {
-		ret = zone_contents_apply(zone->contents, send_node, ctx);
 		if (ret == KNOT_EOK) {
-			ret = zone_contents_nsec3_apply(zone->contents, send_node, ctx);
+			ret = send_block_rrs(&ctx->block, ctx);
 		}
+	} else {
+		ret = send_zone_contents(zone, ctx);
 	}
 
 zone_read_failed:
-	mm_free(&args->mm, ctx);
+	free_send_ctx(ctx);
 
 	return ret;
 }
@@ -740,19 +897,11 @@ static int zone_flag_txn_get(zone_t *zone, ctl_args_t *args, const char *flag)
 
 		ret = send_node((zone_node_t *)node, ctx);
 	} else {
-		zone_tree_it_t it = { 0 };
-		ret = zone_tree_it_double_begin(zone->control_update->new_cont->nodes,
-						zone->control_update->new_cont->nsec3_nodes,
-						&it);
-		while (ret == KNOT_EOK && !zone_tree_it_finished(&it)) {
-			ret = send_node(zone_tree_it_val(&it), ctx);
-			zone_tree_it_next(&it);
-		}
-		zone_tree_it_free(&it);
+		ret = send_contents(zone->control_update->new_cont, ctx);
 	}
 
 zone_txn_get_failed:
-	mm_free(&args->mm, ctx);
+	free_send_ctx(ctx);
 
 	return ret;
 }
@@ -771,11 +920,6 @@ static int send_changeset_part(changeset_t *ch, send_ctx_t *ctx, bool from)
 		knot_rrset_t *soa = from ? ch->soa_from : ch->soa_to;
 		assert(soa);
 
-		char *owner = knot_dname_to_str(ctx->owner, soa->owner, sizeof(ctx->owner));
-		if (owner == NULL) {
-			return KNOT_EINVAL;
-		}
-
 		int ret = send_rrset(soa, ctx);
 		if (ret != KNOT_EOK) {
 			return ret;
@@ -791,12 +935,6 @@ static int send_changeset_part(changeset_t *ch, send_ctx_t *ctx, bool from)
 
 	knot_rrset_t rrset = changeset_iter_next(&it);
 	while (!knot_rrset_empty(&rrset)) {
-		char *owner = knot_dname_to_str(ctx->owner, rrset.owner, sizeof(ctx->owner));
-		if (owner == NULL) {
-			changeset_iter_clear(&it);
-			return KNOT_EINVAL;
-		}
-
 		ret = send_rrset(&rrset, ctx);
 		if (ret != KNOT_EOK) {
 			changeset_iter_clear(&it);
@@ -845,7 +983,7 @@ static int zone_txn_diff(zone_t *zone, ctl_args_t *args)
 	}
 
 	ret = send_changeset(&zone->control_update->change, ctx);
-	mm_free(&args->mm, ctx);
+	free_send_ctx(ctx);
 	return ret;
 }
 
@@ -888,10 +1026,7 @@ static int create_rrset(knot_rrset_t **rrset, zone_t *zone, ctl_args_t *args,
 	const char *ttl   = need_ttl ? args->data[KNOT_CTL_IDX_TTL] : NULL;
 
 	// Prepare a buffer for a reconstructed record.
-	const size_t buff_len = sizeof(((send_ctx_t *)0)->owner) +
-	                        sizeof(((send_ctx_t *)0)->ttl) +
-	                        sizeof(((send_ctx_t *)0)->type) +
-	                        sizeof(((send_ctx_t *)0)->rdata);
+	const size_t buff_len = TXT_RR_LEN;
 	char *buff = mm_alloc(&args->mm, buff_len);
 	if (buff == NULL) {
 		return KNOT_ENOMEM;
@@ -1167,13 +1302,14 @@ static int zone_purge(zone_t *zone, ctl_args_t *args)
 	return KNOT_EOK;
 }
 
-static int send_stats_ctr(mod_ctr_t *ctr, ctl_args_t *args, knot_ctl_data_t *data)
+static int send_stats_ctr(knotd_mod_t *mod, mod_ctr_t *ctr, ctl_args_t *args,
+                          knot_ctl_data_t *data)
 {
 	char index[128];
 	char value[32];
 
 	if (ctr->count == 1) {
-		uint64_t counter = ATOMIC_GET(ctr->counter);
+		uint64_t counter = mod_stats_get(mod, ctr, 0);
 		int ret = snprintf(value, sizeof(value), "%"PRIu64, counter);
 		if (ret <= 0 || ret >= sizeof(value)) {
 			return KNOT_ESPACE;
@@ -1191,7 +1327,7 @@ static int send_stats_ctr(mod_ctr_t *ctr, ctl_args_t *args, knot_ctl_data_t *dat
 		                          CTL_FLAG_FORCE);
 
 		for (uint32_t i = 0; i < ctr->count; i++) {
-			uint64_t counter = ATOMIC_GET(ctr->counters[i]);
+			uint64_t counter = mod_stats_get(mod, ctr, i);
 
 			// Skip empty counters.
 			if (counter == 0 && !force) {
@@ -1269,7 +1405,7 @@ static int modules_stats(list_t *query_modules, ctl_args_t *args, knot_dname_t *
 		data[KNOT_CTL_IDX_SECTION] = mod->id->name + 1;
 
 		for (int i = 0; i < mod->stats_count; i++) {
-			mod_ctr_t *ctr = mod->stats + i;
+			mod_ctr_t *ctr = mod->stats_info + i;
 
 			// Skip empty counter.
 			if (ctr->name == NULL) {
@@ -1298,7 +1434,7 @@ static int modules_stats(list_t *query_modules, ctl_args_t *args, knot_dname_t *
 			data[KNOT_CTL_IDX_ITEM] = ctr->name;
 
 			// Send the counters.
-			int ret = send_stats_ctr(ctr, args, &data);
+			int ret = send_stats_ctr(mod, ctr, args, &data);
 			if (ret != KNOT_EOK) {
 				return ret;
 			}
@@ -1368,6 +1504,16 @@ static int ctl_zone(ctl_args_t *args, ctl_cmd_t cmd)
 	}
 }
 
+static void zone_load_status(zone_t *zone, size_t *loaded, size_t *waiting)
+{
+	if (zone->contents != NULL) {
+		(*loaded)++;
+	}
+	if (zone_events_get_time(zone, ZONE_EVENT_LOAD) > 0) {
+		(*waiting)++;
+	}
+}
+
 static int server_status(ctl_args_t *args)
 {
 	const char *type = args->data[KNOT_CTL_IDX_TYPE];
@@ -1388,6 +1534,12 @@ static int server_status(ctl_args_t *args)
 		               "background workers: %zu (running: %d, pending: %d)",
 		               conf()->cache.srv_udp_threads, conf()->cache.srv_tcp_threads,
 		               conf()->cache.srv_bg_threads, running_bkg_wrk, wrk_queue);
+	} else if (strcasecmp(type, "loading") == 0) {
+		size_t loaded = 0, waiting = 0;
+		knot_zonedb_foreach(args->server->zone_db, zone_load_status, &loaded, &waiting);
+		ret = snprintf(buff, sizeof(buff), "Zones: %zu, loaded: %zu, "
+		               "waiting for load: %zu",
+		               knot_zonedb_size(args->server->zone_db), loaded, waiting);
 	} else if (strcasecmp(type, "configure") == 0) {
 		ret = snprintf(buff, sizeof(buff), "%s", CONFIGURE_SUMMARY);
 	} else {
@@ -1753,17 +1905,19 @@ static int ctl_conf_modify(ctl_args_t *args, ctl_cmd_t cmd)
 typedef struct {
 	const char *name;
 	int (*fcn)(ctl_args_t *, ctl_cmd_t);
+	bool read_only;
+	bool exclusive;
 } desc_t;
 
 static const desc_t cmd_table[] = {
 	[CTL_NONE]            = { "" },
 
-	[CTL_STATUS]          = { "status",          ctl_server },
+	[CTL_STATUS]          = { "status",          ctl_server, true },
 	[CTL_STOP]            = { "stop",            ctl_server },
-	[CTL_RELOAD]          = { "reload",          ctl_server },
-	[CTL_STATS]           = { "stats",           ctl_stats },
+	[CTL_RELOAD]          = { "reload",          ctl_server, false, true },
+	[CTL_STATS]           = { "stats",           ctl_stats, true },
 
-	[CTL_ZONE_STATUS]     = { "zone-status",        ctl_zone },
+	[CTL_ZONE_STATUS]     = { "zone-status",        ctl_zone, true },
 	[CTL_ZONE_RELOAD]     = { "zone-reload",        ctl_zone },
 	[CTL_ZONE_REFRESH]    = { "zone-refresh",       ctl_zone },
 	[CTL_ZONE_RETRANSFER] = { "zone-retransfer",    ctl_zone },
@@ -1775,7 +1929,7 @@ static const desc_t cmd_table[] = {
 	[CTL_ZONE_FREEZE]     = { "zone-freeze",        ctl_zone },
 	[CTL_ZONE_THAW]       = { "zone-thaw",          ctl_zone },
 
-	[CTL_ZONE_READ]       = { "zone-read",       ctl_zone },
+	[CTL_ZONE_READ]       = { "zone-read",       ctl_zone, true },
 	[CTL_ZONE_BEGIN]      = { "zone-begin",      ctl_zone },
 	[CTL_ZONE_COMMIT]     = { "zone-commit",     ctl_zone },
 	[CTL_ZONE_ABORT]      = { "zone-abort",      ctl_zone },
@@ -1784,12 +1938,12 @@ static const desc_t cmd_table[] = {
 	[CTL_ZONE_SET]        = { "zone-set",        ctl_zone },
 	[CTL_ZONE_UNSET]      = { "zone-unset",      ctl_zone },
 	[CTL_ZONE_PURGE]      = { "zone-purge",      ctl_zone },
-	[CTL_ZONE_STATS]      = { "zone-stats",	     ctl_zone },
+	[CTL_ZONE_STATS]      = { "zone-stats",	     ctl_zone, true },
 
-	[CTL_CONF_LIST]       = { "conf-list",       ctl_conf_read },
-	[CTL_CONF_READ]       = { "conf-read",       ctl_conf_read },
+	[CTL_CONF_LIST]       = { "conf-list",       ctl_conf_read, true },
+	[CTL_CONF_READ]       = { "conf-read",       ctl_conf_read, true },
 	[CTL_CONF_BEGIN]      = { "conf-begin",      ctl_conf_txn },
-	[CTL_CONF_COMMIT]     = { "conf-commit",     ctl_conf_txn },
+	[CTL_CONF_COMMIT]     = { "conf-commit",     ctl_conf_txn, false, true },
 	[CTL_CONF_ABORT]      = { "conf-abort",      ctl_conf_txn },
 	[CTL_CONF_DIFF]       = { "conf-diff",       ctl_conf_read },
 	[CTL_CONF_GET]        = { "conf-get",        ctl_conf_read },
@@ -1823,6 +1977,24 @@ ctl_cmd_t ctl_str_to_cmd(const char *cmd_str)
 	return CTL_NONE;
 }
 
+bool ctl_cmd_read_only(ctl_cmd_t cmd)
+{
+	if (cmd <= CTL_NONE || cmd > MAX_CTL_CODE) {
+		return false;
+	}
+
+	return cmd_table[cmd].read_only;
+}
+
+bool ctl_cmd_exclusive(ctl_cmd_t cmd)
+{
+	if (cmd <= CTL_NONE || cmd > MAX_CTL_CODE) {
+		return false;
+	}
+
+	return cmd_table[cmd].exclusive;
+}
+
 int ctl_exec(ctl_cmd_t cmd, ctl_args_t *args)
 {
 	if (args == NULL) {
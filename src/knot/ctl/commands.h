@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -109,6 +109,28 @@ const char *ctl_cmd_to_str(ctl_cmd_t cmd);
  */
 ctl_cmd_t ctl_str_to_cmd(const char *cmd_str);
 
+/*!
+ * Checks if the command only reads the server state.
+ *
+ * Such commands can be processed concurrently with other commands.
+ *
+ * \param[in] cmd  Command.
+ *
+ * \return True if read-only.
+ */
+bool ctl_cmd_read_only(ctl_cmd_t cmd);
+
+/*!
+ * Checks if the command can replace the configuration or the zone database.
+ *
+ * Such commands can't be processed concurrently with read-only commands.
+ *
+ * \param[in] cmd  Command.
+ *
+ * \return True if exclusive.
+ */
+bool ctl_cmd_exclusive(ctl_cmd_t cmd);
+
 /*!
  * Executes a control command.
  *
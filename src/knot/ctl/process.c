@@ -1,4 +1,4 @@
-/*  Copyright (C) 2016 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -14,18 +14,126 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
+#include <stdlib.h>
+
 #include "contrib/mempattern.h"
+#include "contrib/ucw/lists.h"
 #include "contrib/ucw/mempool.h"
 #include "knot/common/log.h"
 #include "knot/ctl/commands.h"
 #include "knot/ctl/process.h"
+#include "knot/worker/pool.h"
 #include "libknot/error.h"
 
-int ctl_process(knot_ctl_t *ctl, server_t *server)
+struct ctl_pool {
+	server_t *server;
+	ctl_stop_cb stop;
+
+	worker_pool_t *sessions; /*!< Threads processing control sessions. */
+	worker_pool_t *serial;   /*!< Single thread for state-changing commands. */
+
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+	list_t pending;          /*!< Sessions not finished yet. */
+	unsigned readers;        /*!< Number of running read-only commands. */
+	bool exclusive;          /*!< Exclusive job waiting or running. */
+};
+
+/*! Control session processed on a pool thread. */
+typedef struct {
+	node_t n;
+	task_t task;
+	ctl_pool_t *pool;
+	knot_ctl_t *ctl;
+} ctl_session_t;
+
+/*! Operation executed on the serializing thread. */
+typedef struct {
+	task_t task;
+	ctl_pool_t *pool;
+	int (*fcn)(void *);
+	void *ctx;
+	int ret;
+	bool exclusive;
+	bool finished;
+} ctl_job_t;
+
+typedef struct {
+	ctl_cmd_t cmd;
+	ctl_args_t *args;
+} ctl_cmd_job_t;
+
+static void job_run(task_t *task)
 {
-	if (ctl == NULL || server == NULL) {
-		return KNOT_EINVAL;
+	ctl_job_t *job = task->ctx;
+	ctl_pool_t *pool = job->pool;
+
+	/* Wait for the running read-only commands and hold off the new ones. */
+	if (job->exclusive) {
+		pthread_mutex_lock(&pool->lock);
+		pool->exclusive = true;
+		while (pool->readers > 0) {
+			pthread_cond_wait(&pool->done, &pool->lock);
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	int ret = job->fcn(job->ctx);
+
+	pthread_mutex_lock(&pool->lock);
+	if (job->exclusive) {
+		pool->exclusive = false;
+	}
+	job->ret = ret;
+	job->finished = true;
+	pthread_cond_broadcast(&pool->done);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static int cmd_job_run(void *ctx)
+{
+	ctl_cmd_job_t *job = ctx;
+	return ctl_exec(job->cmd, job->args);
+}
+
+static int exec_cmd(ctl_pool_t *pool, ctl_cmd_t cmd, ctl_args_t *args)
+{
+	if (pool == NULL) {
+		return ctl_exec(cmd, args);
+	}
+
+	/* Read-only commands run in parallel. The configuration and the zone
+	 * database stay valid as reloads wait for them, the zone contents
+	 * are accessed under RCU only as they can be replaced anytime. */
+	if (ctl_cmd_read_only(cmd)) {
+		pthread_mutex_lock(&pool->lock);
+		while (pool->exclusive) {
+			pthread_cond_wait(&pool->done, &pool->lock);
+		}
+		pool->readers++;
+		pthread_mutex_unlock(&pool->lock);
+
+		int ret = ctl_exec(cmd, args);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->readers--;
+		pthread_cond_broadcast(&pool->done);
+		pthread_mutex_unlock(&pool->lock);
+
+		return ret;
+	}
+
+	ctl_cmd_job_t job = { cmd, args };
+	if (ctl_cmd_exclusive(cmd)) {
+		return ctl_pool_exclusive(pool, cmd_job_run, &job);
+	} else {
+		return ctl_pool_serial(pool, cmd_job_run, &job);
 	}
+}
+
+static int process(knot_ctl_t *ctl, server_t *server, ctl_pool_t *pool)
+{
 
 	ctl_args_t args = {
 		.ctl = ctl,
@@ -93,7 +201,7 @@ int ctl_process(knot_ctl_t *ctl, server_t *server)
 		}
 
 		// Execute the command.
-		int cmd_ret = ctl_exec(cmd, &args);
+		int cmd_ret = exec_cmd(pool, cmd, &args);
 		switch (cmd_ret) {
 		case KNOT_EOK:
 			strip = false;
@@ -126,3 +234,167 @@ int ctl_process(knot_ctl_t *ctl, server_t *server)
 		}
 	}
 }
+
+int ctl_process(knot_ctl_t *ctl, server_t *server)
+{
+	if (ctl == NULL || server == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	return process(ctl, server, NULL);
+}
+
+ctl_pool_t *ctl_pool_create(server_t *server, unsigned threads, ctl_stop_cb stop)
+{
+	if (server == NULL || threads == 0) {
+		return NULL;
+	}
+
+	ctl_pool_t *pool = calloc(1, sizeof(*pool));
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	pool->server = server;
+	pool->stop = stop;
+	init_list(&pool->pending);
+
+	if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+		free(pool);
+		return NULL;
+	}
+	if (pthread_cond_init(&pool->done, NULL) != 0) {
+		pthread_mutex_destroy(&pool->lock);
+		free(pool);
+		return NULL;
+	}
+
+	pool->sessions = worker_pool_create(threads);
+	pool->serial = worker_pool_create(1);
+	if (pool->sessions == NULL || pool->serial == NULL) {
+		ctl_pool_free(pool);
+		return NULL;
+	}
+
+	worker_pool_start(pool->sessions);
+	worker_pool_start(pool->serial);
+
+	return pool;
+}
+
+static void session_free(ctl_session_t *session)
+{
+	knot_ctl_free(session->ctl);
+	free(session);
+}
+
+static void session_run(task_t *task)
+{
+	ctl_session_t *session = task->ctx;
+	ctl_pool_t *pool = session->pool;
+
+	int ret = process(session->ctl, pool->server, pool);
+	knot_ctl_close(session->ctl);
+	if (ret == KNOT_CTL_ESTOP && pool->stop != NULL) {
+		pool->stop();
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	rem_node(&session->n);
+	pthread_mutex_unlock(&pool->lock);
+
+	session_free(session);
+}
+
+int ctl_pool_assign(ctl_pool_t *pool, knot_ctl_t *ctl)
+{
+	if (pool == NULL || ctl == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	ctl_session_t *session = calloc(1, sizeof(*session));
+	if (session == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	session->ctl = knot_ctl_clone(ctl);
+	if (session->ctl == NULL) {
+		free(session);
+		return KNOT_ENOMEM;
+	}
+	session->pool = pool;
+	session->task.ctx = session;
+	session->task.run = session_run;
+
+	pthread_mutex_lock(&pool->lock);
+	add_tail(&pool->pending, &session->n);
+	pthread_mutex_unlock(&pool->lock);
+
+	worker_pool_assign(pool->sessions, &session->task);
+
+	return KNOT_EOK;
+}
+
+static int pool_run(ctl_pool_t *pool, int (*fcn)(void *), void *ctx,
+                    bool exclusive)
+{
+	if (pool == NULL || fcn == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	ctl_job_t job = {
+		.task = { .ctx = &job, .run = job_run },
+		.pool = pool,
+		.fcn = fcn,
+		.ctx = ctx,
+		.exclusive = exclusive
+	};
+
+	worker_pool_assign(pool->serial, &job.task);
+
+	pthread_mutex_lock(&pool->lock);
+	while (!job.finished) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return job.ret;
+}
+
+int ctl_pool_serial(ctl_pool_t *pool, int (*fcn)(void *), void *ctx)
+{
+	return pool_run(pool, fcn, ctx, false);
+}
+
+int ctl_pool_exclusive(ctl_pool_t *pool, int (*fcn)(void *), void *ctx)
+{
+	return pool_run(pool, fcn, ctx, true);
+}
+
+void ctl_pool_free(ctl_pool_t *pool)
+{
+	if (pool == NULL) {
+		return;
+	}
+
+	/* Finish running sessions, drop the queued ones. */
+	if (pool->sessions != NULL) {
+		worker_pool_stop(pool->sessions);
+		worker_pool_join(pool->sessions);
+		worker_pool_destroy(pool->sessions);
+	}
+	if (pool->serial != NULL) {
+		worker_pool_stop(pool->serial);
+		worker_pool_join(pool->serial);
+		worker_pool_destroy(pool->serial);
+	}
+
+	ctl_session_t *session, *next;
+	WALK_LIST_DELSAFE(session, next, pool->pending) {
+		session_free(session);
+	}
+
+	pthread_cond_destroy(&pool->done);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2018 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -28,3 +28,68 @@
  * \return Error code, KNOT_EOK if successful.
  */
 int ctl_process(knot_ctl_t *ctl, server_t *server);
+
+/*! Pool of threads processing control sessions concurrently. */
+typedef struct ctl_pool ctl_pool_t;
+
+/*! Callback requesting the server stop. */
+typedef void (*ctl_stop_cb)(void);
+
+/*!
+ * Creates a pool for concurrent processing of control sessions.
+ *
+ * Read-only commands are processed in parallel, the other commands are
+ * executed one at a time on a dedicated thread.
+ * Commands which can replace the configuration or the zone database
+ * additionally wait until no read-only command is running.
+ *
+ * \param[in] server   Server instance.
+ * \param[in] threads  Number of threads processing the sessions.
+ * \param[in] stop     Callback called if a session requests the server stop.
+ *
+ * \return Pool or NULL if failed.
+ */
+ctl_pool_t *ctl_pool_create(server_t *server, unsigned threads, ctl_stop_cb stop);
+
+/*!
+ * Takes over the accepted connection and processes it on a pool thread.
+ *
+ * \param[in] pool  Control pool.
+ * \param[in] ctl   Control context with an accepted connection.
+ *
+ * \return Error code, KNOT_EOK if successful.
+ */
+int ctl_pool_assign(ctl_pool_t *pool, knot_ctl_t *ctl);
+
+/*!
+ * Executes the function on the thread serializing state-changing commands.
+ *
+ * \param[in] pool  Control pool.
+ * \param[in] fcn   Function to execute.
+ * \param[in] ctx   Function parameter.
+ *
+ * \return Return value of the function.
+ */
+int ctl_pool_serial(ctl_pool_t *pool, int (*fcn)(void *), void *ctx);
+
+/*!
+ * Executes the function on the serializing thread with no read-only command
+ * running concurrently.
+ *
+ * This is required if the function can replace the configuration or the zone
+ * database, e.g. on server reload.
+ *
+ * \param[in] pool  Control pool.
+ * \param[in] fcn   Function to execute.
+ * \param[in] ctx   Function parameter.
+ *
+ * \return Return value of the function.
+ */
+int ctl_pool_exclusive(ctl_pool_t *pool, int (*fcn)(void *), void *ctx);
+
+/*!
+ * Waits for the running sessions and frees the pool.
+ *
+ * \param[in] pool  Control pool.
+ */
+void ctl_pool_free(ctl_pool_t *pool);
@@ -15,7 +15,10 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "libdnssec/error.h"
 #include "libknot/dname.h"
 #include "knot/dnssec/nsec-chain.h"
 #include "knot/dnssec/nsec3-chain.h"
@@ -222,6 +225,43 @@ static zone_node_t *create_nsec3_node(const knot_dname_t *owner,
 	return new_node;
 }
 
+/*!
+ * \brief Create new NSEC3 node with given owner for given regular node.
+ *
+ * \param node         Node for which the NSEC3 node is created.
+ * \param nsec3_owner  Owner of the NSEC3 node.
+ * \param apex         Zone apex node.
+ * \param params       NSEC3 hash function parameters.
+ * \param ttl          TTL of the new NSEC3 node.
+ *
+ * \return New NSEC3 node, NULL if failed.
+ */
+static zone_node_t *create_nsec3_node_hashed(const zone_node_t *node,
+                                             const knot_dname_t *nsec3_owner,
+                                             zone_node_t *apex,
+                                             const dnssec_nsec3_params_t *params,
+                                             uint32_t ttl)
+{
+	dnssec_nsec_bitmap_t *rr_types = dnssec_nsec_bitmap_new();
+	if (!rr_types) {
+		return NULL;
+	}
+
+	bitmap_add_node_rrsets(rr_types, KNOT_RRTYPE_NSEC3, node);
+	if (node->rrset_count > 0 && node_should_be_signed_nsec3(node)) {
+		dnssec_nsec_bitmap_add(rr_types, KNOT_RRTYPE_RRSIG);
+	}
+	if (node == apex) {
+		dnssec_nsec_bitmap_add(rr_types, KNOT_RRTYPE_NSEC3PARAM);
+	}
+
+	zone_node_t *nsec3_node = create_nsec3_node(nsec3_owner, params, apex,
+	                                            rr_types, ttl);
+	dnssec_nsec_bitmap_free(rr_types);
+
+	return nsec3_node;
+}
+
 /*!
  * \brief Create new NSEC3 node for given regular node.
  *
@@ -248,24 +288,7 @@ static zone_node_t *create_nsec3_node_for_node(const zone_node_t *node,
 		return NULL;
 	}
 
-	dnssec_nsec_bitmap_t *rr_types = dnssec_nsec_bitmap_new();
-	if (!rr_types) {
-		return NULL;
-	}
-
-	bitmap_add_node_rrsets(rr_types, KNOT_RRTYPE_NSEC3, node);
-	if (node->rrset_count > 0 && node_should_be_signed_nsec3(node)) {
-		dnssec_nsec_bitmap_add(rr_types, KNOT_RRTYPE_RRSIG);
-	}
-	if (node == apex) {
-		dnssec_nsec_bitmap_add(rr_types, KNOT_RRTYPE_NSEC3PARAM);
-	}
-
-	zone_node_t *nsec3_node = create_nsec3_node(nsec3_owner, params, apex,
-	                                            rr_types, ttl);
-	dnssec_nsec_bitmap_free(rr_types);
-
-	return nsec3_node;
+	return create_nsec3_node_hashed(node, nsec3_owner, apex, params, ttl);
 }
 
 /* - NSEC3 chain creation --------------------------------------------------- */
@@ -401,15 +424,75 @@ static int reconnect_nsec3_nodes2(zone_node_t *a, zone_node_t *b,
 	return ret;
 }
 
+typedef struct {
+	const zone_contents_t *zone;
+	const dnssec_nsec3_params_t *params;
+	uint32_t ttl;
+	zone_node_t **created;   /*!< NSEC3 nodes indexed by their nodes in the tree. */
+} nsec3_nodes_args_t;
+
+/*!
+ * \brief Create NSEC3 nodes for a chunk of nodes, hashing their owners at once.
+ */
+static int create_nsec3_chunk(zone_node_t **nodes, size_t count, size_t first,
+                              void *data)
+{
+	nsec3_nodes_args_t *args = data;
+	zone_node_t **created = args->created + first;
+	zone_node_t *apex = args->zone->apex;
+	size_t hash_size = dnssec_nsec3_hash_length(args->params->algorithm);
+	if (hash_size == 0) {
+		return KNOT_EINVAL;
+	}
+
+	dnssec_binary_t owners[ZONE_TREE_CHUNK];
+	size_t indices[ZONE_TREE_CHUNK];
+	size_t hashed = 0;
+	for (size_t i = 0; i < count; i++) {
+		zone_node_t *node = nodes[i];
+		if (node->flags & (NODE_FLAGS_NONAUTH | NODE_FLAGS_EMPTY | NODE_FLAGS_DELETED)) {
+			continue;
+		}
+		owners[hashed].data = node->owner;
+		owners[hashed].size = knot_dname_size(node->owner);
+		indices[hashed++] = i;
+	}
+
+	uint8_t hashes[ZONE_TREE_CHUNK * hash_size];
+	int ret = dnssec_nsec3_hash_batch(owners, hashed, args->params, hashes);
+	if (ret != DNSSEC_EOK) {
+		return knot_error_from_libdnssec(ret);
+	}
+
+	for (size_t i = 0; i < hashed; i++) {
+		knot_dname_storage_t nsec3_owner;
+		ret = knot_nsec3_hash_to_dname(nsec3_owner, sizeof(nsec3_owner),
+		                               hashes + i * hash_size, hash_size,
+		                               apex->owner);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+
+		size_t idx = indices[i];
+		created[idx] = create_nsec3_node_hashed(nodes[idx], nsec3_owner, apex,
+		                                        args->params, args->ttl);
+		if (created[idx] == NULL) {
+			return KNOT_ENOMEM;
+		}
+	}
+
+	return KNOT_EOK;
+}
+
 /*!
  * \brief Create NSEC3 node for each regular node in the zone.
  *
  * \param zone         Zone.
  * \param params       NSEC3 params.
  * \param ttl          TTL for the created NSEC records.
- * \param cds_in_apex  Hint to guess apex node type bitmap: false=just DNSKEY, true=DNSKEY,CDS,CDNSKEY.
  * \param nsec3_nodes  Tree whereto new NSEC3 nodes will be added.
  * \param update       Zone update for possible NSEC removals
+ * \param num_threads  Maximal number of threads to use.
  *
  * \return Error code, KNOT_EOK if successful.
  */
@@ -417,7 +500,8 @@ static int create_nsec3_nodes(const zone_contents_t *zone,
                               const dnssec_nsec3_params_t *params,
                               uint32_t ttl,
                               zone_tree_t *nsec3_nodes,
-                              zone_update_t *update)
+                              zone_update_t *update,
+                              size_t num_threads)
 {
 	assert(zone);
 	assert(nsec3_nodes);
@@ -426,7 +510,7 @@ static int create_nsec3_nodes(const zone_contents_t *zone,
 	zone_tree_delsafe_it_t it = { 0 };
 	int result = zone_tree_delsafe_it_begin(zone->nodes, &it, false); // delsafe - removing nodes that contain only NSEC+RRSIG
 
-	while (!zone_tree_delsafe_it_finished(&it)) {
+	while (result == KNOT_EOK && !zone_tree_delsafe_it_finished(&it)) {
 		zone_node_t *node = zone_tree_delsafe_it_val(&it);
 
 		/*!
@@ -434,31 +518,51 @@ static int create_nsec3_nodes(const zone_contents_t *zone,
 		 * and NSEC3 in the zone at once.)
 		 */
 		result = knot_nsec_changeset_remove(node, update);
-		if (result != KNOT_EOK) {
-			break;
-		}
-		if (node->flags & NODE_FLAGS_NONAUTH || node->flags & NODE_FLAGS_EMPTY || node->flags & NODE_FLAGS_DELETED) {
-			zone_tree_delsafe_it_next(&it);
-			continue;
-		}
+		zone_tree_delsafe_it_next(&it);
+	}
 
-		zone_node_t *nsec3_node;
-		nsec3_node = create_nsec3_node_for_node(node, zone->apex,
-							params, ttl);
-		if (!nsec3_node) {
-			result = KNOT_ENOMEM;
-			break;
-		}
+	zone_tree_delsafe_it_free(&it);
+	if (result != KNOT_EOK) {
+		return result;
+	}
 
-		result = zone_tree_insert(nsec3_nodes, &nsec3_node);
-		if (result != KNOT_EOK) {
-			break;
-		}
+	/* The zone tree doesn't change any more, the NSEC3 nodes are created
+	 * by chunks of nodes in parallel and inserted at once.
+	 */
+	size_t count = zone_tree_count(zone->nodes);
+	zone_node_t **created = calloc(count, sizeof(*created));
+	if (created == NULL) {
+		return KNOT_ENOMEM;
+	}
 
-		zone_tree_delsafe_it_next(&it);
+	nsec3_nodes_args_t args = {
+		.zone = zone,
+		.params = params,
+		.ttl = ttl,
+		.created = created,
+	};
+	num_threads = MAX(num_threads, 1);
+	void *ctxs[num_threads];
+	for (size_t i = 0; i < num_threads; i++) {
+		ctxs[i] = &args;
 	}
+	result = zone_tree_parallel_chunks(zone->nodes, create_nsec3_chunk, ctxs,
+	                                   num_threads);
 
-	zone_tree_delsafe_it_free(&it);
+	for (size_t i = 0; i < count; i++) {
+		if (created[i] == NULL) {
+			continue;
+		}
+		if (result == KNOT_EOK) {
+			result = zone_tree_insert(nsec3_nodes, &created[i]);
+			if (result == KNOT_EOK) {
+				continue;
+			}
+		}
+		node_free_rrsets(created[i], NULL);
+		node_free(created[i], NULL);
+	}
+	free(created);
 
 	return result;
 }
@@ -708,7 +812,8 @@ int delete_nsec3_chain(zone_update_t *up)
 int knot_nsec3_create_chain(const zone_contents_t *zone,
                             const dnssec_nsec3_params_t *params,
                             uint32_t ttl,
-                            zone_update_t *update)
+                            zone_update_t *update,
+                            size_t num_threads)
 {
 	assert(zone);
 	assert(params);
@@ -735,7 +840,7 @@ int knot_nsec3_create_chain(const zone_contents_t *zone,
 		return result;
 	}
 
-	result = create_nsec3_nodes(zone, params, ttl, nsec3_nodes, update);
+	result = create_nsec3_nodes(zone, params, ttl, nsec3_nodes, update, num_threads);
 	if (result != KNOT_EOK) {
 		free_nsec3_tree(nsec3_nodes);
 		return result;
@@ -768,7 +873,8 @@ int knot_nsec3_create_chain(const zone_contents_t *zone,
 
 int knot_nsec3_fix_chain(zone_update_t *update,
                          const dnssec_nsec3_params_t *params,
-                         uint32_t ttl)
+                         uint32_t ttl,
+                         size_t num_threads)
 {
 	assert(update);
 	assert(params);
@@ -781,7 +887,8 @@ int knot_nsec3_fix_chain(zone_update_t *update,
 		if (ret != KNOT_EOK) {
 			return ret;
 		}
-		return knot_nsec3_create_chain(update->new_cont, params, ttl, update);
+		return knot_nsec3_create_chain(update->new_cont, params, ttl, update,
+		                               num_threads);
 	}
 
 	mark_empty_ctx_t mctx = { opt_out, true, update->new_cont };
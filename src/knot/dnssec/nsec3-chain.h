@@ -30,28 +30,32 @@ int delete_nsec3_chain(zone_update_t *up);
 /*!
  * \brief Creates new NSEC3 chain, add differences from current into a changeset.
  *
- * \param zone       Zone to be checked.
- * \param params     NSEC3 parameters.
- * \param ttl        TTL for new records.
- * \param update     Zone update to stare immediate changes into.
+ * \param zone         Zone to be checked.
+ * \param params       NSEC3 parameters.
+ * \param ttl          TTL for new records.
+ * \param update       Zone update to stare immediate changes into.
+ * \param num_threads  Number of threads for creating the NSEC3 nodes.
  *
  * \return KNOT_E*
  */
 int knot_nsec3_create_chain(const zone_contents_t *zone,
                             const dnssec_nsec3_params_t *params,
                             uint32_t ttl,
-                            zone_update_t *update);
+                            zone_update_t *update,
+                            size_t num_threads);
 
 /*!
  * \brief Updates zone's NSEC3 chain to follow the differences in zone update.
  *
- * \param update     Zone Update structure holding the zone and its update. Also modified!
- * \param params     NSEC3 parameters.
- * \param ttl        TTL for new records.
+ * \param update       Zone Update structure holding the zone and its update. Also modified!
+ * \param params       NSEC3 parameters.
+ * \param ttl          TTL for new records.
+ * \param num_threads  Number of threads for re-creating the chain.
  *
  * \retval KNOT_ENORECORD if the chain must be recreated from scratch.
  * \return KNOT_E*
  */
 int knot_nsec3_fix_chain(zone_update_t *update,
                          const dnssec_nsec3_params_t *params,
-                         uint32_t ttl);
+                         uint32_t ttl,
+                         size_t num_threads);
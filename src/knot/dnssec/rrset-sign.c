@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -15,7 +15,9 @@
  */
 
 #include <assert.h>
+#include <string.h>
 
+#include "contrib/mempattern.h"
 #include "contrib/wire_ctx.h"
 #include "libdnssec/error.h"
 #include "knot/dnssec/rrset-sign.h"
@@ -314,19 +316,43 @@ int knot_synth_rrsig(uint16_t type, const knot_rdataset_t *rrsig_rrs,
 		return KNOT_EINVAL;
 	}
 
-	knot_rdata_t *rr_to_copy = rrsig_rrs->rdata;
+	// The selected RRSIGs keep the canonical order, so they are copied as
+	// they are into a single allocation.
+	uint16_t count = 0;
+	size_t size = 0;
+	knot_rdata_t *rr = rrsig_rrs->rdata;
 	for (int i = 0; i < rrsig_rrs->count; ++i) {
-		if (type == knot_rrsig_type_covered(rr_to_copy)) {
-			int ret = knot_rdataset_add(out_sig, rr_to_copy, mm);
-			if (ret != KNOT_EOK) {
-				knot_rdataset_clear(out_sig, mm);
-				return ret;
-			}
+		if (type == knot_rrsig_type_covered(rr)) {
+			count++;
+			size += knot_rdata_size(rr->len);
 		}
-		rr_to_copy = knot_rdataset_next(rr_to_copy);
+		rr = knot_rdataset_next(rr);
 	}
 
-	return out_sig->count > 0 ? KNOT_EOK : KNOT_ENOENT;
+	if (count == 0) {
+		return KNOT_ENOENT;
+	}
+
+	uint8_t *out = mm_alloc(mm, size);
+	if (out == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	out_sig->rdata = (knot_rdata_t *)out;
+	out_sig->count = count;
+	out_sig->size = size;
+
+	rr = rrsig_rrs->rdata;
+	for (int i = 0; i < rrsig_rrs->count; ++i) {
+		if (type == knot_rrsig_type_covered(rr)) {
+			size_t rr_size = knot_rdata_size(rr->len);
+			memcpy(out, rr, rr_size);
+			out += rr_size;
+		}
+		rr = knot_rdataset_next(rr);
+	}
+
+	return KNOT_EOK;
 }
 
 /*- Verification of signatures -----------------------------------------------*/
@@ -351,20 +377,17 @@ static bool is_expired_signature(const knot_rdata_t *rrsig, uint32_t now,
 }
 
 int knot_check_signature(const knot_rrset_t *covered,
-                    const knot_rrset_t *rrsigs, size_t pos,
-                    const dnssec_key_t *key,
-                    dnssec_sign_ctx_t *sign_ctx,
-                    const kdnssec_ctx_t *dnssec_ctx,
-                    bool skip_crypto)
+                         const knot_rdata_t *rrsig,
+                         const dnssec_key_t *key,
+                         dnssec_sign_ctx_t *sign_ctx,
+                         const kdnssec_ctx_t *dnssec_ctx,
+                         bool skip_crypto)
 {
-	if (knot_rrset_empty(covered) || knot_rrset_empty(rrsigs) || !key ||
+	if (knot_rrset_empty(covered) || rrsig == NULL || !key ||
 	    !sign_ctx || !dnssec_ctx) {
 		return KNOT_EINVAL;
 	}
 
-	knot_rdata_t *rrsig = knot_rdataset_at(&rrsigs->rrs, pos);
-	assert(rrsig);
-
 	// consider signature invalid even if validity ends in refresh - in order to refresh it soon enough
 	knot_timediff_t refresh = dnssec_ctx->policy->rrsig_refresh_before +
 	                          dnssec_ctx->policy->rrsig_prerefresh;
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -96,8 +96,7 @@ int knot_synth_rrsig(uint16_t type, const knot_rdataset_t *rrsig_rrs,
  * \brief Check if RRSIG signature is valid.
  *
  * \param covered     RRs covered by the signature.
- * \param rrsigs      RR set with RRSIGs.
- * \param pos         Number of RRSIG RR in 'rrsigs' to be validated.
+ * \param rrsig       RRSIG RR to be validated.
  * \param key         Signing key.
  * \param sign_ctx    Signing context.
  * \param dnssec_ctx  DNSSEC context.
@@ -107,7 +106,7 @@ int knot_synth_rrsig(uint16_t type, const knot_rdataset_t *rrsig_rrs,
  * \retval KNOT_DNSSEC_EINVALID_SIGNATURE  The signature is invalid.
  */
 int knot_check_signature(const knot_rrset_t *covered,
-                         const knot_rrset_t *rrsigs, size_t pos,
+                         const knot_rdata_t *rrsig,
                          const dnssec_key_t *key,
                          dnssec_sign_ctx_t *sign_ctx,
                          const kdnssec_ctx_t *dnssec_ctx,
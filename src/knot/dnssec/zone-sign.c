@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -99,7 +99,7 @@ static bool apex_dnssec_changed(zone_update_t *update)
  * \param ctx      Signing context.
  * \param policy   DNSSEC policy.
  * \param skip_crypto All RRSIGs in this node have been verified, just check validity.
- * \param at       RRSIG position.
+ * \param at       Output: the valid RRSIG RR.
  *
  * \return The signature exists and is valid.
  */
@@ -109,7 +109,7 @@ static bool valid_signature_exists(const knot_rrset_t *covered,
 				   dnssec_sign_ctx_t *ctx,
 				   const kdnssec_ctx_t *dnssec_ctx,
                                    bool skip_crypto,
-				   uint16_t *at)
+				   knot_rdata_t **at)
 {
 	assert(key);
 
@@ -120,6 +120,7 @@ static bool valid_signature_exists(const knot_rrset_t *covered,
 	uint16_t rrsigs_rdata_count = rrsigs->rrs.count;
 	knot_rdata_t *rdata = rrsigs->rrs.rdata;
 	for (uint16_t i = 0; i < rrsigs_rdata_count; i++) {
+		knot_rdata_t *rrsig = rdata;
 		uint16_t rr_keytag = knot_rrsig_key_tag(rdata);
 		uint16_t rr_covered = knot_rrsig_type_covered(rdata);
 		rdata = knot_rdataset_next(rdata);
@@ -129,10 +130,10 @@ static bool valid_signature_exists(const knot_rrset_t *covered,
 			continue;
 		}
 
-		if (knot_check_signature(covered, rrsigs, i, key, ctx,
+		if (knot_check_signature(covered, rrsig, key, ctx,
 		                         dnssec_ctx, skip_crypto) == KNOT_EOK) {
 			if (at != NULL) {
-				*at = i;
+				*at = rrsig;
 			}
 			return true;
 		}
@@ -260,10 +261,9 @@ static int add_missing_rrsigs(const knot_rrset_t *covered,
 			continue;
 		}
 
-		uint16_t valid_at;
+		knot_rdata_t *valid_rr;
 		if (valid_signature_exists(covered, rrsigs, key->key, sign_ctx->sign_ctxs[i],
-		                           sign_ctx->dnssec_ctx, skip_crypto, &valid_at)) {
-			knot_rdata_t *valid_rr = knot_rdataset_at(&rrsigs->rrs, valid_at);
+		                           sign_ctx->dnssec_ctx, skip_crypto, &valid_rr)) {
 			result = knot_rdataset_remove(&to_remove.rrs, valid_rr, NULL);
 			note_earliest_expiration(valid_rr, expires_at);
 			continue;
@@ -459,16 +459,9 @@ static int sign_node_rrsets(const zone_node_t *node,
  * \brief Struct to carry data for 'sign_data' callback function.
  */
 typedef struct {
-	zone_tree_t *tree;
 	zone_sign_ctx_t *sign_ctx;
 	changeset_t changeset;
 	knot_time_t expires_at;
-	size_t num_threads;
-	size_t thread_index;
-	size_t rrset_index;
-	int errcode;
-	int thread_init_errcode;
-	pthread_t thread;
 } node_sign_args_t;
 
 /*!
@@ -488,21 +481,27 @@ static int sign_node(zone_node_t *node, void *data)
 		return KNOT_EOK;
 	}
 
-	if (args->rrset_index++ % args->num_threads != args->thread_index) {
-		return KNOT_EOK;
-	}
-
 	int result = sign_node_rrsets(node, args->sign_ctx,
 	                              &args->changeset, &args->expires_at);
 
 	return result;
 }
 
-static void *tree_sign_thread(void *_arg)
+/*!
+ * \brief Sign a chunk of consecutive nodes (callback function).
+ */
+static int sign_chunk(zone_node_t **nodes, size_t count, size_t first, void *data)
 {
-	node_sign_args_t *arg = _arg;
-	arg->errcode = zone_tree_apply(arg->tree, sign_node, _arg);
-	return NULL;
+	UNUSED(first);
+
+	for (size_t i = 0; i < count; i++) {
+		int ret = sign_node(nodes[i], data);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	return KNOT_EOK;
 }
 
 static int set_signed(zone_node_t *node, void *data)
@@ -535,14 +534,17 @@ static int zone_tree_sign(zone_tree_t *tree,
 	assert(dnssec_ctx);
 	assert(update);
 
+	num_threads = MAX(num_threads, 1);
+
 	int ret = KNOT_EOK;
 	node_sign_args_t args[num_threads];
+	void *ctxs[num_threads];
 	memset(args, 0, sizeof(args));
 	*expires_at = knot_time_plus(dnssec_ctx->now, dnssec_ctx->policy->rrsig_lifetime);
 
 	// init context structures
 	for (size_t i = 0; i < num_threads; i++) {
-		args[i].tree = tree;
+		ctxs[i] = &args[i];
 		args[i].sign_ctx = zone_sign_ctx(zone_keys, dnssec_ctx);
 		if (args[i].sign_ctx == NULL) {
 			ret = KNOT_ENOMEM;
@@ -553,49 +555,18 @@ static int zone_tree_sign(zone_tree_t *tree,
 			break;
 		}
 		args[i].expires_at = 0;
-		args[i].num_threads = num_threads;
-		args[i].thread_index = i;
-		args[i].rrset_index = 0;
-		args[i].errcode = KNOT_EOK;
-		args[i].thread_init_errcode = -1;
 	}
-	if (ret != KNOT_EOK) {
-		for (size_t i = 0; i < num_threads; i++) {
-			changeset_clear(&args[i].changeset);
-			zone_sign_ctx_free(args[i].sign_ctx);
-		}
-		return ret;
-	}
-
-	if (num_threads == 1) {
-		args[0].thread_init_errcode = 0;
-		tree_sign_thread(&args[0]);
-	} else {
-		// start working threads
-		for (size_t i = 0; i < num_threads; i++) {
-			args[i].thread_init_errcode =
-				pthread_create(&args[i].thread, NULL, tree_sign_thread, &args[i]);
-		}
 
-		// join those threads that have been really started
-		for (size_t i = 0; i < num_threads; i++) {
-			if (args[i].thread_init_errcode == 0) {
-				args[i].thread_init_errcode = pthread_join(args[i].thread, NULL);
-			}
-		}
+	if (ret == KNOT_EOK) {
+		ret = zone_tree_parallel_chunks(tree, sign_chunk, ctxs, num_threads);
 	}
 
-	// collect return code and results
+	// collect results
 	for (size_t i = 0; i < num_threads && ret == KNOT_EOK; i++) {
-		if (args[i].thread_init_errcode != 0) {
-			ret = knot_map_errno_code(args[i].thread_init_errcode);
-		} else {
-			ret = args[i].errcode;
-			if (ret == KNOT_EOK) {
-				ret = zone_update_apply_changeset(update, &args[i].changeset); // _fix not needed
-				*expires_at = knot_time_min(*expires_at, args[i].expires_at);
-			}
-		}
+		ret = zone_update_apply_changeset(update, &args[i].changeset); // _fix not needed
+		*expires_at = knot_time_min(*expires_at, args[i].expires_at);
+	}
+	for (size_t i = 0; i < num_threads; i++) {
 		changeset_clear(&args[i].changeset);
 		zone_sign_ctx_free(args[i].sign_ctx);
 	}
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -83,7 +83,7 @@ int event_load(conf_t *conf, zone_t *zone)
 					   zone->zonefile.mtime.tv_nsec == mtime.tv_nsec);
 		free(filename);
 		if (ret == KNOT_EOK) {
-			ret = zone_load_contents(conf, zone->name, &zf_conts, false);
+			ret = zone_load_contents(conf, zone->name, &zf_conts, true, false);
 		}
 		if (ret != KNOT_EOK) {
 			zf_conts = NULL;
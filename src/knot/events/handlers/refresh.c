@@ -16,8 +16,11 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "contrib/mempattern.h"
+#include "contrib/semaphore.h"
 #include "libdnssec/random.h"
 #include "knot/common/log.h"
 #include "knot/conf/conf.h"
@@ -29,6 +32,7 @@
 #include "knot/query/query.h"
 #include "knot/query/requestor.h"
 #include "knot/updates/changesets.h"
+#include "knot/worker/pool.h"
 #include "knot/zone/adjust.h"
 #include "knot/zone/serial.h"
 #include "knot/zone/zone.h"
@@ -77,6 +81,9 @@
 #define BOOTSTRAP_MAXTIME (24*60*60)
 #define BOOTSTRAP_JITTER (30)
 
+/*! \brief Maximal number of received AXFR messages waiting for the zone builder. */
+#define AXFR_BUILD_QUEUE 64
+
 enum state {
 	REFRESH_STATE_INVALID = 0,
 	STATE_SOA_QUERY,
@@ -112,6 +119,10 @@ struct refresh_data {
 
 	struct {
 		zone_contents_t *zone;    //!< AXFR result, new zone.
+		bool has_soa;             //!< Initial SOA received.
+		worker_pool_t *builder;   //!< Zone building thread, NULL if not pipelined.
+		knot_sem_t free_slots;    //!< Free slots in the builder queue.
+		int build_ret;            //!< Zone building result.
 	} axfr;
 
 	struct {
@@ -157,7 +168,8 @@ static int xfr_validate(zone_contents_t *zone, struct refresh_data *data)
 		.cb = err_handler_logger
 	};
 
-	int ret = sem_checks_process(zone, false, &handler, time(NULL));
+	int ret = sem_checks_process(zone, false, &handler, time(NULL),
+	                             data->conf->cache.srv_bg_threads);
 	if (ret != KNOT_EOK) {
 		// error is logged by the error handler
 		return ret;
@@ -204,6 +216,36 @@ static void xfr_log_read_ms(const knot_dname_t *zone, int ret)
 	log_zone_error(zone, "failed reading master's serial from KASP DB (%s)", knot_strerror(ret));
 }
 
+/*! \brief Parsed RR queued for the zone builder, followed by owner and rdata. */
+typedef struct {
+	uint32_t ttl;
+	uint16_t type;
+	uint16_t rclass;
+	uint16_t owner_size;
+	uint16_t rdata_size;
+} axfr_rr_t;
+
+/*! \brief Received AXFR message queued for the zone builder. */
+typedef struct {
+	task_t task;
+	struct refresh_data *data;
+	size_t count;       //!< Number of RRs.
+	uint8_t rrs[];      //!< Sequence of axfr_rr_t.
+} axfr_msg_t;
+
+#define AXFR_RR_ALIGN(size, align) (((size) + (align) - 1) & ~((align) - 1))
+
+static size_t axfr_rr_rdata_offset(size_t owner_size)
+{
+	return AXFR_RR_ALIGN(sizeof(axfr_rr_t) + owner_size, sizeof(uint16_t));
+}
+
+static size_t axfr_rr_size(size_t owner_size, size_t rdata_size)
+{
+	return AXFR_RR_ALIGN(axfr_rr_rdata_offset(owner_size) + rdata_size,
+	                     sizeof(uint32_t));
+}
+
 static int axfr_init(struct refresh_data *data)
 {
 	zone_contents_t *new_zone = zone_contents_new(data->zone->name, true);
@@ -212,11 +254,139 @@ static int axfr_init(struct refresh_data *data)
 	}
 
 	data->axfr.zone = new_zone;
+	data->axfr.has_soa = false;
+	data->axfr.build_ret = KNOT_EOK;
+	return KNOT_EOK;
+}
+
+static int axfr_build_rr(const knot_rrset_t *rr, zone_contents_t *zone)
+{
+	// zc is stateless structure which can be initialized for each rr
+	// the changes are stored only in zone (aka zc.z)
+	zcreator_t zc = {
+		.z = zone,
+		.master = false,
+		.ret = KNOT_EOK
+	};
+
+	return zcreator_step(&zc, rr);
+}
+
+static int axfr_build_packet(const knot_pkt_t *pkt, uint16_t count,
+                             zone_contents_t *zone)
+{
+	const knot_pktsection_t *answer = knot_pkt_section(pkt, KNOT_ANSWER);
+	for (uint16_t i = 0; i < count; ++i) {
+		int ret = axfr_build_rr(knot_pkt_rr(answer, i), zone);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	return KNOT_EOK;
+}
+
+static void axfr_build_msg(task_t *task)
+{
+	axfr_msg_t *msg = task->ctx;
+	struct refresh_data *data = msg->data;
+
+	// The result is read by the refresh thread once the queue is drained.
+	const uint8_t *pos = msg->rrs;
+	for (size_t i = 0; i < msg->count && data->axfr.build_ret == KNOT_EOK; i++) {
+		const axfr_rr_t *hdr = (const axfr_rr_t *)pos;
+		knot_rrset_t rr;
+		knot_rrset_init(&rr, (knot_dname_t *)(pos + sizeof(*hdr)),
+		                hdr->type, hdr->rclass, hdr->ttl);
+		rr.rrs.count = 1;
+		rr.rrs.size = hdr->rdata_size;
+		rr.rrs.rdata = (knot_rdata_t *)(pos + axfr_rr_rdata_offset(hdr->owner_size));
+
+		data->axfr.build_ret = axfr_build_rr(&rr, data->axfr.zone);
+		pos += axfr_rr_size(hdr->owner_size, hdr->rdata_size);
+	}
+
+	knot_sem_post(&data->axfr.free_slots);
+	free(msg);
+}
+
+static int axfr_build_start(struct refresh_data *data)
+{
+	worker_pool_t *builder = worker_pool_create(1);
+	if (builder == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	knot_sem_init(&data->axfr.free_slots, AXFR_BUILD_QUEUE);
+	worker_pool_start(builder);
+	data->axfr.builder = builder;
+
+	return KNOT_EOK;
+}
+
+static int axfr_build_enqueue(const knot_pkt_t *pkt, uint16_t count,
+                              struct refresh_data *data)
+{
+	// Copy the parsed RRs so that the builder doesn't have to parse again.
+	const knot_pktsection_t *answer = knot_pkt_section(pkt, KNOT_ANSWER);
+	size_t size = 0;
+	for (uint16_t i = 0; i < count; ++i) {
+		const knot_rrset_t *rr = knot_pkt_rr(answer, i);
+		size += axfr_rr_size(knot_dname_size(rr->owner), rr->rrs.size);
+	}
+
+	axfr_msg_t *msg = malloc(sizeof(*msg) + size);
+	if (msg == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	uint8_t *pos = msg->rrs;
+	for (uint16_t i = 0; i < count; ++i) {
+		const knot_rrset_t *rr = knot_pkt_rr(answer, i);
+		axfr_rr_t *hdr = (axfr_rr_t *)pos;
+		hdr->ttl = rr->ttl;
+		hdr->type = rr->type;
+		hdr->rclass = rr->rclass;
+		hdr->owner_size = knot_dname_size(rr->owner);
+		hdr->rdata_size = rr->rrs.size;
+		memcpy(pos + sizeof(*hdr), rr->owner, hdr->owner_size);
+		memcpy(pos + axfr_rr_rdata_offset(hdr->owner_size), rr->rrs.rdata,
+		       hdr->rdata_size);
+		pos += axfr_rr_size(hdr->owner_size, hdr->rdata_size);
+	}
+
+	msg->count = count;
+	msg->data = data;
+	msg->task.ctx = msg;
+	msg->task.run = axfr_build_msg;
+
+	// Wait if the builder is too far behind.
+	knot_sem_wait(&data->axfr.free_slots);
+	worker_pool_assign(data->axfr.builder, &msg->task);
+
 	return KNOT_EOK;
 }
 
+/*! \brief Wait for the queued messages and stop the zone builder. */
+static int axfr_build_stop(struct refresh_data *data)
+{
+	if (data->axfr.builder == NULL) {
+		return data->axfr.build_ret;
+	}
+
+	worker_pool_wait(data->axfr.builder);
+	worker_pool_stop(data->axfr.builder);
+	worker_pool_join(data->axfr.builder);
+	worker_pool_destroy(data->axfr.builder);
+	knot_sem_destroy(&data->axfr.free_slots);
+	data->axfr.builder = NULL;
+
+	return data->axfr.build_ret;
+}
+
 static void axfr_cleanup(struct refresh_data *data)
 {
+	(void)axfr_build_stop(data);
 	zone_contents_deep_free(data->axfr.zone);
 	data->axfr.zone = NULL;
 }
@@ -316,22 +486,11 @@ static int axfr_consume_rr(const knot_rrset_t *rr, struct refresh_data *data)
 	assert(data);
 	assert(data->axfr.zone);
 
-	// zc is stateless structure which can be initialized for each rr
-	// the changes are stored only in data->axfr.zone (aka zc.z)
-	zcreator_t zc = {
-		.z = data->axfr.zone,
-		.master = false,
-		.ret = KNOT_EOK
-	};
-
-	if (rr->type == KNOT_RRTYPE_SOA &&
-	    node_rrtype_exists(zc.z->apex, KNOT_RRTYPE_SOA)) {
-		return KNOT_STATE_DONE;
-	}
-
-	int ret = zcreator_step(&zc, rr);
-	if (ret != KNOT_EOK) {
-		return KNOT_STATE_FAIL;
+	if (rr->type == KNOT_RRTYPE_SOA) {
+		if (data->axfr.has_soa) {
+			return KNOT_STATE_DONE;
+		}
+		data->axfr.has_soa = true;
 	}
 
 	data->change_size += knot_rrset_size(rr);
@@ -349,12 +508,38 @@ static int axfr_consume_packet(knot_pkt_t *pkt, struct refresh_data *data)
 	assert(pkt);
 	assert(data);
 
+	// Find the RRs belonging to the transfer, the final SOA excluded
 	const knot_pktsection_t *answer = knot_pkt_section(pkt, KNOT_ANSWER);
-	int ret = KNOT_STATE_CONSUME;
-	for (uint16_t i = 0; i < answer->count && ret == KNOT_STATE_CONSUME; ++i) {
-		ret = axfr_consume_rr(knot_pkt_rr(answer, i), data);
+	int next = KNOT_STATE_CONSUME;
+	uint16_t count = 0;
+	while (count < answer->count && next == KNOT_STATE_CONSUME) {
+		next = axfr_consume_rr(knot_pkt_rr(answer, count), data);
+		if (next == KNOT_STATE_CONSUME) {
+			count++;
+		}
 	}
-	return ret;
+	if (next == KNOT_STATE_FAIL) {
+		return next;
+	}
+
+	// Build the zone in a separate thread if more messages are expected
+	if (data->axfr.builder == NULL && next == KNOT_STATE_CONSUME) {
+		(void)axfr_build_start(data);
+	}
+
+	int ret;
+	if (data->axfr.builder != NULL) {
+		ret = axfr_build_enqueue(pkt, count, data);
+	} else {
+		ret = axfr_build_packet(pkt, count, data->axfr.zone);
+	}
+	if (ret != KNOT_EOK) {
+		AXFRIN_LOG(LOG_WARNING, data->zone->name, data->remote,
+		           "failed to build zone (%s)", knot_strerror(ret));
+		return KNOT_STATE_FAIL;
+	}
+
+	return next;
 }
 
 static int axfr_consume(knot_pkt_t *pkt, struct refresh_data *data)
@@ -389,6 +574,10 @@ static int axfr_consume(knot_pkt_t *pkt, struct refresh_data *data)
 	// Process saved SOA if fallback from IXFR
 	if (data->initial_soa_copy != NULL) {
 		next = axfr_consume_rr(data->initial_soa_copy, data);
+		if (next == KNOT_STATE_CONSUME &&
+		    axfr_build_rr(data->initial_soa_copy, data->axfr.zone) != KNOT_EOK) {
+			next = KNOT_STATE_FAIL;
+		}
 		knot_rrset_free(data->initial_soa_copy, data->mm);
 		data->initial_soa_copy = NULL;
 		if (next != KNOT_STATE_CONSUME) {
@@ -400,8 +589,14 @@ static int axfr_consume(knot_pkt_t *pkt, struct refresh_data *data)
 	xfr_stats_add(&data->stats, pkt->size);
 	next = axfr_consume_packet(pkt, data);
 
-	// Finalize
+	// Finalize once the zone is built
 	if (next == KNOT_STATE_DONE) {
+		int ret = axfr_build_stop(data);
+		if (ret != KNOT_EOK) {
+			AXFRIN_LOG(LOG_WARNING, data->zone->name, data->remote,
+			           "failed to build zone (%s)", knot_strerror(ret));
+			return KNOT_STATE_FAIL;
+		}
 		xfr_stats_end(&data->stats);
 	}
 
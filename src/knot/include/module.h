@@ -36,7 +36,7 @@
 /*** Query module API. ***/
 
 /*! Current module ABI version. */
-#define KNOTD_MOD_ABI_VERSION	200
+#define KNOTD_MOD_ABI_VERSION	300
 /*! Module configuration name prefix. */
 #define KNOTD_MOD_NAME_PREFIX	"mod-"
 
@@ -219,32 +219,41 @@ int knotd_mod_stats_add(knotd_mod_t *mod, const char *ctr_name, uint32_t idx_cou
 /*!
  * Increments a statistics counter.
  *
- * \param[in] mod     Module context.
- * \param[in] ctr_id  Counter id (counted in the order the counters were registered).
- * \param[in] idx     Subcounter index (set 0 for single-counter).
- * \param[in] val     Value increment.
+ * \note Each worker thread updates its own copy of the counters, the reported
+ *       value is the sum over all threads.
+ *
+ * \param[in] mod        Module context.
+ * \param[in] thread_id  Current thread id (qdata->params->thread_id).
+ * \param[in] ctr_id     Counter id (counted in the order the counters were registered).
+ * \param[in] idx        Subcounter index (set 0 for single-counter).
+ * \param[in] val        Value increment.
  */
-void knotd_mod_stats_incr(knotd_mod_t *mod, uint32_t ctr_id, uint32_t idx, uint64_t val);
+void knotd_mod_stats_incr(knotd_mod_t *mod, unsigned thread_id, uint32_t ctr_id,
+                          uint32_t idx, uint64_t val);
 
 /*!
  * Decrements a statistics counter.
  *
- * \param[in] mod     Module context.
- * \param[in] ctr_id  Counter id (counted in the order the counters were registered).
- * \param[in] idx     Subcounter index (set 0 for single-counter).
- * \param[in] val     Value decrement.
+ * \param[in] mod        Module context.
+ * \param[in] thread_id  Current thread id (qdata->params->thread_id).
+ * \param[in] ctr_id     Counter id (counted in the order the counters were registered).
+ * \param[in] idx        Subcounter index (set 0 for single-counter).
+ * \param[in] val        Value decrement.
  */
-void knotd_mod_stats_decr(knotd_mod_t *mod, uint32_t ctr_id, uint32_t idx, uint64_t val);
+void knotd_mod_stats_decr(knotd_mod_t *mod, unsigned thread_id, uint32_t ctr_id,
+                          uint32_t idx, uint64_t val);
 
 /*!
- * Sets a statistics counter value.
+ * Sets a statistics counter value of the current thread.
  *
- * \param[in] mod     Module context.
- * \param[in] ctr_id  Counter id (counted in the order the counters were registered).
- * \param[in] idx     Subcounter index (set 0 for single-counter).
- * \param[in] val     Value.
+ * \param[in] mod        Module context.
+ * \param[in] thread_id  Current thread id (qdata->params->thread_id).
+ * \param[in] ctr_id     Counter id (counted in the order the counters were registered).
+ * \param[in] idx        Subcounter index (set 0 for single-counter).
+ * \param[in] val        Value.
  */
-void knotd_mod_stats_store(knotd_mod_t *mod, uint32_t ctr_id, uint32_t idx, uint64_t val);
+void knotd_mod_stats_store(knotd_mod_t *mod, unsigned thread_id, uint32_t ctr_id,
+                           uint32_t idx, uint64_t val);
 
 /*! Configuration single-value abstraction. */
 typedef union {
@@ -277,6 +286,7 @@ typedef enum {
 	KNOTD_CONF_ENV_HOSTNAME    = 1, /*!< Current hostname. */
 	KNOTD_CONF_ENV_WORKERS_UDP = 2, /*!< Current number of UDP workers. */
 	KNOTD_CONF_ENV_WORKERS_TCP = 3, /*!< Current number of TCP workers. */
+	KNOTD_CONF_ENV_THREADS     = 4, /*!< Upper bound of query processing thread ids. */
 } knotd_conf_env_t;
 
 /*!
@@ -385,6 +395,7 @@ typedef enum {
 typedef struct {
 	knotd_query_flag_t flags;              /*!< Current query flgas. */
 	const struct sockaddr_storage *remote; /*!< Current remote address. */
+	const struct sockaddr_storage *local;  /*!< Current local address. */
 	int socket;                            /*!< Current network socket. */
 	unsigned thread_id;                    /*!< Current thread id. */
 	void *server;                          /*!< Server object private item. */
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -162,6 +162,7 @@ void serialize_prepare(serialize_ctx_t *ctx, size_t max_size, size_t *realsize)
 
 	size_t candidate = 0;
 	long tmp_phase = ctx->rrset_phase;
+	const knot_rdata_t *rr = NULL; // RR at tmp_phase, found at most once per RRset.
 	while (1) {
 		if (tmp_phase >= ctx->rrset_buf[ctx->rrset_buf_size - 1].rrs.count) {
 			if (ctx->rrset_buf_size >= RRSET_BUF_MAXSIZE) {
@@ -177,9 +178,12 @@ void serialize_prepare(serialize_ctx_t *ctx, size_t max_size, size_t *realsize)
 		if (tmp_phase == SERIALIZE_RRSET_INIT) {
 			candidate += 3 * sizeof(uint16_t) +
 			             knot_dname_size(ctx->rrset_buf[ctx->rrset_buf_size - 1].owner);
+			rr = NULL;
 		} else {
-			candidate += sizeof(uint32_t) + sizeof(uint16_t) +
-			             knot_rdataset_at(&ctx->rrset_buf[ctx->rrset_buf_size - 1].rrs, tmp_phase)->len;
+			rr = (rr == NULL) ?
+			     knot_rdataset_at(&ctx->rrset_buf[ctx->rrset_buf_size - 1].rrs, tmp_phase) :
+			     knot_rdataset_next((knot_rdata_t *)rr);
+			candidate += sizeof(uint32_t) + sizeof(uint16_t) + rr->len;
 		}
 		if (candidate > max_size) {
 			return;
@@ -193,6 +197,7 @@ void serialize_chunk(serialize_ctx_t *ctx, uint8_t *dst_chunk, size_t chunk_size
 {
 	wire_ctx_t wire = wire_ctx_init(dst_chunk, chunk_size);
 
+	const knot_rdata_t *rr = NULL; // RR at rrset_phase, found at most once per RRset.
 	for (size_t i = 0; ; ) {
 		if (ctx->rrset_phase >= ctx->rrset_buf[i].rrs.count) {
 			if (++i >= ctx->rrset_buf_size) {
@@ -210,9 +215,11 @@ void serialize_chunk(serialize_ctx_t *ctx, uint8_t *dst_chunk, size_t chunk_size
 			wire_ctx_write_u16(&wire, ctx->rrset_buf[i].type);
 			wire_ctx_write_u16(&wire, ctx->rrset_buf[i].rclass);
 			wire_ctx_write_u16(&wire, ctx->rrset_buf[i].rrs.count);
+			rr = NULL;
 		} else {
-			const knot_rdata_t *rr = knot_rdataset_at(&ctx->rrset_buf[i].rrs,
-			                                          ctx->rrset_phase);
+			rr = (rr == NULL) ?
+			     knot_rdataset_at(&ctx->rrset_buf[i].rrs, ctx->rrset_phase) :
+			     knot_rdataset_next((knot_rdata_t *)rr);
 			assert(rr);
 			uint16_t rdlen = rr->len;
 			if (wire_ctx_available(&wire) < sizeof(uint32_t) + sizeof(uint16_t) + rdlen) {
@@ -304,9 +311,8 @@ int serialize_rrset(wire_ctx_t *wire, const knot_rrset_t *rrset)
 	wire_ctx_write_u16(wire, rrset->rclass);
 	wire_ctx_write_u16(wire, rrset->rrs.count);
 
+	const knot_rdata_t *rr = rrset->rrs.rdata;
 	for (size_t phase = 0; phase < rrset->rrs.count; phase++) {
-		const knot_rdata_t *rr = knot_rdataset_at(&rrset->rrs, phase);
-		assert(rr);
 		uint16_t rdlen = rr->len;
 		if (wire_ctx_available(wire) < sizeof(uint32_t) + sizeof(uint16_t) + rdlen) {
 			assert(0);
@@ -315,6 +321,7 @@ int serialize_rrset(wire_ctx_t *wire, const knot_rrset_t *rrset)
 		wire_ctx_write_u16(wire, rdlen);
 		wire_ctx_write(wire, rr->data, rdlen);
 		assert(wire->error == KNOT_EOK);
+		rr = knot_rdataset_next((knot_rdata_t *)rr);
 	}
 
 	return KNOT_EOK;
@@ -380,11 +387,11 @@ size_t rrset_serialized_size(const knot_rrset_t *rrset)
 	// Owner size + type + class + RR count.
 	size_t size = knot_dname_size(rrset->owner) + 3 * sizeof(uint16_t);
 
+	const knot_rdata_t *rr = rrset->rrs.rdata;
 	for (uint16_t i = 0; i < rrset->rrs.count; i++) {
-		const knot_rdata_t *rr = knot_rdataset_at(&rrset->rrs, i);
-		assert(rr);
 		// TTL + RR size + RR.
 		size += sizeof(uint32_t) + sizeof(uint16_t) + rr->len;
+		rr = knot_rdataset_next((knot_rdata_t *)rr);
 	}
 
 	return size;
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -92,8 +92,8 @@ static knotd_state_t log_message(knotd_state_t state, const knot_pkt_t *pkt,
 	Dnstap__Message msg;
 	int ret = dt_message_fill(&msg, msgtype,
 	                          (const struct sockaddr *)qdata->params->remote,
-	                          NULL, /* todo: fill me! */
-				  protocol, pkt->wire, pkt->size, &tv);
+	                          (const struct sockaddr *)qdata->params->local,
+	                          protocol, pkt->wire, pkt->size, &tv);
 	if (ret != KNOT_EOK) {
 		return state;
 	}
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -14,6 +14,7 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <arpa/inet.h>
@@ -25,9 +26,11 @@
 #include "contrib/qp-trie/trie.h"
 #include "contrib/ucw/lists.h"
 #include "contrib/macros.h"
+#include "contrib/openbsd/siphash.h"
 #include "contrib/sockaddr.h"
 #include "contrib/string.h"
 #include "contrib/strtonum.h"
+#include "libdnssec/error.h"
 #include "libdnssec/random.h"
 #include "libzscanner/scanner.h"
 
@@ -36,6 +39,7 @@
 #define MOD_MODE	"\x04""mode"
 #define MOD_GEODB_FILE	"\x0A""geodb-file"
 #define MOD_GEODB_KEY	"\x09""geodb-key"
+#define MOD_CACHE_SIZE	"\x0A""cache-size"
 
 enum operation_mode {
 	MODE_SUBNET,
@@ -62,6 +66,7 @@ const yp_item_t geoip_conf[] = {
 	{ MOD_MODE,        YP_TOPT, YP_VOPT = { modes, MODE_SUBNET} },
 	{ MOD_GEODB_FILE,  YP_TSTR, YP_VNONE },
 	{ MOD_GEODB_KEY,   YP_TSTR, YP_VSTR = { "country/iso_code" }, YP_FMULTI },
+	{ MOD_CACHE_SIZE,  YP_TINT, YP_VINT = { 0, INT32_MAX, 1024 } },
 	{ NULL }
 };
 
@@ -87,6 +92,44 @@ int geoip_conf_check(knotd_conf_check_args_t *args)
 	return KNOT_EOK;
 }
 
+/*! \brief Number of entries in one set of the view cache. */
+#define CACHE_WAYS 4
+
+enum {
+	CTR_VIEW_CACHE = 0,
+};
+
+enum {
+	VIEW_CACHE_HIT = 0,
+	VIEW_CACHE_MISS,
+	VIEW_CACHE__COUNT
+};
+
+static char *view_cache_to_str(uint32_t idx, uint32_t count)
+{
+	switch (idx) {
+	case VIEW_CACHE_HIT:  return strdup("hit");
+	case VIEW_CACHE_MISS: return strdup("miss");
+	default:              assert(0); return NULL;
+	}
+}
+
+struct geo_view;
+struct geo_trie_val;
+
+typedef struct {
+	const struct geo_trie_val *data; /*!< Views of the queried name, NULL if unused. */
+	const struct geo_view *view;     /*!< Selected view, NULL if none is suitable. */
+	uint16_t netmask;                /*!< Prefix length for the ECS scope. */
+	uint16_t family;                 /*!< Client address family. */
+	uint8_t addr[16];                /*!< Client address. */
+} cache_entry_t;
+
+typedef struct {
+	unsigned mask;           /*!< Number of sets - 1. */
+	cache_entry_t *entries;  /*!< Sets of CACHE_WAYS entries, most recent first. */
+} view_cache_t;
+
 typedef struct {
 	enum operation_mode mode;
 	uint32_t ttl;
@@ -96,9 +139,13 @@ typedef struct {
 	geodb_t *geodb;
 	geodb_path_t paths[GEODB_MAX_DEPTH];
 	uint16_t path_count;
+
+	SIPHASH_KEY cache_key;
+	view_cache_t *caches; // One cache per worker thread.
+	unsigned cache_count;
 } geoip_ctx_t;
 
-typedef struct {
+typedef struct geo_view {
 	struct sockaddr_storage *subnet;
 	uint8_t subnet_prefix;
 
@@ -117,7 +164,7 @@ typedef struct {
 	knot_rrset_t *rrsigs;
 } geo_view_t;
 
-typedef struct {
+typedef struct geo_trie_val {
 	size_t count, avail;
 	geo_view_t *views;
 	uint16_t total_weight;
@@ -616,8 +663,47 @@ static void clear_geo_trie(trie_t *trie)
 	trie_clear(trie);
 }
 
+static void free_view_caches(geoip_ctx_t *ctx)
+{
+	for (unsigned i = 0; i < ctx->cache_count; i++) {
+		free(ctx->caches[i].entries);
+	}
+	free(ctx->caches);
+}
+
+static int init_view_caches(geoip_ctx_t *ctx, unsigned threads, unsigned size)
+{
+	unsigned sets = 1;
+	while (sets * CACHE_WAYS < size && sets <= (UINT_MAX >> 1) / CACHE_WAYS) {
+		sets <<= 1;
+	}
+
+	ctx->caches = calloc(threads, sizeof(view_cache_t));
+	if (ctx->caches == NULL) {
+		return KNOT_ENOMEM;
+	}
+	ctx->cache_count = threads;
+
+	for (unsigned i = 0; i < threads; i++) {
+		view_cache_t *cache = &ctx->caches[i];
+		cache->mask = sets - 1;
+		cache->entries = calloc(sets * CACHE_WAYS, sizeof(cache_entry_t));
+		if (cache->entries == NULL) {
+			return KNOT_ENOMEM;
+		}
+	}
+
+	if (dnssec_random_buffer((uint8_t *)&ctx->cache_key,
+	                         sizeof(ctx->cache_key)) != DNSSEC_EOK) {
+		return KNOT_ERROR;
+	}
+
+	return KNOT_EOK;
+}
+
 static void free_geoip_ctx(geoip_ctx_t *ctx)
 {
+	free_view_caches(ctx);
 	geodb_close(ctx->geodb);
 	free(ctx->geodb);
 	clear_geo_trie(ctx->geo_trie);
@@ -728,7 +814,152 @@ static geo_view_t *find_best_view(geo_view_t *dummy, geo_trie_val_t *data, geoip
 	return &data->views[idx];
 }
 
-static void find_rr_in_view(uint16_t qtype, geo_view_t *view,
+/*!
+ * \brief Get the cache set for the client address and the queried name.
+ *
+ * The set is kept in the least-recently-used order, the first entry is
+ * the most recent one.
+ */
+static cache_entry_t *view_cache_set(geoip_ctx_t *ctx, view_cache_t *cache,
+                                     const struct sockaddr_storage *remote,
+                                     const geo_trie_val_t *data, cache_entry_t *key)
+{
+	size_t addr_len = 0;
+	const uint8_t *addr = (const uint8_t *)sockaddr_raw(remote, &addr_len);
+	assert(addr_len <= sizeof(key->addr));
+
+	memset(key, 0, sizeof(*key));
+	key->data = data;
+	key->family = remote->ss_family;
+	memcpy(key->addr, addr, addr_len);
+
+	SIPHASH_CTX hctx;
+	SipHash24_Init(&hctx, &ctx->cache_key);
+	SipHash24_Update(&hctx, &key->data, sizeof(key->data));
+	SipHash24_Update(&hctx, &key->family, sizeof(key->family));
+	SipHash24_Update(&hctx, key->addr, sizeof(key->addr));
+	uint64_t hash = SipHash24_End(&hctx);
+
+	return &cache->entries[(hash & cache->mask) * CACHE_WAYS];
+}
+
+static bool view_cache_match(const cache_entry_t *entry, const cache_entry_t *key)
+{
+	return entry->data == key->data && entry->family == key->family &&
+	       memcmp(entry->addr, key->addr, sizeof(key->addr)) == 0;
+}
+
+/*! \brief Look up the view and move the entry to the front of the set if found. */
+static bool view_cache_get(cache_entry_t *set, const cache_entry_t *key,
+                           const geo_view_t **view, uint16_t *netmask)
+{
+	for (unsigned i = 0; i < CACHE_WAYS; i++) {
+		if (!view_cache_match(&set[i], key)) {
+			continue;
+		}
+
+		cache_entry_t hit = set[i];
+		memmove(&set[1], &set[0], i * sizeof(*set));
+		set[0] = hit;
+
+		*view = hit.view;
+		*netmask = hit.netmask;
+		return true;
+	}
+
+	return false;
+}
+
+/*! \brief Store the view into the set, evicting the least recent entry. */
+static void view_cache_put(cache_entry_t *set, cache_entry_t *key,
+                           const geo_view_t *view, uint16_t netmask)
+{
+	memmove(&set[1], &set[0], (CACHE_WAYS - 1) * sizeof(*set));
+	key->view = view;
+	key->netmask = netmask;
+	set[0] = *key;
+}
+
+/*!
+ * \brief Select the view for the client address.
+ *
+ * \param netmask  Prefix length of the client network the selection applies to.
+ */
+static geo_view_t *select_view(geoip_ctx_t *ctx, geo_trie_val_t *data,
+                               const struct sockaddr_storage *remote,
+                               uint16_t *netmask)
+{
+	geodb_data_t entries[ctx->path_count];
+
+	// Create dummy view and fill it with data about the current remote.
+	geo_view_t dummy = { 0 };
+	switch(ctx->mode) {
+	case MODE_SUBNET:
+		dummy.subnet = (struct sockaddr_storage *)remote;
+		dummy.subnet_prefix = (remote->ss_family == AF_INET) ? 32 : 128;
+		break;
+	case MODE_GEODB:
+		if (geodb_query(ctx->geodb, entries, (struct sockaddr *)remote,
+		                ctx->paths, ctx->path_count, netmask) != 0) {
+			return NULL;
+		}
+		// MMDB may supply IPv6 prefixes even for IPv4 address, see man libmaxminddb.
+		if (remote->ss_family == AF_INET && *netmask > 32) {
+			*netmask -= 96;
+		}
+		geodb_fill_geodata(entries, ctx->path_count,
+		                   dummy.geodata, dummy.geodata_len, &dummy.geodepth);
+		break;
+	case MODE_WEIGHTED:
+		dummy.weight = dnssec_random_uint16_t() % data->total_weight;
+		break;
+	default:
+		assert(0);
+		break;
+	}
+
+	// Find last lower or equal view.
+	geo_view_t *view = find_best_view(&dummy, data, ctx);
+
+	// Save netmask for ECS if in subnet mode.
+	if (view != NULL && ctx->mode == MODE_SUBNET) {
+		*netmask = view->subnet_prefix;
+	}
+
+	return view;
+}
+
+/*!
+ * \brief Select the view for the client address using the thread view cache.
+ *
+ * \param cache_ctr  Set to VIEW_CACHE_HIT or VIEW_CACHE_MISS if the cache was used.
+ */
+static const geo_view_t *get_view(geoip_ctx_t *ctx, unsigned thread_id,
+                                  geo_trie_val_t *data,
+                                  const struct sockaddr_storage *remote,
+                                  uint16_t *netmask, int *cache_ctr)
+{
+	// The selection is random in the weighted mode, so it isn't cached.
+	if (ctx->mode == MODE_WEIGHTED || thread_id >= ctx->cache_count) {
+		return select_view(ctx, data, remote, netmask);
+	}
+
+	const geo_view_t *view = NULL;
+	cache_entry_t key;
+	cache_entry_t *set = view_cache_set(ctx, &ctx->caches[thread_id],
+	                                    remote, data, &key);
+	if (view_cache_get(set, &key, &view, netmask)) {
+		*cache_ctr = VIEW_CACHE_HIT;
+	} else {
+		*cache_ctr = VIEW_CACHE_MISS;
+		view = select_view(ctx, data, remote, netmask);
+		view_cache_put(set, &key, view, *netmask);
+	}
+
+	return view;
+}
+
+static void find_rr_in_view(uint16_t qtype, const geo_view_t *view,
                             knot_rrset_t **rr, knot_rrset_t **rrsig)
 {
 	knot_rrset_t *cname = NULL;
@@ -788,46 +1019,18 @@ static knotd_in_state_t geoip_process(knotd_in_state_t state, knot_pkt_t *pkt,
 	}
 
 	uint16_t netmask = 0;
-	geodb_data_t entries[ctx->path_count];
-
-	// Create dummy view and fill it with data about the current remote.
-	geo_view_t dummy = { 0 };
-	switch(ctx->mode) {
-	case MODE_SUBNET:
-		dummy.subnet = (struct sockaddr_storage *)remote;
-		dummy.subnet_prefix = (remote->ss_family == AF_INET) ? 32 : 128;
-		break;
-	case MODE_GEODB:
-		if (geodb_query(ctx->geodb, entries, (struct sockaddr *)remote,
-		                ctx->paths, ctx->path_count, &netmask) != 0) {
-			return state;
-		}
-		// MMDB may supply IPv6 prefixes even for IPv4 address, see man libmaxminddb.
-		if (remote->ss_family == AF_INET && netmask > 32) {
-			netmask -= 96;
-		}
-		geodb_fill_geodata(entries, ctx->path_count,
-		                   dummy.geodata, dummy.geodata_len, &dummy.geodepth);
-		break;
-	case MODE_WEIGHTED:
-		dummy.weight = dnssec_random_uint16_t() % data->total_weight;
-		break;
-	default:
-		assert(0);
-		break;
+	int cache_ctr = -1;
+	unsigned thread_id = qdata->params->thread_id;
+	const geo_view_t *view = get_view(ctx, thread_id, data, remote, &netmask,
+	                                  &cache_ctr);
+	if (cache_ctr >= 0) {
+		knotd_mod_stats_incr(mod, thread_id, CTR_VIEW_CACHE, cache_ctr, 1);
 	}
 
-	// Find last lower or equal view.
-	geo_view_t *view = find_best_view(&dummy, data, ctx);
 	if (view == NULL) { // No suitable view was found.
 		return state;
 	}
 
-	// Save netmask for ECS if in subnet mode.
-	if (ctx->mode == MODE_SUBNET) {
-		netmask = view->subnet_prefix;
-	}
-
 	// Fetch the correct rrset from found view.
 	knot_rrset_t *rr = NULL;
 	knot_rrset_t *rrsig = NULL;
@@ -934,6 +1137,27 @@ int geoip_load(knotd_mod_t *mod)
 	// Prepare geo views for faster search.
 	geo_sort_and_link(ctx);
 
+	// Create per-thread view caches, dropped with the context on reload.
+	conf = knotd_conf_mod(mod, MOD_CACHE_SIZE);
+	if (ctx->mode != MODE_WEIGHTED && conf.single.integer > 0) {
+		knotd_conf_t threads = knotd_conf_env(mod, KNOTD_CONF_ENV_THREADS);
+
+		ret = init_view_caches(ctx, MAX(threads.single.integer, 1),
+		                       conf.single.integer);
+		if (ret != KNOT_EOK) {
+			knotd_mod_log(mod, LOG_ERR, "failed to create view cache");
+			free_geoip_ctx(ctx);
+			return ret;
+		}
+
+		ret = knotd_mod_stats_add(mod, "view-cache", VIEW_CACHE__COUNT,
+		                          view_cache_to_str);
+		if (ret != KNOT_EOK) {
+			free_geoip_ctx(ctx);
+			return ret;
+		}
+	}
+
 	knotd_mod_ctx_set(mod, ctx);
 
 	return knotd_mod_in_hook(mod, KNOTD_STAGE_PREANSWER, geoip_process);
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -22,6 +22,7 @@
 #include "libdnssec/error.h"
 #include "knot/include/module.h"
 #include "knot/modules/onlinesign/nsec_next.h"
+#include "knot/modules/onlinesign/rrsig_cache.h"
 // Next dependencies force static module!
 #include "knot/dnssec/ds_query.h"
 #include "knot/dnssec/key-events.h"
@@ -34,6 +35,14 @@
 
 #define MOD_POLICY	"\x06""policy"
 #define MOD_NSEC_BITMAP	"\x0B""nsec-bitmap"
+#define MOD_CACHE_SIZE	"\x0A""cache-size"
+#define MOD_CACHE_VALIDITY	"\x0E""cache-validity"
+
+#ifdef HAVE_ATOMIC
+ #define ATOMIC_SET(dst, val) __atomic_store_n(&(dst), (val), __ATOMIC_RELAXED)
+#else
+ #define ATOMIC_SET(dst, val) ((dst) = (val))
+#endif
 
 int policy_check(knotd_conf_check_args_t *args)
 {
@@ -60,6 +69,8 @@ int bitmap_check(knotd_conf_check_args_t *args)
 const yp_item_t online_sign_conf[] = {
 	{ MOD_POLICY,      YP_TREF, YP_VREF = { C_POLICY }, YP_FNONE, { policy_check } },
 	{ MOD_NSEC_BITMAP, YP_TSTR, YP_VNONE, YP_FMULTI, { bitmap_check } },
+	{ MOD_CACHE_SIZE,     YP_TINT, YP_VINT = { 0, INT32_MAX, 4096 } },
+	{ MOD_CACHE_VALIDITY, YP_TINT, YP_VINT = { 1, 100, 50 } },
 	{ NULL }
 };
 
@@ -87,9 +98,32 @@ typedef struct {
 
 	uint16_t *nsec_force_types;
 
+	rrsig_cache_t *rrsig_cache;
+	unsigned cache_validity;
+	const zone_contents_t *cache_contents;
+
 	bool zone_doomed;
 } online_sign_ctx_t;
 
+enum {
+	CTR_RRSIG_CACHE = 0,
+};
+
+enum {
+	RRSIG_CACHE_HIT = 0,
+	RRSIG_CACHE_MISS,
+	RRSIG_CACHE__COUNT
+};
+
+static char *rrsig_cache_to_str(uint32_t idx, uint32_t count)
+{
+	switch (idx) {
+	case RRSIG_CACHE_HIT:  return strdup("hit");
+	case RRSIG_CACHE_MISS: return strdup("miss");
+	default:               assert(0); return NULL;
+	}
+}
+
 static bool want_dnssec(knotd_qdata_t *qdata)
 {
 	return knot_pkt_has_dnssec(qdata->query);
@@ -247,10 +281,62 @@ static knot_rrset_t *synth_nsec(knot_pkt_t *pkt, knotd_qdata_t *qdata, knotd_mod
 	return nsec;
 }
 
+/*! \brief Signing context of a packet section. */
+typedef struct {
+	zone_sign_ctx_t *ctx; /*!< Created on the first cache miss. */
+	uint64_t cache_gen;   /*!< Cache generation at the context creation. */
+} section_sign_t;
+
+/*!
+ * \brief Sign the RR set or take its signatures from the cache.
+ *
+ * The signing context is created on the first cache miss.
+ */
+static int sign_cached(knot_rrset_t *rrsig, const knot_rrset_t *copy,
+                       knotd_qdata_t *qdata, knotd_mod_t *mod,
+                       section_sign_t *sign, knot_mm_t *mm)
+{
+	online_sign_ctx_t *ctx = knotd_mod_ctx(mod);
+	knot_time_t now = mod->dnssec->now;
+
+	if (ctx->rrsig_cache != NULL) {
+		int ret = rrsig_cache_get(ctx->rrsig_cache, copy, now, rrsig, mm);
+		if (ret == KNOT_EOK) {
+			knotd_mod_stats_incr(mod, qdata->params->thread_id,
+			                     CTR_RRSIG_CACHE, RRSIG_CACHE_HIT, 1);
+			return KNOT_EOK;
+		} else if (ret != KNOT_ENOENT) {
+			return ret;
+		}
+		knotd_mod_stats_incr(mod, qdata->params->thread_id,
+		                     CTR_RRSIG_CACHE, RRSIG_CACHE_MISS, 1);
+	}
+
+	if (sign->ctx == NULL) {
+		if (ctx->rrsig_cache != NULL) {
+			sign->cache_gen = rrsig_cache_gen(ctx->rrsig_cache);
+		}
+		sign->ctx = zone_sign_ctx(mod->keyset, mod->dnssec);
+		if (sign->ctx == NULL) {
+			return KNOT_ENOMEM;
+		}
+	}
+
+	int ret = knot_sign_rrset2(rrsig, copy, sign->ctx, mm);
+	if (ret == KNOT_EOK && ctx->rrsig_cache != NULL) {
+		knot_time_t refresh = now + (knot_time_t)mod->dnssec->policy->rrsig_lifetime *
+		                            ctx->cache_validity / 100;
+		rrsig_cache_put(ctx->rrsig_cache, copy, rrsig, refresh, sign->cache_gen);
+	}
+
+	return ret;
+}
+
 static knot_rrset_t *sign_rrset(const knot_dname_t *owner,
                                 const knot_rrset_t *cover,
+                                knotd_qdata_t *qdata,
                                 knotd_mod_t *mod,
-                                zone_sign_ctx_t *sign_ctx,
+                                section_sign_t *sign,
                                 knot_mm_t *mm)
 {
 	// copy of RR set with replaced owner name
@@ -275,10 +361,7 @@ static knot_rrset_t *sign_rrset(const knot_dname_t *owner,
 		return NULL;
 	}
 
-	online_sign_ctx_t *ctx = knotd_mod_ctx(mod);
-	pthread_rwlock_rdlock(&ctx->signing_mutex);
-	int ret = knot_sign_rrset2(rrsig, copy, sign_ctx, mm);
-	pthread_rwlock_unlock(&ctx->signing_mutex);
+	int ret = sign_cached(rrsig, copy, qdata, mod, sign, mm);
 	if (ret != KNOT_EOK) {
 		knot_rrset_free(copy, NULL);
 		knot_rrset_free(rrsig, mm);
@@ -330,10 +413,11 @@ static knotd_in_state_t sign_section(knotd_in_state_t state, knot_pkt_t *pkt,
 	const knot_pktsection_t *section = knot_pkt_section(pkt, pkt->current);
 	assert(section);
 
-	zone_sign_ctx_t *sign_ctx = zone_sign_ctx(mod->keyset, mod->dnssec);
-	if (sign_ctx == NULL) {
-		return KNOTD_IN_STATE_ERROR;
-	}
+	section_sign_t sign = { NULL };
+
+	// The signing context refers to the keys, which mustn't be reloaded meanwhile.
+	online_sign_ctx_t *ctx = knotd_mod_ctx(mod);
+	pthread_rwlock_rdlock(&ctx->signing_mutex);
 
 	uint16_t count_unsigned = section->count;
 	for (int i = 0; i < count_unsigned; i++) {
@@ -348,7 +432,7 @@ static knotd_in_state_t sign_section(knotd_in_state_t state, knot_pkt_t *pkt,
 		knot_dname_unpack(owner, pkt->wire + rr_pos, sizeof(owner), pkt->wire);
 		knot_dname_to_lower(owner);
 
-		knot_rrset_t *rrsig = sign_rrset(owner, rr, mod, sign_ctx, &pkt->mm);
+		knot_rrset_t *rrsig = sign_rrset(owner, rr, qdata, mod, &sign, &pkt->mm);
 		if (!rrsig) {
 			state = KNOTD_IN_STATE_ERROR;
 			break;
@@ -362,7 +446,9 @@ static knotd_in_state_t sign_section(knotd_in_state_t state, knot_pkt_t *pkt,
 		}
 	}
 
-	zone_sign_ctx_free(sign_ctx);
+	zone_sign_ctx_free(sign.ctx);
+
+	pthread_rwlock_unlock(&ctx->signing_mutex);
 
 	return state;
 }
@@ -502,6 +588,12 @@ static knotd_in_state_t pre_routine(knotd_in_state_t state, knot_pkt_t *pkt,
 		return KNOTD_IN_STATE_ERROR;
 	}
 	mod->dnssec->now = time(NULL);
+	const zone_contents_t *contents = qdata->extra->contents;
+	if (ctx->rrsig_cache != NULL && ATOMIC_GET(ctx->cache_contents) != contents) {
+		// Zone updated, signatures of removed records are useless.
+		rrsig_cache_invalidate(ctx->rrsig_cache);
+		ATOMIC_SET(ctx->cache_contents, contents);
+	}
 	int ret = KNOT_ESEMCHECK;
 	if (knot_time_cmp(ctx->event_parent_ds_q, mod->dnssec->now) <= 0) {
 		pthread_rwlock_rdlock(&ctx->signing_mutex);
@@ -532,6 +624,7 @@ static knotd_in_state_t pre_routine(knotd_in_state_t state, knot_pkt_t *pkt,
 		pthread_rwlock_wrlock(&ctx->signing_mutex);
 		knotd_mod_dnssec_unload_keyset(mod);
 		ret = knotd_mod_dnssec_load_keyset(mod, true);
+		rrsig_cache_invalidate(ctx->rrsig_cache);
 		if (ret != KNOT_EOK) {
 			ctx->zone_doomed = true;
 			state = KNOTD_IN_STATE_ERROR;
@@ -622,6 +715,7 @@ static void online_sign_ctx_free(online_sign_ctx_t *ctx)
 	pthread_mutex_destroy(&ctx->event_mutex);
 	pthread_rwlock_destroy(&ctx->signing_mutex);
 
+	rrsig_cache_free(ctx->rrsig_cache);
 	free(ctx->nsec_force_types);
 	free(ctx);
 }
@@ -721,6 +815,25 @@ int online_sign_load(knotd_mod_t *mod)
 		return ret;
 	}
 
+	conf = knotd_conf_mod(mod, MOD_CACHE_SIZE);
+	if (conf.single.integer > 0) {
+		ctx->rrsig_cache = rrsig_cache_new(conf.single.integer);
+		if (ctx->rrsig_cache == NULL) {
+			online_sign_ctx_free(ctx);
+			return KNOT_ENOMEM;
+		}
+
+		conf = knotd_conf_mod(mod, MOD_CACHE_VALIDITY);
+		ctx->cache_validity = conf.single.integer;
+
+		ret = knotd_mod_stats_add(mod, "rrsig-cache", RRSIG_CACHE__COUNT,
+		                          rrsig_cache_to_str);
+		if (ret != KNOT_EOK) {
+			online_sign_ctx_free(ctx);
+			return ret;
+		}
+	}
+
 	knotd_mod_ctx_set(mod, ctx);
 
 	knotd_mod_in_hook(mod, KNOTD_STAGE_ANSWER, pre_routine);
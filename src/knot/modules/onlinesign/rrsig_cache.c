@@ -0,0 +1,249 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "knot/modules/onlinesign/rrsig_cache.h"
+#include "libdnssec/error.h"
+#include "libdnssec/random.h"
+#include "libknot/errcode.h"
+#include "contrib/openbsd/siphash.h"
+
+#ifdef HAVE_ATOMIC
+ #define ATOMIC_GET(src) __atomic_load_n(&(src), __ATOMIC_ACQUIRE)
+ #define ATOMIC_INC(dst) __atomic_add_fetch(&(dst), 1, __ATOMIC_SEQ_CST)
+#else
+ #define ATOMIC_GET(src) (src)
+ #define ATOMIC_INC(dst) ((dst)++)
+#endif
+
+#define CACHE_LOCKS 64
+
+/*! \brief Size of the fixed part of the key (type, class, TTL, rdata count). */
+#define KEY_HDR_SIZE (2 * sizeof(uint16_t) + sizeof(uint32_t) + sizeof(uint16_t))
+
+typedef struct {
+	uint64_t gen;          /*!< Cache generation of the entry. */
+	uint64_t hash;         /*!< Key hash. */
+	knot_time_t refresh;   /*!< Time after which the entry isn't used. */
+	uint16_t key_size;     /*!< Size of the covered RR set in the data. */
+	uint16_t sig_count;    /*!< Number of signatures. */
+	uint16_t sig_size;     /*!< Size of the signatures in the data. */
+	uint8_t *data;         /*!< Covered RR set followed by signature rdata. */
+} entry_t;
+
+struct rrsig_cache {
+	SIPHASH_KEY key;                 /*!< Hashing secret. */
+	uint64_t gen;                    /*!< Current generation. */
+	unsigned mask;                   /*!< Number of entries - 1. */
+	pthread_mutex_t lk[CACHE_LOCKS]; /*!< Entry locks. */
+	entry_t entries[];
+};
+
+typedef struct {
+	const knot_rrset_t *rrset;
+	uint8_t hdr[KEY_HDR_SIZE];
+	size_t owner_size;
+	size_t size;
+	uint64_t hash;
+} cache_key_t;
+
+static void key_init(cache_key_t *key, const rrsig_cache_t *cache,
+                     const knot_rrset_t *covered)
+{
+	key->rrset = covered;
+	key->owner_size = knot_dname_size(covered->owner);
+	key->size = key->owner_size + KEY_HDR_SIZE + covered->rrs.size;
+
+	uint8_t *pos = key->hdr;
+	memcpy(pos, &covered->type, sizeof(covered->type));
+	pos += sizeof(covered->type);
+	memcpy(pos, &covered->rclass, sizeof(covered->rclass));
+	pos += sizeof(covered->rclass);
+	memcpy(pos, &covered->ttl, sizeof(covered->ttl));
+	pos += sizeof(covered->ttl);
+	memcpy(pos, &covered->rrs.count, sizeof(covered->rrs.count));
+
+	SIPHASH_CTX ctx;
+	SipHash24_Init(&ctx, &cache->key);
+	SipHash24_Update(&ctx, covered->owner, key->owner_size);
+	SipHash24_Update(&ctx, key->hdr, sizeof(key->hdr));
+	SipHash24_Update(&ctx, covered->rrs.rdata, covered->rrs.size);
+	key->hash = SipHash24_End(&ctx);
+}
+
+static void key_write(const cache_key_t *key, uint8_t *data)
+{
+	const knot_rrset_t *rrset = key->rrset;
+
+	memcpy(data, rrset->owner, key->owner_size);
+	data += key->owner_size;
+	memcpy(data, key->hdr, sizeof(key->hdr));
+	data += sizeof(key->hdr);
+	memcpy(data, rrset->rrs.rdata, rrset->rrs.size);
+}
+
+static bool entry_match(const entry_t *entry, const cache_key_t *key,
+                        uint64_t gen, knot_time_t now)
+{
+	if (entry->gen != gen || entry->hash != key->hash ||
+	    entry->key_size != key->size || knot_time_cmp(now, entry->refresh) >= 0) {
+		return false;
+	}
+
+	const knot_rrset_t *rrset = key->rrset;
+	const uint8_t *data = entry->data;
+
+	return memcmp(data, rrset->owner, key->owner_size) == 0 &&
+	       memcmp(data + key->owner_size, key->hdr, sizeof(key->hdr)) == 0 &&
+	       memcmp(data + key->owner_size + sizeof(key->hdr), rrset->rrs.rdata,
+	              rrset->rrs.size) == 0;
+}
+
+rrsig_cache_t *rrsig_cache_new(unsigned size)
+{
+	if (size == 0) {
+		return NULL;
+	}
+
+	unsigned entries = 1;
+	while (entries < size && entries <= (UINT_MAX >> 1)) {
+		entries <<= 1;
+	}
+
+	rrsig_cache_t *cache = calloc(1, sizeof(*cache) + entries * sizeof(entry_t));
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache->gen = 1; // Distinct from unused entries.
+	cache->mask = entries - 1;
+
+	if (dnssec_random_buffer((uint8_t *)&cache->key, sizeof(cache->key)) != DNSSEC_EOK) {
+		free(cache);
+		return NULL;
+	}
+
+	for (unsigned i = 0; i < CACHE_LOCKS; i++) {
+		pthread_mutex_init(&cache->lk[i], NULL);
+	}
+
+	return cache;
+}
+
+void rrsig_cache_free(rrsig_cache_t *cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+
+	for (unsigned i = 0; i <= cache->mask; i++) {
+		free(cache->entries[i].data);
+	}
+	for (unsigned i = 0; i < CACHE_LOCKS; i++) {
+		pthread_mutex_destroy(&cache->lk[i]);
+	}
+	free(cache);
+}
+
+void rrsig_cache_invalidate(rrsig_cache_t *cache)
+{
+	if (cache != NULL) {
+		ATOMIC_INC(cache->gen);
+	}
+}
+
+int rrsig_cache_get(rrsig_cache_t *cache, const knot_rrset_t *covered,
+                    knot_time_t now, knot_rrset_t *rrsigs, knot_mm_t *mm)
+{
+	assert(cache && covered && rrsigs);
+
+	cache_key_t key;
+	key_init(&key, cache, covered);
+	uint64_t gen = ATOMIC_GET(cache->gen);
+
+	unsigned idx = key.hash & cache->mask;
+	entry_t *entry = &cache->entries[idx];
+	pthread_mutex_t *lk = &cache->lk[idx % CACHE_LOCKS];
+
+	int ret = KNOT_ENOENT;
+	pthread_mutex_lock(lk);
+	if (entry_match(entry, &key, gen, now)) {
+		knot_rdataset_t sigs = {
+			.count = entry->sig_count,
+			.size = entry->sig_size,
+			.rdata = (knot_rdata_t *)(entry->data + entry->key_size)
+		};
+		ret = knot_rdataset_copy(&rrsigs->rrs, &sigs, mm);
+	}
+	pthread_mutex_unlock(lk);
+
+	return ret;
+}
+
+uint64_t rrsig_cache_gen(rrsig_cache_t *cache)
+{
+	assert(cache);
+
+	return ATOMIC_GET(cache->gen);
+}
+
+void rrsig_cache_put(rrsig_cache_t *cache, const knot_rrset_t *covered,
+                     const knot_rrset_t *rrsigs, knot_time_t refresh,
+                     uint64_t gen)
+{
+	assert(cache && covered && rrsigs);
+
+	// An entry stored despite a concurrent invalidation never matches.
+	if (gen != ATOMIC_GET(cache->gen)) {
+		return;
+	}
+
+	cache_key_t key;
+	key_init(&key, cache, covered);
+
+	size_t size = key.size + rrsigs->rrs.size;
+	if (rrsigs->rrs.count == 0 || size > RRSIG_CACHE_MAX_SIZE) {
+		return;
+	}
+
+	uint8_t *data = malloc(size);
+	if (data == NULL) {
+		return;
+	}
+	key_write(&key, data);
+	memcpy(data + key.size, rrsigs->rrs.rdata, rrsigs->rrs.size);
+
+	unsigned idx = key.hash & cache->mask;
+	entry_t *entry = &cache->entries[idx];
+	pthread_mutex_t *lk = &cache->lk[idx % CACHE_LOCKS];
+
+	pthread_mutex_lock(lk);
+	uint8_t *old_data = entry->data;
+	entry->gen = gen;
+	entry->hash = key.hash;
+	entry->refresh = refresh;
+	entry->key_size = key.size;
+	entry->sig_count = rrsigs->rrs.count;
+	entry->sig_size = rrsigs->rrs.size;
+	entry->data = data;
+	pthread_mutex_unlock(lk);
+
+	free(old_data);
+}
@@ -0,0 +1,98 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Cache of signatures computed by the online signing module.
+ *
+ * Entries are keyed by the complete covered RR set (owner, type, class, TTL
+ * and rdata), so a changed record never matches a stale signature. Each entry
+ * is tagged with the cache generation, which is increased whenever the signing
+ * keys or the zone contents change, and with the time after which
+ * the signatures shall be recomputed.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "contrib/time.h"
+#include "libknot/mm_ctx.h"
+#include "libknot/rrset.h"
+
+/*! \brief Maximal size of the cached covered RR set and its signatures. */
+#define RRSIG_CACHE_MAX_SIZE 4096
+
+struct rrsig_cache;
+typedef struct rrsig_cache rrsig_cache_t;
+
+/*!
+ * \brief Create a signature cache.
+ *
+ * \param size  Number of entries (rounded up to a power of two).
+ *
+ * \return Signature cache or NULL.
+ */
+rrsig_cache_t *rrsig_cache_new(unsigned size);
+
+/*!
+ * \brief Free the signature cache.
+ */
+void rrsig_cache_free(rrsig_cache_t *cache);
+
+/*!
+ * \brief Invalidate all entries.
+ */
+void rrsig_cache_invalidate(rrsig_cache_t *cache);
+
+/*!
+ * \brief Get the current cache generation.
+ *
+ * The generation shall be obtained before the signing keys are used, so that
+ * signatures made with keys replaced meanwhile aren't stored.
+ */
+uint64_t rrsig_cache_gen(rrsig_cache_t *cache);
+
+/*!
+ * \brief Get cached signatures of the RR set.
+ *
+ * \param cache    Signature cache.
+ * \param covered  Covered RR set with lower-cased owner.
+ * \param now      Current time.
+ * \param rrsigs   Empty RRSIG RR set to be filled.
+ * \param mm       Memory context of the RRSIG RR set.
+ *
+ * \retval KNOT_EOK if found.
+ * \retval KNOT_ENOENT if not found or to be refreshed.
+ * \retval KNOT_E* if error.
+ */
+int rrsig_cache_get(rrsig_cache_t *cache, const knot_rrset_t *covered,
+                    knot_time_t now, knot_rrset_t *rrsigs, knot_mm_t *mm);
+
+/*!
+ * \brief Store the signatures of the RR set into the cache.
+ *
+ * Too large RR sets and signatures from an invalidated generation are not
+ * stored.
+ *
+ * \param cache    Signature cache.
+ * \param covered  Covered RR set with lower-cased owner.
+ * \param rrsigs   Signatures of the RR set.
+ * \param refresh  Time after which the signatures are no longer returned.
+ * \param gen      Cache generation the signatures were made in.
+ */
+void rrsig_cache_put(rrsig_cache_t *cache, const knot_rrset_t *covered,
+                     const knot_rrset_t *rrsigs, knot_time_t refresh,
+                     uint64_t gen);
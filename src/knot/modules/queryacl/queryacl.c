@@ -1,4 +1,4 @@
-/*  Copyright (C) 2018 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -15,7 +15,7 @@
  */
 
 #include "knot/include/module.h"
-#include "contrib/sockaddr.h"
+#include "contrib/prefix_tree.h"
 
 #define MOD_ADDRESS	"\x07""address"
 #define MOD_INTERFACE	"\x09""interface"
@@ -27,10 +27,49 @@ const yp_item_t queryacl_conf[] = {
 };
 
 typedef struct {
-	knotd_conf_t allow_addr;
-	knotd_conf_t allow_iface;
+	prefix_tree_t *allow_addr;
+	prefix_tree_t *allow_iface;
 } queryacl_ctx_t;
 
+/*!
+ * \brief Precompile the configured networks and ranges for fast matching.
+ *
+ * The output prefix tree is NULL if the item isn't configured.
+ */
+static int load_ranges(knotd_mod_t *mod, const yp_name_t *item, prefix_tree_t **out)
+{
+	knotd_conf_t conf = knotd_conf_mod(mod, item);
+	if (conf.count == 0) {
+		*out = NULL;
+		return KNOT_EOK;
+	}
+
+	prefix_tree_t *tree = prefix_tree_new();
+	if (tree == NULL) {
+		knotd_conf_free(&conf);
+		return KNOT_ENOMEM;
+	}
+
+	int ret = KNOT_EOK;
+	for (size_t i = 0; i < conf.count && ret == KNOT_EOK; i++) {
+		knotd_conf_val_t *val = &conf.multi[i];
+		if (val->addr_max.ss_family == AF_UNSPEC) {
+			ret = prefix_tree_add_net(tree, &val->addr, val->addr_mask, NULL, NULL);
+		} else {
+			ret = prefix_tree_add_range(tree, &val->addr, &val->addr_max, NULL, NULL);
+		}
+	}
+	knotd_conf_free(&conf);
+
+	if (ret != KNOT_EOK) {
+		prefix_tree_free(tree);
+		return ret;
+	}
+
+	*out = tree;
+	return KNOT_EOK;
+}
+
 static knotd_state_t queryacl_process(knotd_state_t state, knot_pkt_t *pkt,
                                       knotd_qdata_t *qdata, knotd_mod_t *mod)
 {
@@ -43,23 +82,15 @@ static knotd_state_t queryacl_process(knotd_state_t state, knot_pkt_t *pkt,
 		return state;
 	}
 
-	// Get interface address.
-	struct sockaddr_storage iface;
-	socklen_t iface_len = sizeof(iface);
-	if (getsockname(qdata->params->socket, (struct sockaddr *)&iface, &iface_len) != 0) {
-		knotd_mod_log(mod, LOG_ERR, "failed to get interface address");
-		return KNOTD_STATE_FAIL;
-	}
-
-	if (ctx->allow_addr.count > 0) {
-		if (!knotd_conf_addr_range_match(&ctx->allow_addr, qdata->params->remote)) {
+	if (ctx->allow_addr != NULL) {
+		if (!prefix_tree_match(ctx->allow_addr, qdata->params->remote)) {
 			qdata->rcode = KNOT_RCODE_NOTAUTH;
 			return KNOTD_STATE_FAIL;
 		}
 	}
 
-	if (ctx->allow_iface.count > 0) {
-		if (!knotd_conf_addr_range_match(&ctx->allow_iface, &iface)) {
+	if (ctx->allow_iface != NULL) {
+		if (!prefix_tree_match(ctx->allow_iface, qdata->params->local)) {
 			qdata->rcode = KNOT_RCODE_NOTAUTH;
 			return KNOTD_STATE_FAIL;
 		}
@@ -76,8 +107,15 @@ int queryacl_load(knotd_mod_t *mod)
 		return KNOT_ENOMEM;
 	}
 
-	ctx->allow_addr = knotd_conf_mod(mod, MOD_ADDRESS);
-	ctx->allow_iface = knotd_conf_mod(mod, MOD_INTERFACE);
+	int ret = load_ranges(mod, MOD_ADDRESS, &ctx->allow_addr);
+	if (ret == KNOT_EOK) {
+		ret = load_ranges(mod, MOD_INTERFACE, &ctx->allow_iface);
+	}
+	if (ret != KNOT_EOK) {
+		prefix_tree_free(ctx->allow_addr);
+		free(ctx);
+		return ret;
+	}
 
 	knotd_mod_ctx_set(mod, ctx);
 
@@ -88,8 +126,8 @@ void queryacl_unload(knotd_mod_t *mod)
 {
 	queryacl_ctx_t *ctx = knotd_mod_ctx(mod);
 	if (ctx != NULL) {
-		knotd_conf_free(&ctx->allow_addr);
-		knotd_conf_free(&ctx->allow_iface);
+		prefix_tree_free(ctx->allow_addr);
+		prefix_tree_free(ctx->allow_iface);
 	}
 	free(ctx);
 }
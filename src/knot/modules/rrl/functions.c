@@ -14,18 +14,18 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "knot/modules/rrl/functions.h"
+#include "contrib/macros.h"
 #include "contrib/openbsd/strlcat.h"
 #include "contrib/sockaddr.h"
 #include "contrib/time.h"
 #include "libdnssec/error.h"
 #include "libdnssec/random.h"
 
-/* Hopscotch defines. */
-#define HOP_LEN (sizeof(unsigned)*8)
 /* Limits (class, ipv6 remote, dname) */
 #define RRL_CLSBLK_MAXLEN (1 + 8 + 255)
 /* CIDR block prefix lengths for v4/v6 */
@@ -35,7 +35,32 @@
 #define RRL_SSTART 2 /* 1/Nth of the rate for slow start */
 #define RRL_PSIZE_LARGE 1024
 #define RRL_CAPACITY 4 /* Window size in seconds */
-#define RRL_LOCK_GRANULARITY 32 /* Last digit granularity */
+
+/* Bucket group (one cache line). */
+#define RRL_GROUP_LEN 8
+#define RRL_GROUP_SIZE (RRL_GROUP_LEN * sizeof(uint64_t))
+
+/* Bucket word layout: tag (28b) | tokens (20b) | timestamp (12b) | flags (4b). */
+#define BKT_FLAGS_BITS 4
+#define BKT_TIME_BITS  12
+#define BKT_NTOK_BITS  20
+#define BKT_TIME_SHIFT BKT_FLAGS_BITS
+#define BKT_NTOK_SHIFT (BKT_TIME_SHIFT + BKT_TIME_BITS)
+#define BKT_TAG_SHIFT  (BKT_NTOK_SHIFT + BKT_NTOK_BITS)
+#define BKT_MASK(bits) ((UINT64_C(1) << (bits)) - 1)
+#define BKT_NTOK_MAX   BKT_MASK(BKT_NTOK_BITS)
+
+#ifdef HAVE_ATOMIC
+ #define ATOMIC_GET(src)           __atomic_load_n(&(src), __ATOMIC_RELAXED)
+ #define ATOMIC_CAS(dst, old, val) __atomic_compare_exchange_n(&(dst), &(old), (val), false, \
+                                                               __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#elif defined(HAVE_SYNC_ATOMIC)
+ #define ATOMIC_GET(src)           __sync_fetch_and_add(&(src), 0)
+ #define ATOMIC_CAS(dst, old, val) __sync_bool_compare_and_swap(&(dst), (old), (val))
+#else
+ #define ATOMIC_GET(src)           (src)
+ #define ATOMIC_CAS(dst, old, val) ((dst) = (val), true)
+#endif
 
 /* Classification */
 enum {
@@ -187,79 +212,39 @@ static int rrl_classify(uint8_t *dst, size_t maxlen, const struct sockaddr_stora
 	return blklen;
 }
 
-static int bucket_free(rrl_item_t *bucket, uint32_t now)
-{
-	return bucket->cls == CLS_NULL || (bucket->time + 1 < now);
-}
+/* Unpacked bucket. */
+typedef struct {
+	uint32_t tag;        /* Classification hash tag (0 if empty). */
+	uint32_t ntok;       /* Tokens available. */
+	uint16_t time;       /* Timestamp (wraps around). */
+	uint8_t  flags;      /* Flags. */
+} rrl_item_t;
 
-static int bucket_match(rrl_item_t *bucket, rrl_item_t *match)
+static void bucket_unpack(uint64_t word, rrl_item_t *bucket)
 {
-	return bucket->cls    == match->cls &&
-	       bucket->netblk == match->netblk &&
-	       bucket->qname  == match->qname;
+	bucket->tag   = word >> BKT_TAG_SHIFT;
+	bucket->ntok  = (word >> BKT_NTOK_SHIFT) & BKT_MASK(BKT_NTOK_BITS);
+	bucket->time  = (word >> BKT_TIME_SHIFT) & BKT_MASK(BKT_TIME_BITS);
+	bucket->flags = word & BKT_MASK(BKT_FLAGS_BITS);
 }
 
-static int find_free(rrl_table_t *tbl, unsigned id, uint32_t now)
+static uint64_t bucket_pack(const rrl_item_t *bucket)
 {
-	for (int i = id; i < tbl->size; i++) {
-		if (bucket_free(&tbl->arr[i], now)) {
-			return i - id;
-		}
-	}
-	for (int i = 0; i < id; i++) {
-		if (bucket_free(&tbl->arr[i], now)) {
-			return i + (tbl->size - id);
-		}
-	}
-
-	/* this happens if table is full... force vacate current elm */
-	return id;
+	return ((uint64_t)bucket->tag << BKT_TAG_SHIFT) |
+	       ((bucket->ntok & BKT_MASK(BKT_NTOK_BITS)) << BKT_NTOK_SHIFT) |
+	       ((bucket->time & BKT_MASK(BKT_TIME_BITS)) << BKT_TIME_SHIFT) |
+	       (bucket->flags & BKT_MASK(BKT_FLAGS_BITS));
 }
 
-static inline unsigned find_match(rrl_table_t *tbl, uint32_t id, rrl_item_t *m)
+/* Elapsed seconds since the bucket timestamp. */
+static uint32_t bucket_dt(const rrl_item_t *bucket, uint32_t now)
 {
-	unsigned new_id = 0;
-	unsigned hop = 0;
-	unsigned match_bitmap = tbl->arr[id].hop;
-	while (match_bitmap != 0) {
-		hop = __builtin_ctz(match_bitmap); /* offset of next potential match */
-		new_id = (id + hop) % tbl->size;
-		if (bucket_match(&tbl->arr[new_id], m)) {
-			return hop;
-		} else {
-			match_bitmap &= ~(1 << hop); /* clear potential match */
-		}
-	}
-
-	return HOP_LEN + 1;
+	return (now - bucket->time) & BKT_MASK(BKT_TIME_BITS);
 }
 
-static inline unsigned reduce_dist(rrl_table_t *tbl, unsigned id, unsigned dist, unsigned *free_id)
+static bool bucket_free(const rrl_item_t *bucket, uint32_t now)
 {
-	unsigned rd = HOP_LEN - 1;
-	while (rd > 0) {
-		unsigned vacate_id = (tbl->size + *free_id - rd) % tbl->size; /* bucket to be vacated */
-		if (tbl->arr[vacate_id].hop != 0) {
-			unsigned hop = __builtin_ctz(tbl->arr[vacate_id].hop);  /* offset of first valid bucket */
-			if (hop < rd) { /* only offsets in <vacate_id, free_id> are interesting */
-				unsigned new_id = (vacate_id + hop) % tbl->size; /* this item will be displaced to [free_id] */
-				unsigned keep_hop = tbl->arr[*free_id].hop; /* unpredictable padding */
-				memcpy(tbl->arr + *free_id, tbl->arr + new_id, sizeof(rrl_item_t));
-				tbl->arr[*free_id].hop = keep_hop;
-				tbl->arr[new_id].cls = CLS_NULL;
-				tbl->arr[vacate_id].hop &= ~(1 << hop);
-				tbl->arr[vacate_id].hop |= 1 << rd;
-				*free_id = new_id;
-				return dist - (rd - hop);
-			}
-		}
-		--rd;
-	}
-
-	assert(rd == 0); /* this happens with p=1/fact(HOP_LEN) */
-	*free_id = id;
-	dist = 0; /* force vacate initial element */
-	return dist;
+	return bucket->tag == 0 || bucket_dt(bucket, now) > 1;
 }
 
 static void subnet_tostr(char *dst, size_t maxlen, const struct sockaddr_storage *ss)
@@ -301,173 +286,107 @@ static void rrl_log_state(knotd_mod_t *mod, const struct sockaddr_storage *ss,
 	              addr_str, rrl_clsstr(cls), what);
 }
 
-static void rrl_lock(rrl_table_t *tbl, int lk_id)
-{
-	assert(lk_id > -1);
-	pthread_mutex_lock(tbl->lk + lk_id);
-}
-
-static void rrl_unlock(rrl_table_t *tbl, int lk_id)
-{
-	assert(lk_id > -1);
-	pthread_mutex_unlock(tbl->lk + lk_id);
-}
-
-static int rrl_setlocks(rrl_table_t *tbl, uint32_t granularity)
-{
-	assert(!tbl->lk); /* Cannot change while locks are used. */
-	assert(granularity <= tbl->size / 10); /* Due to int. division err. */
-
-	if (pthread_mutex_init(&tbl->ll, NULL) < 0) {
-		return KNOT_ENOMEM;
-	}
-
-	/* Alloc new locks. */
-	tbl->lk = malloc(granularity * sizeof(pthread_mutex_t));
-	if (!tbl->lk) {
-		return KNOT_ENOMEM;
-	}
-	memset(tbl->lk, 0, granularity * sizeof(pthread_mutex_t));
-
-	/* Initialize. */
-	for (size_t i = 0; i < granularity; ++i) {
-		if (pthread_mutex_init(tbl->lk + i, NULL) < 0) {
-			break;
-		}
-		++tbl->lk_count;
-	}
-
-	/* Incomplete initialization */
-	if (tbl->lk_count != granularity) {
-		for (size_t i = 0; i < tbl->lk_count; ++i) {
-			pthread_mutex_destroy(tbl->lk + i);
-		}
-		free(tbl->lk);
-		tbl->lk_count = 0;
-		return KNOT_ERROR;
-	}
-
-	return KNOT_EOK;
-}
-
 rrl_table_t *rrl_create(size_t size, uint32_t rate)
 {
 	if (size == 0) {
 		return NULL;
 	}
 
-	const size_t tbl_len = sizeof(rrl_table_t) + size * sizeof(rrl_item_t);
-	rrl_table_t *tbl = calloc(1, tbl_len);
+	size_t groups = 1;
+	while (groups * RRL_GROUP_LEN < size && groups <= (SIZE_MAX >> 1) / RRL_GROUP_SIZE) {
+		groups <<= 1;
+	}
+
+	rrl_table_t *tbl = calloc(1, sizeof(*tbl));
 	if (!tbl) {
 		return NULL;
 	}
-	tbl->size = size;
 	tbl->rate = rate;
+	tbl->mask = groups - 1;
 
-	if (dnssec_random_buffer((uint8_t *)&tbl->key, sizeof(tbl->key)) != DNSSEC_EOK) {
+	if (posix_memalign((void **)&tbl->arr, RRL_GROUP_SIZE, groups * RRL_GROUP_SIZE) != 0) {
 		free(tbl);
 		return NULL;
 	}
+	memset(tbl->arr, 0, groups * RRL_GROUP_SIZE);
 
-	if (rrl_setlocks(tbl, RRL_LOCK_GRANULARITY) != KNOT_EOK) {
-		free(tbl);
+	if (dnssec_random_buffer((uint8_t *)&tbl->key, sizeof(tbl->key)) != DNSSEC_EOK) {
+		rrl_destroy(tbl);
 		return NULL;
 	}
 
 	return tbl;
 }
 
-/*! \brief Get bucket for current combination of parameters. */
-static rrl_item_t *rrl_hash(rrl_table_t *tbl, const struct sockaddr_storage *remote,
-                            rrl_req_t *req, const knot_dname_t *zone, uint32_t stamp,
-                            int *lock)
+/*!
+ * \brief Get the bucket for current combination of parameters.
+ *
+ * \param tbl     RRL table.
+ * \param hash    Classification hash.
+ * \param now     Current timestamp.
+ * \param word    Output bucket slot contents as observed.
+ * \param bucket  Output bucket to be updated (a new one if not found).
+ *
+ * \return Bucket slot.
+ */
+static uint64_t *rrl_lookup(rrl_table_t *tbl, uint64_t hash, uint32_t now,
+                            uint64_t *word, rrl_item_t *bucket)
 {
-	uint8_t buf[RRL_CLSBLK_MAXLEN];
-	int len = rrl_classify(buf, sizeof(buf), remote, req, zone);
-	if (len < 0) {
-		return NULL;
+	uint64_t *group = tbl->arr + (hash & tbl->mask) * RRL_GROUP_LEN;
+	uint32_t tag = hash >> BKT_TAG_SHIFT;
+	if (tag == 0) {
+		tag = 1; /* Reserved for empty buckets. */
+	}
+
+	/* Find an exact match or a free bucket in the group. */
+	uint64_t *slot = NULL;
+	for (unsigned i = 0; i < RRL_GROUP_LEN; i++) {
+		uint64_t val = ATOMIC_GET(group[i]);
+		bucket_unpack(val, bucket);
+		if (bucket->tag == tag) {
+			*word = val;
+			return &group[i];
+		}
+		if (slot == NULL && bucket_free(bucket, now)) {
+			*word = val;
+			slot = &group[i];
+		}
 	}
 
-	uint32_t id = SipHash24(&tbl->key, buf, len) % tbl->size;
-
-	/* Lock for lookup. */
-	pthread_mutex_lock(&tbl->ll);
-
-	/* Find an exact match in <id, id + HOP_LEN). */
-	knot_dname_t *qname = buf + sizeof(uint8_t) + sizeof(uint64_t);
-	uint64_t netblk;
-	memcpy(&netblk, buf + sizeof(uint8_t), sizeof(netblk));
+	uint32_t capacity = MIN((uint64_t)tbl->rate * RRL_CAPACITY, BKT_NTOK_MAX);
 	rrl_item_t match = {
-		.hop = 0,
-		.netblk = netblk,
-		.ntok = tbl->rate * RRL_CAPACITY,
-		.cls = buf[0],
-		.flags = RRL_BF_NULL,
-		.qname = SipHash24(&tbl->key, qname, knot_dname_size(qname)),
-		.time = stamp
+		.tag = tag,
+		.ntok = capacity,
+		.time = now,
+		.flags = RRL_BF_NULL
 	};
 
-	unsigned dist = find_match(tbl, id, &match);
-	if (dist > HOP_LEN) { /* not an exact match, find free element [f] */
-		dist = find_free(tbl, id, stamp);
+	if (slot != NULL) {
+		*bucket = match;
+		return slot;
 	}
 
-	/* Reduce distance to fit <id, id + HOP_LEN) */
-	unsigned free_id = (id + dist) % tbl->size;
-	while (dist >= HOP_LEN) {
-		dist = reduce_dist(tbl, id, dist, &free_id);
-	}
-
-	/* Assign granular lock and unlock lookup. */
-	*lock = free_id % tbl->lk_count;
-	rrl_lock(tbl, *lock);
-	pthread_mutex_unlock(&tbl->ll);
-
-	/* found free bucket which is in <id, id + HOP_LEN) */
-	tbl->arr[id].hop |= (1 << dist);
-	rrl_item_t *bucket = &tbl->arr[free_id];
-	assert(free_id == (id + dist) % tbl->size);
-
-	/* Inspect bucket state. */
-	unsigned hop = bucket->hop;
-	if (bucket->cls == CLS_NULL) {
-		memcpy(bucket, &match, sizeof(rrl_item_t));
-		bucket->hop = hop;
-	}
-	/* Check for collisions. */
-	if (!bucket_match(bucket, &match)) {
-		if (!(bucket->flags & RRL_BF_SSTART)) {
-			memcpy(bucket, &match, sizeof(rrl_item_t));
-			bucket->hop = hop;
-			bucket->ntok = tbl->rate + tbl->rate / RRL_SSTART;
-			bucket->flags |= RRL_BF_SSTART;
-		}
+	/* Collision, reset the victim unless in slow-start already. */
+	slot = &group[(hash >> 32) % RRL_GROUP_LEN];
+	*word = ATOMIC_GET(*slot);
+	bucket_unpack(*word, bucket);
+	if (!(bucket->flags & RRL_BF_SSTART)) {
+		*bucket = match;
+		bucket->ntok = MIN(tbl->rate + tbl->rate / RRL_SSTART, capacity);
+		bucket->flags |= RRL_BF_SSTART;
 	}
 
-	return bucket;
+	return slot;
 }
 
-int rrl_query(rrl_table_t *rrl, const struct sockaddr_storage *remote,
-              rrl_req_t *req, const knot_dname_t *zone, knotd_mod_t *mod)
+/*! \brief Account the query to the bucket, return true if limited. */
+static bool rrl_update(rrl_table_t *tbl, rrl_item_t *bucket, uint32_t now,
+                       bool *state_changed)
 {
-	if (!rrl || !req || !remote) {
-		return KNOT_EINVAL;
-	}
-
-	/* Calculate hash and fetch */
-	int ret = KNOT_EOK;
-	int lock = -1;
-	uint32_t now = time_now().tv_sec;
-	rrl_item_t *bucket = rrl_hash(rrl, remote, req, zone, now, &lock);
-	if (!bucket) {
-		if (lock > -1) {
-			rrl_unlock(rrl, lock);
-		}
-		return KNOT_ERROR;
-	}
+	*state_changed = false;
 
 	/* Calculate rate for dT */
-	uint32_t dt = now - bucket->time;
+	uint32_t dt = bucket_dt(bucket, now);
 	if (dt > RRL_CAPACITY) {
 		dt = RRL_CAPACITY;
 	}
@@ -478,37 +397,66 @@ int rrl_query(rrl_table_t *rrl, const struct sockaddr_storage *remote,
 		/* Check state change. */
 		if ((bucket->ntok > 0 || dt > 1) && (bucket->flags & RRL_BF_ELIMIT)) {
 			bucket->flags &= ~RRL_BF_ELIMIT;
-			rrl_log_state(mod, remote, bucket->flags, bucket->cls);
+			*state_changed = true;
 		}
 
 		/* Add new tokens. */
-		uint32_t dn = rrl->rate * dt;
+		uint64_t capacity = MIN((uint64_t)tbl->rate * RRL_CAPACITY, BKT_NTOK_MAX);
 		if (bucket->flags & RRL_BF_SSTART) { /* Bucket in slow-start. */
 			bucket->flags &= ~RRL_BF_SSTART;
 		}
-		bucket->ntok += dn;
-		if (bucket->ntok > RRL_CAPACITY * rrl->rate) {
-			bucket->ntok = RRL_CAPACITY * rrl->rate;
-		}
+		bucket->ntok = MIN(bucket->ntok + (uint64_t)tbl->rate * dt, capacity);
 	}
 
 	/* Last item taken. */
 	if (bucket->ntok == 1 && !(bucket->flags & RRL_BF_ELIMIT)) {
 		bucket->flags |= RRL_BF_ELIMIT;
-		rrl_log_state(mod, remote, bucket->flags, bucket->cls);
+		*state_changed = true;
 	}
 
 	/* Decay current bucket. */
 	if (bucket->ntok > 0) {
 		--bucket->ntok;
-	} else if (bucket->ntok == 0) {
-		ret = KNOT_ELIMIT;
+		return false;
+	}
+
+	return true;
+}
+
+int rrl_query(rrl_table_t *rrl, const struct sockaddr_storage *remote,
+              rrl_req_t *req, const knot_dname_t *zone, knotd_mod_t *mod)
+{
+	if (!rrl || !req || !remote) {
+		return KNOT_EINVAL;
 	}
 
-	if (lock > -1) {
-		rrl_unlock(rrl, lock);
+	uint8_t buf[RRL_CLSBLK_MAXLEN];
+	int len = rrl_classify(buf, sizeof(buf), remote, req, zone);
+	if (len < 0) {
+		return KNOT_ERROR;
 	}
-	return ret;
+
+	uint64_t hash = SipHash24(&rrl->key, buf, len);
+	uint32_t now = time_now().tv_sec;
+
+	/* Update the bucket, retry if changed meanwhile. */
+	rrl_item_t bucket;
+	bool limited, state_changed;
+	for (;;) {
+		uint64_t word;
+		uint64_t *slot = rrl_lookup(rrl, hash, now, &word, &bucket);
+		limited = rrl_update(rrl, &bucket, now, &state_changed);
+		uint64_t new_word = bucket_pack(&bucket);
+		if (new_word == word || ATOMIC_CAS(*slot, word, new_word)) {
+			break;
+		}
+	}
+
+	if (state_changed) {
+		rrl_log_state(mod, remote, bucket.flags, buf[0]);
+	}
+
+	return limited ? KNOT_ELIMIT : KNOT_EOK;
 }
 
 bool rrl_slip_roll(int n_slip)
@@ -526,13 +474,7 @@ bool rrl_slip_roll(int n_slip)
 void rrl_destroy(rrl_table_t *rrl)
 {
 	if (rrl) {
-		if (rrl->lk_count > 0) {
-			pthread_mutex_destroy(&rrl->ll);
-		}
-		for (size_t i = 0; i < rrl->lk_count; ++i) {
-			pthread_mutex_destroy(rrl->lk + i);
-		}
-		free(rrl->lk);
+		free(rrl->arr);
 	}
 
 	free(rrl);
@@ -17,26 +17,12 @@
 #pragma once
 
 #include <stdint.h>
-#include <pthread.h>
 #include <sys/socket.h>
 
 #include "libknot/libknot.h"
 #include "knot/include/module.h"
 #include "contrib/openbsd/siphash.h"
 
-/*!
- * \brief RRL hash bucket.
- */
-typedef struct {
-	unsigned hop;        /* Hop bitmap. */
-	uint64_t netblk;     /* Prefix associated. */
-	uint16_t ntok;       /* Tokens available. */
-	uint8_t  cls;        /* Bucket class. */
-	uint8_t  flags;      /* Flags. */
-	uint32_t qname;      /* imputed(QNAME) hash. */
-	uint32_t time;       /* Timestamp. */
-} rrl_item_t;
-
 /*!
  * \brief RRL hash bucket table.
  *
@@ -45,18 +31,16 @@ typedef struct {
  * When a bucket is in a slow-start mode, it cannot reset again for the time
  * period.
  *
- * To avoid lock contention, N locks are created and distributed amongst buckets.
- * As of now lock K for bucket N is calculated as K = N % (num_buckets).
+ * Each bucket is a single 64-bit word (tag, tokens, timestamp, flags), which
+ * is updated atomically (compare-and-swap), so no locks are needed. Buckets
+ * are grouped by cache lines, a classification is looked up within its group
+ * only. The token accounting is approximate (e.g. timestamps wrap around).
  */
-
 typedef struct {
 	SIPHASH_KEY key;     /* Siphash key. */
 	uint32_t rate;       /* Configured RRL limit. */
-	pthread_mutex_t ll;
-	pthread_mutex_t *lk; /* Table locks. */
-	unsigned lk_count;   /* Table lock count (granularity). */
-	size_t size;         /* Number of buckets. */
-	rrl_item_t arr[];    /* Buckets. */
+	size_t mask;         /* Number of bucket groups - 1. */
+	uint64_t *arr;       /* Buckets. */
 } rrl_table_t;
 
 /*! \brief RRL request flags. */
@@ -77,7 +61,7 @@ typedef struct {
 
 /*!
  * \brief Create a RRL table.
- * \param size Fixed hashtable size (reasonable large prime is recommended).
+ * \param size Minimal number of buckets (rounded up to a power of two).
  * \param rate Rate (in pkts/sec).
  * \return created table or NULL.
  */
@@ -0,0 +1,283 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "knot/nameserver/answer_cache.h"
+#include "libdnssec/error.h"
+#include "libdnssec/random.h"
+#include "libknot/errcode.h"
+#include "libknot/packet/wire.h"
+#include "contrib/macros.h"
+#include "contrib/openbsd/siphash.h"
+
+#ifdef HAVE_ATOMIC
+ #define ATOMIC_GET(src)      __atomic_load_n(&(src), __ATOMIC_ACQUIRE)
+ #define ATOMIC_ADD(dst, val) __atomic_add_fetch(&(dst), (val), __ATOMIC_RELAXED)
+ #define ATOMIC_INC(dst)      __atomic_add_fetch(&(dst), 1, __ATOMIC_SEQ_CST)
+#else
+ #define ATOMIC_GET(src)      (src)
+ #define ATOMIC_ADD(dst, val) ((dst) += (val))
+ #define ATOMIC_INC(dst)      ((dst)++)
+#endif
+
+#define CACHE_LOCKS      64
+#define CACHE_LINE       64
+#define CTR_STRIDE       (CACHE_LINE / sizeof(uint64_t))
+#define CTR_HIT          0
+#define CTR_MISS         1
+
+#define ENTRY_FLAG_DO    (1 << 0)
+#define ENTRY_FLAG_LIMIT (1 << 1)
+
+typedef struct {
+	uint64_t gen;                    /*!< Cache generation of the entry. */
+	const zone_contents_t *contents; /*!< Zone contents the answer was built from. */
+	uint64_t hash;                   /*!< Key hash. */
+	uint16_t max_size;               /*!< Maximal answer size. */
+	uint16_t rcode;                  /*!< Answer RCODE. */
+	uint16_t size;                   /*!< Answer size. */
+	uint8_t flags;                   /*!< DO bit and size limit indication. */
+	uint8_t *wire;                   /*!< Answer without OPT and TSIG. */
+} entry_t;
+
+struct answer_cache {
+	SIPHASH_KEY key;                 /*!< Hashing secret. */
+	uint64_t gen;                    /*!< Current generation. */
+	unsigned mask;                   /*!< Number of entries - 1. */
+	unsigned threads;                /*!< Number of counter blocks. */
+	uint64_t *ctrs;                  /*!< Per-thread hit/miss counters. */
+	pthread_mutex_t lk[CACHE_LOCKS]; /*!< Entry locks. */
+	entry_t entries[];
+};
+
+typedef struct {
+	const uint8_t *question;
+	size_t question_size;
+	uint64_t hash;
+	uint16_t max_size;
+	uint8_t flags;
+} cache_key_t;
+
+static void key_init(cache_key_t *key, const answer_cache_t *cache,
+                     const knot_pkt_t *query, const knot_pkt_t *resp, bool limit)
+{
+	key->question = query->wire + KNOT_WIRE_HEADER_SIZE;
+	key->question_size = knot_pkt_question_size(query);
+	key->max_size = resp->max_size;
+	key->flags = (knot_pkt_has_dnssec(query) ? ENTRY_FLAG_DO : 0) |
+	             (limit ? ENTRY_FLAG_LIMIT : 0);
+
+	SIPHASH_CTX ctx;
+	SipHash24_Init(&ctx, &cache->key);
+	SipHash24_Update(&ctx, key->question, key->question_size);
+	SipHash24_Update(&ctx, &key->max_size, sizeof(key->max_size));
+	SipHash24_Update(&ctx, &key->flags, sizeof(key->flags));
+	key->hash = SipHash24_End(&ctx);
+}
+
+static bool entry_match(const entry_t *entry, const cache_key_t *key, uint64_t gen,
+                        const zone_contents_t *contents)
+{
+	return entry->gen == gen && entry->contents == contents &&
+	       entry->hash == key->hash && entry->max_size == key->max_size &&
+	       entry->flags == key->flags &&
+	       entry->size >= KNOT_WIRE_HEADER_SIZE + key->question_size &&
+	       memcmp(entry->wire + KNOT_WIRE_HEADER_SIZE, key->question,
+	              key->question_size) == 0;
+}
+
+static void ctr_incr(answer_cache_t *cache, unsigned thread_id, unsigned ctr)
+{
+	uint64_t *block = cache->ctrs + (thread_id % cache->threads) * CTR_STRIDE;
+	ATOMIC_ADD(block[ctr], 1);
+}
+
+static uint64_t ctr_sum(const answer_cache_t *cache, unsigned ctr)
+{
+	if (cache == NULL) {
+		return 0;
+	}
+
+	uint64_t sum = 0;
+	for (unsigned i = 0; i < cache->threads; i++) {
+		sum += ATOMIC_GET(cache->ctrs[i * CTR_STRIDE + ctr]);
+	}
+
+	return sum;
+}
+
+answer_cache_t *answer_cache_new(unsigned size, unsigned threads)
+{
+	if (size == 0) {
+		return NULL;
+	}
+
+	unsigned entries = 1;
+	while (entries < size && entries <= (UINT_MAX >> 1)) {
+		entries <<= 1;
+	}
+
+	answer_cache_t *cache = calloc(1, sizeof(*cache) + entries * sizeof(entry_t));
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache->gen = 1; // Distinct from unused entries.
+	cache->mask = entries - 1;
+	cache->threads = MAX(threads, 1);
+
+	size_t ctrs_size = cache->threads * CTR_STRIDE * sizeof(uint64_t);
+	if (posix_memalign((void **)&cache->ctrs, CACHE_LINE, ctrs_size) != 0) {
+		free(cache);
+		return NULL;
+	}
+	memset(cache->ctrs, 0, ctrs_size);
+
+	if (dnssec_random_buffer((uint8_t *)&cache->key, sizeof(cache->key)) != DNSSEC_EOK) {
+		free(cache->ctrs);
+		free(cache);
+		return NULL;
+	}
+
+	for (unsigned i = 0; i < CACHE_LOCKS; i++) {
+		pthread_mutex_init(&cache->lk[i], NULL);
+	}
+
+	return cache;
+}
+
+void answer_cache_free(answer_cache_t *cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+
+	for (unsigned i = 0; i <= cache->mask; i++) {
+		free(cache->entries[i].wire);
+	}
+	for (unsigned i = 0; i < CACHE_LOCKS; i++) {
+		pthread_mutex_destroy(&cache->lk[i]);
+	}
+	free(cache->ctrs);
+	free(cache);
+}
+
+void answer_cache_invalidate(answer_cache_t *cache)
+{
+	if (cache != NULL) {
+		ATOMIC_INC(cache->gen);
+	}
+}
+
+int answer_cache_get(answer_cache_t *cache, unsigned thread_id,
+                     const zone_contents_t *contents, const knot_pkt_t *query,
+                     knot_pkt_t *resp, bool limit, uint16_t *rcode)
+{
+	assert(cache && query && resp && rcode);
+
+	cache_key_t key;
+	key_init(&key, cache, query, resp, limit);
+	uint64_t gen = ATOMIC_GET(cache->gen);
+
+	unsigned idx = key.hash & cache->mask;
+	entry_t *entry = &cache->entries[idx];
+	pthread_mutex_t *lk = &cache->lk[idx % CACHE_LOCKS];
+
+	bool found = false;
+	pthread_mutex_lock(lk);
+	if (entry_match(entry, &key, gen, contents) &&
+	    entry->size + resp->reserved <= resp->max_size) {
+		memcpy(resp->wire, entry->wire, entry->size);
+		resp->size = entry->size;
+		*rcode = entry->rcode;
+		found = true;
+	}
+	pthread_mutex_unlock(lk);
+
+	if (!found) {
+		ctr_incr(cache, thread_id, CTR_MISS);
+		return KNOT_ENOENT;
+	}
+	ctr_incr(cache, thread_id, CTR_HIT);
+
+	/* Patch the query specific header fields. */
+	knot_wire_set_id(resp->wire, knot_wire_get_id(query->wire));
+	if (knot_wire_get_rd(query->wire)) {
+		knot_wire_set_rd(resp->wire);
+	} else {
+		knot_wire_clear_rd(resp->wire);
+	}
+	/* Like in the regular answers, the CD bit is never echoed. */
+	knot_wire_clear_cd(resp->wire);
+
+	return KNOT_EOK;
+}
+
+void answer_cache_put(answer_cache_t *cache, const zone_contents_t *contents,
+                      const knot_pkt_t *query, const knot_pkt_t *resp,
+                      bool limit, uint16_t rcode)
+{
+	assert(cache && query && resp);
+
+	if (resp->size > ANSWER_CACHE_MAX_SIZE || knot_wire_get_tc(resp->wire) ||
+	    resp->opt_rr != NULL || resp->tsig_rr != NULL) {
+		return;
+	}
+
+	cache_key_t key;
+	key_init(&key, cache, query, resp, limit);
+	uint64_t gen = ATOMIC_GET(cache->gen);
+
+	uint8_t *wire = malloc(resp->size);
+	if (wire == NULL) {
+		return;
+	}
+	memcpy(wire, resp->wire, resp->size);
+	/* Keep the lower-cased question for key comparison. */
+	memcpy(wire + KNOT_WIRE_HEADER_SIZE, key.question, key.question_size);
+
+	unsigned idx = key.hash & cache->mask;
+	entry_t *entry = &cache->entries[idx];
+	pthread_mutex_t *lk = &cache->lk[idx % CACHE_LOCKS];
+
+	pthread_mutex_lock(lk);
+	uint8_t *old_wire = entry->wire;
+	entry->gen = gen;
+	entry->contents = contents;
+	entry->hash = key.hash;
+	entry->max_size = key.max_size;
+	entry->rcode = rcode;
+	entry->size = resp->size;
+	entry->flags = key.flags;
+	entry->wire = wire;
+	pthread_mutex_unlock(lk);
+
+	free(old_wire);
+}
+
+uint64_t answer_cache_hits(const answer_cache_t *cache)
+{
+	return ctr_sum(cache, CTR_HIT);
+}
+
+uint64_t answer_cache_misses(const answer_cache_t *cache)
+{
+	return ctr_sum(cache, CTR_MISS);
+}
@@ -0,0 +1,114 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Per-zone cache of complete wire-format answers.
+ *
+ * Entries are keyed by the question (lower-cased QNAME, QTYPE, QCLASS),
+ * the DO bit, the size limit and the maximal answer size. Each entry is tagged
+ * with the zone contents it was built from and with the cache generation,
+ * which is increased whenever the zone contents are switched. This way all
+ * entries are invalidated at once without touching them.
+ *
+ * The cached wire excludes the OPT and TSIG records, which are specific
+ * to each query, and its RCODE is kept aside.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "knot/zone/contents.h"
+#include "libknot/packet/pkt.h"
+
+/*! \brief Maximal size of a cached answer. */
+#define ANSWER_CACHE_MAX_SIZE 4096
+
+struct answer_cache;
+typedef struct answer_cache answer_cache_t;
+
+/*!
+ * \brief Create an answer cache.
+ *
+ * \param size     Number of entries (rounded up to a power of two).
+ * \param threads  Number of threads updating the hit/miss counters.
+ *
+ * \return Answer cache or NULL.
+ */
+answer_cache_t *answer_cache_new(unsigned size, unsigned threads);
+
+/*!
+ * \brief Free the answer cache.
+ */
+void answer_cache_free(answer_cache_t *cache);
+
+/*!
+ * \brief Invalidate all entries.
+ *
+ * \note Must be called before the new zone contents are published.
+ */
+void answer_cache_invalidate(answer_cache_t *cache);
+
+/*!
+ * \brief Fill the response with a cached answer.
+ *
+ * The response must be initialized from the query (lower-cased QNAME) and
+ * its maximal size set. On success the response wire contains the cached
+ * answer with the message ID and the RD flag of the query, but the packet
+ * sections are not parsed.
+ *
+ * \param cache      Answer cache.
+ * \param thread_id  Calling thread.
+ * \param contents   Zone contents used for answering.
+ * \param query      Incoming query.
+ * \param resp       Response to be filled.
+ * \param limit      Indication of limited answer size (UDP).
+ * \param rcode      Output RCODE of the cached answer.
+ *
+ * \retval KNOT_EOK if found.
+ * \retval KNOT_ENOENT if not found.
+ */
+int answer_cache_get(answer_cache_t *cache, unsigned thread_id,
+                     const zone_contents_t *contents, const knot_pkt_t *query,
+                     knot_pkt_t *resp, bool limit, uint16_t *rcode);
+
+/*!
+ * \brief Store the answer into the cache.
+ *
+ * The response must not contain the OPT and TSIG records yet. Truncated
+ * and too large answers are not stored.
+ *
+ * \param cache     Answer cache.
+ * \param contents  Zone contents the answer was built from.
+ * \param query     Incoming query.
+ * \param resp      Complete response.
+ * \param limit     Indication of limited answer size (UDP).
+ * \param rcode     RCODE of the answer.
+ */
+void answer_cache_put(answer_cache_t *cache, const zone_contents_t *contents,
+                      const knot_pkt_t *query, const knot_pkt_t *resp,
+                      bool limit, uint16_t rcode);
+
+/*!
+ * \brief Get the number of cache hits summed over all threads.
+ */
+uint64_t answer_cache_hits(const answer_cache_t *cache);
+
+/*!
+ * \brief Get the number of cache misses summed over all threads.
+ */
+uint64_t answer_cache_misses(const answer_cache_t *cache);
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -19,6 +19,7 @@
 #include "contrib/mempattern.h"
 #include "contrib/sockaddr.h"
 #include "knot/nameserver/axfr.h"
+#include "knot/nameserver/axfr_cache.h"
 #include "knot/nameserver/internet.h"
 #include "knot/nameserver/log.h"
 #include "knot/nameserver/xfr.h"
@@ -37,6 +38,9 @@ struct axfr_proc {
 	trie_it_t *i;
 	zone_tree_it_t it;
 	unsigned cur_rrset;
+	axfr_snapshot_t *snapshot;
+	unsigned cur_msg;
+	dnssec_binary_t tsig_secret;
 };
 
 static int axfr_put_rrsets(knot_pkt_t *pkt, zone_node_t *node,
@@ -95,10 +99,75 @@ static void axfr_query_cleanup(knotd_qdata_t *qdata)
 
 	zone_tree_it_free(&axfr->it);
 	ptrlist_free(&axfr->proc.nodes, qdata->mm);
-	mm_free(qdata->mm, axfr);
 
 	/* Allow zone changes (finished). */
-	rcu_read_unlock();
+	if (axfr->snapshot != NULL) {
+		axfr_snapshot_release(axfr->snapshot);
+		dnssec_binary_free(&axfr->tsig_secret);
+	} else {
+		rcu_read_unlock();
+	}
+
+	mm_free(qdata->mm, axfr);
+}
+
+static void axfr_snapshot_init(knot_pkt_t *pkt, knotd_qdata_t *qdata,
+                               struct axfr_proc *axfr)
+{
+	const zone_t *zone = qdata->extra->zone;
+	if (zone->axfr_cache == NULL) {
+		return;
+	}
+
+	/* Each snapshot message must fit into the responses of this transfer. */
+	size_t reserved = pkt->reserved + knot_tsig_wire_size(&qdata->sign.tsig_key);
+	if (reserved > AXFR_SNAPSHOT_RESERVE || pkt->max_size < KNOT_WIRE_MAX_PKTSIZE) {
+		return;
+	}
+
+	int ret = axfr_cache_get(zone->axfr_cache, qdata->extra->contents,
+	                         &axfr->snapshot);
+	if (ret != KNOT_EOK) {
+		if (ret != KNOT_EBUSY) {
+			AXFROUT_LOG(LOG_DEBUG, qdata, "failed to build snapshot (%s)",
+			            knot_strerror(ret));
+		}
+		axfr->snapshot = NULL;
+		return;
+	}
+
+	/* The RCU isn't held between the messages, so the TSIG secret, pointing
+	 * to the configuration or to the zone ACL, could be freed meanwhile.
+	 * The zone and the query plans are looked up again for each message. */
+	if (qdata->sign.tsig_key.name != NULL) {
+		ret = dnssec_binary_dup(&qdata->sign.tsig_key.secret, &axfr->tsig_secret);
+		if (ret != KNOT_EOK) {
+			axfr_snapshot_release(axfr->snapshot);
+			axfr->snapshot = NULL;
+			return;
+		}
+		qdata->sign.tsig_key.secret = axfr->tsig_secret;
+	}
+}
+
+static int axfr_process_snapshot(knot_pkt_t *pkt, knotd_qdata_t *qdata)
+{
+	struct axfr_proc *axfr = qdata->extra->ext;
+
+	int ret = axfr_snapshot_write(axfr->snapshot, axfr->cur_msg, pkt);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	/* Update counters. */
+	xfr_stats_add(&axfr->proc.stats, pkt->size + knot_rrset_size(&qdata->opt_rr));
+
+	/* The zone contents aren't pinned until the next message. */
+	qdata->extra->contents = NULL;
+
+	axfr->cur_msg++;
+	return (axfr->cur_msg < axfr_snapshot_messages(axfr->snapshot)) ?
+	       KNOT_ESPACE : KNOT_EOK;
 }
 
 static int axfr_query_check(knotd_qdata_t *qdata)
@@ -110,9 +179,9 @@ static int axfr_query_check(knotd_qdata_t *qdata)
 	return KNOT_STATE_DONE;
 }
 
-static int axfr_query_init(knotd_qdata_t *qdata)
+static int axfr_query_init(knot_pkt_t *pkt, knotd_qdata_t *qdata)
 {
-	assert(qdata);
+	assert(pkt && qdata);
 
 	/* Check AXFR query validity. */
 	if (axfr_query_check(qdata) == KNOT_STATE_FAIL) {
@@ -147,8 +216,13 @@ static int axfr_query_init(knotd_qdata_t *qdata)
 	qdata->extra->ext = axfr;
 	qdata->extra->ext_cleanup = &axfr_query_cleanup;
 
+	/* Use the pre-rendered messages if available. */
+	axfr_snapshot_init(pkt, qdata, axfr);
+
 	/* No zone changes during multipacket answer (unlocked in axfr_answer_cleanup) */
-	rcu_read_lock();
+	if (axfr->snapshot == NULL) {
+		rcu_read_lock();
+	}
 
 	return KNOT_EOK;
 }
@@ -168,7 +242,7 @@ int axfr_process_query(knot_pkt_t *pkt, knotd_qdata_t *qdata)
 	/* Initialize on first call. */
 	struct axfr_proc *axfr = qdata->extra->ext;
 	if (axfr == NULL) {
-		int ret = axfr_query_init(qdata);
+		int ret = axfr_query_init(pkt, qdata);
 		axfr = qdata->extra->ext;
 		switch (ret) {
 		case KNOT_EOK:      /* OK */
@@ -194,7 +268,11 @@ int axfr_process_query(knot_pkt_t *pkt, knotd_qdata_t *qdata)
 	}
 
 	/* Answer current packet (or continue). */
-	ret = xfr_process_list(pkt, &axfr_process_node_tree, qdata);
+	if (axfr->snapshot != NULL) {
+		ret = axfr_process_snapshot(pkt, qdata);
+	} else {
+		ret = xfr_process_list(pkt, &axfr_process_node_tree, qdata);
+	}
 	switch (ret) {
 	case KNOT_ESPACE: /* Couldn't write more, send packet and continue. */
 		return KNOT_STATE_PRODUCE; /* Check for more. */
@@ -0,0 +1,347 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "knot/nameserver/axfr_cache.h"
+#include "libknot/errcode.h"
+#include "libknot/packet/wire.h"
+#include "contrib/macros.h"
+
+#ifdef HAVE_ATOMIC
+ #define ATOMIC_INC(dst) __atomic_add_fetch(&(dst), 1, __ATOMIC_RELAXED)
+ #define ATOMIC_DEC(dst) __atomic_sub_fetch(&(dst), 1, __ATOMIC_ACQ_REL)
+#elif defined(HAVE_SYNC_ATOMIC)
+ #define ATOMIC_INC(dst) __sync_add_and_fetch(&(dst), 1)
+ #define ATOMIC_DEC(dst) __sync_sub_and_fetch(&(dst), 1)
+#else
+ #define ATOMIC_INC(dst) (++(dst))
+ #define ATOMIC_DEC(dst) (--(dst))
+#endif
+
+#define SNAPSHOT_INIT_SIZE (1 << 16)
+
+typedef struct {
+	size_t offset;      /*!< Message body offset in the snapshot data. */
+	uint16_t size;      /*!< Message body size. */
+	uint16_t ancount;   /*!< Number of RRs in the message. */
+} snapshot_msg_t;
+
+struct axfr_snapshot {
+	const zone_contents_t *contents; /*!< Source contents, not dereferenced. */
+	unsigned refs;                   /*!< Reference count. */
+	uint16_t prefix_size;            /*!< Header and question size. */
+	unsigned count;                  /*!< Number of messages. */
+	unsigned max_count;              /*!< Allocated message descriptors. */
+	snapshot_msg_t *msgs;            /*!< Message descriptors. */
+	size_t size;                     /*!< Size of all message bodies. */
+	size_t max_size;                 /*!< Allocated data size. */
+	uint8_t *data;                   /*!< Message bodies. */
+};
+
+struct axfr_cache {
+	pthread_mutex_t lock;            /*!< Current snapshot lock. */
+	pthread_mutex_t build_lock;      /*!< Held by the transfer building a snapshot. */
+	axfr_snapshot_t *current;        /*!< Snapshot of the current contents. */
+};
+
+static void snapshot_free(axfr_snapshot_t *snap)
+{
+	free(snap->msgs);
+	free(snap->data);
+	free(snap);
+}
+
+static int snapshot_pkt_init(knot_pkt_t *pkt, const zone_contents_t *contents)
+{
+	knot_pkt_clear(pkt);
+
+	int ret = knot_pkt_put_question(pkt, contents->apex->owner, KNOT_CLASS_IN,
+	                                KNOT_RRTYPE_AXFR);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	return knot_pkt_reserve(pkt, AXFR_SNAPSHOT_RESERVE);
+}
+
+/*! \brief Move the packet answer section into the snapshot, reset the packet. */
+static int snapshot_flush(axfr_snapshot_t *snap, knot_pkt_t *pkt,
+                          const zone_contents_t *contents)
+{
+	assert(pkt->size >= snap->prefix_size);
+	size_t size = pkt->size - snap->prefix_size;
+
+	if (snap->count == snap->max_count) {
+		unsigned max_count = MAX(2 * snap->max_count, 16);
+		snapshot_msg_t *msgs = realloc(snap->msgs, max_count * sizeof(*msgs));
+		if (msgs == NULL) {
+			return KNOT_ENOMEM;
+		}
+		snap->msgs = msgs;
+		snap->max_count = max_count;
+	}
+
+	if (snap->size + size > snap->max_size) {
+		size_t max_size = MAX(2 * snap->max_size, SNAPSHOT_INIT_SIZE);
+		uint8_t *data = realloc(snap->data, max_size);
+		if (data == NULL) {
+			return KNOT_ENOMEM;
+		}
+		snap->data = data;
+		snap->max_size = max_size;
+	}
+
+	memcpy(snap->data + snap->size, pkt->wire + snap->prefix_size, size);
+	snap->msgs[snap->count++] = (snapshot_msg_t) {
+		.offset = snap->size,
+		.size = size,
+		.ancount = knot_wire_get_ancount(pkt->wire)
+	};
+	snap->size += size;
+
+	return snapshot_pkt_init(pkt, contents);
+}
+
+static int snapshot_put(axfr_snapshot_t *snap, knot_pkt_t *pkt,
+                        const zone_contents_t *contents,
+                        const knot_rrset_t *rrset, uint16_t flags)
+{
+	int ret = knot_pkt_put(pkt, 0, rrset, flags);
+	if (ret == KNOT_ESPACE && pkt->rrset_count > 0) {
+		ret = snapshot_flush(snap, pkt, contents);
+		if (ret == KNOT_EOK) {
+			ret = knot_pkt_put(pkt, 0, rrset, flags);
+		}
+	}
+
+	/* The RRSet is larger than the message. */
+	if (ret == KNOT_ESPACE) {
+		return KNOT_ENOXFR;
+	}
+
+	return ret;
+}
+
+static int snapshot_put_tree(axfr_snapshot_t *snap, knot_pkt_t *pkt,
+                             const zone_contents_t *contents, zone_tree_t *tree)
+{
+	if (zone_tree_is_empty(tree)) {
+		return KNOT_EOK;
+	}
+
+	zone_tree_it_t it = { 0 };
+	int ret = zone_tree_it_begin(tree, &it);
+	while (ret == KNOT_EOK && !zone_tree_it_finished(&it)) {
+		zone_node_t *node = zone_tree_it_val(&it);
+		for (unsigned i = 0; ret == KNOT_EOK && i < node->rrset_count; i++) {
+			knot_rrset_t rrset = node_rrset_at(node, i);
+			if (rrset.type != KNOT_RRTYPE_SOA) {
+				ret = snapshot_put(snap, pkt, contents, &rrset,
+				                   KNOT_PF_NOTRUNC | KNOT_PF_ORIGTTL);
+			}
+		}
+		zone_tree_it_next(&it);
+	}
+	zone_tree_it_free(&it);
+
+	return ret;
+}
+
+/*! \brief Encode the transfer the same way as axfr_process_query() does. */
+static int snapshot_build(const zone_contents_t *contents, axfr_snapshot_t **out)
+{
+	axfr_snapshot_t *snap = calloc(1, sizeof(*snap));
+	knot_pkt_t *pkt = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	if (snap == NULL || pkt == NULL) {
+		free(snap);
+		knot_pkt_free(pkt);
+		return KNOT_ENOMEM;
+	}
+	snap->contents = contents;
+	snap->refs = 1;
+
+	int ret = snapshot_pkt_init(pkt, contents);
+	snap->prefix_size = pkt->size;
+
+	knot_rrset_t soa = node_rrset(contents->apex, KNOT_RRTYPE_SOA);
+	if (ret == KNOT_EOK) {
+		ret = snapshot_put(snap, pkt, contents, &soa, KNOT_PF_NOTRUNC);
+	}
+	if (ret == KNOT_EOK) {
+		ret = snapshot_put_tree(snap, pkt, contents, contents->nodes);
+	}
+	if (ret == KNOT_EOK) {
+		ret = snapshot_put_tree(snap, pkt, contents, contents->nsec3_nodes);
+	}
+	if (ret == KNOT_EOK) {
+		ret = snapshot_put(snap, pkt, contents, &soa, KNOT_PF_NOTRUNC);
+	}
+	if (ret == KNOT_EOK) {
+		ret = snapshot_flush(snap, pkt, contents);
+	}
+
+	knot_pkt_free(pkt);
+
+	if (ret != KNOT_EOK) {
+		snapshot_free(snap);
+		return ret;
+	}
+
+	*out = snap;
+	return KNOT_EOK;
+}
+
+axfr_cache_t *axfr_cache_new(void)
+{
+	axfr_cache_t *cache = calloc(1, sizeof(*cache));
+	if (cache == NULL) {
+		return NULL;
+	}
+
+	pthread_mutex_init(&cache->lock, NULL);
+	pthread_mutex_init(&cache->build_lock, NULL);
+
+	return cache;
+}
+
+void axfr_cache_free(axfr_cache_t *cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+
+	axfr_snapshot_release(cache->current);
+	pthread_mutex_destroy(&cache->lock);
+	pthread_mutex_destroy(&cache->build_lock);
+	free(cache);
+}
+
+void axfr_cache_invalidate(axfr_cache_t *cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	axfr_snapshot_t *old = cache->current;
+	cache->current = NULL;
+	pthread_mutex_unlock(&cache->lock);
+
+	axfr_snapshot_release(old);
+}
+
+static axfr_snapshot_t *cache_lookup(axfr_cache_t *cache,
+                                     const zone_contents_t *contents)
+{
+	pthread_mutex_lock(&cache->lock);
+	axfr_snapshot_t *snap = cache->current;
+	if (snap != NULL && snap->contents == contents) {
+		ATOMIC_INC(snap->refs);
+	} else {
+		snap = NULL;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return snap;
+}
+
+int axfr_cache_get(axfr_cache_t *cache, const zone_contents_t *contents,
+                   axfr_snapshot_t **snapshot)
+{
+	if (cache == NULL || contents == NULL || snapshot == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	*snapshot = cache_lookup(cache, contents);
+	if (*snapshot != NULL) {
+		return KNOT_EOK;
+	}
+
+	/* Only one transfer builds the snapshot, the concurrent ones don't wait
+	 * for it and are served the usual way meanwhile. */
+	if (pthread_mutex_trylock(&cache->build_lock) != 0) {
+		return KNOT_EBUSY;
+	}
+
+	*snapshot = cache_lookup(cache, contents);
+	if (*snapshot != NULL) {
+		pthread_mutex_unlock(&cache->build_lock);
+		return KNOT_EOK;
+	}
+
+	axfr_snapshot_t *snap = NULL;
+	int ret = snapshot_build(contents, &snap);
+	if (ret != KNOT_EOK) {
+		pthread_mutex_unlock(&cache->build_lock);
+		return ret;
+	}
+
+	/* A snapshot of outdated contents (if invalidated meanwhile) is replaced
+	 * by the next build, the contents can't be reused before invalidation. */
+	snap->refs++;
+	pthread_mutex_lock(&cache->lock);
+	axfr_snapshot_t *old = cache->current;
+	cache->current = snap;
+	pthread_mutex_unlock(&cache->lock);
+
+	pthread_mutex_unlock(&cache->build_lock);
+
+	axfr_snapshot_release(old);
+
+	*snapshot = snap;
+	return KNOT_EOK;
+}
+
+void axfr_snapshot_release(axfr_snapshot_t *snapshot)
+{
+	if (snapshot != NULL && ATOMIC_DEC(snapshot->refs) == 0) {
+		snapshot_free(snapshot);
+	}
+}
+
+unsigned axfr_snapshot_messages(const axfr_snapshot_t *snapshot)
+{
+	return (snapshot != NULL) ? snapshot->count : 0;
+}
+
+size_t axfr_snapshot_size(const axfr_snapshot_t *snapshot)
+{
+	return (snapshot != NULL) ? snapshot->size : 0;
+}
+
+int axfr_snapshot_write(const axfr_snapshot_t *snapshot, unsigned msg,
+                        knot_pkt_t *pkt)
+{
+	if (snapshot == NULL || pkt == NULL || msg >= snapshot->count ||
+	    pkt->size != snapshot->prefix_size) {
+		return KNOT_EINVAL;
+	}
+
+	const snapshot_msg_t *m = &snapshot->msgs[msg];
+	if (pkt->size + pkt->reserved + m->size > pkt->max_size) {
+		return KNOT_ESPACE;
+	}
+
+	memcpy(pkt->wire + pkt->size, snapshot->data + m->offset, m->size);
+	pkt->size += m->size;
+	knot_wire_set_ancount(pkt->wire, m->ancount);
+
+	return KNOT_EOK;
+}
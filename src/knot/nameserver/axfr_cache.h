@@ -0,0 +1,110 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Per-zone cache of pre-rendered outgoing AXFR message streams.
+ *
+ * The snapshot contains the answer sections of all AXFR messages for given
+ * zone contents, compressed against the zone name in the question. As the
+ * question section of each response has the same length, the message bodies
+ * are copied after the question of every outgoing message as they are.
+ *
+ * A snapshot is built once by the first transfer after the zone contents
+ * change and is shared by all transfers via reference counting. Transfers
+ * starting while the snapshot is being built use the regular AXFR processing. It doesn't
+ * refer to the zone contents, so the transfers don't need to hold the RCU
+ * read lock.
+ */
+
+#pragma once
+
+#include "knot/zone/contents.h"
+#include "libknot/packet/pkt.h"
+
+/*! \brief Space left for the OPT and TSIG records in each snapshot message. */
+#define AXFR_SNAPSHOT_RESERVE 1024
+
+struct axfr_cache;
+typedef struct axfr_cache axfr_cache_t;
+
+struct axfr_snapshot;
+typedef struct axfr_snapshot axfr_snapshot_t;
+
+/*!
+ * \brief Create an AXFR snapshot cache.
+ *
+ * \return AXFR cache or NULL.
+ */
+axfr_cache_t *axfr_cache_new(void);
+
+/*!
+ * \brief Free the AXFR cache.
+ *
+ * \note Snapshots used by running transfers are freed upon their release.
+ */
+void axfr_cache_free(axfr_cache_t *cache);
+
+/*!
+ * \brief Drop the current snapshot.
+ *
+ * \note Must be called before the new zone contents are published.
+ */
+void axfr_cache_invalidate(axfr_cache_t *cache);
+
+/*!
+ * \brief Get a snapshot of the zone contents, build it if not available.
+ *
+ * \note Must be called within the RCU read-side section protecting the contents.
+ *
+ * \param cache     AXFR cache.
+ * \param contents  Zone contents to be transferred.
+ * \param snapshot  Output snapshot, to be released with axfr_snapshot_release().
+ *
+ * \retval KNOT_EBUSY if the snapshot is being built by another transfer.
+ * \return KNOT_E*
+ */
+int axfr_cache_get(axfr_cache_t *cache, const zone_contents_t *contents,
+                   axfr_snapshot_t **snapshot);
+
+/*!
+ * \brief Release the snapshot reference.
+ */
+void axfr_snapshot_release(axfr_snapshot_t *snapshot);
+
+/*!
+ * \brief Get the number of messages in the snapshot.
+ */
+unsigned axfr_snapshot_messages(const axfr_snapshot_t *snapshot);
+
+/*!
+ * \brief Get the total size of the message bodies in the snapshot.
+ */
+size_t axfr_snapshot_size(const axfr_snapshot_t *snapshot);
+
+/*!
+ * \brief Append the answer section of the given message to the response.
+ *
+ * The packet sections are not updated, only the wire and ANCOUNT.
+ *
+ * \param snapshot  AXFR snapshot.
+ * \param msg       Message index.
+ * \param pkt       Response containing just the question for the zone name.
+ *
+ * \retval KNOT_ESPACE if the message doesn't fit into the response.
+ * \return KNOT_E*
+ */
+int axfr_snapshot_write(const axfr_snapshot_t *snapshot, unsigned msg,
+                        knot_pkt_t *pkt);
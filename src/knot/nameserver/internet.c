@@ -190,9 +190,8 @@ static int put_authority_soa(knot_pkt_t *pkt, knotd_qdata_t *qdata,
 static int put_delegation(knot_pkt_t *pkt, knotd_qdata_t *qdata)
 {
 	/* Find closest delegation point. */
-	while (!(qdata->extra->node->flags & NODE_FLAGS_DELEG)) {
-		qdata->extra->node = node_parent(qdata->extra->node);
-	}
+	qdata->extra->node = node_cut(qdata->extra->node);
+	assert(qdata->extra->node != NULL);
 
 	/* Insert NS record. */
 	knot_rrset_t rrset = node_rrset(qdata->extra->node, KNOT_RRTYPE_NS);
@@ -365,9 +364,7 @@ static int name_not_found(knot_pkt_t *pkt, knotd_qdata_t *qdata)
 	/* Name is covered by wildcard. */
 	if (qdata->extra->encloser->flags & NODE_FLAGS_WILDCARD_CHILD) {
 		/* Find wildcard child in the zone. */
-		const zone_node_t *wildcard_node =
-			zone_contents_find_wildcard_child(
-				qdata->extra->contents, qdata->extra->encloser);
+		const zone_node_t *wildcard_node = node_wildcard_child(qdata->extra->encloser);
 
 		qdata->extra->node = wildcard_node;
 		assert(qdata->extra->node != NULL);
@@ -390,16 +387,10 @@ static int name_not_found(knot_pkt_t *pkt, knotd_qdata_t *qdata)
 		return follow_cname(pkt, KNOT_RRTYPE_DNAME, qdata);
 	}
 
-	/* Look up an authoritative encloser or its parent. */
-	const zone_node_t *node = qdata->extra->encloser;
-	while (node->rrset_count == 0 || node->flags & NODE_FLAGS_NONAUTH) {
-		node = node_parent(node);
-		assert(node);
-	}
-
 	/* Name is below delegation. */
-	if ((node->flags & NODE_FLAGS_DELEG)) {
-		qdata->extra->node = node;
+	const zone_node_t *cut = node_cut(qdata->extra->encloser);
+	if (cut != NULL) {
+		qdata->extra->node = cut;
 		return KNOTD_IN_STATE_DELEG;
 	}
 
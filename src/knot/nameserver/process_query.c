@@ -19,6 +19,7 @@
 #include "libdnssec/tsig.h"
 #include "knot/common/log.h"
 #include "knot/dnssec/rrset-sign.h"
+#include "knot/nameserver/answer_cache.h"
 #include "knot/nameserver/process_query.h"
 #include "knot/nameserver/query_module.h"
 #include "knot/nameserver/chaos.h"
@@ -383,6 +384,8 @@ static int prepare_answer(knot_pkt_t *query, knot_pkt_t *resp, knot_layer_t *ctx
 	/* Update maximal answer size. */
 	bool has_limit = qdata->params->flags & KNOTD_QUERY_FLAG_LIMIT_SIZE;
 	if (has_limit) {
+		/* Never exceed the output buffer (e.g. an MTU-limited XDP frame). */
+		size_t buf_size = resp->max_size;
 		resp->max_size = KNOT_WIRE_MIN_PKTSIZE;
 		if (knot_pkt_has_edns(query)) {
 			uint16_t server_size;
@@ -400,6 +403,7 @@ static int prepare_answer(knot_pkt_t *query, knot_pkt_t *resp, knot_layer_t *ctx
 			uint16_t transfer = MIN(client_size, server_size);
 			resp->max_size = MAX(resp->max_size, transfer);
 		}
+		resp->max_size = MIN(resp->max_size, buf_size);
 	} else {
 		resp->max_size = KNOT_WIRE_MAX_PKTSIZE;
 	}
@@ -489,6 +493,111 @@ static int process_query_err(knot_layer_t *ctx, knot_pkt_t *pkt)
 	return KNOT_STATE_DONE;
 }
 
+/*! \brief Get the zone answer cache if applicable to the query. */
+static answer_cache_t *answer_cache_find(knotd_qdata_t *qdata, struct query_plan *plan,
+                                         struct query_plan *zone_plan)
+{
+	const zone_t *zone = qdata->extra->zone;
+	if (zone == NULL || zone->answer_cache == NULL ||
+	    qdata->extra->contents == NULL ||
+	    qdata->type != KNOTD_QUERY_TYPE_NORMAL ||
+	    knot_pkt_qclass(qdata->query) != KNOT_CLASS_IN ||
+	    knot_pkt_has_tsig(qdata->query) ||
+	    conf()->cache.srv_ans_rotate ||
+	    query_plan_alters_answer(plan) ||
+	    query_plan_alters_answer(zone_plan)) {
+		return NULL;
+	}
+
+	return zone->answer_cache;
+}
+
+static bool has_end_steps(struct query_plan *plan)
+{
+	return plan != NULL && !EMPTY_LIST(plan->stage[KNOTD_STAGE_END]);
+}
+
+static int answer_cache_answer(answer_cache_t *cache, knot_pkt_t *pkt,
+                               knotd_qdata_t *qdata, bool parse)
+{
+	bool limit = qdata->params->flags & KNOTD_QUERY_FLAG_LIMIT_SIZE;
+	uint16_t rcode;
+	int ret = answer_cache_get(cache, qdata->params->thread_id,
+	                           qdata->extra->contents, qdata->query, pkt,
+	                           limit, &rcode);
+	if (ret != KNOT_EOK) {
+		return KNOT_STATE_PRODUCE;
+	}
+
+	qdata->rcode = rcode;
+
+	/* Restore the packet sections for the modules inspecting the answer. */
+	if (parse && knot_pkt_parse(pkt, KNOT_PF_NOCANON) != KNOT_EOK) {
+		qdata->rcode = KNOT_RCODE_SERVFAIL;
+		return KNOT_STATE_FAIL;
+	}
+
+	return KNOT_STATE_DONE;
+}
+
+static void answer_cache_store(answer_cache_t *cache, knot_pkt_t *pkt,
+                               knotd_qdata_t *qdata)
+{
+	/* Wildcard answers are distinguished by the rate limiting. */
+	if (!EMPTY_LIST(qdata->extra->wildcards)) {
+		return;
+	}
+
+	bool limit = qdata->params->flags & KNOTD_QUERY_FLAG_LIMIT_SIZE;
+	answer_cache_put(cache, qdata->extra->contents, qdata->query, pkt,
+	                 limit, qdata->rcode);
+}
+
+/*! \brief Check the query parse state and initialize the response. */
+static int answer_prepare(knot_pkt_t *pkt, knot_layer_t *ctx)
+{
+	knotd_qdata_t *qdata = QUERY_DATA(ctx);
+
+	/* Check parse state. */
+	knot_pkt_t *query = qdata->query;
+	if (query->parsed < query->size) {
+		qdata->rcode = KNOT_RCODE_FORMERR;
+		return KNOT_STATE_FAIL;
+	}
+
+	if (prepare_answer(query, pkt, ctx) != KNOT_EOK) {
+		return KNOT_STATE_FAIL;
+	}
+
+	return KNOT_STATE_PRODUCE;
+}
+
+static int process_query_prepare(knot_layer_t *ctx, knot_pkt_t *pkt)
+{
+	assert(pkt && ctx);
+
+	if (ctx->state != KNOT_STATE_PRODUCE) {
+		return ctx->state;
+	}
+
+	/* The caller keeps the RCU read lock until the answer is produced. */
+	rcu_read_lock();
+
+	knotd_qdata_t *qdata = QUERY_DATA(ctx);
+	qdata->extra->prepared = answer_prepare(pkt, ctx);
+
+	/* Warm up the zone data while the rest of the batch is being prepared. */
+	const zone_contents_t *contents = qdata->extra->contents;
+	if (contents != NULL) {
+		__builtin_prefetch(contents->apex);
+		__builtin_prefetch(contents->nodes);
+	}
+
+	rcu_read_unlock();
+
+	return KNOT_STATE_PRODUCE;
+}
+
 #define PROCESS_BEGIN(plan, step, next_state, qdata) \
 	if (plan != NULL) { \
 		WALK_LIST(step, plan->stage[KNOTD_STAGE_BEGIN]) { \
@@ -520,19 +629,13 @@ static int process_query_out(knot_layer_t *ctx, knot_pkt_t *pkt)
 	struct query_plan *zone_plan = NULL;
 	struct query_step *step;
 
-	int next_state = KNOT_STATE_PRODUCE;
-
-	/* Check parse state. */
-	knot_pkt_t *query = qdata->query;
-	if (query->parsed < query->size) {
-		qdata->rcode = KNOT_RCODE_FORMERR;
-		next_state = KNOT_STATE_FAIL;
-		goto finish;
+	/* Preprocessing (unless already done). */
+	int next_state = qdata->extra->prepared;
+	qdata->extra->prepared = KNOT_STATE_NOOP;
+	if (next_state == KNOT_STATE_NOOP) {
+		next_state = answer_prepare(pkt, ctx);
 	}
-
-	/* Preprocessing. */
-	if (prepare_answer(query, pkt, ctx) != KNOT_EOK) {
-		next_state = KNOT_STATE_FAIL;
+	if (next_state == KNOT_STATE_FAIL) {
 		goto finish;
 	}
 
@@ -544,6 +647,16 @@ static int process_query_out(knot_layer_t *ctx, knot_pkt_t *pkt)
 	PROCESS_BEGIN(plan, step, next_state, qdata);
 	PROCESS_BEGIN(zone_plan, step, next_state, qdata);
 
+	/* Try a cached answer. */
+	answer_cache_t *cache = answer_cache_find(qdata, plan, zone_plan);
+	if (next_state == KNOT_STATE_PRODUCE && cache != NULL) {
+		bool parse = has_end_steps(plan) || has_end_steps(zone_plan);
+		next_state = answer_cache_answer(cache, pkt, qdata, parse);
+		if (next_state == KNOT_STATE_FAIL) {
+			goto finish;
+		}
+	}
+
 	/* Answer based on qclass. */
 	if (next_state == KNOT_STATE_PRODUCE) {
 		switch (knot_pkt_qclass(pkt)) {
@@ -553,6 +666,9 @@ static int process_query_out(knot_layer_t *ctx, knot_pkt_t *pkt)
 		case KNOT_CLASS_ANY:
 		case KNOT_CLASS_IN:
 			next_state = query_internet(pkt, ctx);
+			if (next_state == KNOT_STATE_DONE && cache != NULL) {
+				answer_cache_store(cache, pkt, qdata);
+			}
 			break;
 		default:
 			qdata->rcode = KNOT_RCODE_REFUSED;
@@ -629,9 +745,17 @@ bool process_query_acl_check(conf_t *conf, acl_action_t action,
 		tsig.algorithm = knot_tsig_rdata_alg(query->tsig_rr);
 	}
 
-	/* Check if authenticated. */
-	conf_val_t acl = conf_zone_get(conf, C_ACL, zone_name);
-	if (!acl_allowed(conf, &acl, action, query_source, &tsig, zone_name, query)) {
+	/* Check if authenticated, preferably with the compiled zone ACL. */
+	bool allowed;
+	const acl_t *compiled = rcu_dereference(qdata->extra->zone->acl);
+	if (compiled != NULL) {
+		allowed = acl_match(compiled, action, query_source, &tsig, query);
+	} else {
+		conf_val_t acl = conf_zone_get(conf, C_ACL, zone_name);
+		allowed = acl_allowed(conf, &acl, action, query_source, &tsig,
+		                      zone_name, query);
+	}
+	if (!allowed) {
 		char addr_str[SOCKADDR_STRLEN] = { 0 };
 		sockaddr_tostr(addr_str, sizeof(addr_str), query_source);
 		const knot_lookup_t *act = knot_lookup_by_id((knot_lookup_t *)acl_actions,
@@ -897,6 +1021,7 @@ const knot_layer_api_t *process_query_layer(void)
 		.finish  = &process_query_finish,
 		.consume = &process_query_in,
 		.produce = &process_query_out,
+		.prepare = &process_query_prepare,
 	};
 	return &api;
 }
@@ -39,6 +39,9 @@ typedef struct knotd_qdata_extra {
 	knot_dname_storage_t orig_qname;
 	uint8_t cname_chain; /*!< Length of the CNAME chain so far. */
 
+	/* Result of the answer preparation done in advance (batch processing). */
+	int prepared;
+
 	/* Extensions. */
 	void *ext;
 	void (*ext_cleanup)(knotd_qdata_t *); /*!< Extensions cleanup callback. */
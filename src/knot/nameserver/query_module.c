@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "contrib/macros.h"
 #include "contrib/sockaddr.h"
 #include "libknot/attribute.h"
 #include "knot/common/log.h"
@@ -30,14 +31,14 @@
 #include "knot/nameserver/query_module.h"
 #include "knot/nameserver/process_query.h"
 
+/*! \brief Assumed CPU cache line size (thread blocks of counters alignment). */
+#define STATS_CACHE_LINE 64
+
+/* Counter values are modified only by the thread owning the block, the atomic
+ * store just prevents torn reads during the aggregation. */
 #ifdef HAVE_ATOMIC
- #define ATOMIC_ADD(dst, val) __atomic_add_fetch(&(dst), (val), __ATOMIC_RELAXED)
- #define ATOMIC_SUB(dst, val) __atomic_sub_fetch(&(dst), (val), __ATOMIC_RELAXED)
  #define ATOMIC_SET(dst, val) __atomic_store_n(&(dst), (val), __ATOMIC_RELAXED)
 #else
- #warning "Statistics data can be inaccurate if configured with multiple udp/tcp workers"
- #define ATOMIC_ADD(dst, val) ((dst) += (val))
- #define ATOMIC_SUB(dst, val) ((dst) -= (val))
  #define ATOMIC_SET(dst, val) ((dst) = (val))
 #endif
 
@@ -103,6 +104,21 @@ int query_plan_step(struct query_plan *plan, knotd_stage_t stage,
 	return KNOT_EOK;
 }
 
+bool query_plan_alters_answer(const struct query_plan *plan)
+{
+	if (plan == NULL) {
+		return false;
+	}
+
+	for (unsigned i = KNOTD_STAGE_PREANSWER; i < KNOTD_STAGE_END; ++i) {
+		if (!EMPTY_LIST(plan->stage[i])) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 _public_
 int knotd_mod_hook(knotd_mod_t *mod, knotd_stage_t stage, knotd_mod_hook_f hook)
 {
@@ -227,6 +243,15 @@ void knotd_mod_vlog(knotd_mod_t *mod, int priority, const char *fmt, va_list arg
 	#undef LOG_ARGS
 }
 
+/*! \brief Number of query processing threads, all thread ids are lower. */
+static unsigned stats_threads(knotd_mod_t *mod)
+{
+	conf_t *config = (mod->config != NULL) ? mod->config : conf();
+	size_t threads = config->cache.srv_udp_threads + config->cache.srv_tcp_threads;
+
+	return MAX(threads, 1);
+}
+
 _public_
 int knotd_mod_stats_add(knotd_mod_t *mod, const char *ctr_name, uint32_t idx_count,
                         knotd_mod_idx_to_str_f idx_to_str)
@@ -235,39 +260,47 @@ int knotd_mod_stats_add(knotd_mod_t *mod, const char *ctr_name, uint32_t idx_cou
 		return KNOT_EINVAL;
 	}
 
-	mod_ctr_t *stats = NULL;
-	if (mod->stats == NULL) {
-		assert(mod->stats_count == 0);
-		stats = malloc(sizeof(*stats));
-		if (stats == NULL) {
-			return KNOT_ENOMEM;
-		}
-		mod->stats = stats;
-	} else {
-		assert(mod->stats_count > 0);
-		size_t old_size = mod->stats_count * sizeof(*stats);
-		size_t new_size = old_size + sizeof(*stats);
-		stats = realloc(mod->stats, new_size);
-		if (stats == NULL) {
-			knotd_mod_stats_free(mod);
-			return KNOT_ENOMEM;
-		}
-		mod->stats = stats;
-		stats += mod->stats_count;
+	mod_ctr_t *stats = realloc(mod->stats_info,
+	                           (mod->stats_count + 1) * sizeof(*stats));
+	if (stats == NULL) {
+		knotd_mod_stats_free(mod);
+		return KNOT_ENOMEM;
 	}
+	mod->stats_info = stats;
 
-	if (idx_count == 1) {
-		stats->counter = 0;
-	} else {
-		size_t size = idx_count * sizeof(((mod_ctr_t *)0)->counter);
-		stats->counters = calloc(1, size);
-		if (stats->counters == NULL) {
+	if (mod->stats_vals == NULL) {
+		mod->stats_threads = stats_threads(mod);
+	}
+
+	/* Resize the thread blocks, each padded to whole cache lines. */
+	uint32_t offset = 0;
+	if (mod->stats_count > 0) {
+		mod_ctr_t *last = &stats[mod->stats_count - 1];
+		offset = last->offset + last->count;
+	}
+	const size_t line_vals = STATS_CACHE_LINE / sizeof(uint64_t);
+	uint32_t stride = (offset + idx_count + line_vals - 1) / line_vals * line_vals;
+	if (stride != mod->stats_stride) {
+		uint64_t *vals = NULL;
+		size_t size = mod->stats_threads * stride * sizeof(*vals);
+		if (posix_memalign((void **)&vals, STATS_CACHE_LINE, size) != 0) {
 			knotd_mod_stats_free(mod);
 			return KNOT_ENOMEM;
 		}
-		stats->idx_to_str = idx_to_str;
+		memset(vals, 0, size);
+		for (unsigned i = 0; i < mod->stats_threads && mod->stats_vals != NULL; i++) {
+			memcpy(vals + i * stride, mod->stats_vals + i * mod->stats_stride,
+			       offset * sizeof(*vals));
+		}
+		free(mod->stats_vals);
+		mod->stats_vals = vals;
+		mod->stats_stride = stride;
 	}
+
+	stats += mod->stats_count;
 	stats->name = ctr_name;
+	stats->idx_to_str = (idx_count > 1) ? idx_to_str : NULL;
+	stats->offset = offset;
 	stats->count = idx_count;
 
 	mod->stats_count++;
@@ -278,48 +311,61 @@ int knotd_mod_stats_add(knotd_mod_t *mod, const char *ctr_name, uint32_t idx_cou
 _public_
 void knotd_mod_stats_free(knotd_mod_t *mod)
 {
-	if (mod == NULL || mod->stats == NULL) {
+	if (mod == NULL) {
 		return;
 	}
 
-	for (int i = 0; i < mod->stats_count; i++) {
-		if (mod->stats[i].count > 1) {
-			free(mod->stats[i].counters);
-		}
+	free(mod->stats_info);
+	free(mod->stats_vals);
+	mod->stats_info = NULL;
+	mod->stats_vals = NULL;
+	mod->stats_count = 0;
+	mod->stats_stride = 0;
+}
+
+uint64_t mod_stats_get(const knotd_mod_t *mod, const mod_ctr_t *ctr, uint32_t idx)
+{
+	assert(mod && ctr && idx < ctr->count);
+
+	uint64_t sum = 0;
+	const uint64_t *val = mod->stats_vals + ctr->offset + idx;
+	for (unsigned i = 0; i < mod->stats_threads; i++, val += mod->stats_stride) {
+		sum += ATOMIC_GET(*val);
 	}
 
-	free(mod->stats);
+	return sum;
 }
 
 #define STATS_BODY(OPERATION) { \
-	if (mod == NULL) return; \
+	if (mod == NULL || mod->stats_vals == NULL) return; \
 	\
-	mod_ctr_t *ctr = mod->stats + ctr_id; \
-	if (ctr->count == 1) { \
-		assert(idx == 0); \
-		OPERATION(ctr->counter, val); \
-	} else { \
-		assert(idx < ctr->count); \
-		OPERATION(ctr->counters[idx], val); \
-	} \
+	mod_ctr_t *ctr = mod->stats_info + ctr_id; \
+	assert(thread_id < mod->stats_threads); \
+	assert(idx < ctr->count); \
+	uint64_t *counter = mod->stats_vals + thread_id * mod->stats_stride + \
+	                    ctr->offset + idx; \
+	ATOMIC_SET(*counter, OPERATION); \
 }
 
 _public_
-void knotd_mod_stats_incr(knotd_mod_t *mod, uint32_t ctr_id, uint32_t idx, uint64_t val)
+void knotd_mod_stats_incr(knotd_mod_t *mod, unsigned thread_id, uint32_t ctr_id,
+                          uint32_t idx, uint64_t val)
 {
-	STATS_BODY(ATOMIC_ADD)
+	STATS_BODY(*counter + val)
 }
 
 _public_
-void knotd_mod_stats_decr(knotd_mod_t *mod, uint32_t ctr_id, uint32_t idx, uint64_t val)
+void knotd_mod_stats_decr(knotd_mod_t *mod, unsigned thread_id, uint32_t ctr_id,
+                          uint32_t idx, uint64_t val)
 {
-	STATS_BODY(ATOMIC_SUB)
+	STATS_BODY(*counter - val)
 }
 
 _public_
-void knotd_mod_stats_store(knotd_mod_t *mod, uint32_t ctr_id, uint32_t idx, uint64_t val)
+void knotd_mod_stats_store(knotd_mod_t *mod, unsigned thread_id, uint32_t ctr_id,
+                           uint32_t idx, uint64_t val)
 {
-	STATS_BODY(ATOMIC_SET)
+	STATS_BODY(val)
 }
 
 _public_
@@ -348,6 +394,9 @@ knotd_conf_t knotd_conf_env(knotd_mod_t *mod, knotd_conf_env_t env)
 	case KNOTD_CONF_ENV_WORKERS_TCP:
 		out.single.integer = config->cache.srv_tcp_threads;
 		break;
+	case KNOTD_CONF_ENV_THREADS:
+		out.single.integer = stats_threads(mod);
+		break;
 	default:
 		return out;
 	}
@@ -60,6 +60,9 @@ void query_plan_free(struct query_plan *plan);
 int query_plan_step(struct query_plan *plan, knotd_stage_t stage,
                     query_step_process_f process, void *ctx);
 
+/*! \brief Check if the plan contains steps processing the answer sections. */
+bool query_plan_alters_answer(const struct query_plan *plan);
+
 /*! \brief Open query module identified by name. */
 knotd_mod_t *query_module_open(conf_t *conf, server_t *server, conf_mod_id_t *mod_id,
                                struct query_plan *plan, const knot_dname_t *zone);
@@ -71,13 +74,8 @@ typedef char* (*mod_idx_to_str_f)(uint32_t idx, uint32_t count);
 
 typedef struct {
 	const char *name;
-	union {
-		uint64_t counter;
-		struct {
-			uint64_t *counters;
-			mod_idx_to_str_f idx_to_str;
-		};
-	};
+	mod_idx_to_str_f idx_to_str; // unused if count == 1
+	uint32_t offset; // offset of counters in a thread block of stats_vals
 	uint32_t count;
 } mod_ctr_t;
 
@@ -92,9 +90,15 @@ struct knotd_mod {
 	kdnssec_ctx_t *dnssec;
 	zone_keyset_t *keyset;
 	zone_sign_ctx_t *sign_ctx;
-	mod_ctr_t *stats;
+	mod_ctr_t *stats_info;
+	uint64_t *stats_vals; // per-thread blocks of counter values
 	uint32_t stats_count;
+	uint32_t stats_stride; // size of one (cache-line aligned) thread block
+	uint32_t stats_threads;
 	void *ctx;
 };
 
 void knotd_mod_stats_free(knotd_mod_t *mod);
+
+/*! \brief Get a (sub)counter value summed over all threads. */
+uint64_t mod_stats_get(const knotd_mod_t *mod, const mod_ctr_t *ctr, uint32_t idx);
@@ -55,6 +55,7 @@ struct knot_layer_api {
 	int (*finish)(knot_layer_t *ctx);
 	int (*consume)(knot_layer_t *ctx, knot_pkt_t *pkt);
 	int (*produce)(knot_layer_t *ctx, knot_pkt_t *pkt);
+	int (*prepare)(knot_layer_t *ctx, knot_pkt_t *pkt);
 };
 
 /*! \brief Helper for conditional layer call. */
@@ -133,3 +134,21 @@ inline static void knot_layer_produce(knot_layer_t *ctx, knot_pkt_t *pkt)
 {
 	LAYER_CALL(ctx, produce, pkt);
 }
+
+/*!
+ * \brief Prepare output generation in advance (optional).
+ *
+ * Allows processing a batch of packets in stages: all the packets are consumed
+ * first, then the output is prepared for each of them, and finally produced.
+ * Layers without this callback prepare the output within the produce call.
+ *
+ * \note Any state the preparation depends on (e.g. RCU protected data) must
+ *       be kept by the caller until the output is produced.
+ *
+ * \param ctx Layer context (must be in the produce state).
+ * \param pkt Data packet.
+ */
+inline static void knot_layer_prepare(knot_layer_t *ctx, knot_pkt_t *pkt)
+{
+	LAYER_CALL(ctx, prepare, pkt);
+}
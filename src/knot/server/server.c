@@ -18,6 +18,7 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <net/if.h>
 #include <netinet/tcp.h>
 
 #include "libknot/errcode.h"
@@ -32,11 +33,15 @@
 #include "knot/server/server.h"
 #include "knot/server/udp-handler.h"
 #include "knot/server/tcp-handler.h"
+#ifdef ENABLE_XDP
+#include "knot/server/xdp-socket.h"
+#endif
 #include "knot/zone/timers.h"
 #include "knot/zone/zonedb-load.h"
 #include "knot/worker/pool.h"
 #include "contrib/net.h"
 #include "contrib/sockaddr.h"
+#include "contrib/strtonum.h"
 #include "contrib/trim.h"
 
 /*! \brief Minimal send/receive buffer sizes. */
@@ -72,6 +77,20 @@ static void server_deinit_iface(iface_t *iface)
 		free(iface->fd_tcp);
 	}
 
+#ifdef ENABLE_XDP
+	/* Free XDP sockets and detach the program. */
+	if (iface->xdp_sockets != NULL) {
+		for (int i = 0; i < iface->xdp_socket_count; i++) {
+			xdp_socket_deinit(iface->xdp_sockets[i]);
+		}
+		free(iface->xdp_sockets);
+	}
+	if (iface->xdp_bpf != NULL) {
+		xdp_bpf_unload(iface->xdp_bpf);
+		free(iface->xdp_bpf);
+	}
+#endif
+
 	free(iface);
 }
 
@@ -188,6 +207,21 @@ static int enable_fastopen(int sock, int backlog)
 	return KNOT_EOK;
 }
 
+/*!
+ * \brief Enable busy polling of the device receive queue for the socket.
+ */
+static int enable_busy_poll(int sock, int timeout)
+{
+#if defined(SO_BUSY_POLL)
+	if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &timeout, sizeof(timeout)) != 0) {
+		return knot_map_errno();
+	}
+	return KNOT_EOK;
+#else
+	return KNOT_ENOTSUP;
+#endif
+}
+
 /*!
  * \brief Create and initialize new interface.
  *
@@ -197,13 +231,14 @@ static int enable_fastopen(int sock, int backlog)
  * \param udp_thread_count  Number of created UDP workers.
  * \param tcp_thread_count  Number of created TCP workers.
  * \param tcp_reuseport     Indication if reuseport on TCP is enabled.
+ * \param udp_busy_poll     Busy polling time for UDP sockets (microseconds).
  *
  * \retval Pointer to a new initialized inteface.
  * \retval NULL if error.
  */
 static iface_t *server_init_iface(struct sockaddr_storage *addr,
                                   int udp_thread_count, int tcp_thread_count,
-                                  bool tcp_reuseport)
+                                  bool tcp_reuseport, int udp_busy_poll)
 {
 	iface_t *new_if = calloc(1, sizeof(*new_if));
 	if (new_if == NULL) {
@@ -243,6 +278,7 @@ static iface_t *server_init_iface(struct sockaddr_storage *addr,
 	bool warn_bufsize = true;
 	bool warn_pktinfo = true;
 	bool warn_flag_misc = true;
+	bool warn_busy_poll = true;
 
 	/* Create bound UDP sockets. */
 	for (int i = 0; i < udp_socket_count; i++) {
@@ -282,6 +318,15 @@ static iface_t *server_init_iface(struct sockaddr_storage *addr,
 			warn_flag_misc = false;
 		}
 
+		if (udp_busy_poll > 0) {
+			ret = enable_busy_poll(sock, udp_busy_poll);
+			if (ret != KNOT_EOK && warn_busy_poll) {
+				log_warning("failed to enable busy polling for UDP (%s)",
+				            knot_strerror(ret));
+				warn_busy_poll = false;
+			}
+		}
+
 		new_if->fd_udp[new_if->fd_udp_count] = sock;
 		new_if->fd_udp_count += 1;
 	}
@@ -338,6 +383,86 @@ static iface_t *server_init_iface(struct sockaddr_storage *addr,
 	return new_if;
 }
 
+#ifdef ENABLE_XDP
+/*!
+ * \brief Create and initialize new XDP interface.
+ *
+ * The XDP program is attached to the interface and one AF_XDP socket
+ * is bound to each interface queue up to the number of UDP workers.
+ *
+ * \param spec              Interface specification (name[@port]).
+ * \param udp_thread_count  Number of created UDP workers.
+ *
+ * \retval Pointer to a new initialized inteface.
+ * \retval NULL if error.
+ */
+static iface_t *server_init_xdp_iface(const char *spec, int udp_thread_count)
+{
+	char ifname[IF_NAMESIZE] = { 0 };
+	uint16_t port = 53;
+
+	const char *sep = strchr(spec, '@');
+	size_t name_len = (sep != NULL) ? sep - spec : strlen(spec);
+	if (name_len == 0 || name_len >= sizeof(ifname) ||
+	    (sep != NULL && str_to_u16(sep + 1, &port) != KNOT_EOK)) {
+		log_error("invalid XDP interface '%s'", spec);
+		return NULL;
+	}
+	memcpy(ifname, spec, name_len);
+
+	iface_t *new_if = calloc(1, sizeof(*new_if));
+	if (new_if != NULL) {
+		new_if->xdp_bpf = calloc(1, sizeof(*new_if->xdp_bpf));
+		new_if->xdp_sockets = calloc(udp_thread_count, sizeof(*new_if->xdp_sockets));
+	}
+	if (new_if == NULL || new_if->xdp_bpf == NULL || new_if->xdp_sockets == NULL) {
+		log_error("failed to initialize XDP interface %s", ifname);
+		if (new_if != NULL) {
+			free(new_if->xdp_bpf);
+			new_if->xdp_bpf = NULL;
+			server_deinit_iface(new_if);
+		}
+		return NULL;
+	}
+
+	int ret = xdp_bpf_load(new_if->xdp_bpf, ifname, port, udp_thread_count);
+	if (ret != KNOT_EOK) {
+		log_error("failed to attach XDP program to %s (%s)", ifname,
+		          knot_strerror(ret));
+		free(new_if->xdp_bpf);
+		new_if->xdp_bpf = NULL;
+		server_deinit_iface(new_if);
+		return NULL;
+	}
+
+	/* Bind a socket to each queue, the interface may have fewer queues. */
+	for (int i = 0; i < udp_thread_count; i++) {
+		ret = xdp_socket_init(&new_if->xdp_sockets[i], ifname, i, new_if->xdp_bpf);
+		if (ret != KNOT_EOK) {
+			break;
+		}
+		new_if->xdp_socket_count += 1;
+	}
+
+	if (new_if->xdp_socket_count == 0) {
+		log_error("failed to create XDP socket on %s (%s)", ifname,
+		          knot_strerror(ret));
+		server_deinit_iface(new_if);
+		return NULL;
+	} else if (new_if->xdp_socket_count < udp_thread_count) {
+		log_warning("XDP interface %s, only %u of %u UDP workers have a queue (%s)",
+		            ifname, new_if->xdp_socket_count, udp_thread_count,
+		            knot_strerror(ret));
+	}
+
+	log_info("XDP interface %s port %u, %s mode, %u queues", ifname, port,
+	         new_if->xdp_bpf->generic ? "generic" : "native",
+	         new_if->xdp_socket_count);
+
+	return new_if;
+}
+#endif /* ENABLE_XDP */
+
 /*! \brief Initialize bound sockets according to configuration. */
 static int configure_sockets(conf_t *conf, server_t *s)
 {
@@ -372,7 +497,9 @@ static int configure_sockets(conf_t *conf, server_t *s)
 		unsigned size_udp = s->handlers[IO_UDP].handler.unit->size;
 		unsigned size_tcp = s->handlers[IO_TCP].handler.unit->size;
 		bool tcp_reuseport = conf->cache.srv_tcp_reuseport;
-		iface_t *new_if = server_init_iface(&addr, size_udp, size_tcp, tcp_reuseport);
+		int udp_busy_poll = conf->cache.srv_udp_busy_poll;
+		iface_t *new_if = server_init_iface(&addr, size_udp, size_tcp,
+		                                    tcp_reuseport, udp_busy_poll);
 		if (new_if != NULL) {
 			add_tail(newlist, &new_if->n);
 		}
@@ -381,10 +508,32 @@ static int configure_sockets(conf_t *conf, server_t *s)
 	}
 	free(rundir);
 
+	/* Attach to XDP interfaces. */
+	conf_val_t xdp_val = conf_get(conf, C_SRV, C_LISTEN_XDP);
+#ifdef ENABLE_XDP
+	while (xdp_val.code == KNOT_EOK) {
+		const char *spec = conf_str(&xdp_val);
+		log_info("binding to XDP interface %s", spec);
+
+		unsigned size_udp = s->handlers[IO_UDP].handler.unit->size;
+		iface_t *new_if = server_init_xdp_iface(spec, size_udp);
+		if (new_if != NULL) {
+			add_tail(newlist, &new_if->n);
+		}
+
+		conf_val_next(&xdp_val);
+	}
+#else
+	if (xdp_val.code == KNOT_EOK) {
+		log_warning("XDP not supported, ignoring listen-xdp");
+	}
+#endif
+
 	/* Publish new list. */
 	s->ifaces = newlist;
 
-	/* Set the ID's (thread_id) of both the TCP and UDP threads. */
+	/* Set the ID's (thread_id) of both the TCP and UDP threads. Modules
+	 * size their per-thread data by KNOTD_CONF_ENV_THREADS accordingly. */
 	unsigned thread_count = 0;
 	for (unsigned proto = IO_UDP; proto <= IO_TCP; ++proto) {
 		dt_unit_t *tu = s->handlers[proto].handler.unit;
@@ -623,7 +772,13 @@ static bool listen_changed(conf_t *conf, server_t *server)
 
 	conf_val_t listen_val = conf_get(conf, C_SRV, C_LISTEN);
 	size_t new_count = conf_val_count(&listen_val);
-	size_t old_count = list_size(server->ifaces);
+	size_t old_count = 0;
+	iface_t *iface;
+	WALK_LIST(iface, *server->ifaces) {
+		if (iface->xdp_sockets == NULL) {
+			old_count++;
+		}
+	}
 	if (new_count != old_count) {
 		return true;
 	}
@@ -636,9 +791,9 @@ static bool listen_changed(conf_t *conf, server_t *server)
 	while (listen_val.code == KNOT_EOK) {
 		struct sockaddr_storage addr = conf_addr(&listen_val, rundir);
 		bool found = false;
-		iface_t *iface;
 		WALK_LIST(iface, *server->ifaces) {
-			if (sockaddr_cmp(&addr, &iface->addr, false) == 0) {
+			if (iface->xdp_sockets == NULL &&
+			    sockaddr_cmp(&addr, &iface->addr, false) == 0) {
 				matches++;
 				found = true;
 				break;
@@ -751,6 +906,9 @@ int server_reload(server_t *server)
 	}
 	if (full || (flags & (CONF_IO_FRLD_ZONES | CONF_IO_FRLD_ZONE))) {
 		server_update_zones(conf(), server);
+	} else {
+		/* Referenced ACL or key items might have changed. */
+		zonedb_reload_acl(conf(), server->zone_db);
 	}
 
 	/* Free old config needed for module unload in zone reload. */
@@ -913,12 +1071,13 @@ void server_update_zones(conf_t *conf, server_t *server)
 	/* Reload zone database and free old zones. */
 	zonedb_reload(conf, server);
 
+	/* Compile ACLs of the new and reused zones. */
+	zonedb_reload_acl(conf, server->zone_db);
+
 	/* Trim extra heap. */
 	mem_trim();
 
 	/* Resume processing events on new zones. */
 	evsched_resume(&server->sched);
-	if (server->zone_db) {
-		knot_zonedb_foreach(server->zone_db, zone_events_start);
-	}
+	zonedb_start(conf, server->zone_db);
 }
@@ -49,6 +49,9 @@ typedef enum {
 
 /*!
  * \brief Server interface structure.
+ *
+ * An XDP interface has no UDP/TCP sockets, but one AF_XDP socket per UDP
+ * thread (interface queue) instead.
  */
 typedef struct iface {
 	struct node n;
@@ -56,6 +59,9 @@ typedef struct iface {
 	int fd_udp_count;
 	int *fd_tcp;
 	int fd_tcp_count;
+	struct xdp_socket **xdp_sockets;
+	int xdp_socket_count;
+	struct xdp_bpf *xdp_bpf;
 	struct sockaddr_storage addr;
 } iface_t;
 
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -34,6 +34,7 @@
 #include "knot/common/log.h"
 #include "knot/nameserver/process_query.h"
 #include "knot/query/layer.h"
+#include "libknot/wire.h"
 #include "contrib/macros.h"
 #include "contrib/mempattern.h"
 #include "contrib/net.h"
@@ -41,6 +42,30 @@
 #include "contrib/time.h"
 #include "contrib/ucw/mempool.h"
 
+/*! \brief Maximum size of a length-prefixed DNS message. */
+#define TCP_MSG_MAX (sizeof(uint16_t) + KNOT_WIRE_MAX_PKTSIZE)
+
+/*! \brief Size of the worker TX buffer (answers sent in one batch). */
+#define TCP_TX_BATCH (4 * TCP_MSG_MAX)
+
+/*!
+ * \brief TCP connection state (stored in the fdset context).
+ *
+ * Unprocessed input (a partial message or queries postponed due to a full
+ * socket send buffer) and unsent output are kept here between poll cycles.
+ * Both buffers are allocated only when needed, so idle connections don't
+ * occupy any extra memory.
+ */
+typedef struct {
+	struct sockaddr_storage remote;  /*!< Peer address. */
+	struct sockaddr_storage local;   /*!< Local address. */
+	uint8_t *rx;                     /*!< Unprocessed received data. */
+	size_t rx_len;                   /*!< Length of the unprocessed data. */
+	uint8_t *tx;                     /*!< Unsent answers. */
+	size_t tx_len;                   /*!< Length of the unsent data. */
+	size_t tx_off;                   /*!< Offset of the unsent data. */
+} tcp_conn_t;
+
 /*! \brief TCP context data. */
 typedef struct tcp_context {
 	knot_layer_t layer;              /*!< Query processing layer. */
@@ -74,23 +99,32 @@ static void update_tcp_conf(tcp_context_t *tcp)
 	rcu_read_unlock();
 }
 
+static void tcp_conn_free(tcp_conn_t *conn)
+{
+	if (conn != NULL) {
+		free(conn->rx);
+		free(conn->tx);
+		free(conn);
+	}
+}
+
 /*! \brief Sweep TCP connection. */
 static enum fdset_sweep_state tcp_sweep(fdset_t *set, int i, void *data)
 {
 	UNUSED(data);
 	assert(set && i < set->n && i >= 0);
-	int fd = set->pfd[i].fd;
+	int fd = fdset_get_fd(set, i);
+	tcp_conn_t *conn = fdset_get_ctx(set, i);
 
 	/* Best-effort, name and shame. */
-	struct sockaddr_storage ss;
-	socklen_t len = sizeof(struct sockaddr_storage);
-	if (getpeername(fd, (struct sockaddr*)&ss, &len) == 0) {
+	if (conn != NULL) {
 		char addr_str[SOCKADDR_STRLEN] = {0};
-		sockaddr_tostr(addr_str, sizeof(addr_str), &ss);
+		sockaddr_tostr(addr_str, sizeof(addr_str), &conn->remote);
 		log_notice("TCP, terminated inactive client, address %s", addr_str);
 	}
 
 	close(fd);
+	tcp_conn_free(conn);
 
 	return FDSET_SWEEP;
 }
@@ -130,9 +164,11 @@ static unsigned tcp_set_ifaces(const list_t *ifaces, fdset_t *fds, int thread_id
 		return 0;
 	}
 
-	fdset_clear(fds);
 	iface_t *i;
 	WALK_LIST(i, *ifaces) {
+		if (i->fd_tcp_count == 0) { // Ignore XDP interfaces.
+			continue;
+		}
 		int tcp_id = 0;
 #ifdef ENABLE_REUSEPORT
 		if (conf()->cache.srv_tcp_reuseport) {
@@ -149,41 +185,101 @@ static unsigned tcp_set_ifaces(const list_t *ifaces, fdset_t *fds, int thread_id
 	return fds->n;
 }
 
-static int tcp_handle(tcp_context_t *tcp, int fd, struct iovec *rx, struct iovec *tx)
+/*!
+ * \brief Send as much of the data as possible without blocking.
+ *
+ * The unsent rest is stored in the connection TX buffer.
+ *
+ * \retval KNOT_EOK     All data sent.
+ * \retval KNOT_EAGAIN  Some data postponed until the socket is writable.
+ * \retval KNOT_E*      Connection failure.
+ */
+static int tcp_send_nonblock(int fd, tcp_conn_t *conn, const uint8_t *data, size_t len)
 {
-	/* Get peer name. */
-	struct sockaddr_storage ss;
-	socklen_t addrlen = sizeof(struct sockaddr_storage);
-	if (getpeername(fd, (struct sockaddr *)&ss, &addrlen) != 0) {
-		return KNOT_EADDRNOTAVAIL;
+	assert(conn->tx_len == 0);
+
+	size_t sent = 0;
+	while (sent < len) {
+		ssize_t ret = send(fd, data + sent, len - sent, MSG_NOSIGNAL);
+		if (ret > 0) {
+			sent += ret;
+		} else if (ret == -1 && errno == EINTR) {
+			continue;
+		} else if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		} else {
+			return KNOT_ECONN;
+		}
+	}
+
+	if (sent == len) {
+		return KNOT_EOK;
+	}
+
+	conn->tx = malloc(len - sent);
+	if (conn->tx == NULL) {
+		return KNOT_ENOMEM;
 	}
+	memcpy(conn->tx, data + sent, len - sent);
+	conn->tx_len = len - sent;
+	conn->tx_off = 0;
 
+	return KNOT_EAGAIN;
+}
+
+/*!
+ * \brief Send postponed answers of a connection.
+ *
+ * \retval KNOT_EOK     All postponed data sent.
+ * \retval KNOT_EAGAIN  Socket is still not writable.
+ * \retval KNOT_E*      Connection failure.
+ */
+static int tcp_send_pending(int fd, tcp_conn_t *conn)
+{
+	while (conn->tx_len > 0) {
+		ssize_t ret = send(fd, conn->tx + conn->tx_off, conn->tx_len, MSG_NOSIGNAL);
+		if (ret > 0) {
+			conn->tx_off += ret;
+			conn->tx_len -= ret;
+		} else if (ret == -1 && errno == EINTR) {
+			continue;
+		} else if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return KNOT_EAGAIN;
+		} else {
+			return KNOT_ECONN;
+		}
+	}
+
+	free(conn->tx);
+	conn->tx = NULL;
+	conn->tx_off = 0;
+
+	return KNOT_EOK;
+}
+
+/*!
+ * \brief Answer one query, answers are appended to the worker TX buffer.
+ *
+ * Multi-message answers (e.g. zone transfers) not fitting into the TX buffer
+ * are sent out in a blocking way, limited by the TCP I/O timeout.
+ */
+static int tcp_handle(tcp_context_t *tcp, int fd, tcp_conn_t *conn,
+                      uint8_t *query_wire, size_t query_len, struct iovec *tx)
+{
 	/* Create query processing parameter. */
 	knotd_qdata_params_t params = {
-		.remote = &ss,
+		.remote = &conn->remote,
+		.local = &conn->local,
 		.socket = fd,
 		.server = tcp->server,
 		.thread_id = tcp->thread_id
 	};
 
-	rx->iov_len = KNOT_WIRE_MAX_PKTSIZE;
-	tx->iov_len = KNOT_WIRE_MAX_PKTSIZE;
-
-	/* Receive data. */
-	int recv = net_dns_tcp_recv(fd, rx->iov_base, rx->iov_len, tcp->io_timeout);
-	if (recv > 0) {
-		rx->iov_len = recv;
-	} else {
-		tcp_log_error(&ss, "receive", recv);
-		return KNOT_EOF;
-	}
-
 	/* Initialize processing layer. */
 	knot_layer_begin(&tcp->layer, &params);
 
-	/* Create packets. */
-	knot_pkt_t *ans = knot_pkt_new(tx->iov_base, tx->iov_len, tcp->layer.mm);
-	knot_pkt_t *query = knot_pkt_new(rx->iov_base, rx->iov_len, tcp->layer.mm);
+	/* Create query packet. */
+	knot_pkt_t *query = knot_pkt_new(query_wire, query_len, tcp->layer.mm);
 
 	/* Input packet. */
 	(void) knot_pkt_parse(query, 0);
@@ -193,15 +289,25 @@ static int tcp_handle(tcp_context_t *tcp, int fd, struct iovec *rx, struct iovec
 
 	/* Resolve until NOOP or finished. */
 	while (tcp_active_state(tcp->layer.state)) {
-		knot_layer_produce(&tcp->layer, ans);
-		/* Send, if response generation passed and wasn't ignored. */
-		if (ans->size > 0 && tcp_send_state(tcp->layer.state)) {
-			int sent = net_dns_tcp_send(fd, ans->wire, ans->size, tcp->io_timeout);
-			if (sent != ans->size) {
-				tcp_log_error(&ss, "send", sent);
+		/* Flush the batch if there is not enough space for another answer. */
+		if (tx->iov_len + TCP_MSG_MAX > TCP_TX_BATCH) {
+			int sent = net_stream_send(fd, tx->iov_base, tx->iov_len, tcp->io_timeout);
+			if (sent != tx->iov_len) {
+				tcp_log_error(&conn->remote, "send", sent);
 				ret = KNOT_EOF;
 				break;
 			}
+			tx->iov_len = 0;
+		}
+
+		uint8_t *wire = (uint8_t *)tx->iov_base + tx->iov_len;
+		knot_pkt_t *ans = knot_pkt_new(wire + sizeof(uint16_t),
+		                               KNOT_WIRE_MAX_PKTSIZE, tcp->layer.mm);
+		knot_layer_produce(&tcp->layer, ans);
+		/* Queue, if response generation passed and wasn't ignored. */
+		if (ans->size > 0 && tcp_send_state(tcp->layer.state)) {
+			knot_wire_write_u16(wire, ans->size);
+			tx->iov_len += sizeof(uint16_t) + ans->size;
 		}
 	}
 
@@ -214,34 +320,179 @@ static int tcp_handle(tcp_context_t *tcp, int fd, struct iovec *rx, struct iovec
 	return ret;
 }
 
+/*!
+ * \brief Answer all complete queries in the input buffer.
+ *
+ * Processing stops if the socket isn't able to take more answers, remaining
+ * input is kept in the connection for later processing.
+ */
+static int tcp_process(tcp_context_t *tcp, int fd, tcp_conn_t *conn,
+                       uint8_t *data, size_t len)
+{
+	struct iovec *tx = &tcp->iov[1];
+	tx->iov_len = 0;
+
+	int ret = KNOT_EOK;
+	size_t off = 0;
+	while (len - off >= sizeof(uint16_t)) {
+		size_t msg_len = knot_wire_read_u16(data + off);
+		if (msg_len == 0) {
+			ret = KNOT_EMALF;
+			break;
+		}
+		if (len - off - sizeof(uint16_t) < msg_len) {
+			break; // Incomplete message.
+		}
+
+		ret = tcp_handle(tcp, fd, conn, data + off + sizeof(uint16_t),
+		                 msg_len, tx);
+		off += sizeof(uint16_t) + msg_len;
+		if (ret != KNOT_EOK) {
+			break;
+		}
+
+		/* Stop reading queries if the socket is congested. */
+		if (tx->iov_len + TCP_MSG_MAX > TCP_TX_BATCH) {
+			ret = tcp_send_nonblock(fd, conn, tx->iov_base, tx->iov_len);
+			tx->iov_len = 0;
+			if (ret != KNOT_EOK) {
+				break;
+			}
+		}
+	}
+
+	/* Send the rest of the batch. */
+	if (tx->iov_len > 0 && (ret == KNOT_EOK || ret == KNOT_EMALF)) {
+		int send_ret = tcp_send_nonblock(fd, conn, tx->iov_base, tx->iov_len);
+		if (ret == KNOT_EOK) {
+			ret = send_ret;
+		}
+	}
+	if (ret != KNOT_EOK && ret != KNOT_EAGAIN) {
+		return ret;
+	}
+
+	/* Keep the unprocessed input. */
+	size_t rest = len - off;
+	if (rest > 0 && data + off != conn->rx) {
+		uint8_t *rx = malloc(rest);
+		if (rx == NULL) {
+			return KNOT_ENOMEM;
+		}
+		memcpy(rx, data + off, rest);
+		free(conn->rx);
+		conn->rx = rx;
+	} else if (rest == 0) {
+		free(conn->rx);
+		conn->rx = NULL;
+	}
+	conn->rx_len = rest;
+
+	return ret;
+}
+
 static void tcp_event_accept(tcp_context_t *tcp, unsigned i)
 {
+	tcp_conn_t *conn = calloc(1, sizeof(*conn));
+	if (conn == NULL) {
+		return;
+	}
+
 	/* Accept client. */
-	int fd = tcp->set.pfd[i].fd;
-	int client = net_accept(fd, NULL);
+	int fd = fdset_get_fd(&tcp->set, i);
+	int client = net_accept(fd, &conn->remote);
 	if (client >= 0) {
+		/* Get the local address once for all the queries. */
+		socklen_t local_len = sizeof(conn->local);
+		if (getsockname(client, (struct sockaddr *)&conn->local, &local_len) != 0) {
+			close(client);
+			tcp_conn_free(conn);
+			return;
+		}
+
 		/* Assign to fdset. */
-		int next_id = fdset_add(&tcp->set, client, POLLIN, NULL);
+		int next_id = fdset_add(&tcp->set, client, POLLIN, conn);
 		if (next_id < 0) {
 			close(client);
+			tcp_conn_free(conn);
 			return;
 		}
 
 		/* Update watchdog timer. */
 		fdset_set_watchdog(&tcp->set, next_id, tcp->idle_timeout);
+	} else {
+		tcp_conn_free(conn);
 	}
 }
 
+/*!
+ * \brief Update watched events and the watchdog according to connection state.
+ *
+ * Partially received queries and postponed answers are subject to the I/O
+ * timeout instead of the idle timeout.
+ */
+static void tcp_conn_update(tcp_context_t *tcp, unsigned i, tcp_conn_t *conn)
+{
+	fdset_t *set = &tcp->set;
+
+	(void)fdset_set_events(set, i, (conn->tx_len > 0) ? POLLOUT : POLLIN);
+
+	int timeout = tcp->idle_timeout;
+	if ((conn->rx_len > 0 || conn->tx_len > 0) && tcp->io_timeout > 0) {
+		timeout = MAX(1, tcp->io_timeout / 1000);
+	}
+	fdset_set_watchdog(set, i, timeout);
+}
+
 static int tcp_event_serve(tcp_context_t *tcp, unsigned i)
 {
-	int fd = tcp->set.pfd[i].fd;
-	int ret = tcp_handle(tcp, fd, &tcp->iov[0], &tcp->iov[1]);
-	if (ret == KNOT_EOK) {
-		/* Update socket activity timer. */
-		fdset_set_watchdog(&tcp->set, i, tcp->idle_timeout);
+	int fd = fdset_get_fd(&tcp->set, i);
+	tcp_conn_t *conn = fdset_get_ctx(&tcp->set, i);
+	struct iovec *rx = &tcp->iov[0];
+
+	/* Prepend the unprocessed input and receive more data. */
+	assert(conn->rx_len < rx->iov_len);
+	uint8_t *data = rx->iov_base;
+	if (conn->rx_len > 0) {
+		memcpy(data, conn->rx, conn->rx_len);
+	}
+	int recv = net_stream_recv(fd, data + conn->rx_len, rx->iov_len - conn->rx_len, 0);
+	if (recv == KNOT_ETIMEOUT) {
+		return KNOT_EOK; // Nothing to read.
+	} else if (recv <= 0) {
+		tcp_log_error(&conn->remote, "receive", recv);
+		return KNOT_EOF;
 	}
 
-	return ret;
+	int ret = tcp_process(tcp, fd, conn, data, conn->rx_len + recv);
+	if (ret != KNOT_EOK && ret != KNOT_EAGAIN) {
+		return ret;
+	}
+
+	/* Update socket activity timer and watched events. */
+	tcp_conn_update(tcp, i, conn);
+
+	return KNOT_EOK;
+}
+
+static int tcp_event_send(tcp_context_t *tcp, unsigned i)
+{
+	int fd = fdset_get_fd(&tcp->set, i);
+	tcp_conn_t *conn = fdset_get_ctx(&tcp->set, i);
+
+	int ret = tcp_send_pending(fd, conn);
+	if (ret == KNOT_EOK && conn->rx_len > 0) {
+		/* Continue with the postponed queries. */
+		ret = tcp_process(tcp, fd, conn, conn->rx, conn->rx_len);
+	}
+	if (ret != KNOT_EOK && ret != KNOT_EAGAIN) {
+		return ret;
+	}
+
+	/* Update socket activity timer and watched events. */
+	tcp_conn_update(tcp, i, conn);
+
+	return KNOT_EOK;
 }
 
 static void tcp_wait_for_events(tcp_context_t *tcp)
@@ -253,21 +504,22 @@ static void tcp_wait_for_events(tcp_context_t *tcp)
 	tcp->is_throttled = set->n == tcp->max_worker_fds;
 
 	/* If throttled, temporarily ignore new TCP connections. */
-	unsigned i = tcp->is_throttled ? tcp->client_threshold : 0;
+	unsigned offset = tcp->is_throttled ? tcp->client_threshold : 0;
 
 	/* Wait for events. */
-	int nfds = poll(&(set->pfd[i]), set->n - i, TCP_SWEEP_INTERVAL * 1000);
+	fdset_it_t it;
+	(void)fdset_poll(set, &it, offset, TCP_SWEEP_INTERVAL * 1000);
 
 	/* Mark the time of last poll call. */
 	tcp->last_poll_time = time_now();
 
 	/* Process events. */
-	while (nfds > 0 && i < set->n) {
+	for (; !fdset_it_is_done(&it); fdset_it_next(&it)) {
 		bool should_close = false;
-		if (set->pfd[i].revents & (POLLERR|POLLHUP|POLLNVAL)) {
+		unsigned i = fdset_it_get_idx(&it);
+		if (fdset_it_is_error(&it)) {
 			should_close = (i >= tcp->client_threshold);
-			--nfds;
-		} else if (set->pfd[i].revents & (POLLIN)) {
+		} else if (fdset_it_is_pollin(&it)) {
 			/* Master sockets - new connection to accept. */
 			if (i < tcp->client_threshold) {
 				/* Don't accept more clients than configured. */
@@ -279,17 +531,22 @@ static void tcp_wait_for_events(tcp_context_t *tcp)
 			} else if (tcp_event_serve(tcp, i) != KNOT_EOK) {
 				should_close = true;
 			}
-			--nfds;
+		} else if (fdset_it_is_pollout(&it)) {
+			/* Client sockets - postponed answers can be sent. */
+			if (tcp_event_send(tcp, i) != KNOT_EOK) {
+				should_close = true;
+			}
 		}
 
 		/* Evaluate. */
 		if (should_close) {
-			close(set->pfd[i].fd);
-			fdset_remove(set, i);
-		} else {
-			++i;
+			int fd = fdset_get_fd(set, i);
+			tcp_conn_free(fdset_get_ctx(set, i));
+			fdset_it_remove(&it);
+			close(fd);
 		}
 	}
+	fdset_it_commit(&it);
 }
 
 int tcp_master(dthread_t *thread)
@@ -318,8 +575,9 @@ int tcp_master(dthread_t *thread)
 	fdset_init(&tcp.set, FDSET_INIT_SIZE);
 
 	/* Create iovec abstraction. */
+	const size_t iov_size[2] = { TCP_MSG_MAX, TCP_TX_BATCH };
 	for (unsigned i = 0; i < 2; ++i) {
-		tcp.iov[i].iov_len = KNOT_WIRE_MAX_PKTSIZE;
+		tcp.iov[i].iov_len = iov_size[i];
 		tcp.iov[i].iov_base = malloc(tcp.iov[i].iov_len);
 		if (tcp.iov[i].iov_base == NULL) {
 			ret = KNOT_ENOMEM;
@@ -356,6 +614,9 @@ int tcp_master(dthread_t *thread)
 	}
 
 finish:
+	for (unsigned i = tcp.client_threshold; i < tcp.set.n; ++i) {
+		tcp_conn_free(fdset_get_ctx(&tcp.set, i));
+	}
 	free(tcp.iov[0].iov_base);
 	free(tcp.iov[1].iov_base);
 	mp_delete(mm.ctx);
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -26,6 +26,7 @@
 #include <string.h>
 #include <assert.h>
 #include <sys/param.h>
+#include <urcu.h>
 #ifdef HAVE_SYS_UIO_H	// struct iovec (OpenBSD)
 #include <sys/uio.h>
 #endif /* HAVE_SYS_UIO_H */
@@ -33,11 +34,15 @@
 #include "contrib/macros.h"
 #include "contrib/mempattern.h"
 #include "contrib/sockaddr.h"
+#include "contrib/time.h"
 #include "contrib/ucw/mempool.h"
 #include "knot/nameserver/process_query.h"
 #include "knot/query/layer.h"
 #include "knot/server/server.h"
 #include "knot/server/udp-handler.h"
+#ifdef ENABLE_XDP
+#include "knot/server/xdp-socket.h"
+#endif
 
 /* Buffer identifiers. */
 enum {
@@ -46,68 +51,118 @@ enum {
 	NBUFS = 2
 };
 
+/*! \brief Maximal number of queries processed in one batch. */
+#define UDP_BATCH_MAX 32
+
+/*! \brief Maximal number of consecutive full batches read without polling. */
+#define UDP_DRAIN_MAX 16
+
 /*! \brief UDP context data. */
 typedef struct {
-	knot_layer_t layer; /*!< Query processing layer. */
+	knot_layer_t layers[UDP_BATCH_MAX]; /*!< Query processing layers. */
 	server_t *server;   /*!< Name server structure. */
 	unsigned thread_id; /*!< Thread identifier. */
+	const iface_t *iface; /*!< Interface of the processed messages. */
 } udp_context_t;
 
+/*! \brief One datagram of a batch. */
+typedef struct {
+	struct sockaddr_storage *remote; /*!< Remote address. */
+	struct sockaddr_storage *local;  /*!< Local address. */
+	struct iovec *rx;                /*!< Query buffer. */
+	struct iovec *tx;                /*!< Answer buffer, zero length if no answer. */
+} udp_msg_t;
+
 static bool udp_state_active(int state)
 {
 	return (state == KNOT_STATE_PRODUCE || state == KNOT_STATE_FAIL);
 }
 
-static void udp_handle(udp_context_t *udp, int fd, struct sockaddr_storage *ss,
-                       struct iovec *rx, struct iovec *tx)
+static void udp_handle_batch(udp_context_t *udp, int fd, udp_msg_t *msgs,
+                             unsigned count)
 {
-	/* Create query processing parameter. */
-	knotd_qdata_params_t params = {
-		.remote = ss,
-		.flags = KNOTD_QUERY_FLAG_NO_AXFR | KNOTD_QUERY_FLAG_NO_IXFR | /* No transfers. */
-		         KNOTD_QUERY_FLAG_LIMIT_SIZE | /* Enforce UDP packet size limit. */
-		         KNOTD_QUERY_FLAG_LIMIT_ANY,  /* Limit ANY over UDP (depends on zone as well). */
-		.socket = fd,
-		.server = udp->server,
-		.thread_id = udp->thread_id
-	};
+	assert(count <= UDP_BATCH_MAX);
+
+	knotd_qdata_params_t params[UDP_BATCH_MAX];
+	knot_pkt_t *ans[UDP_BATCH_MAX];
+
+	/* Parse all the queries first. */
+	for (unsigned i = 0; i < count; i++) {
+		knot_layer_t *layer = &udp->layers[i];
+
+		/* Create query processing parameter. */
+		params[i] = (knotd_qdata_params_t) {
+			.remote = msgs[i].remote,
+			.local = msgs[i].local,
+			.flags = KNOTD_QUERY_FLAG_NO_AXFR | KNOTD_QUERY_FLAG_NO_IXFR | /* No transfers. */
+			         KNOTD_QUERY_FLAG_LIMIT_SIZE | /* Enforce UDP packet size limit. */
+			         KNOTD_QUERY_FLAG_LIMIT_ANY,  /* Limit ANY over UDP (depends on zone as well). */
+			.socket = fd,
+			.server = udp->server,
+			.thread_id = udp->thread_id
+		};
+
+		/* Start query processing. */
+		knot_layer_begin(layer, &params[i]);
+
+		/* Create packets. */
+		knot_pkt_t *query = knot_pkt_new(msgs[i].rx->iov_base, msgs[i].rx->iov_len, layer->mm);
+		ans[i] = knot_pkt_new(msgs[i].tx->iov_base, msgs[i].tx->iov_len, layer->mm);
+
+		/* Input packet. */
+		(void) knot_pkt_parse(query, 0);
+		knot_layer_consume(layer, query);
+	}
 
-	/* Start query processing. */
-	knot_layer_begin(&udp->layer, &params);
+	/* Zones found for the batch stay valid until all the answers are done. */
+	rcu_read_lock();
 
-	/* Create packets. */
-	knot_pkt_t *query = knot_pkt_new(rx->iov_base, rx->iov_len, udp->layer.mm);
-	knot_pkt_t *ans = knot_pkt_new(tx->iov_base, tx->iov_len, udp->layer.mm);
+	/* Find zones for the whole batch. */
+	for (unsigned i = 0; i < count; i++) {
+		if (udp->layers[i].state == KNOT_STATE_PRODUCE) {
+			knot_layer_prepare(&udp->layers[i], ans[i]);
+		}
+	}
 
-	/* Input packet. */
-	(void) knot_pkt_parse(query, 0);
-	knot_layer_consume(&udp->layer, query);
+	/* Process answers. */
+	for (unsigned i = 0; i < count; i++) {
+		knot_layer_t *layer = &udp->layers[i];
+		while (udp_state_active(layer->state)) {
+			knot_layer_produce(layer, ans[i]);
+		}
 
-	/* Process answer. */
-	while (udp_state_active(udp->layer.state)) {
-		knot_layer_produce(&udp->layer, ans);
-	}
+		/* Send response only if finished successfully. */
+		if (layer->state == KNOT_STATE_DONE) {
+			msgs[i].tx->iov_len = ans[i]->size;
+		} else {
+			msgs[i].tx->iov_len = 0;
+		}
 
-	/* Send response only if finished successfully. */
-	if (udp->layer.state == KNOT_STATE_DONE) {
-		tx->iov_len = ans->size;
-	} else {
-		tx->iov_len = 0;
+		/* Reset after processing. */
+		knot_layer_finish(layer);
 	}
 
-	/* Reset after processing. */
-	knot_layer_finish(&udp->layer);
+	rcu_read_unlock();
+
+	/* Flush per-batch memory (including query and answer packets). */
+	mp_flush(udp->layers[0].mm->ctx);
+}
 
-	/* Flush per-query memory (including query and answer packets). */
-	mp_flush(udp->layer.mm->ctx);
+static void udp_handle(udp_context_t *udp, int fd, udp_msg_t *msgs, unsigned count)
+{
+	for (unsigned i = 0; i < count; i += UDP_BATCH_MAX) {
+		udp_handle_batch(udp, fd, msgs + i, MIN(count - i, UDP_BATCH_MAX));
+	}
 }
 
-/*! \brief Pointer to selected UDP master implementation. */
-static void* (*_udp_init)(void) = 0;
-static void (*_udp_deinit)(void *) = 0;
-static int (*_udp_recv)(int, void *) = 0;
-static int (*_udp_handle)(udp_context_t *, void *) = 0;
-static int (*_udp_send)(void *) = 0;
+/*! \brief UDP master implementation (socket API backend). */
+typedef struct {
+	void *(*udp_init)(void *, unsigned);
+	void (*udp_deinit)(void *);
+	int (*udp_recv)(int, void *);
+	int (*udp_handle)(udp_context_t *, void *);
+	int (*udp_send)(void *);
+} udp_api_t;
 
 /*! \brief Control message to fit IP_PKTINFO or IPv6_RECVPKTINFO. */
 typedef union {
@@ -143,18 +198,56 @@ static void udp_pktinfo_handle(const struct msghdr *rx, struct msghdr *tx)
 #endif
 }
 
+/*!
+ * \brief Get the local address of a received message.
+ *
+ * The address of a socket bound to a specific address is the interface
+ * address, the destination address from the packet information is used
+ * for sockets bound to the wildcard address.
+ */
+static void udp_pktinfo_local(const struct msghdr *rx, const iface_t *iface,
+                              struct sockaddr_storage *local)
+{
+	memcpy(local, &iface->addr, sizeof(*local));
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(rx);
+	if (cmsg == NULL) {
+		return;
+	}
+
+#if defined(IP_PKTINFO)
+	if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+		struct in_pktinfo *info = (struct in_pktinfo *)CMSG_DATA(cmsg);
+		((struct sockaddr_in *)local)->sin_addr = info->ipi_addr;
+	}
+#elif defined(IP_RECVDSTADDR)
+	if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVDSTADDR) {
+		struct in_addr *addr = (struct in_addr *)CMSG_DATA(cmsg);
+		((struct sockaddr_in *)local)->sin_addr = *addr;
+	}
+#endif
+	if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
+		struct in6_pktinfo *info = (struct in6_pktinfo *)CMSG_DATA(cmsg);
+		((struct sockaddr_in6 *)local)->sin6_addr = info->ipi6_addr;
+	}
+}
+
 /* UDP recvfrom() request struct. */
 struct udp_recvfrom {
 	int fd;
 	struct sockaddr_storage addr;
+	struct sockaddr_storage local;
 	struct msghdr msg[NBUFS];
 	struct iovec iov[NBUFS];
 	uint8_t buf[NBUFS][KNOT_WIRE_MAX_PKTSIZE];
 	cmsg_pktinfo_t pktinfo;
 };
 
-static void *udp_recvfrom_init(void)
+static void *udp_recvfrom_init(void *xdp_sock, unsigned batch)
 {
+	UNUSED(xdp_sock);
+	UNUSED(batch);
+
 	struct udp_recvfrom *rq = malloc(sizeof(struct udp_recvfrom));
 	if (rq == NULL) {
 		return NULL;
@@ -206,10 +299,12 @@ static int udp_recvfrom_handle(udp_context_t *ctx, void *d)
 	rq->msg[TX].msg_namelen = rq->msg[RX].msg_namelen;
 	rq->iov[TX].iov_len = KNOT_WIRE_MAX_PKTSIZE;
 
+	udp_pktinfo_local(&rq->msg[RX], ctx->iface, &rq->local);
 	udp_pktinfo_handle(&rq->msg[RX], &rq->msg[TX]);
 
 	/* Process received pkt. */
-	udp_handle(ctx, rq->fd, &rq->addr, &rq->iov[RX], &rq->iov[TX]);
+	udp_msg_t msg = { &rq->addr, &rq->local, &rq->iov[RX], &rq->iov[TX] };
+	udp_handle(ctx, rq->fd, &msg, 1);
 
 	return KNOT_EOK;
 }
@@ -235,31 +330,42 @@ static int udp_recvfrom_send(void *d)
 /* UDP recvmmsg() request struct. */
 struct udp_recvmmsg {
 	int fd;
-	struct sockaddr_storage addrs[RECVMMSG_BATCHLEN];
+	struct sockaddr_storage *addrs;
+	struct sockaddr_storage *locals;
 	char *iobuf[NBUFS];
 	struct iovec *iov[NBUFS];
 	struct mmsghdr *msgs[NBUFS];
+	udp_msg_t *pkts;
+	unsigned batch;
 	unsigned rcvd;
 	knot_mm_t mm;
-	cmsg_pktinfo_t pktinfo[RECVMMSG_BATCHLEN];
+	cmsg_pktinfo_t *pktinfo;
 };
 
-static void *udp_recvmmsg_init(void)
+static void *udp_recvmmsg_init(void *xdp_sock, unsigned batch)
 {
+	UNUSED(xdp_sock);
+
 	knot_mm_t mm;
 	mm_ctx_mempool(&mm, sizeof(struct udp_recvmmsg));
 
 	struct udp_recvmmsg *rq = mm_alloc(&mm, sizeof(struct udp_recvmmsg));
 	memset(rq, 0, sizeof(*rq));
 	memcpy(&rq->mm, &mm, sizeof(knot_mm_t));
+	rq->batch = batch;
+	rq->addrs = mm_alloc(&mm, sizeof(struct sockaddr_storage) * batch);
+	memset(rq->addrs, 0, sizeof(struct sockaddr_storage) * batch);
+	rq->locals = mm_alloc(&mm, sizeof(struct sockaddr_storage) * batch);
+	rq->pktinfo = mm_alloc(&mm, sizeof(cmsg_pktinfo_t) * batch);
+	rq->pkts = mm_alloc(&mm, sizeof(udp_msg_t) * batch);
 
 	/* Initialize buffers. */
 	for (unsigned i = 0; i < NBUFS; ++i) {
-		rq->iobuf[i] = mm_alloc(&mm, KNOT_WIRE_MAX_PKTSIZE * RECVMMSG_BATCHLEN);
-		rq->iov[i] = mm_alloc(&mm, sizeof(struct iovec) * RECVMMSG_BATCHLEN);
-		rq->msgs[i] = mm_alloc(&mm, sizeof(struct mmsghdr) * RECVMMSG_BATCHLEN);
-		memset(rq->msgs[i], 0, sizeof(struct mmsghdr) * RECVMMSG_BATCHLEN);
-		for (unsigned k = 0; k < RECVMMSG_BATCHLEN; ++k) {
+		rq->iobuf[i] = mm_alloc(&mm, KNOT_WIRE_MAX_PKTSIZE * batch);
+		rq->iov[i] = mm_alloc(&mm, sizeof(struct iovec) * batch);
+		rq->msgs[i] = mm_alloc(&mm, sizeof(struct mmsghdr) * batch);
+		memset(rq->msgs[i], 0, sizeof(struct mmsghdr) * batch);
+		for (unsigned k = 0; k < batch; ++k) {
 			rq->iov[i][k].iov_base = rq->iobuf[i] + k * KNOT_WIRE_MAX_PKTSIZE;
 			rq->iov[i][k].iov_len = KNOT_WIRE_MAX_PKTSIZE;
 			rq->msgs[i][k].msg_hdr.msg_iov = rq->iov[i] + k;
@@ -286,7 +392,7 @@ static int udp_recvmmsg_recv(int fd, void *d)
 {
 	struct udp_recvmmsg *rq = (struct udp_recvmmsg *)d;
 
-	int n = recvmmsg(fd, rq->msgs[RX], RECVMMSG_BATCHLEN, MSG_DONTWAIT, NULL);
+	int n = recvmmsg(fd, rq->msgs[RX], rq->batch, MSG_DONTWAIT, NULL);
 	if (n > 0) {
 		rq->fd = fd;
 		rq->rcvd = n;
@@ -297,16 +403,24 @@ static int udp_recvmmsg_recv(int fd, void *d)
 static int udp_recvmmsg_handle(udp_context_t *ctx, void *d)
 {
 	struct udp_recvmmsg *rq = (struct udp_recvmmsg *)d;
+	udp_msg_t *msgs = rq->pkts;
 
-	/* Handle each received msg. */
 	for (unsigned i = 0; i < rq->rcvd; ++i) {
 		struct iovec *rx = rq->msgs[RX][i].msg_hdr.msg_iov;
 		struct iovec *tx = rq->msgs[TX][i].msg_hdr.msg_iov;
 		rx->iov_len = rq->msgs[RX][i].msg_len; /* Received bytes. */
 
+		udp_pktinfo_local(&rq->msgs[RX][i].msg_hdr, ctx->iface, rq->locals + i);
 		udp_pktinfo_handle(&rq->msgs[RX][i].msg_hdr, &rq->msgs[TX][i].msg_hdr);
 
-		udp_handle(ctx, rq->fd, rq->addrs + i, rx, tx);
+		msgs[i] = (udp_msg_t) { rq->addrs + i, rq->locals + i, rx, tx };
+	}
+
+	/* Handle all received msgs at once. */
+	udp_handle(ctx, rq->fd, msgs, rq->rcvd);
+
+	for (unsigned i = 0; i < rq->rcvd; ++i) {
+		struct iovec *tx = msgs[i].tx;
 		rq->msgs[TX][i].msg_len = tx->iov_len;
 		rq->msgs[TX][i].msg_hdr.msg_namelen = 0;
 		if (tx->iov_len > 0) {
@@ -338,22 +452,109 @@ static int udp_recvmmsg_send(void *d)
 }
 #endif /* ENABLE_RECVMMSG */
 
+#ifdef ENABLE_XDP
+
+/* UDP AF_XDP request struct. */
+struct udp_xdp {
+	xdp_socket_t *sock;
+	xdp_msg_t msgs[NBUFS][XDP_BATCHLEN];
+	unsigned rcvd;
+	unsigned replies;
+};
+
+static void *udp_xdp_init(void *xdp_sock, unsigned batch)
+{
+	UNUSED(batch);
+
+	struct udp_xdp *rq = calloc(1, sizeof(struct udp_xdp));
+	if (rq == NULL) {
+		return NULL;
+	}
+	rq->sock = xdp_sock;
+
+	return rq;
+}
+
+static void udp_xdp_deinit(void *d)
+{
+	struct udp_xdp *rq = (struct udp_xdp *)d;
+	free(rq);
+}
+
+static int udp_xdp_recv(int fd, void *d)
+{
+	UNUSED(fd);
+
+	struct udp_xdp *rq = (struct udp_xdp *)d;
+	int ret = xdp_recv(rq->sock, rq->msgs[RX], XDP_BATCHLEN, &rq->rcvd);
+	if (ret != KNOT_EOK) {
+		rq->rcvd = 0;
+	}
+	return rq->rcvd;
+}
+
+static int udp_xdp_handle(udp_context_t *ctx, void *d)
+{
+	struct udp_xdp *rq = (struct udp_xdp *)d;
+	int fd = xdp_socket_fd(rq->sock);
+
+	udp_msg_t msgs[XDP_BATCHLEN];
+
+	/* Handle all received msgs, the rest is dropped if out of TX frames. */
+	for (rq->replies = 0; rq->replies < rq->rcvd; rq->replies++) {
+		xdp_msg_t *rx = &rq->msgs[RX][rq->replies];
+		xdp_msg_t *tx = &rq->msgs[TX][rq->replies];
+		if (xdp_reply_alloc(rq->sock, rx, tx) != KNOT_EOK) {
+			break;
+		}
+
+		msgs[rq->replies] = (udp_msg_t) { &rx->ip_from, &rx->ip_to, &rx->payload,
+		                                  &tx->payload };
+	}
+
+	udp_handle(ctx, fd, msgs, rq->replies);
+
+	return KNOT_EOK;
+}
+
+static int udp_xdp_send(void *d)
+{
+	struct udp_xdp *rq = (struct udp_xdp *)d;
+	unsigned sent = 0;
+	(void)xdp_send(rq->sock, rq->msgs[TX], rq->replies, &sent);
+	xdp_recv_finish(rq->sock, rq->msgs[RX], rq->rcvd);
+
+	return sent;
+}
+
+static const udp_api_t xdp_api = {
+	udp_xdp_init,
+	udp_xdp_deinit,
+	udp_xdp_recv,
+	udp_xdp_handle,
+	udp_xdp_send,
+};
+#endif /* ENABLE_XDP */
+
+/*! \brief Selected socket API backend. */
+static udp_api_t sock_api;
+
 /*! \brief Initialize UDP master routine on run-time. */
 void __attribute__ ((constructor)) udp_master_init(void)
 {
 	/* Initialize defaults. */
-	_udp_init =   udp_recvfrom_init;
-	_udp_deinit = udp_recvfrom_deinit;
-	_udp_recv =   udp_recvfrom_recv;
-	_udp_handle = udp_recvfrom_handle;
-	_udp_send =   udp_recvfrom_send;
+	sock_api.udp_init =   udp_recvfrom_init;
+	sock_api.udp_deinit = udp_recvfrom_deinit;
+	sock_api.udp_recv =   udp_recvfrom_recv;
+	sock_api.udp_handle = udp_recvfrom_handle;
+	sock_api.udp_send =   udp_recvfrom_send;
 
 #ifdef ENABLE_RECVMMSG
-	_udp_init =   udp_recvmmsg_init;
-	_udp_deinit = udp_recvmmsg_deinit;
-	_udp_recv =   udp_recvmmsg_recv;
-	_udp_handle = udp_recvmmsg_handle;
-	_udp_send =   udp_recvmmsg_send;
+	sock_api.udp_init =   udp_recvmmsg_init;
+	sock_api.udp_deinit = udp_recvmmsg_deinit;
+	sock_api.udp_recv =   udp_recvmmsg_recv;
+	sock_api.udp_handle = udp_recvmmsg_handle;
+	sock_api.udp_send =   udp_recvmmsg_send;
 #endif /* ENABLE_RECVMMSG */
 }
 
@@ -369,17 +570,31 @@ static int iface_udp_fd(const iface_t *iface, int thread_id)
 #endif
 }
 
+/*! \brief A watched descriptor with its backend and request context. */
+typedef struct {
+	const udp_api_t *api;
+	void *rq;
+	unsigned batch; /*!< Number of messages in a full batch. */
+	const iface_t *iface; /*!< Interface the descriptor belongs to. */
+} udp_source_t;
+
 /*!
  * \brief Make a set of watched descriptors based on the interface list.
  *
- * \param[in]   ifaces     Interface list.
- * \param[out]  fds_ptr    Allocated set of descriptors (a pointer to it).
- * \param[in]   thread_id  Thread ID.
+ * Regular UDP sockets share one request context, each AF_XDP socket (one per
+ * interface queue, the queue index equals the thread ID) has its own one.
+ *
+ * \param[in]   ifaces      Interface list.
+ * \param[out]  fds_ptr     Allocated set of descriptors (a pointer to it).
+ * \param[out]  srcs_ptr    Allocated set of descriptor sources.
+ * \param[in]   thread_id   Thread ID.
+ * \param[in]   batch       Batch size for regular UDP sockets.
  *
  * \return Number of watched descriptors, zero on error.
  */
 static unsigned udp_set_ifaces(const list_t *ifaces, struct pollfd **fds_ptr,
-                               int thread_id)
+                               udp_source_t **srcs_ptr, int thread_id,
+                               unsigned batch)
 {
 	if (ifaces == NULL) {
 		return 0;
@@ -387,22 +602,116 @@ static unsigned udp_set_ifaces(const list_t *ifaces, struct pollfd **fds_ptr,
 
 	unsigned nfds = list_size(ifaces);
 	struct pollfd *fds = calloc(nfds, sizeof(*fds));
-	if (fds == NULL) {
+	udp_source_t *srcs = calloc(nfds, sizeof(*srcs));
+	if (fds == NULL || srcs == NULL) {
+		free(fds);
+		free(srcs);
 		return 0;
 	}
 
+	void *sock_rq = NULL;
+
 	iface_t *iface;
-	int i = 0;
+	unsigned i = 0;
 	WALK_LIST(iface, *ifaces) {
-		fds[i].fd = iface_udp_fd(iface, thread_id);
+#ifdef ENABLE_XDP
+		if (iface->xdp_sockets != NULL) {
+			if (thread_id >= iface->xdp_socket_count ||
+			    iface->xdp_sockets[thread_id] == NULL) {
+				continue; // No queue for this thread.
+			}
+			xdp_socket_t *sock = iface->xdp_sockets[thread_id];
+			srcs[i].api = &xdp_api;
+			srcs[i].rq = xdp_api.udp_init(sock, XDP_BATCHLEN);
+			srcs[i].batch = XDP_BATCHLEN;
+			fds[i].fd = xdp_socket_fd(sock);
+		} else
+#endif
+		{
+			if (sock_rq == NULL) {
+				sock_rq = sock_api.udp_init(NULL, batch);
+			}
+			srcs[i].api = &sock_api;
+			srcs[i].rq = sock_rq;
+			srcs[i].batch = (sock_api.udp_init == udp_recvfrom_init) ? 1 : batch;
+			fds[i].fd = iface_udp_fd(iface, thread_id);
+		}
+		if (srcs[i].rq == NULL) {
+			continue;
+		}
+		srcs[i].iface = iface;
 		fds[i].events = POLLIN;
 		fds[i].revents = 0;
 		i += 1;
 	}
 
 	*fds_ptr = fds;
+	*srcs_ptr = srcs;
+
+	return i;
+}
+
+/*! \brief Release request contexts of the watched descriptors. */
+static void udp_unset_ifaces(udp_source_t *srcs, unsigned nfds)
+{
+	bool sock_freed = false;
+	for (unsigned i = 0; i < nfds; i++) {
+		if (srcs[i].api == &sock_api) {
+			if (sock_freed) {
+				continue;
+			}
+			sock_freed = true;
+		}
+		srcs[i].api->udp_deinit(srcs[i].rq);
+	}
+	free(srcs);
+}
+
+/*!
+ * \brief Receive and answer messages on a readable descriptor.
+ *
+ * Reading continues without polling while the batches come back full,
+ * which indicates more messages waiting in the socket. With busy polling,
+ * the descriptor is also read (without blocking) until no message arrives
+ * for the given time. Such reads poll the device receive queue if the
+ * SO_BUSY_POLL socket option is set. The other descriptors of the worker
+ * wait meanwhile, so the number of batches read at once stays bounded.
+ *
+ * \param udp   UDP context.
+ * \param src   Source of the readable descriptor.
+ * \param fd    Readable descriptor.
+ * \param spin  Time to keep reading the idle descriptor (microseconds).
+ */
+static void udp_drain(udp_context_t *udp, const udp_source_t *src, int fd,
+                      int spin)
+{
+	udp->iface = src->iface;
+	struct timespec last = { 0 };
+	if (spin > 0) {
+		last = time_now();
+	}
 
-	return nfds;
+	for (unsigned i = 0; i < UDP_DRAIN_MAX; ) {
+		int rcvd = src->api->udp_recv(fd, src->rq);
+		if (rcvd > 0) {
+			src->api->udp_handle(udp, src->rq);
+			src->api->udp_send(src->rq);
+			i++;
+			if ((unsigned)rcvd == src->batch) {
+				continue;
+			}
+		}
+		if (spin <= 0) {
+			break;
+		}
+
+		struct timespec now = time_now();
+		if (rcvd > 0) {
+			last = now;
+		} else if (time_diff_ms(&last, &now) * 1000 >= spin) {
+			break;
+		}
+	}
 }
 
 int udp_master(dthread_t *thread)
@@ -420,7 +729,6 @@ int udp_master(dthread_t *thread)
 	/* Prepare structures for bound sockets. */
 	unsigned thr_id = dt_get_id(thread);
 	iohandler_t *handler = (iohandler_t *)thread->data;
-	void *rq = _udp_init();
 
 	/* Create big enough memory cushion. */
 	knot_mm_t mm;
@@ -431,13 +739,18 @@ int udp_master(dthread_t *thread)
 		.server = handler->server,
 		.thread_id = handler->thread_id[thr_id]
 	};
-	knot_layer_init(&udp.layer, &mm, process_query_layer());
+	for (unsigned i = 0; i < UDP_BATCH_MAX; i++) {
+		knot_layer_init(&udp.layers[i], &mm, process_query_layer());
+	}
 
 	/* Event source. */
 	struct pollfd *fds = NULL;
+	udp_source_t *srcs = NULL;
 
 	/* Allocate descriptors for the configured interfaces. */
-	unsigned nfds = udp_set_ifaces(handler->server->ifaces, &fds, udp.thread_id);
+	unsigned nfds = udp_set_ifaces(handler->server->ifaces, &fds, &srcs,
+	                               udp.thread_id, conf()->cache.srv_udp_batch_size);
+	int busy_poll = conf()->cache.srv_udp_busy_poll;
 	if (nfds == 0) {
 		goto finish;
 	}
@@ -464,15 +777,14 @@ int udp_master(dthread_t *thread)
 				continue;
 			}
 			events -= 1;
-			if (_udp_recv(fds[i].fd, rq) > 0) {
-				_udp_handle(&udp, rq);
-				_udp_send(rq);
-			}
+			udp_drain(&udp, &srcs[i], fds[i].fd, busy_poll);
 		}
 	}
 
 finish:
-	_udp_deinit(rq);
+	if (srcs != NULL) {
+		udp_unset_ifaces(srcs, nfds);
+	}
 	free(fds);
 	mp_delete(mm.ctx);
 
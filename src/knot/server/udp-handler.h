@@ -26,7 +26,9 @@
 
 #include "knot/server/dthreads.h"
 
-#define RECVMMSG_BATCHLEN 10 /*!< Default recvmmsg() batch size. */
+#define RECVMMSG_BATCHLEN     10 /*!< Default recvmmsg() batch size. */
+#define RECVMMSG_BATCHLEN_MAX 64 /*!< Maximal recvmmsg() batch size. */
+#define UDP_BUSY_POLL_MAX   1000 /*!< Maximal busy polling time in microseconds. */
 
 /*!
  * \brief UDP handler thread runnable.
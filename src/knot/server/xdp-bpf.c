@@ -0,0 +1,292 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "libknot/errcode.h"
+#include "knot/server/xdp-bpf.h"
+
+/* BPF instruction encoding helpers (see linux/samples/bpf/bpf_insn.h). */
+#define INSN(c, d, s, o, i) \
+	((struct bpf_insn) { .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+#define MOV64_REG(d, s)       INSN(BPF_ALU64 | BPF_MOV | BPF_X, d, s, 0, 0)
+#define MOV64_IMM(d, i)       INSN(BPF_ALU64 | BPF_MOV | BPF_K, d, 0, 0, i)
+#define ADD64_IMM(d, i)       INSN(BPF_ALU64 | BPF_ADD | BPF_K, d, 0, 0, i)
+#define AND64_IMM(d, i)       INSN(BPF_ALU64 | BPF_AND | BPF_K, d, 0, 0, i)
+#define LDX_MEM(sz, d, s, o)  INSN(BPF_LDX | BPF_MEM | (sz), d, s, o, 0)
+#define JMP_REG(op, d, s, o)  INSN(BPF_JMP | (op) | BPF_X, d, s, o, 0)
+#define JMP_IMM(op, d, i, o)  INSN(BPF_JMP | (op) | BPF_K, d, 0, o, i)
+#define JMP_A(o)              INSN(BPF_JMP | BPF_JA, 0, 0, o, 0)
+#define LD_MAP_FD(d, fd)      INSN(BPF_LD | BPF_DW | BPF_IMM, d, BPF_PSEUDO_MAP_FD, 0, fd), \
+                              INSN(0, 0, 0, 0, 0)
+#define CALL(f)               INSN(BPF_JMP | BPF_CALL, 0, 0, 0, f)
+#define EXIT()                INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+/* Offsets within the Ethernet frame. */
+enum {
+	OFF_ETH_PROTO = 12,
+	OFF_IP4 = ETH_HLEN,
+	OFF_IP4_PROTO = OFF_IP4 + 9,
+	OFF_IP4_FRAG = OFF_IP4 + 6,
+	OFF_IP4_DPORT = OFF_IP4 + 20 + 2,
+	OFF_IP6_NEXT = ETH_HLEN + 6,
+	OFF_IP6_DPORT = ETH_HLEN + 40 + 2,
+	MIN_LEN_IP4 = ETH_HLEN + 20 + 8,
+	MIN_LEN_IP6 = ETH_HLEN + 40 + 8,
+};
+
+static int sys_bpf(enum bpf_cmd cmd, union bpf_attr *attr)
+{
+	int ret = syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+	return (ret < 0) ? knot_map_errno() : ret;
+}
+
+static int create_map(unsigned queues)
+{
+	union bpf_attr attr = {
+		.map_type = BPF_MAP_TYPE_XSKMAP,
+		.key_size = sizeof(uint32_t),
+		.value_size = sizeof(int),
+		.max_entries = queues,
+	};
+
+	return sys_bpf(BPF_MAP_CREATE, &attr);
+}
+
+static int load_prog(int map_fd, uint16_t port)
+{
+	/*
+	 * r6 = ctx, r2 = data, r3 = data_end, r4 = bound check, r5 = scratch.
+	 * Jump offsets are relative to the next instruction, all failed checks
+	 * jump to the final XDP_PASS.
+	 */
+	const struct bpf_insn prog[] = {
+		/*  0 */ MOV64_REG(BPF_REG_6, BPF_REG_1),
+		/*  1 */ LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, data)),
+		/*  2 */ LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_6, offsetof(struct xdp_md, data_end)),
+		/*  3 */ MOV64_REG(BPF_REG_4, BPF_REG_2),
+		/*  4 */ ADD64_IMM(BPF_REG_4, MIN_LEN_IP4),
+		/*  5 */ JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, 25),
+		/*  6 */ LDX_MEM(BPF_H, BPF_REG_5, BPF_REG_2, OFF_ETH_PROTO),
+		/*  7 */ JMP_IMM(BPF_JEQ, BPF_REG_5, htons(ETH_P_IPV6), 10),
+		/*  8 */ JMP_IMM(BPF_JNE, BPF_REG_5, htons(ETH_P_IP), 22),
+		/* IPv4 without options, not fragmented. */
+		/*  9 */ LDX_MEM(BPF_B, BPF_REG_5, BPF_REG_2, OFF_IP4),
+		/* 10 */ JMP_IMM(BPF_JNE, BPF_REG_5, 0x45, 20),
+		/* 11 */ LDX_MEM(BPF_B, BPF_REG_5, BPF_REG_2, OFF_IP4_PROTO),
+		/* 12 */ JMP_IMM(BPF_JNE, BPF_REG_5, IPPROTO_UDP, 18),
+		/* 13 */ LDX_MEM(BPF_H, BPF_REG_5, BPF_REG_2, OFF_IP4_FRAG),
+		/* 14 */ AND64_IMM(BPF_REG_5, htons(0x3fff)),
+		/* 15 */ JMP_IMM(BPF_JNE, BPF_REG_5, 0, 15),
+		/* 16 */ LDX_MEM(BPF_H, BPF_REG_5, BPF_REG_2, OFF_IP4_DPORT),
+		/* 17 */ JMP_A(6),
+		/* IPv6 without extension headers. */
+		/* 18 */ MOV64_REG(BPF_REG_4, BPF_REG_2),
+		/* 19 */ ADD64_IMM(BPF_REG_4, MIN_LEN_IP6),
+		/* 20 */ JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, 10),
+		/* 21 */ LDX_MEM(BPF_B, BPF_REG_5, BPF_REG_2, OFF_IP6_NEXT),
+		/* 22 */ JMP_IMM(BPF_JNE, BPF_REG_5, IPPROTO_UDP, 8),
+		/* 23 */ LDX_MEM(BPF_H, BPF_REG_5, BPF_REG_2, OFF_IP6_DPORT),
+		/* Destination port check and redirect. */
+		/* 24 */ JMP_IMM(BPF_JNE, BPF_REG_5, htons(port), 6),
+		/* 25 */ LD_MAP_FD(BPF_REG_1, map_fd),
+		/* 27 */ LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index)),
+		/* 28 */ MOV64_IMM(BPF_REG_3, XDP_PASS), // Fallback action if no socket.
+		/* 29 */ CALL(BPF_FUNC_redirect_map),
+		/* 30 */ EXIT(),
+		/* 31 */ MOV64_IMM(BPF_REG_0, XDP_PASS),
+		/* 32 */ EXIT(),
+	};
+
+	static const char license[] = "GPL";
+
+	union bpf_attr attr = {
+		.prog_type = BPF_PROG_TYPE_XDP,
+		.insns = (uintptr_t)prog,
+		.insn_cnt = sizeof(prog) / sizeof(prog[0]),
+		.license = (uintptr_t)license,
+	};
+
+	return sys_bpf(BPF_PROG_LOAD, &attr);
+}
+
+/*! \brief Attach (or detach if prog_fd is -1) the program via rtnetlink. */
+static int set_link_xdp(int ifindex, int prog_fd, uint32_t flags)
+{
+	int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (sock < 0) {
+		return knot_map_errno();
+	}
+
+	struct {
+		struct nlmsghdr nh;
+		struct ifinfomsg ifi;
+		char attrs[64];
+	} req = {
+		.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg)),
+		.nh.nlmsg_type = RTM_SETLINK,
+		.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK,
+		.ifi.ifi_family = AF_UNSPEC,
+		.ifi.ifi_index = ifindex,
+	};
+
+	/* Nested IFLA_XDP with IFLA_XDP_FD and IFLA_XDP_FLAGS. */
+	struct nlattr *nest = (struct nlattr *)((char *)&req + NLMSG_ALIGN(req.nh.nlmsg_len));
+	nest->nla_type = NLA_F_NESTED | IFLA_XDP;
+	nest->nla_len = NLA_HDRLEN;
+
+	struct nlattr *attr = (struct nlattr *)((char *)nest + nest->nla_len);
+	attr->nla_type = IFLA_XDP_FD;
+	attr->nla_len = NLA_HDRLEN + sizeof(int);
+	memcpy((char *)attr + NLA_HDRLEN, &prog_fd, sizeof(int));
+	nest->nla_len += NLA_ALIGN(attr->nla_len);
+
+	attr = (struct nlattr *)((char *)nest + nest->nla_len);
+	attr->nla_type = IFLA_XDP_FLAGS;
+	attr->nla_len = NLA_HDRLEN + sizeof(uint32_t);
+	memcpy((char *)attr + NLA_HDRLEN, &flags, sizeof(uint32_t));
+	nest->nla_len += NLA_ALIGN(attr->nla_len);
+
+	req.nh.nlmsg_len = NLMSG_ALIGN(req.nh.nlmsg_len) + nest->nla_len;
+
+	int ret = KNOT_EOK;
+	if (send(sock, &req, req.nh.nlmsg_len, 0) < 0) {
+		ret = knot_map_errno();
+		goto finish;
+	}
+
+	char buf[512];
+	ssize_t len = recv(sock, buf, sizeof(buf), 0);
+	if (len < 0) {
+		ret = knot_map_errno();
+		goto finish;
+	}
+
+	for (struct nlmsghdr *nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, len);
+	     nh = NLMSG_NEXT(nh, len)) {
+		if (nh->nlmsg_type == NLMSG_ERROR) {
+			struct nlmsgerr *err = (struct nlmsgerr *)NLMSG_DATA(nh);
+			if (err->error != 0) {
+				ret = knot_map_errno_code(-err->error);
+			}
+			break;
+		}
+	}
+finish:
+	close(sock);
+	return ret;
+}
+
+int xdp_bpf_load(xdp_bpf_t *bpf, const char *ifname, uint16_t port, unsigned queues)
+{
+	if (bpf == NULL || ifname == NULL || queues == 0) {
+		return KNOT_EINVAL;
+	}
+
+	memset(bpf, 0, sizeof(*bpf));
+	bpf->prog_fd = -1;
+	bpf->map_fd = -1;
+
+	bpf->ifindex = if_nametoindex(ifname);
+	if (bpf->ifindex == 0) {
+		return KNOT_EINVAL;
+	}
+
+	/* Older kernels account BPF objects to the locked memory limit. */
+	struct rlimit unlimited = { RLIM_INFINITY, RLIM_INFINITY };
+	(void)setrlimit(RLIMIT_MEMLOCK, &unlimited);
+
+	int ret = create_map(queues);
+	if (ret < 0) {
+		return ret;
+	}
+	bpf->map_fd = ret;
+
+	ret = load_prog(bpf->map_fd, port);
+	if (ret < 0) {
+		xdp_bpf_unload(bpf);
+		return ret;
+	}
+	bpf->prog_fd = ret;
+
+	/* Prefer the native driver mode, fall back to the generic mode. */
+	bpf->flags = XDP_FLAGS_DRV_MODE;
+	ret = set_link_xdp(bpf->ifindex, bpf->prog_fd, bpf->flags);
+	if (ret != KNOT_EOK) {
+		bpf->flags = XDP_FLAGS_SKB_MODE;
+		bpf->generic = true;
+		ret = set_link_xdp(bpf->ifindex, bpf->prog_fd, bpf->flags);
+	}
+	if (ret != KNOT_EOK) {
+		bpf->ifindex = 0;
+		xdp_bpf_unload(bpf);
+		return ret;
+	}
+
+	return KNOT_EOK;
+}
+
+int xdp_bpf_set_socket(xdp_bpf_t *bpf, unsigned queue, int xsk_fd)
+{
+	if (bpf == NULL || bpf->map_fd < 0 || xsk_fd < 0) {
+		return KNOT_EINVAL;
+	}
+
+	uint32_t key = queue;
+	union bpf_attr attr = {
+		.map_fd = bpf->map_fd,
+		.key = (uintptr_t)&key,
+		.value = (uintptr_t)&xsk_fd,
+		.flags = BPF_ANY,
+	};
+
+	int ret = sys_bpf(BPF_MAP_UPDATE_ELEM, &attr);
+	return (ret < 0) ? ret : KNOT_EOK;
+}
+
+void xdp_bpf_unload(xdp_bpf_t *bpf)
+{
+	if (bpf == NULL) {
+		return;
+	}
+
+	if (bpf->ifindex > 0) {
+		(void)set_link_xdp(bpf->ifindex, -1, bpf->flags);
+		bpf->ifindex = 0;
+	}
+	if (bpf->prog_fd >= 0) {
+		close(bpf->prog_fd);
+		bpf->prog_fd = -1;
+	}
+	if (bpf->map_fd >= 0) {
+		close(bpf->map_fd);
+		bpf->map_fd = -1;
+	}
+}
@@ -0,0 +1,72 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief XDP program redirecting DNS traffic to AF_XDP sockets.
+ *
+ * The program is generated in run-time and loaded directly via the bpf()
+ * syscall, so no libbpf nor BPF compiler is needed. It redirects UDP datagrams
+ * (IPv4 without options or IPv6 without extension headers) with a given
+ * destination port into an XSKMAP indexed by the RX queue number. All other
+ * traffic, including traffic for queues without a registered socket, is passed
+ * to the kernel network stack.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! \brief Loaded XDP program context. */
+typedef struct xdp_bpf {
+	int prog_fd;        /*!< Program descriptor. */
+	int map_fd;         /*!< XSKMAP descriptor. */
+	int ifindex;        /*!< Interface index the program is attached to. */
+	uint32_t flags;     /*!< XDP attach flags (mode). */
+	bool generic;       /*!< Indication of generic (SKB) mode. */
+} xdp_bpf_t;
+
+/*!
+ * \brief Load the XDP program and attach it to an interface.
+ *
+ * Driver (native) mode is tried first, then the generic (SKB) mode.
+ *
+ * \param bpf       Context to be initialized.
+ * \param ifname    Interface name.
+ * \param port      UDP destination port to be redirected.
+ * \param queues    Number of queues (XSKMAP size).
+ *
+ * \return KNOT_E*
+ */
+int xdp_bpf_load(xdp_bpf_t *bpf, const char *ifname, uint16_t port, unsigned queues);
+
+/*!
+ * \brief Register an AF_XDP socket for a given RX queue.
+ *
+ * \param bpf       Loaded context.
+ * \param queue     Queue index.
+ * \param xsk_fd    AF_XDP socket descriptor.
+ *
+ * \return KNOT_E*
+ */
+int xdp_bpf_set_socket(xdp_bpf_t *bpf, unsigned queue, int xsk_fd);
+
+/*!
+ * \brief Detach the XDP program and release the context.
+ *
+ * \param bpf  Loaded context.
+ */
+void xdp_bpf_unload(xdp_bpf_t *bpf);
@@ -0,0 +1,589 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "libknot/errcode.h"
+#include "knot/server/xdp-socket.h"
+#include "contrib/macros.h"
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+
+enum {
+	FRAME_SIZE = 4096,             /*!< UMEM frame (chunk) size. */
+	RING_SIZE = 1024,              /*!< Size of each ring (power of 2). */
+	FRAME_COUNT = 2 * RING_SIZE,   /*!< RX frames + TX frames. */
+	IP4_HLEN = 20,
+	IP6_HLEN = 40,
+	UDP_HLEN = 8,
+	IP4_TTL = 64,
+};
+
+/*! \brief Single-producer single-consumer ring shared with the kernel. */
+typedef struct {
+	uint32_t *producer;
+	uint32_t *consumer;
+	uint32_t *flags;
+	void *desc;
+	uint32_t mask;
+	void *map;
+	size_t map_len;
+} xdp_ring_t;
+
+struct xdp_socket {
+	int fd;
+	unsigned queue;
+	uint8_t *umem;
+	xdp_ring_t fq;          /*!< Fill ring (frames for RX). */
+	xdp_ring_t cq;          /*!< Completion ring (sent TX frames). */
+	xdp_ring_t rx;
+	xdp_ring_t tx;
+	uint64_t tx_free[RING_SIZE]; /*!< Stack of free TX frames. */
+	unsigned tx_free_count;
+	size_t max_payload[2];  /*!< Maximum payload for IPv4 and IPv6. */
+};
+
+static uint32_t ring_load(uint32_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static void ring_store(uint32_t *ptr, uint32_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+/*! \brief Number of entries available for the consumer. */
+static uint32_t ring_cons_avail(xdp_ring_t *ring)
+{
+	return ring_load(ring->producer) - *ring->consumer;
+}
+
+/*! \brief Number of free entries for the producer. */
+static uint32_t ring_prod_free(xdp_ring_t *ring)
+{
+	return ring->mask + 1 - (*ring->producer - ring_load(ring->consumer));
+}
+
+static int ring_map(int fd, xdp_ring_t *ring, const struct xdp_ring_offset *off,
+                    size_t desc_size, off_t pgoff)
+{
+	ring->map_len = off->desc + RING_SIZE * desc_size;
+	ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+	                 MAP_SHARED | MAP_POPULATE, fd, pgoff);
+	if (ring->map == MAP_FAILED) {
+		ring->map = NULL;
+		return knot_map_errno();
+	}
+
+	uint8_t *base = ring->map;
+	ring->producer = (uint32_t *)(base + off->producer);
+	ring->consumer = (uint32_t *)(base + off->consumer);
+	ring->flags = (uint32_t *)(base + off->flags);
+	ring->desc = base + off->desc;
+	ring->mask = RING_SIZE - 1;
+
+	return KNOT_EOK;
+}
+
+static void ring_unmap(xdp_ring_t *ring)
+{
+	if (ring->map != NULL) {
+		munmap(ring->map, ring->map_len);
+		ring->map = NULL;
+	}
+}
+
+static int setsockopt_int(int fd, int opt, int val)
+{
+	if (setsockopt(fd, SOL_XDP, opt, &val, sizeof(val)) != 0) {
+		return knot_map_errno();
+	}
+	return KNOT_EOK;
+}
+
+static int socket_setup(xdp_socket_t *s, int ifindex)
+{
+	struct xdp_umem_reg umem = {
+		.addr = (uintptr_t)s->umem,
+		.len = (uint64_t)FRAME_COUNT * FRAME_SIZE,
+		.chunk_size = FRAME_SIZE,
+		.headroom = 0,
+	};
+	if (setsockopt(s->fd, SOL_XDP, XDP_UMEM_REG, &umem, sizeof(umem)) != 0) {
+		return knot_map_errno();
+	}
+
+	int ret = setsockopt_int(s->fd, XDP_UMEM_FILL_RING, RING_SIZE);
+	if (ret == KNOT_EOK) {
+		ret = setsockopt_int(s->fd, XDP_UMEM_COMPLETION_RING, RING_SIZE);
+	}
+	if (ret == KNOT_EOK) {
+		ret = setsockopt_int(s->fd, XDP_RX_RING, RING_SIZE);
+	}
+	if (ret == KNOT_EOK) {
+		ret = setsockopt_int(s->fd, XDP_TX_RING, RING_SIZE);
+	}
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	struct xdp_mmap_offsets off;
+	socklen_t optlen = sizeof(off);
+	if (getsockopt(s->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) != 0) {
+		return knot_map_errno();
+	}
+
+	ret = ring_map(s->fd, &s->fq, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING);
+	if (ret == KNOT_EOK) {
+		ret = ring_map(s->fd, &s->cq, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING);
+	}
+	if (ret == KNOT_EOK) {
+		ret = ring_map(s->fd, &s->rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING);
+	}
+	if (ret == KNOT_EOK) {
+		ret = ring_map(s->fd, &s->tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING);
+	}
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	/* The first half of UMEM is for RX, the second half for TX. */
+	uint64_t *fill = s->fq.desc;
+	for (unsigned i = 0; i < RING_SIZE; i++) {
+		fill[i] = (uint64_t)i * FRAME_SIZE;
+	}
+	ring_store(s->fq.producer, RING_SIZE);
+
+	for (unsigned i = 0; i < RING_SIZE; i++) {
+		s->tx_free[i] = (uint64_t)(RING_SIZE + i) * FRAME_SIZE;
+	}
+	s->tx_free_count = RING_SIZE;
+
+	/* Try zero-copy mode first, it isn't available in the generic mode. */
+	struct sockaddr_xdp sxdp = {
+		.sxdp_family = AF_XDP,
+		.sxdp_ifindex = ifindex,
+		.sxdp_queue_id = s->queue,
+		.sxdp_flags = XDP_ZEROCOPY,
+	};
+	if (bind(s->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) != 0) {
+		sxdp.sxdp_flags = XDP_COPY;
+		if (bind(s->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) != 0) {
+			return knot_map_errno();
+		}
+	}
+
+	return KNOT_EOK;
+}
+
+static void set_max_payload(xdp_socket_t *s, const char *ifname)
+{
+	int mtu = ETH_DATA_LEN;
+
+	struct ifreq ifr = { { { 0 } } };
+	strncpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name) - 1);
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock >= 0) {
+		if (ioctl(sock, SIOCGIFMTU, &ifr) == 0) {
+			mtu = ifr.ifr_mtu;
+		}
+		close(sock);
+	}
+
+	/* No IP fragmentation is possible, fit into MTU and frame. */
+	size_t frame_max = FRAME_SIZE - ETH_HLEN;
+	size_t l3_max = MIN((size_t)mtu, frame_max);
+	s->max_payload[0] = l3_max - IP4_HLEN - UDP_HLEN;
+	s->max_payload[1] = l3_max - IP6_HLEN - UDP_HLEN;
+}
+
+int xdp_socket_init(xdp_socket_t **socket_out, const char *ifname, unsigned queue,
+                    xdp_bpf_t *bpf)
+{
+	if (socket_out == NULL || ifname == NULL || bpf == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	xdp_socket_t *s = calloc(1, sizeof(*s));
+	if (s == NULL) {
+		return KNOT_ENOMEM;
+	}
+	s->queue = queue;
+
+	s->fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+	if (s->fd < 0) {
+		int ret = knot_map_errno();
+		free(s);
+		return ret;
+	}
+
+	int ret = posix_memalign((void **)&s->umem, getpagesize(),
+	                         (size_t)FRAME_COUNT * FRAME_SIZE);
+	if (ret != 0) {
+		s->umem = NULL;
+		xdp_socket_deinit(s);
+		return KNOT_ENOMEM;
+	}
+
+	ret = socket_setup(s, bpf->ifindex);
+	if (ret == KNOT_EOK) {
+		ret = xdp_bpf_set_socket(bpf, queue, s->fd);
+	}
+	if (ret != KNOT_EOK) {
+		xdp_socket_deinit(s);
+		return ret;
+	}
+
+	set_max_payload(s, ifname);
+
+	*socket_out = s;
+
+	return KNOT_EOK;
+}
+
+void xdp_socket_deinit(xdp_socket_t *s)
+{
+	if (s == NULL) {
+		return;
+	}
+
+	ring_unmap(&s->fq);
+	ring_unmap(&s->cq);
+	ring_unmap(&s->rx);
+	ring_unmap(&s->tx);
+	if (s->fd >= 0) {
+		close(s->fd);
+	}
+	free(s->umem);
+	free(s);
+}
+
+int xdp_socket_fd(const xdp_socket_t *s)
+{
+	return (s != NULL) ? s->fd : -1;
+}
+
+/*! \brief Sum 16-bit words in network order. */
+static uint32_t csum_add(uint32_t sum, const void *data, size_t len)
+{
+	const uint8_t *bytes = data;
+	for (size_t i = 0; i + 1 < len; i += 2) {
+		sum += ((uint32_t)bytes[i] << 8) | bytes[i + 1];
+	}
+	if (len & 1) {
+		sum += (uint32_t)bytes[len - 1] << 8;
+	}
+	return sum;
+}
+
+static uint16_t csum_fold(uint32_t sum)
+{
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+	return ~sum & 0xffff;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+	return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static void put16(uint8_t *p, uint16_t val)
+{
+	p[0] = val >> 8;
+	p[1] = val & 0xff;
+}
+
+int xdp_parse_frame(uint8_t *data, size_t len, xdp_msg_t *msg)
+{
+	if (data == NULL || msg == NULL || len < ETH_HLEN) {
+		return KNOT_EINVAL;
+	}
+
+	memcpy(msg->eth_to, data, XDP_ETH_ALEN);
+	memcpy(msg->eth_from, data + XDP_ETH_ALEN, XDP_ETH_ALEN);
+	uint16_t proto = get16(data + 12);
+
+	uint8_t *ip = data + ETH_HLEN;
+	size_t ip_len = len - ETH_HLEN;
+	uint8_t *udp = NULL;
+
+	memset(&msg->ip_from, 0, sizeof(msg->ip_from));
+	memset(&msg->ip_to, 0, sizeof(msg->ip_to));
+
+	if (proto == ETH_P_IP) {
+		if (ip_len < IP4_HLEN + UDP_HLEN || ip[0] != 0x45 || ip[9] != IPPROTO_UDP) {
+			return KNOT_EMALF;
+		}
+		struct sockaddr_in *from = (struct sockaddr_in *)&msg->ip_from;
+		struct sockaddr_in *to = (struct sockaddr_in *)&msg->ip_to;
+		from->sin_family = AF_INET;
+		to->sin_family = AF_INET;
+		memcpy(&from->sin_addr, ip + 12, sizeof(from->sin_addr));
+		memcpy(&to->sin_addr, ip + 16, sizeof(to->sin_addr));
+		size_t total = get16(ip + 2);
+		if (total < IP4_HLEN + UDP_HLEN || total > ip_len) {
+			return KNOT_EMALF;
+		}
+		ip_len = total;
+		udp = ip + IP4_HLEN;
+		memcpy(&from->sin_port, udp, sizeof(uint16_t));
+		memcpy(&to->sin_port, udp + 2, sizeof(uint16_t));
+		ip_len -= IP4_HLEN;
+	} else if (proto == ETH_P_IPV6) {
+		if (ip_len < IP6_HLEN + UDP_HLEN || (ip[0] >> 4) != 6 || ip[6] != IPPROTO_UDP) {
+			return KNOT_EMALF;
+		}
+		struct sockaddr_in6 *from = (struct sockaddr_in6 *)&msg->ip_from;
+		struct sockaddr_in6 *to = (struct sockaddr_in6 *)&msg->ip_to;
+		from->sin6_family = AF_INET6;
+		to->sin6_family = AF_INET6;
+		memcpy(&from->sin6_addr, ip + 8, sizeof(from->sin6_addr));
+		memcpy(&to->sin6_addr, ip + 24, sizeof(to->sin6_addr));
+		size_t payload = get16(ip + 4);
+		if (payload < UDP_HLEN || payload > ip_len - IP6_HLEN) {
+			return KNOT_EMALF;
+		}
+		ip_len = payload;
+		udp = ip + IP6_HLEN;
+		memcpy(&from->sin6_port, udp, sizeof(uint16_t));
+		memcpy(&to->sin6_port, udp + 2, sizeof(uint16_t));
+	} else {
+		return KNOT_ENOTSUP;
+	}
+
+	size_t udp_len = get16(udp + 4);
+	if (udp_len < UDP_HLEN || udp_len > ip_len) {
+		return KNOT_EMALF;
+	}
+
+	msg->payload.iov_base = udp + UDP_HLEN;
+	msg->payload.iov_len = udp_len - UDP_HLEN;
+
+	return KNOT_EOK;
+}
+
+size_t xdp_headers_size(const xdp_msg_t *msg)
+{
+	return ETH_HLEN + UDP_HLEN +
+	       (msg->ip_from.ss_family == AF_INET6 ? IP6_HLEN : IP4_HLEN);
+}
+
+size_t xdp_write_headers(const xdp_msg_t *msg)
+{
+	size_t hdr_len = xdp_headers_size(msg);
+	uint8_t *data = (uint8_t *)msg->payload.iov_base - hdr_len;
+	size_t udp_len = UDP_HLEN + msg->payload.iov_len;
+
+	memcpy(data, msg->eth_to, XDP_ETH_ALEN);
+	memcpy(data + XDP_ETH_ALEN, msg->eth_from, XDP_ETH_ALEN);
+
+	uint8_t *ip = data + ETH_HLEN;
+	uint8_t *udp = NULL;
+	uint32_t sum = 0;
+
+	if (msg->ip_from.ss_family == AF_INET6) {
+		const struct sockaddr_in6 *from = (const struct sockaddr_in6 *)&msg->ip_from;
+		const struct sockaddr_in6 *to = (const struct sockaddr_in6 *)&msg->ip_to;
+		put16(data + 12, ETH_P_IPV6);
+
+		memset(ip, 0, IP6_HLEN);
+		ip[0] = 6 << 4;
+		put16(ip + 4, udp_len);
+		ip[6] = IPPROTO_UDP;
+		ip[7] = IP4_TTL;
+		memcpy(ip + 8, &from->sin6_addr, sizeof(from->sin6_addr));
+		memcpy(ip + 24, &to->sin6_addr, sizeof(to->sin6_addr));
+
+		udp = ip + IP6_HLEN;
+		memcpy(udp, &from->sin6_port, sizeof(uint16_t));
+		memcpy(udp + 2, &to->sin6_port, sizeof(uint16_t));
+
+		sum = csum_add(sum, ip + 8, 32);
+	} else {
+		const struct sockaddr_in *from = (const struct sockaddr_in *)&msg->ip_from;
+		const struct sockaddr_in *to = (const struct sockaddr_in *)&msg->ip_to;
+		put16(data + 12, ETH_P_IP);
+
+		memset(ip, 0, IP4_HLEN);
+		ip[0] = 0x45;
+		put16(ip + 2, IP4_HLEN + udp_len);
+		ip[8] = IP4_TTL;
+		ip[9] = IPPROTO_UDP;
+		memcpy(ip + 12, &from->sin_addr, sizeof(from->sin_addr));
+		memcpy(ip + 16, &to->sin_addr, sizeof(to->sin_addr));
+		put16(ip + 10, csum_fold(csum_add(0, ip, IP4_HLEN)));
+
+		udp = ip + IP4_HLEN;
+		memcpy(udp, &from->sin_port, sizeof(uint16_t));
+		memcpy(udp + 2, &to->sin_port, sizeof(uint16_t));
+
+		sum = csum_add(sum, ip + 12, 8);
+	}
+
+	/* UDP checksum including the pseudo-header. */
+	put16(udp + 4, udp_len);
+	put16(udp + 6, 0);
+	sum += IPPROTO_UDP + udp_len;
+	sum = csum_add(sum, udp, udp_len);
+	uint16_t csum = csum_fold(sum);
+	put16(udp + 6, csum == 0 ? 0xffff : csum);
+
+	return hdr_len + msg->payload.iov_len;
+}
+
+int xdp_recv(xdp_socket_t *s, xdp_msg_t msgs[], unsigned max, unsigned *count)
+{
+	if (s == NULL || msgs == NULL || count == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	uint32_t avail = MIN(ring_cons_avail(&s->rx), max);
+	uint32_t cons = *s->rx.consumer;
+	const struct xdp_desc *descs = s->rx.desc;
+
+	unsigned n = 0;
+	for (uint32_t i = 0; i < avail; i++) {
+		const struct xdp_desc *desc = &descs[(cons + i) & s->rx.mask];
+		xdp_msg_t *msg = &msgs[n];
+		msg->frame = desc->addr - (desc->addr % FRAME_SIZE);
+		if (xdp_parse_frame(s->umem + desc->addr, desc->len, msg) == KNOT_EOK) {
+			n++;
+		} else {
+			/* Give the frame back immediately. */
+			xdp_recv_finish(s, msg, 1);
+		}
+	}
+	ring_store(s->rx.consumer, cons + avail);
+
+	*count = n;
+
+	return KNOT_EOK;
+}
+
+void xdp_recv_finish(xdp_socket_t *s, const xdp_msg_t msgs[], unsigned count)
+{
+	if (s == NULL || msgs == NULL) {
+		return;
+	}
+
+	/* There are exactly RING_SIZE RX frames, so the fill ring never overflows. */
+	assert(ring_prod_free(&s->fq) >= count);
+
+	uint32_t prod = *s->fq.producer;
+	uint64_t *fill = s->fq.desc;
+	for (unsigned i = 0; i < count; i++) {
+		fill[(prod + i) & s->fq.mask] = msgs[i].frame;
+	}
+	ring_store(s->fq.producer, prod + count);
+}
+
+/*! \brief Move frames of finished transmissions to the free stack. */
+static void tx_reclaim(xdp_socket_t *s)
+{
+	uint32_t avail = ring_cons_avail(&s->cq);
+	uint32_t cons = *s->cq.consumer;
+	const uint64_t *comp = s->cq.desc;
+	for (uint32_t i = 0; i < avail; i++) {
+		assert(s->tx_free_count < RING_SIZE);
+		s->tx_free[s->tx_free_count++] = comp[(cons + i) & s->cq.mask];
+	}
+	ring_store(s->cq.consumer, cons + avail);
+}
+
+int xdp_reply_alloc(xdp_socket_t *s, const xdp_msg_t *query, xdp_msg_t *reply)
+{
+	if (s == NULL || query == NULL || reply == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	if (s->tx_free_count == 0) {
+		tx_reclaim(s);
+		if (s->tx_free_count == 0) {
+			return KNOT_ENOMEM;
+		}
+	}
+
+	reply->frame = s->tx_free[--s->tx_free_count];
+	memcpy(&reply->ip_from, &query->ip_to, sizeof(reply->ip_from));
+	memcpy(&reply->ip_to, &query->ip_from, sizeof(reply->ip_to));
+	memcpy(reply->eth_from, query->eth_to, XDP_ETH_ALEN);
+	memcpy(reply->eth_to, query->eth_from, XDP_ETH_ALEN);
+
+	bool ipv6 = (query->ip_from.ss_family == AF_INET6);
+	reply->payload.iov_base = s->umem + reply->frame + xdp_headers_size(reply);
+	reply->payload.iov_len = s->max_payload[ipv6 ? 1 : 0];
+
+	return KNOT_EOK;
+}
+
+int xdp_send(xdp_socket_t *s, const xdp_msg_t msgs[], unsigned count, unsigned *sent)
+{
+	if (s == NULL || msgs == NULL || sent == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	/* TX frames are never more than the TX ring size. */
+	assert(ring_prod_free(&s->tx) >= count);
+
+	uint32_t prod = *s->tx.producer;
+	struct xdp_desc *descs = s->tx.desc;
+	unsigned n = 0;
+	for (unsigned i = 0; i < count; i++) {
+		const xdp_msg_t *msg = &msgs[i];
+		if (msg->payload.iov_len == 0) {
+			s->tx_free[s->tx_free_count++] = msg->frame;
+			continue;
+		}
+
+		struct xdp_desc *desc = &descs[(prod + n) & s->tx.mask];
+		desc->addr = msg->frame;
+		desc->len = xdp_write_headers(msg);
+		desc->options = 0;
+		n++;
+	}
+	ring_store(s->tx.producer, prod + n);
+
+	*sent = n;
+
+	int ret = KNOT_EOK;
+	if (n > 0 && sendto(s->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+	    errno != EAGAIN && errno != EBUSY && errno != ENOBUFS) {
+		ret = knot_map_errno();
+	}
+
+	tx_reclaim(s);
+
+	return ret;
+}
@@ -0,0 +1,150 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief AF_XDP socket interface.
+ *
+ * Each socket owns its UMEM area, which is split into RX frames (kept in
+ * the fill ring) and TX frames (kept in a free-frame stack). Received frames
+ * are parsed down to the UDP payload, answers are written into TX frames
+ * and the Ethernet, IP and UDP headers are rebuilt from the request.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "knot/server/xdp-bpf.h"
+
+/*! \brief Maximum number of messages processed in one batch. */
+#define XDP_BATCHLEN 32
+
+/*! \brief Ethernet address length. */
+#define XDP_ETH_ALEN 6
+
+/*! \brief A UDP datagram stored in an UMEM frame. */
+typedef struct {
+	struct sockaddr_storage ip_from;  /*!< Source address and port. */
+	struct sockaddr_storage ip_to;    /*!< Destination address and port. */
+	uint8_t eth_from[XDP_ETH_ALEN];   /*!< Source MAC address. */
+	uint8_t eth_to[XDP_ETH_ALEN];     /*!< Destination MAC address. */
+	struct iovec payload;             /*!< UDP payload. */
+	uint64_t frame;                   /*!< UMEM frame address (internal). */
+} xdp_msg_t;
+
+/*! \brief AF_XDP socket (opaque). */
+typedef struct xdp_socket xdp_socket_t;
+
+/*!
+ * \brief Create an AF_XDP socket bound to an interface queue.
+ *
+ * \param socket    Output socket.
+ * \param ifname    Interface name.
+ * \param queue     Interface RX/TX queue index.
+ * \param bpf       Loaded XDP program the socket is registered to.
+ *
+ * \return KNOT_E*
+ */
+int xdp_socket_init(xdp_socket_t **socket, const char *ifname, unsigned queue,
+                    xdp_bpf_t *bpf);
+
+/*!
+ * \brief Close the socket and free its UMEM.
+ */
+void xdp_socket_deinit(xdp_socket_t *socket);
+
+/*!
+ * \brief Get the socket descriptor (for poll).
+ */
+int xdp_socket_fd(const xdp_socket_t *socket);
+
+/*!
+ * \brief Receive a batch of UDP datagrams.
+ *
+ * Frames of received messages must be released using xdp_recv_finish().
+ *
+ * \param socket  Socket.
+ * \param msgs    Output messages.
+ * \param max     Capacity of msgs.
+ * \param count   Number of received messages.
+ *
+ * \return KNOT_E*
+ */
+int xdp_recv(xdp_socket_t *socket, xdp_msg_t msgs[], unsigned max, unsigned *count);
+
+/*!
+ * \brief Return frames of received messages back to the kernel.
+ */
+void xdp_recv_finish(xdp_socket_t *socket, const xdp_msg_t msgs[], unsigned count);
+
+/*!
+ * \brief Allocate a reply message to a received one.
+ *
+ * Addresses are swapped and the payload points to the free space in a TX
+ * frame, its length is limited by the interface MTU.
+ *
+ * \param socket  Socket.
+ * \param query   Received message.
+ * \param reply   Output reply message.
+ *
+ * \return KNOT_E*
+ */
+int xdp_reply_alloc(xdp_socket_t *socket, const xdp_msg_t *query, xdp_msg_t *reply);
+
+/*!
+ * \brief Send a batch of messages.
+ *
+ * Headers are written in front of the payloads. Messages with empty payload
+ * aren't sent, only their frames are released.
+ *
+ * \param socket  Socket.
+ * \param msgs    Messages allocated by xdp_reply_alloc().
+ * \param count   Number of messages.
+ * \param sent    Number of messages actually sent.
+ *
+ * \return KNOT_E*
+ */
+int xdp_send(xdp_socket_t *socket, const xdp_msg_t msgs[], unsigned count,
+             unsigned *sent);
+
+/*!
+ * \brief Parse Ethernet, IP and UDP headers of a frame.
+ *
+ * \param data  Frame data.
+ * \param len   Frame length.
+ * \param msg   Output message (payload points into data).
+ *
+ * \return KNOT_E*
+ */
+int xdp_parse_frame(uint8_t *data, size_t len, xdp_msg_t *msg);
+
+/*!
+ * \brief Size of headers written in front of the payload.
+ */
+size_t xdp_headers_size(const xdp_msg_t *msg);
+
+/*!
+ * \brief Write Ethernet, IP and UDP headers in front of the payload.
+ *
+ * \param msg  Message with addresses and payload set; the payload must be
+ *             preceded by at least xdp_headers_size() bytes.
+ *
+ * \return Frame length (the frame starts xdp_headers_size() bytes before
+ *         the payload).
+ */
+size_t xdp_write_headers(const xdp_msg_t *msg);
@@ -14,7 +14,14 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "knot/updates/acl.h"
+#include "contrib/macros.h"
+#include "contrib/prefix_tree.h"
+#include "contrib/qp-trie/trie.h"
+#include "contrib/sockaddr.h"
 #include "contrib/wire_ctx.h"
 
 static bool match_type(uint16_t type, conf_val_t *types)
@@ -247,3 +254,525 @@ next_acl:
 
 	return false;
 }
+
+/*! \brief Number of rule set words kept on the stack during lookup. */
+#define RULES_STACK_WORDS 8
+
+/*! \brief Compiled TSIG key. */
+typedef struct {
+	dnssec_tsig_algorithm_t algorithm;
+	dnssec_binary_t secret;
+	uint32_t rules; /*!< Index of the rule set referencing the key. */
+} acl_key_t;
+
+/*! \brief Compiled ACL rule. */
+typedef struct {
+	bool deny;
+	bool no_action;
+	acl_update_owner_t owner;
+	acl_update_owner_match_t owner_match;
+	uint16_t *types;
+	size_t types_count;
+	knot_dname_t **names; /*!< NULL item for a name which cannot be built. */
+	size_t names_count;
+} acl_rule_t;
+
+struct acl {
+	knot_dname_t *zone_name;
+
+	acl_rule_t *rules;
+	size_t rules_count;
+
+	/*! Rule sets (bitmaps), set 0 is always empty. */
+	uint64_t *sets;
+	size_t set_words;
+	size_t sets_count;
+	size_t sets_max;
+
+	prefix_tree_t *addrs;    /*!< Networks -> rule sets of the address lists. */
+
+	uint32_t any_addr;       /*!< Rules without an address list. */
+	uint32_t no_key;         /*!< Rules without a key list. */
+	uint32_t actions[4];     /*!< Rules allowing the action (or no action). */
+
+	trie_t *keys;            /*!< TSIG key name -> acl_key_t. */
+};
+
+static uint64_t *rule_set(const acl_t *acl, uint32_t idx)
+{
+	return acl->sets + idx * acl->set_words;
+}
+
+static int new_set(acl_t *acl, uint32_t *idx)
+{
+	if (acl->sets_count == acl->sets_max) {
+		size_t max = MAX(8, 2 * acl->sets_max);
+		uint64_t *sets = realloc(acl->sets, max * acl->set_words * sizeof(uint64_t));
+		if (sets == NULL) {
+			return KNOT_ENOMEM;
+		}
+		acl->sets = sets;
+		acl->sets_max = max;
+	}
+
+	*idx = acl->sets_count++;
+	memset(rule_set(acl, *idx), 0, acl->set_words * sizeof(uint64_t));
+
+	return KNOT_EOK;
+}
+
+static void set_rule(acl_t *acl, uint32_t set, size_t rule)
+{
+	rule_set(acl, set)[rule / 64] |= (uint64_t)1 << (rule % 64);
+}
+
+typedef struct {
+	acl_t *acl;
+	size_t rule;
+} addr_rule_ctx_t;
+
+/*! Adds the rule to the rule set of a network covering the address list item. */
+static int addr_rule_set(uint32_t *value, void *data)
+{
+	addr_rule_ctx_t *ctx = data;
+
+	if (*value == 0) {
+		int ret = new_set(ctx->acl, value);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+	set_rule(ctx->acl, *value, ctx->rule);
+
+	return KNOT_EOK;
+}
+
+static int compile_addr(acl_t *acl, conf_val_t *range, size_t rule)
+{
+	addr_rule_ctx_t ctx = { acl, rule };
+
+	while (range->code == KNOT_EOK) {
+		int prefix;
+		struct sockaddr_storage min, max;
+		min = conf_addr_range(range, &max, &prefix);
+
+		int ret;
+		if (max.ss_family == AF_UNSPEC) {
+			/* Network with a prefix (a single address if no prefix). */
+			ret = prefix_tree_add_net(acl->addrs, &min, (unsigned)prefix,
+			                          addr_rule_set, &ctx);
+		} else {
+			ret = prefix_tree_add_range(acl->addrs, &min, &max,
+			                            addr_rule_set, &ctx);
+		}
+		/* Unsupported items are skipped. */
+		if (ret != KNOT_EOK && ret != KNOT_EINVAL) {
+			return ret;
+		}
+
+		conf_val_next(range);
+	}
+
+	return KNOT_EOK;
+}
+
+static int compile_keys(acl_t *acl, conf_t *conf, conf_val_t *key_val, size_t rule)
+{
+	while (key_val->code == KNOT_EOK) {
+		const knot_dname_t *name = conf_dname(key_val);
+		trie_val_t *val = trie_get_ins(acl->keys, (const trie_key_t *)name,
+		                               knot_dname_size(name));
+		if (val == NULL) {
+			return KNOT_ENOMEM;
+		}
+
+		acl_key_t *key = *val;
+		if (key == NULL) {
+			key = calloc(1, sizeof(*key));
+			if (key == NULL) {
+				return KNOT_ENOMEM;
+			}
+			*val = key;
+
+			conf_val_t alg_val = conf_id_get(conf, C_KEY, C_ALG, key_val);
+			key->algorithm = conf_opt(&alg_val);
+
+			size_t size;
+			conf_val_t secret_val = conf_id_get(conf, C_KEY, C_SECRET, key_val);
+			const uint8_t *secret = conf_bin(&secret_val, &size);
+			if (secret != NULL && size > 0) {
+				key->secret.data = malloc(size);
+				if (key->secret.data == NULL) {
+					return KNOT_ENOMEM;
+				}
+				memcpy(key->secret.data, secret, size);
+				key->secret.size = size;
+			}
+
+			int ret = new_set(acl, &key->rules);
+			if (ret != KNOT_EOK) {
+				return ret;
+			}
+		}
+		set_rule(acl, key->rules, rule);
+
+		conf_val_next(key_val);
+	}
+
+	return KNOT_EOK;
+}
+
+static int compile_update(acl_t *acl, conf_t *conf, conf_val_t *id, acl_rule_t *rule)
+{
+	conf_val_t val = conf_id_get(conf, C_ACL, C_UPDATE_TYPE, id);
+	size_t count = conf_val_count(&val);
+	if (count > 0) {
+		rule->types = malloc(count * sizeof(uint16_t));
+		if (rule->types == NULL) {
+			return KNOT_ENOMEM;
+		}
+		while (val.code == KNOT_EOK) {
+			rule->types[rule->types_count++] = knot_wire_read_u64(val.data);
+			conf_val_next(&val);
+		}
+	}
+
+	val = conf_id_get(conf, C_ACL, C_UPDATE_OWNER, id);
+	rule->owner = conf_opt(&val);
+	rule->owner_match = ACL_UPDATE_MATCH_SUBEQ;
+	if (rule->owner != ACL_UPDATE_OWNER_NONE) {
+		val = conf_id_get(conf, C_ACL, C_UPDATE_OWNER_MATCH, id);
+		rule->owner_match = conf_opt(&val);
+	}
+	if (rule->owner != ACL_UPDATE_OWNER_NAME) {
+		return KNOT_EOK;
+	}
+
+	val = conf_id_get(conf, C_ACL, C_UPDATE_OWNER_NAME, id);
+	count = conf_val_count(&val);
+	if (count == 0) {
+		return KNOT_EOK;
+	}
+	rule->names = calloc(count, sizeof(knot_dname_t *));
+	if (rule->names == NULL) {
+		return KNOT_ENOMEM;
+	}
+	while (val.code == KNOT_EOK) {
+		knot_dname_storage_t full_name;
+		size_t len;
+		const uint8_t *name = conf_data(&val, &len);
+		if (name[len - 1] != '\0') {
+			// Append zone name if non-FQDN.
+			wire_ctx_t ctx = wire_ctx_init(full_name, sizeof(full_name));
+			wire_ctx_write(&ctx, name, len);
+			wire_ctx_write(&ctx, acl->zone_name, knot_dname_size(acl->zone_name));
+			name = (ctx.error == KNOT_EOK) ? full_name : NULL;
+		}
+		if (name != NULL) {
+			knot_dname_t *copy = knot_dname_copy(name, NULL);
+			if (copy == NULL) {
+				return KNOT_ENOMEM;
+			}
+			rule->names[rule->names_count] = copy;
+		}
+		rule->names_count++;
+		conf_val_next(&val);
+	}
+
+	return KNOT_EOK;
+}
+
+static int compile_rule(acl_t *acl, conf_t *conf, conf_val_t *id, size_t idx)
+{
+	acl_rule_t *rule = &acl->rules[idx];
+
+	conf_val_t val = conf_id_get(conf, C_ACL, C_ADDR, id);
+	if (val.code == KNOT_ENOENT) {
+		set_rule(acl, acl->any_addr, idx);
+	} else {
+		int ret = compile_addr(acl, &val, idx);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	val = conf_id_get(conf, C_ACL, C_KEY, id);
+	if (val.code == KNOT_ENOENT) {
+		set_rule(acl, acl->no_key, idx);
+	} else {
+		int ret = compile_keys(acl, conf, &val, idx);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	set_rule(acl, acl->actions[ACL_ACTION_NONE], idx);
+	val = conf_id_get(conf, C_ACL, C_ACTION, id);
+	if (val.code == KNOT_ENOENT) {
+		/* Empty action list denies any action. */
+		rule->no_action = true;
+		for (int action = ACL_ACTION_NOTIFY; action <= ACL_ACTION_UPDATE; action++) {
+			set_rule(acl, acl->actions[action], idx);
+		}
+	}
+	while (val.code == KNOT_EOK) {
+		unsigned action = conf_opt(&val);
+		if (action > ACL_ACTION_NONE && action <= ACL_ACTION_UPDATE) {
+			set_rule(acl, acl->actions[action], idx);
+		}
+		conf_val_next(&val);
+	}
+
+	val = conf_id_get(conf, C_ACL, C_DENY, id);
+	rule->deny = conf_bool(&val);
+
+	return compile_update(acl, conf, id, rule);
+}
+
+acl_t *acl_compile(conf_t *conf, const knot_dname_t *zone_name)
+{
+	if (conf == NULL || zone_name == NULL) {
+		return NULL;
+	}
+
+	acl_t *acl = calloc(1, sizeof(*acl));
+	if (acl == NULL) {
+		return NULL;
+	}
+
+	conf_val_t id = conf_zone_get(conf, C_ACL, zone_name);
+	acl->rules_count = conf_val_count(&id);
+	acl->set_words = MAX(1, (acl->rules_count + 63) / 64);
+	acl->zone_name = knot_dname_copy(zone_name, NULL);
+	acl->rules = calloc(MAX(1, acl->rules_count), sizeof(acl_rule_t));
+	acl->keys = trie_create(NULL);
+	if (acl->zone_name == NULL || acl->rules == NULL || acl->keys == NULL) {
+		goto failed;
+	}
+
+	uint32_t empty;
+	acl->addrs = prefix_tree_new();
+	if (acl->addrs == NULL ||
+	    new_set(acl, &empty) != KNOT_EOK ||
+	    new_set(acl, &acl->any_addr) != KNOT_EOK ||
+	    new_set(acl, &acl->no_key) != KNOT_EOK) {
+		goto failed;
+	}
+	for (int action = ACL_ACTION_NONE; action <= ACL_ACTION_UPDATE; action++) {
+		if (new_set(acl, &acl->actions[action]) != KNOT_EOK) {
+			goto failed;
+		}
+	}
+
+	for (size_t i = 0; id.code == KNOT_EOK && i < acl->rules_count; i++) {
+		if (compile_rule(acl, conf, &id, i) != KNOT_EOK) {
+			goto failed;
+		}
+		conf_val_next(&id);
+	}
+
+	return acl;
+failed:
+	acl_free(acl);
+	return NULL;
+}
+
+static bool rule_match_type(const acl_rule_t *rule, uint16_t type)
+{
+	for (size_t i = 0; i < rule->types_count; i++) {
+		if (rule->types[i] == type) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool rule_match_names(const acl_rule_t *rule, const knot_dname_t *rr_owner)
+{
+	if (rule->names_count == 0) {
+		return true;
+	}
+
+	for (size_t i = 0; i < rule->names_count; i++) {
+		if (rule->names[i] == NULL) {
+			return false;
+		}
+		if (match_name(rr_owner, rule->names[i], rule->owner_match)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool rule_update_match(const acl_t *acl, const acl_rule_t *rule,
+                              const knot_dname_t *key_name, knot_pkt_t *query)
+{
+	if (query == NULL ||
+	    (rule->types_count == 0 && rule->owner == ACL_UPDATE_OWNER_NONE)) {
+		return true;
+	}
+
+	uint16_t pos = query->sections[KNOT_AUTHORITY].pos;
+	uint16_t count = query->sections[KNOT_AUTHORITY].count;
+
+	for (int i = pos; i < pos + count; i++) {
+		knot_rrset_t *rr = &query->rr[i];
+		if (rule->types_count > 0 && !rule_match_type(rule, rr->type)) {
+			return false;
+		}
+
+		switch (rule->owner) {
+		case ACL_UPDATE_OWNER_NAME:
+			if (!rule_match_names(rule, rr->owner)) {
+				return false;
+			}
+			break;
+		case ACL_UPDATE_OWNER_KEY:
+			if (!match_name(rr->owner, key_name, rule->owner_match)) {
+				return false;
+			}
+			break;
+		case ACL_UPDATE_OWNER_ZONE:
+			if (!match_name(rr->owner, acl->zone_name, rule->owner_match)) {
+				return false;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	return true;
+}
+
+typedef struct {
+	const acl_t *acl;
+	uint64_t *out;
+} addr_rules_ctx_t;
+
+static void addr_rules_add(uint32_t value, void *data)
+{
+	addr_rules_ctx_t *ctx = data;
+
+	const uint64_t *set = rule_set(ctx->acl, value);
+	for (size_t i = 0; i < ctx->acl->set_words; i++) {
+		ctx->out[i] |= set[i];
+	}
+}
+
+/*! Collects the rules whose address lists contain the address. */
+static void addr_rules(const acl_t *acl, const struct sockaddr_storage *addr,
+                       uint64_t *out)
+{
+	memcpy(out, rule_set(acl, acl->any_addr), acl->set_words * sizeof(uint64_t));
+
+	addr_rules_ctx_t ctx = { acl, out };
+	prefix_tree_lookup(acl->addrs, addr, addr_rules_add, &ctx);
+}
+
+bool acl_match(const acl_t *acl, acl_action_t action,
+               const struct sockaddr_storage *addr, knot_tsig_key_t *tsig,
+               knot_pkt_t *query)
+{
+	if (acl == NULL || addr == NULL || tsig == NULL ||
+	    action < ACL_ACTION_NONE || action > ACL_ACTION_UPDATE) {
+		return false;
+	}
+
+	/* Rules matching the key, or rules without keys if no key provided. */
+	const acl_key_t *key = NULL;
+	uint32_t key_rules = acl->no_key;
+	if (tsig->name != NULL) {
+		trie_val_t *val = trie_get_try(acl->keys, (const trie_key_t *)tsig->name,
+		                               knot_dname_size(tsig->name));
+		key = (val != NULL) ? *val : NULL;
+		if (key == NULL || key->algorithm != tsig->algorithm) {
+			return false;
+		}
+		key_rules = key->rules;
+	}
+
+	uint64_t stack_rules[RULES_STACK_WORDS];
+	uint64_t *rules = stack_rules;
+	if (acl->set_words > RULES_STACK_WORDS) {
+		rules = malloc(acl->set_words * sizeof(uint64_t));
+		if (rules == NULL) {
+			return false;
+		}
+	}
+
+	addr_rules(acl, addr, rules);
+	const uint64_t *by_key = rule_set(acl, key_rules);
+	const uint64_t *by_action = rule_set(acl, acl->actions[action]);
+
+	/* The first matching rule in the configured order decides. */
+	bool allowed = false;
+	for (size_t i = 0; i < acl->set_words; i++) {
+		uint64_t word = rules[i] & by_key[i] & by_action[i];
+		while (word != 0) {
+			const acl_rule_t *rule = &acl->rules[i * 64 + __builtin_ctzll(word)];
+			word &= word - 1;
+
+			if (action != ACL_ACTION_NONE && rule->no_action) {
+				goto done;
+			}
+			if (action == ACL_ACTION_UPDATE &&
+			    !rule_update_match(acl, rule, tsig->name, query)) {
+				continue;
+			}
+			if (rule->deny) {
+				goto done;
+			}
+			if (key != NULL) {
+				tsig->secret = key->secret;
+			}
+			allowed = true;
+			goto done;
+		}
+	}
+done:
+	if (rules != stack_rules) {
+		free(rules);
+	}
+
+	return allowed;
+}
+
+static int free_key(trie_val_t *val, void *ctx)
+{
+	acl_key_t *key = *val;
+	if (key != NULL) {
+		free(key->secret.data);
+		free(key);
+	}
+	return KNOT_EOK;
+}
+
+void acl_free(acl_t *acl)
+{
+	if (acl == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; acl->rules != NULL && i < acl->rules_count; i++) {
+		acl_rule_t *rule = &acl->rules[i];
+		free(rule->types);
+		for (size_t j = 0; j < rule->names_count; j++) {
+			knot_dname_free(rule->names[j], NULL);
+		}
+		free(rule->names);
+	}
+
+	if (acl->keys != NULL) {
+		trie_apply(acl->keys, free_key, NULL);
+		trie_free(acl->keys);
+	}
+
+	free(acl->rules);
+	free(acl->sets);
+	prefix_tree_free(acl->addrs);
+	knot_dname_free(acl->zone_name, NULL);
+	free(acl);
+}
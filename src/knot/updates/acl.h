@@ -1,4 +1,4 @@
-/*  Copyright (C) 2018 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -63,3 +63,41 @@ typedef enum {
 bool acl_allowed(conf_t *conf, conf_val_t *acl, acl_action_t action,
                  const struct sockaddr_storage *addr, knot_tsig_key_t *tsig,
                  const knot_dname_t *zone_name, knot_pkt_t *query);
+
+/*! \brief ACL compiled for one zone. */
+typedef struct acl acl_t;
+
+/*!
+ * \brief Compiles the zone ACL list into an immutable lookup structure.
+ *
+ * The result doesn't refer to the configuration, so it can outlive it.
+ *
+ * \param conf       Configuration.
+ * \param zone_name  Zone name.
+ *
+ * \return Compiled ACL or NULL if failed.
+ */
+acl_t *acl_compile(conf_t *conf, const knot_dname_t *zone_name);
+
+/*!
+ * \brief Checks if the address and/or tsig key matches the compiled ACL.
+ *
+ * The same semantics as acl_allowed(). If tsig.name is not empty and the request
+ * is allowed, tsig.secret points to the key secret owned by the compiled ACL.
+ *
+ * \param acl     Compiled ACL.
+ * \param action  ACL action.
+ * \param addr    IP address.
+ * \param tsig    TSIG parameters.
+ * \param query   Update query.
+ *
+ * \retval True if authenticated.
+ */
+bool acl_match(const acl_t *acl, acl_action_t action,
+               const struct sockaddr_storage *addr, knot_tsig_key_t *tsig,
+               knot_pkt_t *query);
+
+/*!
+ * \brief Frees the compiled ACL.
+ */
+void acl_free(acl_t *acl);
@@ -779,7 +779,7 @@ int zone_update_commit(conf_t *conf, zone_update_t *update)
 	}
 
 	if ((update->flags & (UPDATE_HYBRID | UPDATE_FULL))) {
-		ret = zone_adjust_full(update->new_cont);
+		ret = zone_adjust_full(update->new_cont, conf->cache.srv_bg_threads);
 	} else {
 		ret = zone_adjust_incremental_update(update);
 	}
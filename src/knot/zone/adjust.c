@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -23,6 +23,12 @@
 #include "knot/zone/adds_tree.h"
 #include "knot/zone/measure.h"
 
+/*! \brief Compare node pointers regardless of the bi-node half, don't dereference the old one. */
+static bool node_ptr_changed(const zone_node_t *ptr_orig, zone_node_t *ptr)
+{
+	return ptr_orig != ptr && ptr_orig != binode_counterpart(ptr);
+}
+
 int adjust_cb_flags(zone_node_t *node, adjust_ctx_t *ctx)
 {
 	zone_node_t *parent = node_parent(node);
@@ -38,7 +44,26 @@ int adjust_cb_flags(zone_node_t *node, adjust_ctx_t *ctx)
 		node->flags |= NODE_FLAGS_DELEG;
 	}
 
-	if (node->flags != flags_orig && ctx->changed_nodes != NULL) {
+	// parent is adjusted before its children, so its zone cut is already known
+	zone_node_t *cut = NULL;
+	if (node->flags & NODE_FLAGS_DELEG) {
+		cut = node;
+	} else if (node->flags & NODE_FLAGS_NONAUTH) {
+		cut = node_cut(parent);
+	}
+
+	zone_node_t *wildcard = NULL;
+	if (node->flags & NODE_FLAGS_WILDCARD_CHILD) {
+		wildcard = (zone_node_t *)zone_contents_find_wildcard_child(ctx->zone, node);
+		wildcard = binode_node_as(wildcard, node);
+	}
+
+	bool ptrs_changed = node_ptr_changed(node->cut, cut) ||
+	                    node_ptr_changed(node->wildcard_child, wildcard);
+	node->cut = cut;
+	node->wildcard_child = wildcard;
+
+	if ((node->flags != flags_orig || ptrs_changed) && ctx->changed_nodes != NULL) {
 		return zone_tree_insert(ctx->changed_nodes, &node);
 	}
 
@@ -97,15 +122,12 @@ int adjust_cb_wildcard_nsec3(zone_node_t *node, adjust_ctx_t *ctx)
 	                               wildcard, ctx->zone->apex->owner, &ctx->zone->nsec3_params);
 }
 
-static bool nsec3_params_match(const knot_rdataset_t *rrs,
-                               const dnssec_nsec3_params_t *params,
-                               size_t rdata_pos)
+static bool nsec3_params_match(const knot_rdata_t *rdata,
+                               const dnssec_nsec3_params_t *params)
 {
-	assert(rrs != NULL);
+	assert(rdata != NULL);
 	assert(params != NULL);
 
-	knot_rdata_t *rdata = knot_rdataset_at(rrs, rdata_pos);
-
 	return (knot_nsec3_alg(rdata) == params->algorithm
 	        && knot_nsec3_iters(rdata) == params->iterations
 	        && knot_nsec3_salt_len(rdata) == params->salt.size
@@ -120,10 +142,12 @@ int adjust_cb_nsec3_flags(zone_node_t *node, adjust_ctx_t *ctx)
 	// check if this node belongs to correct chain
 	node->flags &= ~NODE_FLAGS_IN_NSEC3_CHAIN;
 	const knot_rdataset_t *nsec3_rrs = node_rdataset(node, KNOT_RRTYPE_NSEC3);
+	knot_rdata_t *rdata = (nsec3_rrs != NULL) ? nsec3_rrs->rdata : NULL;
 	for (uint16_t i = 0; nsec3_rrs != NULL && i < nsec3_rrs->count; i++) {
-		if (nsec3_params_match(nsec3_rrs, &ctx->zone->nsec3_params, i)) {
+		if (nsec3_params_match(rdata, &ctx->zone->nsec3_params)) {
 			node->flags |= NODE_FLAGS_IN_NSEC3_CHAIN;
 		}
+		rdata = knot_rdataset_next(rdata);
 	}
 
 	if (node->flags != flags_orig && ctx->changed_nodes != NULL) {
@@ -260,15 +284,6 @@ int adjust_cb_additionals(zone_node_t *node, adjust_ctx_t *ctx)
 	return KNOT_EOK;
 }
 
-int adjust_cb_flags_and_nsec3(zone_node_t *node, adjust_ctx_t *ctx)
-{
-	int ret = adjust_cb_flags(node, ctx);
-	if (ret == KNOT_EOK) {
-		ret = adjust_cb_nsec3_pointer(node, ctx);
-	}
-	return ret;
-}
-
 int adjust_cb_nsec3_and_additionals(zone_node_t *node, adjust_ctx_t *ctx)
 {
 	int ret = adjust_cb_nsec3_pointer(node, ctx);
@@ -384,6 +399,35 @@ int zone_adjust_contents(zone_contents_t *zone, adjust_cb_t nodes_cb, adjust_cb_
 	return ret;
 }
 
+typedef struct {
+	adjust_ctx_t *ctx;
+	adjust_cb_t adjust_cb;
+} zone_adjust_parallel_arg_t;
+
+static int adjust_single_parallel(zone_node_t *node, void *data)
+{
+	zone_adjust_parallel_arg_t *args = data;
+
+	if ((node->flags & NODE_FLAGS_DELETED)) {
+		return KNOT_EOK;
+	}
+
+	return args->adjust_cb(node, args->ctx);
+}
+
+int zone_adjust_contents_parallel(zone_contents_t *zone, adjust_cb_t nodes_cb,
+                                  unsigned threads)
+{
+	if (threads <= 1) {
+		return zone_adjust_contents(zone, nodes_cb, NULL, false, NULL);
+	}
+
+	adjust_ctx_t ctx = { zone, NULL, true };
+	zone_adjust_parallel_arg_t arg = { &ctx, nodes_cb };
+
+	return zone_tree_parallel_apply(zone->nodes, adjust_single_parallel, &arg, threads);
+}
+
 int zone_adjust_update(zone_update_t *update, adjust_cb_t nodes_cb, adjust_cb_t nsec3_cb, bool measure_diff)
 {
 	int ret = KNOT_EOK;
@@ -402,11 +446,11 @@ int zone_adjust_update(zone_update_t *update, adjust_cb_t nodes_cb, adjust_cb_t
 	return ret;
 }
 
-int zone_adjust_full(zone_contents_t *zone)
+int zone_adjust_full(zone_contents_t *zone, unsigned threads)
 {
 	int ret = zone_adjust_contents(zone, adjust_cb_flags, adjust_cb_nsec3_flags, true, NULL);
 	if (ret == KNOT_EOK) {
-		ret = zone_adjust_contents(zone, adjust_cb_nsec3_and_additionals, NULL, false, NULL);
+		ret = zone_adjust_contents_parallel(zone, adjust_cb_nsec3_and_additionals, threads);
 	}
 	if (ret == KNOT_EOK) {
 		additionals_tree_free(zone->adds_tree);
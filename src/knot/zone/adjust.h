@@ -54,9 +54,6 @@ int adjust_cb_nsec3_pointer(zone_node_t *node, adjust_ctx_t *ctx);
 // fix NORMAL node flags to additionals, like NS records and glue...
 int adjust_cb_additionals(zone_node_t *node, adjust_ctx_t *ctx);
 
-// adjust_cb_flags and adjust_cb_nsec3_pointer at once
-int adjust_cb_flags_and_nsec3(zone_node_t *node, adjust_ctx_t *ctx);
-
 // adjust_cb_nsec3_pointer, adjust_cb_wildcard_nsec3 and adjust_cb_additionals at once
 int adjust_cb_nsec3_and_additionals(zone_node_t *node, adjust_ctx_t *ctx);
 
@@ -77,6 +74,22 @@ int adjust_cb_void(zone_node_t *node, adjust_ctx_t *ctx);
 int zone_adjust_contents(zone_contents_t *zone, adjust_cb_t nodes_cb, adjust_cb_t nsec3_cb,
                          bool measure_zone, zone_tree_t *add_changed);
 
+/*!
+ * \brief Apply callback to NORMAL nodes using more threads.
+ *
+ * \note The callback may only modify the node being adjusted and it can't rely
+ *       on the adjusting order, thus the node flags and PREV pointers must be
+ *       already adjusted.
+ *
+ * \param zone      Zone to be adjusted.
+ * \param nodes_cb  Callback for NORMAL nodes.
+ * \param threads   Maximal number of threads to use.
+ *
+ * \return KNOT_E*
+ */
+int zone_adjust_contents_parallel(zone_contents_t *zone, adjust_cb_t nodes_cb,
+                                  unsigned threads);
+
 /*!
  * \brief Apply callback to nodes affected by the zone update.
  *
@@ -97,13 +110,14 @@ int zone_adjust_update(zone_update_t *update, adjust_cb_t nodes_cb, adjust_cb_t
  * \brief Do a general-purpose full update.
  *
  * This operates in two phases, first fix basic node flags and prev pointers,
- * than nsec3-related pointers and additionals.
+ * than nsec3-related pointers and additionals, which can be done in parallel.
  *
- * \param zone   Zone to be adjusted.
+ * \param zone     Zone to be adjusted.
+ * \param threads  Number of threads for the second phase.
  *
  * \return KNOT_E*
  */
-int zone_adjust_full(zone_contents_t *zone);
+int zone_adjust_full(zone_contents_t *zone, unsigned threads);
 
 /*!
  * \brief Do a generally approved adjust after incremental update.
@@ -438,7 +438,7 @@ bool zone_contents_find_node_or_wildcard(const zone_contents_t *contents,
 	const zone_node_t *encloser = NULL;
 	zone_contents_find_dname(contents, find, found, &encloser, NULL);
 	if (*found == NULL && encloser != NULL && (encloser->flags & NODE_FLAGS_WILDCARD_CHILD)) {
-		*found = zone_contents_find_wildcard_child(contents, encloser);
+		*found = node_wildcard_child(encloser);
 		assert(*found != NULL);
 	}
 	return (*found != NULL);
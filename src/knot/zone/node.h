@@ -32,6 +32,8 @@ struct rr_data;
 typedef struct zone_node {
 	knot_dname_t *owner; /*!< Domain name being the owner of this node. */
 	struct zone_node *parent; /*!< Parent node in the name hierarchy. */
+	struct zone_node *cut; /*!< Delegation point at or above this node, NULL if authoritative. */
+	struct zone_node *wildcard_child; /*!< Wildcard child, valid with NODE_FLAGS_WILDCARD_CHILD. */
 
 	/*! \brief Array with data of RRSets belonging to this node. */
 	struct rr_data *rrs;
@@ -275,6 +277,26 @@ inline static zone_node_t *node_parent(const zone_node_t *node)
 	return binode_node_as(node->parent, node);
 }
 
+/*!
+ * \brief Returns the delegation point (fixing bi-node issue) the node is at or below.
+ *
+ * \note Set by adjust_cb_flags(), NULL for authoritative nodes.
+ */
+inline static zone_node_t *node_cut(const zone_node_t *node)
+{
+	return binode_node_as(node->cut, node);
+}
+
+/*!
+ * \brief Returns the wildcard child (fixing bi-node issue) of given node.
+ *
+ * \note Set by adjust_cb_flags(), NULL without NODE_FLAGS_WILDCARD_CHILD.
+ */
+inline static zone_node_t *node_wildcard_child(const zone_node_t *node)
+{
+	return binode_node_as(node->wildcard_child, node);
+}
+
 /*!
  * \brief Returns previous (lexicographically in same zone tree) node (fixing bi-node issue) of given node.
  */
@@ -14,6 +14,7 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -146,6 +147,7 @@ typedef enum {
 	OPTIONAL =  1 << 1,
 	NSEC =      1 << 2,
 	NSEC3 =     1 << 3,
+	NSEC_CHAIN = 1 << 4, // NSEC chain walk, can't run in parallel
 } check_level_t;
 
 typedef struct {
@@ -156,6 +158,13 @@ typedef struct {
 	time_t time;
 } semchecks_data_t;
 
+/*! \brief Error handler serializing the callbacks from more threads. */
+typedef struct {
+	sem_handler_t handler;
+	sem_handler_t *orig;
+	pthread_mutex_t mx;
+} sem_handler_locked_t;
+
 static int check_cname(const zone_node_t *node, semchecks_data_t *data);
 static int check_dname(const zone_node_t *node, semchecks_data_t *data);
 static int check_delegation(const zone_node_t *node, semchecks_data_t *data);
@@ -184,7 +193,7 @@ static const struct check_function CHECK_FUNCTIONS[] = {
 	{ check_rrsig,          NSEC | NSEC3 },
 	{ check_rrsig_signed,   NSEC | NSEC3 },
 	{ check_nsec_bitmap,    NSEC | NSEC3 },
-	{ check_nsec,           NSEC },
+	{ check_nsec,           NSEC_CHAIN },
 	{ check_nsec3,          NSEC3 },
 	{ check_nsec3_presence, NSEC3 },
 	{ check_nsec3_opt_out,  NSEC3 },
@@ -1226,8 +1235,47 @@ static void check_dnskey(zone_contents_t *zone, sem_handler_t *handler)
 	}
 }
 
+static void locked_handler_cb(sem_handler_t *handler, const zone_contents_t *zone,
+                              const zone_node_t *node, sem_error_t error, const char *data)
+{
+	sem_handler_locked_t *locked = (sem_handler_locked_t *)handler;
+
+	pthread_mutex_lock(&locked->mx);
+	locked->orig->fatal_error |= handler->fatal_error;
+	locked->orig->cb(locked->orig, zone, node, error, data);
+	pthread_mutex_unlock(&locked->mx);
+}
+
+static int checks_in_parallel(semchecks_data_t *data, unsigned threads)
+{
+	sem_handler_locked_t locked = {
+		.handler = { .cb = locked_handler_cb },
+		.orig = data->handler,
+	};
+	pthread_mutex_init(&locked.mx, NULL);
+
+	semchecks_data_t parallel = *data;
+	parallel.handler = &locked.handler;
+	parallel.level &= ~NSEC_CHAIN;
+
+	int ret = zone_tree_parallel_apply(data->zone->nodes, do_checks_in_tree,
+	                                   &parallel, threads);
+	data->handler->fatal_error |= locked.handler.fatal_error;
+	pthread_mutex_destroy(&locked.mx);
+
+	// NSEC chain is checked in the canonical order
+	if (ret == KNOT_EOK && (data->level & NSEC_CHAIN)) {
+		semchecks_data_t chain = *data;
+		chain.level = NSEC_CHAIN;
+		ret = zone_contents_apply(data->zone, do_checks_in_tree, &chain);
+		data->next_nsec = chain.next_nsec;
+	}
+
+	return ret;
+}
+
 int sem_checks_process(zone_contents_t *zone, bool optional, sem_handler_t *handler,
-                       time_t time)
+                       time_t time, unsigned threads)
 {
 	if (zone == NULL || handler == NULL) {
 		return KNOT_EINVAL;
@@ -1250,13 +1298,14 @@ int sem_checks_process(zone_contents_t *zone, bool optional, sem_handler_t *hand
 				data.level |= NSEC3;
 				check_nsec3param(nsec3param, zone, handler, &data);
 			} else {
-				data.level |= NSEC;
+				data.level |= NSEC | NSEC_CHAIN;
 			}
 			check_dnskey(zone, handler);
 		}
 	}
 
-	int ret = zone_contents_apply(zone, do_checks_in_tree, &data);
+	int ret = (threads > 1) ? checks_in_parallel(&data, threads) :
+	                          zone_contents_apply(zone, do_checks_in_tree, &data);
 	if (ret != KNOT_EOK) {
 		return ret;
 	}
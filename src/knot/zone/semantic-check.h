@@ -117,10 +117,11 @@ struct sem_handler {
  * \param optional  To do also optional check.
  * \param handler   Semantic error handler.
  * \param time      Check zone at given time (rrsig expiration).
+ * \param threads   Number of threads to use for large zones.
  *
  * \retval KNOT_EOK no error found
  * \retval KNOT_ESEMCHECK found semantic error
  * \retval KNOT_EINVAL or other error
  */
 int sem_checks_process(zone_contents_t *zone, bool optional, sem_handler_t *handler,
-                       time_t time);
+                       time_t time, unsigned threads);
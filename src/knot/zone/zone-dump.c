@@ -1,4 +1,4 @@
-/*  Copyright (C) 2018 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -15,19 +15,30 @@
  */
 
 #include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "knot/dnssec/zone-nsec.h"
 #include "knot/zone/zone-dump.h"
 #include "libknot/libknot.h"
+#include "contrib/macros.h"
 
 /*! \brief Size of auxiliary buffer. */
 #define DUMP_BUF_LEN (70 * 1024)
 
+/*! \brief Number of consecutive nodes formatted at once by a dump thread. */
+#define DUMP_BLOCK_NODES 1024
+
+/*! \brief Output size triggering the output of a sequentially formatted block. */
+#define DUMP_BLOCK_SIZE (1024 * 1024)
+
+/*! \brief Number of formatted blocks per thread waiting for the output. */
+#define DUMP_WINDOW 4
+
 /*! \brief Dump parameters. */
 typedef struct {
 	FILE     *file;
-	char     *buf;
-	size_t   buflen;
 	uint64_t rr_count;
 	bool     dump_rrsig;
 	bool     dump_nsec;
@@ -36,21 +47,298 @@ typedef struct {
 	const char *first_comment;
 } dump_params_t;
 
-static int apex_node_dump_text(zone_node_t *node, dump_params_t *params)
+/*! \brief Block of the parallel dump. */
+typedef struct {
+	zone_dump_block_t out;
+	int ret;
+	bool done;
+} dump_slot_t;
+
+/*! \brief Parallel dump context. */
+typedef struct {
+	zone_dump_format_t format;
+	void *data;
+	zone_tree_it_t *it;
+	size_t left;     /*!< Number of nodes to be taken yet. */
+	dump_slot_t *slots;
+	size_t window;
+	size_t claimed;  /*!< Number of blocks taken by the dump threads. */
+	size_t written;  /*!< Number of blocks passed to the output. */
+	bool stop;
+	pthread_mutex_t mx;
+	pthread_cond_t cond;
+} dump_ctx_t;
+
+char *zone_dump_block_reserve(zone_dump_block_t *block, size_t len)
+{
+	if (block->size - block->len < len) {
+		size_t size = MAX(2 * block->size, block->len + len);
+		char *text = realloc(block->text, size);
+		if (text == NULL) {
+			return NULL;
+		}
+		block->text = text;
+		block->size = size;
+	}
+
+	return block->text + block->len;
+}
+
+static bool dump_finished(dump_ctx_t *ctx)
+{
+	return ctx->left == 0 || zone_tree_it_finished(ctx->it);
+}
+
+static int block_format(zone_dump_block_t *block, zone_node_t **nodes, size_t count,
+                        zone_dump_format_t format, void *data)
+{
+	for (size_t i = 0; i < count; i++) {
+		int ret = format(nodes[i], block, data);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	return KNOT_EOK;
+}
+
+static void *dump_thread(void *arg)
+{
+	dump_ctx_t *ctx = arg;
+	zone_node_t *nodes[DUMP_BLOCK_NODES];
+
+	// The auxiliary buffer is lent to the blocks being formatted.
+	char *buf = malloc(DUMP_BUF_LEN);
+	size_t buflen = DUMP_BUF_LEN;
+
+	pthread_mutex_lock(&ctx->mx);
+	if (buf == NULL) {
+		ctx->stop = true;
+		pthread_cond_broadcast(&ctx->cond);
+	}
+	while (true) {
+		while (!ctx->stop && !dump_finished(ctx) &&
+		       ctx->claimed >= ctx->written + ctx->window) {
+			pthread_cond_wait(&ctx->cond, &ctx->mx);
+		}
+		if (ctx->stop || dump_finished(ctx)) {
+			break;
+		}
+
+		dump_slot_t *slot = &ctx->slots[ctx->claimed++ % ctx->window];
+		size_t count = 0;
+		while (count < DUMP_BLOCK_NODES && !dump_finished(ctx)) {
+			nodes[count++] = zone_tree_it_val(ctx->it);
+			zone_tree_it_next(ctx->it);
+			ctx->left--;
+		}
+		pthread_mutex_unlock(&ctx->mx);
+
+		slot->out.len = 0;
+		slot->out.items = 0;
+		slot->out.buf = buf;
+		slot->out.buflen = buflen;
+		int ret = block_format(&slot->out, nodes, count, ctx->format, ctx->data);
+		buf = slot->out.buf;
+		buflen = slot->out.buflen;
+
+		pthread_mutex_lock(&ctx->mx);
+		slot->ret = ret;
+		slot->done = true;
+		pthread_cond_broadcast(&ctx->cond);
+	}
+	pthread_mutex_unlock(&ctx->mx);
+
+	free(buf);
+
+	return NULL;
+}
+
+static int dump_parallel(zone_tree_it_t *it, size_t max_nodes,
+                         zone_dump_format_t format, zone_dump_output_t output,
+                         void *data, unsigned threads)
+{
+	dump_ctx_t ctx = {
+		.format = format,
+		.data = data,
+		.it = it,
+		.left = max_nodes,
+		.window = DUMP_WINDOW * threads,
+	};
+
+	ctx.slots = calloc(ctx.window, sizeof(*ctx.slots));
+	if (ctx.slots == NULL) {
+		return KNOT_ENOMEM;
+	}
+	int ret = KNOT_EOK;
+	pthread_mutex_init(&ctx.mx, NULL);
+	pthread_cond_init(&ctx.cond, NULL);
+
+	pthread_t thr[threads];
+	unsigned started = 0;
+	for (; started < threads; started++) {
+		if (pthread_create(&thr[started], NULL, dump_thread, &ctx) != 0) {
+			break;
+		}
+	}
+	if (started == 0) {
+		ret = KNOT_ENOMEM;
+	}
+
+	// The calling thread passes the formatted blocks to the output in order.
+	pthread_mutex_lock(&ctx.mx);
+	while (ret == KNOT_EOK) {
+		dump_slot_t *slot = &ctx.slots[ctx.written % ctx.window];
+		while (!ctx.stop && !slot->done &&
+		       !(ctx.written == ctx.claimed && dump_finished(&ctx))) {
+			pthread_cond_wait(&ctx.cond, &ctx.mx);
+		}
+		if (ctx.stop) {
+			ret = KNOT_ENOMEM;
+			break;
+		}
+		if (!slot->done) {
+			break; // All blocks written.
+		}
+		pthread_mutex_unlock(&ctx.mx);
+
+		ret = (slot->ret != KNOT_EOK) ? slot->ret : output(&slot->out, data);
+
+		pthread_mutex_lock(&ctx.mx);
+		slot->done = false;
+		ctx.written++;
+		pthread_cond_broadcast(&ctx.cond);
+	}
+	ctx.stop = true;
+	pthread_cond_broadcast(&ctx.cond);
+	pthread_mutex_unlock(&ctx.mx);
+
+	for (unsigned i = 0; i < started; i++) {
+		pthread_join(thr[i], NULL);
+	}
+
+	for (size_t i = 0; i < ctx.window; i++) {
+		free(ctx.slots[i].out.text);
+	}
+	free(ctx.slots);
+	pthread_cond_destroy(&ctx.cond);
+	pthread_mutex_destroy(&ctx.mx);
+
+	return ret;
+}
+
+static int dump_sequential(zone_tree_it_t *it, size_t max_nodes,
+                           zone_dump_format_t format, zone_dump_output_t output,
+                           void *data)
+{
+	zone_dump_block_t block = {
+		.buf = malloc(DUMP_BUF_LEN),
+		.buflen = DUMP_BUF_LEN
+	};
+	if (block.buf == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	int ret = KNOT_EOK;
+	while (ret == KNOT_EOK && max_nodes > 0 && !zone_tree_it_finished(it)) {
+		ret = format(zone_tree_it_val(it), &block, data);
+		zone_tree_it_next(it);
+		max_nodes--;
+
+		// Output the formatted text in large blocks.
+		if (ret == KNOT_EOK && (block.len >= DUMP_BLOCK_SIZE || max_nodes == 0 ||
+		                        zone_tree_it_finished(it))) {
+			ret = output(&block, data);
+			block.len = 0;
+			block.items = 0;
+		}
+	}
+
+	free(block.text);
+	free(block.buf);
+
+	return ret;
+}
+
+int zone_dump_tree_part(zone_tree_t *tree, const knot_dname_t *from,
+                        size_t max_nodes, zone_dump_format_t format,
+                        zone_dump_output_t output, void *data, unsigned threads,
+                        knot_dname_t **next)
+{
+	if (format == NULL || output == NULL || max_nodes == 0) {
+		return KNOT_EINVAL;
+	}
+
+	if (next != NULL) {
+		*next = NULL;
+	}
+
+	if (zone_tree_is_empty(tree)) {
+		return KNOT_EOK;
+	}
+
+	zone_tree_it_t it = { 0 };
+	int ret = (from != NULL) ? zone_tree_it_from_begin(tree, from, &it) :
+	                           zone_tree_it_begin(tree, &it);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	if (threads > 1 && MIN(zone_tree_count(tree), max_nodes) >= 2 * DUMP_BLOCK_NODES) {
+		ret = dump_parallel(&it, max_nodes, format, output, data, threads);
+	} else {
+		ret = dump_sequential(&it, max_nodes, format, output, data);
+	}
+
+	if (ret == KNOT_EOK && next != NULL && !zone_tree_it_finished(&it)) {
+		*next = knot_dname_copy(zone_tree_it_val(&it)->owner, NULL);
+		if (*next == NULL) {
+			ret = KNOT_ENOMEM;
+		}
+	}
+	zone_tree_it_free(&it);
+
+	return ret;
+}
+
+int zone_dump_tree(zone_tree_t *tree, zone_dump_format_t format,
+                   zone_dump_output_t output, void *data, unsigned threads)
+{
+	return zone_dump_tree_part(tree, NULL, SIZE_MAX, format, output, data,
+	                           threads, NULL);
+}
+
+static int rrset_dump_text(const knot_rrset_t *rrset, zone_dump_block_t *block,
+                           const knot_dump_style_t *style)
+{
+	int ret = knot_rrset_txt_dump(rrset, &block->buf, &block->buflen, style);
+	if (ret < 0) {
+		return ret;
+	}
+
+	char *end = zone_dump_block_reserve(block, ret);
+	if (end == NULL) {
+		return KNOT_ENOMEM;
+	}
+	memcpy(end, block->buf, ret);
+	block->len += ret;
+	block->items += rrset->rrs.count;
+
+	return KNOT_EOK;
+}
+
+static int apex_node_dump_text(zone_node_t *node, zone_dump_block_t *block,
+                               dump_params_t *params)
 {
 	knot_rrset_t soa = node_rrset(node, KNOT_RRTYPE_SOA);
 	knot_dump_style_t soa_style = *params->style;
 
 	// Dump SOA record as a first.
 	if (!params->dump_nsec) {
-		int ret = knot_rrset_txt_dump(&soa, &params->buf, &params->buflen,
-		                              &soa_style);
-		if (ret < 0) {
+		int ret = rrset_dump_text(&soa, block, &soa_style);
+		if (ret != KNOT_EOK) {
 			return ret;
 		}
-		params->rr_count += soa.rrs.count;
-		fprintf(params->file, "%s", params->buf);
-		params->buf[0] = '\0';
 	}
 
 	// Dump other records.
@@ -67,28 +355,23 @@ static int apex_node_dump_text(zone_node_t *node, dump_params_t *params)
 			break;
 		}
 
-		int ret = knot_rrset_txt_dump(&rrset, &params->buf, &params->buflen,
-		                              params->style);
-		if (ret < 0) {
+		int ret = rrset_dump_text(&rrset, block, params->style);
+		if (ret != KNOT_EOK) {
 			return ret;
 		}
-		params->rr_count +=  rrset.rrs.count;
-		fprintf(params->file, "%s", params->buf);
-		params->buf[0] = '\0';
 	}
 
 	return KNOT_EOK;
 }
 
-static int node_dump_text(zone_node_t *node, void *data)
+static int node_dump_text(zone_node_t *node, zone_dump_block_t *block, void *data)
 {
 	dump_params_t *params = (dump_params_t *)data;
 
 	// Zone apex rrsets.
 	if (node->owner == params->origin && !params->dump_rrsig &&
 	    !params->dump_nsec) {
-		apex_node_dump_text(node, params);
-		return KNOT_EOK;
+		return apex_node_dump_text(node, block, params);
 	}
 
 	// Dump non-apex rrsets.
@@ -117,35 +400,42 @@ static int node_dump_text(zone_node_t *node, void *data)
 			break;
 		}
 
-		// Dump block comment if available.
-		if (params->first_comment != NULL) {
-			fprintf(params->file, "%s", params->first_comment);
-			params->first_comment = NULL;
-		}
-
-		int ret = knot_rrset_txt_dump(&rrset, &params->buf, &params->buflen,
-		                              params->style);
-		if (ret < 0) {
+		int ret = rrset_dump_text(&rrset, block, params->style);
+		if (ret != KNOT_EOK) {
 			return ret;
 		}
-		params->rr_count += rrset.rrs.count;
-		fprintf(params->file, "%s", params->buf);
-		params->buf[0] = '\0';
 	}
 
 	return KNOT_EOK;
 }
 
-int zone_dump_text(zone_contents_t *zone, FILE *file, bool comments)
+static int block_write_text(zone_dump_block_t *block, void *data)
 {
-	if (zone == NULL || file == NULL) {
-		return KNOT_EINVAL;
+	dump_params_t *params = (dump_params_t *)data;
+
+	if (block->len == 0) {
+		return KNOT_EOK;
 	}
 
-	// Allocate auxiliary buffer for dumping operations.
-	char *buf = malloc(DUMP_BUF_LEN);
-	if (buf == NULL) {
-		return KNOT_ENOMEM;
+	// Dump block comment if available.
+	if (params->first_comment != NULL) {
+		fprintf(params->file, "%s", params->first_comment);
+		params->first_comment = NULL;
+	}
+
+	params->rr_count += block->items;
+	if (fwrite(block->text, block->len, 1, params->file) != 1) {
+		return KNOT_EFILE;
+	}
+
+	return KNOT_EOK;
+}
+
+int zone_dump_text(zone_contents_t *zone, FILE *file, bool comments,
+                   unsigned threads)
+{
+	if (zone == NULL || file == NULL) {
+		return KNOT_EINVAL;
 	}
 
 	if (comments) {
@@ -156,8 +446,6 @@ int zone_dump_text(zone_contents_t *zone, FILE *file, bool comments)
 	zone_node_t *apex = zone->apex;
 	dump_params_t params = {
 		.file = file,
-		.buf = buf,
-		.buflen = DUMP_BUF_LEN,
 		.rr_count = 0,
 		.origin = apex->owner,
 		.style = &KNOT_DUMP_STYLE_DEFAULT,
@@ -166,7 +454,8 @@ int zone_dump_text(zone_contents_t *zone, FILE *file, bool comments)
 	};
 
 	// Dump standard zone records without RRSIGS.
-	int ret = zone_contents_apply(zone, node_dump_text, &params);
+	int ret = zone_dump_tree(zone->nodes, node_dump_text, block_write_text,
+	                         &params, threads);
 	if (ret != KNOT_EOK) {
 		return ret;
 	}
@@ -175,7 +464,8 @@ int zone_dump_text(zone_contents_t *zone, FILE *file, bool comments)
 	params.dump_rrsig = true;
 	params.dump_nsec = false;
 	params.first_comment = comments ? ";; DNSSEC signatures\n" : NULL;
-	ret = zone_contents_apply(zone, node_dump_text, &params);
+	ret = zone_dump_tree(zone->nodes, node_dump_text, block_write_text,
+	                     &params, threads);
 	if (ret != KNOT_EOK) {
 		return ret;
 	}
@@ -184,7 +474,8 @@ int zone_dump_text(zone_contents_t *zone, FILE *file, bool comments)
 	params.dump_rrsig = false;
 	params.dump_nsec = true;
 	params.first_comment = comments ? ";; DNSSEC NSEC chain\n" : NULL;
-	ret = zone_contents_apply(zone, node_dump_text, &params);
+	ret = zone_dump_tree(zone->nodes, node_dump_text, block_write_text,
+	                     &params, threads);
 	if (ret != KNOT_EOK) {
 		return ret;
 	}
@@ -193,7 +484,8 @@ int zone_dump_text(zone_contents_t *zone, FILE *file, bool comments)
 	params.dump_rrsig = false;
 	params.dump_nsec = true;
 	params.first_comment = comments ? ";; DNSSEC NSEC3 chain\n" : NULL;
-	ret = zone_contents_nsec3_apply(zone, node_dump_text, &params);
+	ret = zone_dump_tree(zone->nsec3_nodes, node_dump_text, block_write_text,
+	                     &params, threads);
 	if (ret != KNOT_EOK) {
 		return ret;
 	}
@@ -201,7 +493,8 @@ int zone_dump_text(zone_contents_t *zone, FILE *file, bool comments)
 	params.dump_rrsig = true;
 	params.dump_nsec = false;
 	params.first_comment = comments ? ";; DNSSEC NSEC3 signatures\n" : NULL;
-	ret = zone_contents_nsec3_apply(zone, node_dump_text, &params);
+	ret = zone_dump_tree(zone->nsec3_nodes, node_dump_text, block_write_text,
+	                     &params, threads);
 	if (ret != KNOT_EOK) {
 		return ret;
 	}
@@ -220,7 +513,5 @@ int zone_dump_text(zone_contents_t *zone, FILE *file, bool comments)
 	        	params.rr_count, date);
 	}
 
-	free(params.buf); // params.buf may be != buf because of knot_rrset_txt_dump_dynamic()
-
 	return KNOT_EOK;
 }
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2018 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -18,14 +18,91 @@
 
 #include "knot/zone/zone.h"
 
+/*! \brief Formatted output of consecutive zone nodes. */
+typedef struct {
+	char *text;      /*!< Formatted output. */
+	size_t len;      /*!< Output length. */
+	size_t size;     /*!< Allocated output size. */
+	uint64_t items;  /*!< Number of formatted items (e.g. records). */
+	char *buf;       /*!< Auxiliary buffer of the formatting thread. */
+	size_t buflen;   /*!< Auxiliary buffer size. */
+} zone_dump_block_t;
+
+/*!
+ * \brief Callback formatting a zone node into the output block.
+ *
+ * \note The callback is called from more threads concurrently.
+ */
+typedef int (*zone_dump_format_t)(zone_node_t *node, zone_dump_block_t *block,
+                                  void *data);
+
+/*!
+ * \brief Callback processing the formatted output, called in the zone order.
+ */
+typedef int (*zone_dump_output_t)(zone_dump_block_t *block, void *data);
+
+/*!
+ * \brief Ensures free space at the end of the output block.
+ *
+ * \param block  Output block.
+ * \param len    Required free space.
+ *
+ * \return Pointer to the end of the output, NULL if no memory.
+ */
+char *zone_dump_block_reserve(zone_dump_block_t *block, size_t len);
+
+/*!
+ * \brief Formats zone tree nodes on more threads and outputs them in order.
+ *
+ * Blocks of consecutive nodes are formatted by the dump threads and passed
+ * to the output callback on the calling thread in the tree order. Small trees
+ * are formatted by the calling thread only.
+ *
+ * \param tree      Zone tree to be dumped.
+ * \param format    Node formatting callback.
+ * \param output    Output callback.
+ * \param data      Arbitrary data to be passed to the callbacks.
+ * \param threads   Number of formatting threads.
+ *
+ * \return KNOT_E*
+ */
+int zone_dump_tree(zone_tree_t *tree, zone_dump_format_t format,
+                   zone_dump_output_t output, void *data, unsigned threads);
+
+/*!
+ * \brief Formats a limited run of zone tree nodes, see zone_dump_tree().
+ *
+ * The tree must stay valid during the call only, the dump can be continued
+ * later, possibly in a newer version of the tree, from the returned name.
+ *
+ * \param tree       Zone tree to be dumped.
+ * \param from       Name of the first node to be dumped (or the following one
+ *                   if not present), NULL to start from the tree beginning.
+ * \param max_nodes  Maximum number of nodes to be dumped.
+ * \param format     Node formatting callback.
+ * \param output     Output callback.
+ * \param data       Arbitrary data to be passed to the callbacks.
+ * \param threads    Number of formatting threads.
+ * \param next       Optional output name of the next node to be dumped or NULL
+ *                   if the tree end was reached. Must be freed by the caller.
+ *
+ * \return KNOT_E*
+ */
+int zone_dump_tree_part(zone_tree_t *tree, const knot_dname_t *from,
+                        size_t max_nodes, zone_dump_format_t format,
+                        zone_dump_output_t output, void *data, unsigned threads,
+                        knot_dname_t **next);
+
 /*!
  * \brief Dumps given zone to text file.
  *
  * \param zone      Zone to be saved.
  * \param file      File to write to.
  * \param comments  Add separating comments indicator.
+ * \param threads   Number of formatting threads.
  *
  * \retval KNOT_EOK on success.
  * \retval < 0 if error.
  */
-int zone_dump_text(zone_contents_t *zone, FILE *file, bool comments);
+int zone_dump_text(zone_contents_t *zone, FILE *file, bool comments,
+                   unsigned threads);
@@ -0,0 +1,301 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "knot/zone/zone-image.h"
+#include "libknot/libknot.h"
+#include "contrib/files.h"
+
+#define IMAGE_MAGIC	"KNOTZIMG"
+#define IMAGE_VERSION	1
+
+/*! \brief Records are aligned for direct use of the rdata. */
+#define IMAGE_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+typedef struct {
+	char magic[8];         /*!< Image identification. */
+	uint32_t version;      /*!< Format version, also checks the byte order. */
+	uint32_t origin_size;  /*!< Zone name size. */
+	uint64_t src_dev;      /*!< Zone file device. */
+	uint64_t src_ino;      /*!< Zone file inode. */
+	uint64_t src_size;     /*!< Zone file size. */
+	int64_t src_sec;       /*!< Zone file mtime seconds. */
+	int64_t src_nsec;      /*!< Zone file mtime nanoseconds. */
+	uint64_t rrsets;       /*!< Number of RRSets. */
+} image_hdr_t;
+
+typedef struct {
+	uint16_t type;
+	uint16_t rclass;
+	uint32_t ttl;
+	uint16_t owner_size;
+	uint16_t count;        /*!< Number of RRs in the rdataset. */
+	uint32_t rdata_size;   /*!< Size of the rdataset. */
+} image_rr_t;
+
+static bool same_source(const image_hdr_t *hdr, const struct stat *source)
+{
+	return hdr->src_dev == source->st_dev &&
+	       hdr->src_ino == source->st_ino &&
+	       hdr->src_size == (uint64_t)source->st_size &&
+	       hdr->src_sec == source->st_mtim.tv_sec &&
+	       hdr->src_nsec == source->st_mtim.tv_nsec;
+}
+
+static bool rdataset_valid(const knot_rdataset_t *rrs)
+{
+	const uint8_t *pos = (const uint8_t *)rrs->rdata;
+	size_t left = rrs->size;
+
+	for (uint16_t i = 0; i < rrs->count; i++) {
+		if (left < sizeof(uint16_t)) {
+			return false;
+		}
+		size_t size = knot_rdata_size(((const knot_rdata_t *)pos)->len);
+		if (left < size) {
+			return false;
+		}
+		pos += size;
+		left -= size;
+	}
+
+	return rrs->count > 0 && left == 0;
+}
+
+static int load_rrsets(const uint8_t *pos, const uint8_t *end, uint64_t count,
+                       zone_contents_t *contents)
+{
+	for (uint64_t i = 0; i < count; i++) {
+		image_rr_t rr;
+		if ((size_t)(end - pos) < sizeof(rr)) {
+			return KNOT_EMALF;
+		}
+		memcpy(&rr, pos, sizeof(rr));
+		pos += sizeof(rr);
+
+		size_t owner_size = IMAGE_ALIGN(rr.owner_size);
+		size_t rdata_size = IMAGE_ALIGN(rr.rdata_size);
+		if ((size_t)(end - pos) < owner_size + rdata_size ||
+		    knot_dname_wire_check(pos, pos + rr.owner_size, NULL) != rr.owner_size) {
+			return KNOT_EMALF;
+		}
+		const uint8_t *owner = pos;
+		const uint8_t *rdata = pos + owner_size;
+		pos += owner_size + rdata_size;
+
+		knot_rrset_t rrset;
+		knot_rrset_init(&rrset, (knot_dname_t *)owner, rr.type, rr.rclass, rr.ttl);
+		rrset.rrs = (knot_rdataset_t) { rr.count, rr.rdata_size, (knot_rdata_t *)rdata };
+		if (!rdataset_valid(&rrset.rrs)) {
+			return KNOT_EMALF;
+		}
+
+		zone_node_t *node = NULL;
+		int ret = zone_contents_add_rr(contents, &rrset, &node);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	return (pos == end) ? KNOT_EOK : KNOT_EMALF;
+}
+
+int zone_image_load(const char *path, const struct stat *source,
+                    const knot_dname_t *origin, zone_contents_t **contents)
+{
+	if (path == NULL || source == NULL || origin == NULL || contents == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return knot_map_errno();
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int ret = knot_map_errno();
+		close(fd);
+		return ret;
+	}
+
+	image_hdr_t hdr;
+	size_t origin_size = knot_dname_size(origin);
+	if (st.st_size < (off_t)(sizeof(hdr) + IMAGE_ALIGN(origin_size))) {
+		close(fd);
+		return KNOT_EMALF;
+	}
+
+	uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return knot_map_errno();
+	}
+	(void)madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	const uint8_t *pos = data;
+	const uint8_t *end = data + st.st_size;
+
+	int ret = KNOT_EOK;
+	memcpy(&hdr, pos, sizeof(hdr));
+	pos += sizeof(hdr);
+	if (memcmp(hdr.magic, IMAGE_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.version != IMAGE_VERSION) {
+		ret = KNOT_ENOTSUP;
+	} else if (!same_source(&hdr, source) || hdr.origin_size != origin_size ||
+	           memcmp(pos, origin, origin_size) != 0) {
+		ret = KNOT_ENOENT;
+	}
+	pos += IMAGE_ALIGN(origin_size);
+
+	if (ret == KNOT_EOK) {
+		*contents = zone_contents_new(origin, true);
+		if (*contents == NULL) {
+			ret = KNOT_ENOMEM;
+		}
+	}
+	if (ret == KNOT_EOK) {
+		ret = load_rrsets(pos, end, hdr.rrsets, *contents);
+		if (ret != KNOT_EOK) {
+			zone_contents_deep_free(*contents);
+			*contents = NULL;
+		}
+	}
+
+	munmap(data, st.st_size);
+
+	return ret;
+}
+
+static int write_aligned(FILE *file, const void *data, size_t size)
+{
+	static const uint8_t padding[8] = { 0 };
+
+	if (fwrite(data, size, 1, file) != 1 && size > 0) {
+		return KNOT_EFILE;
+	}
+	size_t pad = IMAGE_ALIGN(size) - size;
+	if (pad > 0 && fwrite(padding, pad, 1, file) != 1) {
+		return KNOT_EFILE;
+	}
+
+	return KNOT_EOK;
+}
+
+static int write_rrsets(FILE *file, zone_contents_t *contents, uint64_t *count)
+{
+	zone_tree_it_t it = { 0 };
+	int ret = zone_tree_it_double_begin(contents->nodes, contents->nsec3_nodes, &it);
+	while (ret == KNOT_EOK && !zone_tree_it_finished(&it)) {
+		zone_node_t *node = zone_tree_it_val(&it);
+		for (uint16_t i = 0; ret == KNOT_EOK && i < node->rrset_count; i++) {
+			knot_rrset_t rrset = node_rrset_at(node, i);
+			image_rr_t rr = {
+				.type = rrset.type,
+				.rclass = rrset.rclass,
+				.ttl = rrset.ttl,
+				.owner_size = knot_dname_size(rrset.owner),
+				.count = rrset.rrs.count,
+				.rdata_size = rrset.rrs.size
+			};
+
+			ret = write_aligned(file, &rr, sizeof(rr));
+			if (ret == KNOT_EOK) {
+				ret = write_aligned(file, rrset.owner, rr.owner_size);
+			}
+			if (ret == KNOT_EOK) {
+				ret = write_aligned(file, rrset.rrs.rdata, rr.rdata_size);
+			}
+			(*count)++;
+		}
+		zone_tree_it_next(&it);
+	}
+	zone_tree_it_free(&it);
+
+	return ret;
+}
+
+int zone_image_write(const char *path, const struct stat *source,
+                     zone_contents_t *contents)
+{
+	if (path == NULL || source == NULL || contents == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	int ret = make_path(path, S_IRUSR|S_IWUSR|S_IXUSR|S_IRGRP|S_IWGRP|S_IXGRP);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	FILE *file = NULL;
+	char *tmp_name = NULL;
+	ret = open_tmp_file(path, &tmp_name, &file, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	const knot_dname_t *origin = contents->apex->owner;
+	image_hdr_t hdr = {
+		.version = IMAGE_VERSION,
+		.origin_size = knot_dname_size(origin),
+		.src_dev = source->st_dev,
+		.src_ino = source->st_ino,
+		.src_size = source->st_size,
+		.src_sec = source->st_mtim.tv_sec,
+		.src_nsec = source->st_mtim.tv_nsec
+	};
+	memcpy(hdr.magic, IMAGE_MAGIC, sizeof(hdr.magic));
+
+	/* The RRSet count is completed once all RRSets are written. */
+	ret = write_aligned(file, &hdr, sizeof(hdr));
+	if (ret == KNOT_EOK) {
+		ret = write_aligned(file, origin, hdr.origin_size);
+	}
+	if (ret == KNOT_EOK) {
+		ret = write_rrsets(file, contents, &hdr.rrsets);
+	}
+	if (ret == KNOT_EOK && (fseek(file, 0, SEEK_SET) != 0 ||
+	                        fwrite(&hdr, sizeof(hdr), 1, file) != 1)) {
+		ret = KNOT_EFILE;
+	}
+	if (fclose(file) != 0 && ret == KNOT_EOK) {
+		ret = KNOT_EFILE;
+	}
+	if (ret != KNOT_EOK) {
+		unlink(tmp_name);
+		free(tmp_name);
+		return ret;
+	}
+
+	/* Swap temporary image and new image. */
+	ret = rename(tmp_name, path);
+	if (ret != 0) {
+		ret = knot_map_errno();
+		unlink(tmp_name);
+		free(tmp_name);
+		return ret;
+	}
+
+	free(tmp_name);
+
+	return KNOT_EOK;
+}
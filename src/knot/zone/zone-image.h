@@ -0,0 +1,62 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Compiled zone file image.
+ *
+ * The image contains all zone records in the in-memory rdataset format
+ * together with the identification (device, inode, size, and mtime) of the
+ * zone file it was compiled from. The image is mapped into memory and the
+ * zone contents are built directly from it, without any text parsing.
+ *
+ * The image format is specific to the host, it's not portable.
+ */
+
+#pragma once
+
+#include <sys/stat.h>
+
+#include "knot/zone/contents.h"
+
+/*!
+ * \brief Load zone contents from the image of the given zone file.
+ *
+ * \note The contents are not adjusted.
+ *
+ * \param path      Image file path.
+ * \param source    Status of the zone file the image must correspond to.
+ * \param origin    Zone name.
+ * \param contents  Output zone contents.
+ *
+ * \retval KNOT_ENOENT if no image or an image of other zone file version exists.
+ * \retval KNOT_ENOTSUP if the image format isn't supported.
+ * \retval KNOT_EMALF if the image is corrupted.
+ * \return KNOT_E*
+ */
+int zone_image_load(const char *path, const struct stat *source,
+                    const knot_dname_t *origin, zone_contents_t **contents);
+
+/*!
+ * \brief Write an image of the zone contents loaded from the given zone file.
+ *
+ * \param path      Image file path.
+ * \param source    Status of the zone file the contents were loaded from.
+ * \param contents  Zone contents.
+ *
+ * \return KNOT_E*
+ */
+int zone_image_write(const char *path, const struct stat *source,
+                     zone_contents_t *contents);
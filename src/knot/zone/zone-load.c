@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -25,7 +25,8 @@
 #include "libknot/libknot.h"
 
 int zone_load_contents(conf_t *conf, const knot_dname_t *zone_name,
-                       zone_contents_t **contents, bool fail_on_warning)
+                       zone_contents_t **contents, bool use_image,
+                       bool fail_on_warning)
 {
 	if (conf == NULL || zone_name == NULL || contents == NULL) {
 		return KNOT_EINVAL;
@@ -47,6 +48,10 @@ int zone_load_contents(conf_t *conf, const knot_dname_t *zone_name,
 
 	zl.err_handler = &handler;
 	zl.creator->master = !zone_load_can_bootstrap(conf, zone_name);
+	zl.threads = conf->cache.srv_bg_threads;
+	if (use_image) {
+		zl.image = conf_zonefile_image(conf, zone_name);
+	}
 
 	*contents = zonefile_load(&zl);
 	zonefile_close(&zl);
@@ -15,6 +15,7 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdlib.h>
 
 #include "knot/zone/zone-tree.h"
@@ -29,6 +30,26 @@ typedef struct {
 	int binode_second;
 } zone_tree_func_t;
 
+/*! \brief Minimal number of nodes per thread worth of parallel apply. */
+#define PARALLEL_MIN   16384
+
+typedef struct {
+	zone_tree_it_t it;
+	size_t pos;              /*!< Position of the next node in the tree. */
+	pthread_mutex_t mx;
+	zone_tree_chunk_cb_t func;
+	int ret;
+} zone_tree_chunks_t;
+
+typedef struct {
+	zone_tree_chunks_t *chunks;
+	void *ctx;
+} zone_tree_chunks_thread_t;
+
+/*! \brief Number of threads running all the concurrent parallel applies. */
+static unsigned parallel_threads = 0;
+static pthread_mutex_t parallel_threads_mx = PTHREAD_MUTEX_INITIALIZER;
+
 static int tree_apply_cb(trie_val_t *node, void *data)
 {
 	zone_tree_func_t *f = (zone_tree_func_t *)data;
@@ -283,6 +304,163 @@ int zone_tree_apply(zone_tree_t *tree, zone_tree_apply_cb_t function, void *data
 	return trie_apply(tree->trie, tree_apply_cb, &f);
 }
 
+/*!
+ * \brief Reserve additional threads for a parallel apply.
+ *
+ * The calling thread is accounted too and the additional threads are reserved
+ * only if the total number of threads of all concurrent parallel applies
+ * doesn't exceed the requested one. Nested or concurrent applies (e.g. when
+ * more zones are being loaded at once) thus don't multiply the threads.
+ */
+static unsigned parallel_threads_reserve(unsigned threads)
+{
+	pthread_mutex_lock(&parallel_threads_mx);
+	parallel_threads++;
+	unsigned extra = (threads > parallel_threads) ? threads - parallel_threads : 0;
+	parallel_threads += extra;
+	pthread_mutex_unlock(&parallel_threads_mx);
+
+	return extra;
+}
+
+static void parallel_threads_release(unsigned extra)
+{
+	pthread_mutex_lock(&parallel_threads_mx);
+	parallel_threads -= extra + 1;
+	pthread_mutex_unlock(&parallel_threads_mx);
+}
+
+static void *parallel_chunks_thread(void *arg)
+{
+	zone_tree_chunks_thread_t *thr = arg;
+	zone_tree_chunks_t *ctx = thr->chunks;
+	zone_node_t *chunk[ZONE_TREE_CHUNK];
+
+	while (true) {
+		size_t count = 0;
+		pthread_mutex_lock(&ctx->mx);
+		size_t first = ctx->pos;
+		while (ctx->ret == KNOT_EOK && count < ZONE_TREE_CHUNK &&
+		       !zone_tree_it_finished(&ctx->it)) {
+			chunk[count++] = zone_tree_it_val(&ctx->it);
+			zone_tree_it_next(&ctx->it);
+		}
+		ctx->pos += count;
+		pthread_mutex_unlock(&ctx->mx);
+
+		if (count == 0) {
+			break;
+		}
+
+		int ret = ctx->func(chunk, count, first, thr->ctx);
+		if (ret != KNOT_EOK) {
+			pthread_mutex_lock(&ctx->mx);
+			if (ctx->ret == KNOT_EOK) {
+				ctx->ret = ret;
+			}
+			pthread_mutex_unlock(&ctx->mx);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+int zone_tree_parallel_chunks(zone_tree_t *tree, zone_tree_chunk_cb_t function,
+                              void **ctxs, unsigned threads)
+{
+	if (function == NULL || ctxs == NULL || threads == 0) {
+		return KNOT_EINVAL;
+	}
+
+	if (zone_tree_is_empty(tree)) {
+		return KNOT_EOK;
+	}
+
+	zone_tree_chunks_t ctx = {
+		.func = function,
+		.ret = KNOT_EOK,
+	};
+	int ret = zone_tree_it_begin(tree, &ctx.it);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+	pthread_mutex_init(&ctx.mx, NULL);
+
+	// Each thread processes at least one chunk.
+	threads = MIN(threads, zone_tree_count(tree) / ZONE_TREE_CHUNK);
+	unsigned extra = (threads > 1) ? parallel_threads_reserve(threads) : 0;
+
+	zone_tree_chunks_thread_t thr_ctx[extra + 1];
+	pthread_t thr[extra + 1];
+	unsigned started = 0;
+	for (unsigned i = 0; i <= extra; i++) {
+		thr_ctx[i].chunks = &ctx;
+		thr_ctx[i].ctx = ctxs[i];
+	}
+	for (; started < extra; started++) {
+		if (pthread_create(&thr[started], NULL, parallel_chunks_thread,
+		                   &thr_ctx[started + 1]) != 0) {
+			break;
+		}
+	}
+
+	// The calling thread is working too, it finishes the job if no thread started.
+	(void)parallel_chunks_thread(&thr_ctx[0]);
+
+	for (unsigned i = 0; i < started; i++) {
+		pthread_join(thr[i], NULL);
+	}
+
+	if (threads > 1) {
+		parallel_threads_release(extra);
+	}
+	pthread_mutex_destroy(&ctx.mx);
+	zone_tree_it_free(&ctx.it);
+
+	return ctx.ret;
+}
+
+static int parallel_apply_chunk(zone_node_t **nodes, size_t count, size_t first,
+                                void *ctx)
+{
+	UNUSED(first);
+	zone_tree_func_t *f = ctx;
+
+	for (size_t i = 0; i < count; i++) {
+		int ret = f->func(nodes[i], f->data);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	return KNOT_EOK;
+}
+
+int zone_tree_parallel_apply(zone_tree_t *tree, zone_tree_apply_cb_t function,
+                             void *data, unsigned threads)
+{
+	if (function == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	threads = MIN(threads, zone_tree_count(tree) / PARALLEL_MIN);
+	if (threads <= 1) {
+		return zone_tree_apply(tree, function, data);
+	}
+
+	zone_tree_func_t f = {
+		.func = function,
+		.data = data,
+	};
+	void *ctxs[threads];
+	for (unsigned i = 0; i < threads; i++) {
+		ctxs[i] = &f;
+	}
+
+	return zone_tree_parallel_chunks(tree, parallel_apply_chunk, ctxs, threads);
+}
+
 int zone_tree_sub_apply(zone_tree_t *tree, const knot_dname_t *sub_root,
                         bool excl_root, zone_tree_apply_cb_t function, void *data)
 {
@@ -325,6 +503,37 @@ int zone_tree_it_sub_begin(zone_tree_t *tree, const knot_dname_t *sub_root,
 	return KNOT_EOK;
 }
 
+int zone_tree_it_from_begin(zone_tree_t *tree, const knot_dname_t *from,
+                            zone_tree_it_t *it)
+{
+	if (tree == NULL || from == NULL) {
+		return KNOT_EINVAL;
+	}
+	int ret = zone_tree_it_begin(tree, it);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+	knot_dname_storage_t lf_storage;
+	uint8_t *lf = knot_dname_lf(from, lf_storage);
+	ret = trie_it_get_leq(it->it, lf + 1, *lf);
+	if (ret == 1) {
+		// Skip the preceding node.
+		zone_tree_it_next(it);
+	} else if (ret == KNOT_ENOENT) {
+		// All nodes follow the name, start from the beginning.
+		trie_it_free(it->it);
+		it->it = trie_it_begin(tree->trie);
+		if (it->it == NULL) {
+			it->tree = NULL;
+			return KNOT_ENOMEM;
+		}
+	} else if (ret != KNOT_EOK) {
+		zone_tree_it_free(it);
+		return ret;
+	}
+	return KNOT_EOK;
+}
+
 int zone_tree_it_double_begin(zone_tree_t *first, zone_tree_t *second, zone_tree_it_t *it)
 {
 	if (it->tree == NULL) {
@@ -212,6 +212,62 @@ int zone_tree_del_node(zone_tree_t *tree, zone_node_t *node, bool free_deleted);
  */
 int zone_tree_apply(zone_tree_t *tree, zone_tree_apply_cb_t function, void *data);
 
+/*! \brief Number of consecutive nodes handed out to a thread at once. */
+#define ZONE_TREE_CHUNK 256
+
+/*!
+ * \brief Callback processing a chunk of consecutive zone tree nodes.
+ *
+ * \param nodes  Nodes of the chunk.
+ * \param count  Number of the nodes (at most ZONE_TREE_CHUNK).
+ * \param first  Position of the first node in the tree.
+ * \param ctx    Context of the processing thread.
+ *
+ * \return KNOT_E*
+ */
+typedef int (*zone_tree_chunk_cb_t)(zone_node_t **nodes, size_t count,
+                                    size_t first, void *ctx);
+
+/*!
+ * \brief Processes the nodes of the zone in chunks using more threads.
+ *
+ * The chunks are handed out to the threads in order, each thread processes
+ * them with its own context. The processing stops after the first error.
+ * Threads are limited like in zone_tree_parallel_apply() and each of them
+ * gets at least one chunk, the calling thread uses \a ctxs[0].
+ *
+ * \param tree      Zone tree to process.
+ * \param function  Chunk callback.
+ * \param ctxs      Array of \a threads thread contexts.
+ * \param threads   Maximal number of threads including the calling one.
+ *
+ * \return KNOT_E*
+ */
+int zone_tree_parallel_chunks(zone_tree_t *tree, zone_tree_chunk_cb_t function,
+                              void **ctxs, unsigned threads);
+
+/*!
+ * \brief Applies given function to each node of the zone using more threads.
+ *
+ * Consecutive nodes are handed out to the threads in chunks, so the function
+ * can't rely on the processing order. It may modify only the node being
+ * processed and must be thread-safe otherwise. Small trees are processed
+ * by the calling thread only.
+ *
+ * Concurrent calls share the limit, the additional threads are started only
+ * while the total number of threads of all the parallel applies running
+ * at once (including the calling ones) doesn't exceed \a threads.
+ *
+ * \param tree      Zone tree to apply the function to.
+ * \param function  Function to be applied to each node of the zone.
+ * \param data      Arbitrary data to be passed to the function.
+ * \param threads   Maximal number of threads including the calling one.
+ *
+ * \return KNOT_E*
+ */
+int zone_tree_parallel_apply(zone_tree_t *tree, zone_tree_apply_cb_t function,
+                             void *data, unsigned threads);
+
 /*!
  * \brief Applies given function to each node in a subtree.
  *
@@ -248,6 +304,18 @@ int zone_tree_it_begin(zone_tree_t *tree, zone_tree_it_t *it);
 int zone_tree_it_sub_begin(zone_tree_t *tree, const knot_dname_t *sub_root,
                            zone_tree_it_t *it);
 
+/*!
+ * \brief Start iteration at the node of the given name or the following one.
+ *
+ * \param tree    Zone tree to iterate in.
+ * \param from    Name of the first node to iterate over.
+ * \param it      Out: iteration context, shall be zeroed before.
+ *
+ * \return KNOT_E*
+ */
+int zone_tree_it_from_begin(zone_tree_t *tree, const knot_dname_t *from,
+                            zone_tree_it_t *it);
+
 /*!
  * \brief Start iteration of two zone trees.
  *
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -24,12 +24,16 @@
 #include "knot/dnssec/kasp/kasp_db.h"
 #include "knot/journal/journal_read.h"
 #include "knot/journal/journal_write.h"
+#include "knot/nameserver/answer_cache.h"
+#include "knot/nameserver/axfr_cache.h"
 #include "knot/nameserver/process_query.h"
 #include "knot/query/requestor.h"
+#include "knot/updates/acl.h"
 #include "knot/updates/zone-update.h"
 #include "knot/zone/contents.h"
 #include "knot/zone/serial.h"
 #include "knot/zone/zone.h"
+#include "knot/zone/zone-image.h"
 #include "knot/zone/zonefile.h"
 #include "libknot/libknot.h"
 #include "contrib/sockaddr.h"
@@ -57,8 +61,6 @@ static void free_ddns_queue(zone_t *zone)
  */
 static int flush_journal(conf_t *conf, zone_t *zone, bool allow_empty_zone, bool verbose)
 {
-	/*! @note Function expects nobody will change zone contents meanwile. */
-
 	assert(zone);
 
 	int ret = KNOT_EOK;
@@ -88,11 +90,16 @@ static int flush_journal(conf_t *conf, zone_t *zone, bool allow_empty_zone, bool
 		return KNOT_EOK;
 	}
 
+	/* A control transaction can commit new contents meanwhile, so the dumped
+	 * contents are kept under RCU until written. */
+	rcu_read_lock();
+
 	/* Check for updated zone. */
 	zone_contents_t *contents = zone->contents;
 	uint32_t serial_to = zone_contents_serial(contents);
 	if (!force && zone->zonefile.exists && zone->zonefile.serial == serial_to &&
 	    !zone->zonefile.retransfer && !zone->zonefile.resigned) {
+		rcu_read_unlock();
 		ret = KNOT_EOK; /* No differences. */
 		goto flush_journal_replan;
 	}
@@ -100,8 +107,9 @@ static int flush_journal(conf_t *conf, zone_t *zone, bool allow_empty_zone, bool
 	char *zonefile = conf_zonefile(conf, zone->name);
 
 	/* Synchronize journal. */
-	ret = zonefile_write(zonefile, contents);
+	ret = zonefile_write(zonefile, contents, conf->cache.srv_bg_threads);
 	if (ret != KNOT_EOK) {
+		rcu_read_unlock();
 		log_zone_warning(zone->name, "failed to update zone file (%s)",
 		                 knot_strerror(ret));
 		free(zonefile);
@@ -119,6 +127,7 @@ static int flush_journal(conf_t *conf, zone_t *zone, bool allow_empty_zone, bool
 	/* Update zone version. */
 	struct stat st;
 	if (stat(zonefile, &st) < 0) {
+		rcu_read_unlock();
 		log_zone_warning(zone->name, "failed to update zone file (%s)",
 		                 knot_strerror(knot_map_errno()));
 		free(zonefile);
@@ -128,6 +137,19 @@ static int flush_journal(conf_t *conf, zone_t *zone, bool allow_empty_zone, bool
 
 	free(zonefile);
 
+	/* Keep the zone image in sync with the zone file. */
+	char *image = conf_zonefile_image(conf, zone->name);
+	if (image != NULL) {
+		int img_ret = zone_image_write(image, &st, contents);
+		if (img_ret != KNOT_EOK) {
+			log_zone_warning(zone->name, "failed to update zone image (%s)",
+			                 knot_strerror(img_ret));
+		}
+		free(image);
+	}
+
+	rcu_read_unlock();
+
 	/* Update zone file attributes. */
 	zone->zonefile.exists = true;
 	zone->zonefile.mtime = st.st_mtim;
@@ -228,6 +250,11 @@ void zone_free(zone_t **zone_ptr)
 
 	conf_deactivate_modules(&zone->query_modules, &zone->query_plan);
 
+	answer_cache_free(zone->answer_cache);
+	axfr_cache_free(zone->axfr_cache);
+
+	acl_free(zone->acl);
+
 	free(zone);
 	*zone_ptr = NULL;
 }
@@ -298,6 +325,10 @@ zone_contents_t *zone_switch_contents(zone_t *zone, zone_contents_t *new_content
 		return NULL;
 	}
 
+	/* Invalidate cached answers before the new contents are visible. */
+	answer_cache_invalidate(zone->answer_cache);
+	axfr_cache_invalidate(zone->axfr_cache);
+
 	zone_contents_t *old_contents;
 	zone_contents_t **current_contents = &zone->contents;
 	old_contents = rcu_xchg_pointer(current_contents, new_contents);
@@ -490,7 +521,11 @@ int zone_dump_to_dir(conf_t *conf, zone_t *zone, const char *dir)
 	}
 	free(zonefile);
 
-	return zonefile_write(target, zone->contents);
+	rcu_read_lock();
+	int ret = zonefile_write(target, zone->contents, conf->cache.srv_bg_threads);
+	rcu_read_unlock();
+
+	return ret;
 }
 
 int zone_set_master_serial(zone_t *zone, uint32_t serial)
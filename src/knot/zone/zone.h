@@ -90,6 +90,15 @@ typedef struct zone
 	/*! \brief Query modules. */
 	list_t query_modules;
 	struct query_plan *query_plan;
+
+	/*! \brief Cache of complete answers (optional). */
+	struct answer_cache *answer_cache;
+
+	/*! \brief Cache of pre-rendered outgoing AXFR (optional). */
+	struct axfr_cache *axfr_cache;
+
+	/*! \brief Compiled zone ACL (RCU protected), NULL if not compiled. */
+	struct acl *acl;
 } zone_t;
 
 /*!
@@ -15,11 +15,16 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
+#include <sys/stat.h>
 #include <urcu.h>
 
 #include "knot/common/log.h"
 #include "knot/conf/module.h"
 #include "knot/events/replan.h"
+#include "knot/nameserver/answer_cache.h"
+#include "knot/nameserver/axfr_cache.h"
+#include "knot/updates/acl.h"
 #include "knot/zone/timers.h"
 #include "knot/zone/zone-load.h"
 #include "knot/zone/zone.h"
@@ -262,6 +267,21 @@ static knot_zonedb_t *create_zonedb(conf_t *conf, server_t *server)
 		conf_activate_modules(conf, server, zone->name, &zone->query_modules,
 		                      &zone->query_plan);
 
+		conf_val_t val = conf_zone_get(conf, C_ANS_CACHE, name);
+		size_t threads = conf->cache.srv_udp_threads + conf->cache.srv_tcp_threads;
+		zone->answer_cache = answer_cache_new(conf_int(&val), threads);
+		if (zone->answer_cache == NULL && conf_int(&val) > 0) {
+			log_zone_warning(name, "failed to create answer cache");
+		}
+
+		val = conf_zone_get(conf, C_AXFR_SNAPSHOT, name);
+		if (conf_bool(&val)) {
+			zone->axfr_cache = axfr_cache_new();
+			if (zone->axfr_cache == NULL) {
+				log_zone_warning(name, "failed to create AXFR snapshot cache");
+			}
+		}
+
 		knot_zonedb_insert(db_new, zone);
 	}
 
@@ -346,3 +366,101 @@ void zonedb_reload(conf_t *conf, server_t *server)
 	/* Remove old zone DB. */
 	remove_old_zonedb(conf, db_old, db_new);
 }
+
+void zonedb_reload_acl(conf_t *conf, knot_zonedb_t *db)
+{
+	if (conf == NULL || db == NULL) {
+		return;
+	}
+
+	size_t count = knot_zonedb_size(db);
+	acl_t **old = calloc(count, sizeof(*old));
+	if (old == NULL) {
+		log_error("failed to compile ACLs (%s)", knot_strerror(KNOT_ENOMEM));
+		return;
+	}
+
+	size_t pos = 0;
+	knot_zonedb_iter_t *it = knot_zonedb_iter_begin(db);
+	while (!knot_zonedb_iter_finished(it) && pos < count) {
+		zone_t *zone = knot_zonedb_iter_val(it);
+		knot_zonedb_iter_next(it);
+
+		/* Without a compiled ACL, the configuration is used directly. */
+		acl_t *acl = acl_compile(conf, zone->name);
+		if (acl == NULL) {
+			log_zone_warning(zone->name, "failed to compile ACL");
+		}
+		old[pos++] = rcu_xchg_pointer(&zone->acl, acl);
+	}
+	knot_zonedb_iter_free(it);
+
+	/* Wait for readers of the old ACLs. */
+	synchronize_rcu();
+
+	for (size_t i = 0; i < pos; i++) {
+		acl_free(old[i]);
+	}
+	free(old);
+}
+
+typedef struct {
+	zone_t *zone;
+	off_t load_size;
+} zone_start_t;
+
+static int zone_start_cmp(const void *a, const void *b)
+{
+	off_t size_a = ((const zone_start_t *)a)->load_size;
+	off_t size_b = ((const zone_start_t *)b)->load_size;
+
+	return (size_a < size_b) - (size_a > size_b);
+}
+
+static off_t zone_load_size(conf_t *conf, zone_t *zone)
+{
+	if (zone_events_get_time(zone, ZONE_EVENT_LOAD) <= 0) {
+		return 0;
+	}
+
+	char *zonefile = conf_zonefile(conf, zone->name);
+	struct stat st;
+	int ret = (zonefile != NULL) ? stat(zonefile, &st) : -1;
+	free(zonefile);
+
+	return (ret == 0) ? st.st_size : 0;
+}
+
+void zonedb_start(conf_t *conf, knot_zonedb_t *db)
+{
+	if (conf == NULL || db == NULL) {
+		return;
+	}
+
+	size_t count = knot_zonedb_size(db);
+	zone_start_t *zones = malloc(count * sizeof(*zones));
+	if (zones == NULL) {
+		knot_zonedb_foreach(db, zone_events_start);
+		return;
+	}
+
+	size_t pos = 0;
+	knot_zonedb_iter_t *it = knot_zonedb_iter_begin(db);
+	while (!knot_zonedb_iter_finished(it) && pos < count) {
+		zone_t *zone = knot_zonedb_iter_val(it);
+		zones[pos].zone = zone;
+		zones[pos].load_size = zone_load_size(conf, zone);
+		pos++;
+		knot_zonedb_iter_next(it);
+	}
+	knot_zonedb_iter_free(it);
+
+	/* Large zones first so that they don't remain alone at the end. */
+	qsort(zones, pos, sizeof(*zones), zone_start_cmp);
+
+	for (size_t i = 0; i < pos; i++) {
+		zone_events_start(zones[i].zone);
+	}
+
+	free(zones);
+}
@@ -26,3 +26,25 @@
  * \param[in] server Server instance.
  */
 void zonedb_reload(conf_t *conf, server_t *server);
+
+/*!
+ * \brief Compile ACLs of all zones in the zone database and replace the old ones.
+ *
+ * If the compilation fails, the zone ACL is evaluated directly from
+ * the configuration.
+ *
+ * \param[in] conf Configuration.
+ * \param[in] db   Zone database.
+ */
+void zonedb_reload_acl(conf_t *conf, knot_zonedb_t *db);
+
+/*!
+ * \brief Start events of all zones in the zone database.
+ *
+ * Zones waiting for load are started in the order of decreasing zone file
+ * size, so that the largest zones are loaded first.
+ *
+ * \param[in] conf Configuration.
+ * \param[in] db   Zone database.
+ */
+void zonedb_start(conf_t *conf, knot_zonedb_t *db);
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -15,9 +15,11 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -27,6 +29,7 @@
 
 #include "libknot/libknot.h"
 #include "contrib/files.h"
+#include "contrib/macros.h"
 #include "knot/common/log.h"
 #include "knot/dnssec/zone-nsec.h"
 #include "knot/zone/semantic-check.h"
@@ -34,15 +37,17 @@
 #include "knot/zone/contents.h"
 #include "knot/zone/zonefile.h"
 #include "knot/zone/zone-dump.h"
+#include "knot/zone/zone-image.h"
 
 #define ERROR(zone, fmt, ...) log_zone_error(zone, "zone loader, " fmt, ##__VA_ARGS__)
 #define WARNING(zone, fmt, ...) log_zone_warning(zone, "zone loader, " fmt, ##__VA_ARGS__)
 #define NOTICE(zone, fmt, ...) log_zone_notice(zone, "zone loader, " fmt, ##__VA_ARGS__)
+#define INFO(zone, fmt, ...) log_zone_info(zone, "zone loader, " fmt, ##__VA_ARGS__)
 
 static void process_error(zs_scanner_t *s)
 {
-	zcreator_t *zc = s->process.data;
-	const knot_dname_t *zname = zc->z->apex->owner;
+	zloader_t *loader = s->process.data;
+	const knot_dname_t *zname = loader->creator->z->apex->owner;
 
 	ERROR(zname, "%s in zone, file '%s', line %"PRIu64" (%s)",
 	      s->error.fatal ? "fatal error" : "error",
@@ -102,12 +107,18 @@ int zcreator_step(zcreator_t *zc, const knot_rrset_t *rr)
 /*! \brief Creates RR from parser input, passes it to handling function. */
 static void process_data(zs_scanner_t *scanner)
 {
-	zcreator_t *zc = scanner->process.data;
+	zloader_t *loader = scanner->process.data;
+	zcreator_t *zc = loader->creator;
 	if (zc->ret != KNOT_EOK) {
 		scanner->state = ZS_STATE_STOP;
 		return;
 	}
 
+	/* Included files are parsed by their own scanners. */
+	if (scanner != &loader->scanner) {
+		loader->included = true;
+	}
+
 	knot_dname_t *owner = knot_dname_copy(scanner->r_owner, NULL);
 	if (owner == NULL) {
 		zc->ret = KNOT_ENOMEM;
@@ -173,7 +184,7 @@ int zonefile_open(zloader_t *loader, const char *source,
 
 	if (zs_init(&loader->scanner, origin_str, KNOT_CLASS_IN, 3600) != 0 ||
 	    zs_set_input_file(&loader->scanner, source) != 0 ||
-	    zs_set_processing(&loader->scanner, process_data, process_error, zc) != 0) {
+	    zs_set_processing(&loader->scanner, process_data, process_error, loader) != 0) {
 		zs_deinit(&loader->scanner);
 		free(origin_str);
 		zone_contents_deep_free(zc->z);
@@ -186,10 +197,442 @@ int zonefile_open(zloader_t *loader, const char *source,
 	loader->creator = zc;
 	loader->semantic_checks = semantic_checks;
 	loader->time = time;
+	loader->threads = 1;
 
 	return KNOT_EOK;
 }
 
+static bool load_image(zloader_t *loader, const struct stat *source)
+{
+	zcreator_t *zc = loader->creator;
+
+	zone_contents_t *contents = NULL;
+	int ret = zone_image_load(loader->image, source, zc->z->apex->owner, &contents);
+	if (ret != KNOT_EOK) {
+		/* Missing, outdated, or incompatible image is silently rewritten. */
+		if (ret != KNOT_ENOENT && ret != KNOT_ENOTSUP) {
+			WARNING(zc->z->apex->owner, "failed to load zone image '%s' (%s)",
+			        loader->image, knot_strerror(ret));
+		}
+		return false;
+	}
+
+	zone_contents_deep_free(zc->z);
+	zc->z = contents;
+
+	INFO(zc->z->apex->owner, "zone image loaded, file '%s'", loader->image);
+
+	return true;
+}
+
+/*! \brief Zone file size to be parsed by one thread at least. */
+#define PARSE_CHUNK_MIN	(1 << 20)
+#define PARSE_CHUNK_MAX	(16 << 20)
+
+#define PARSE_ALIGN(size, align) (((size) + (align) - 1) & ~((size_t)(align) - 1))
+
+/*! \brief Parsed record, followed by the owner and the rdata (knot_rdata_t). */
+typedef struct {
+	uint32_t ttl;
+	uint16_t type;
+	uint16_t rclass;
+	uint16_t owner_size;
+	uint16_t rdata_len;
+} parsed_rr_t;
+
+typedef struct {
+	const char *start;      /*!< Chunk text. */
+	size_t size;            /*!< Chunk text size. */
+	char *origin;           /*!< Origin at the beginning of the chunk. */
+	uint32_t default_ttl;   /*!< Default TTL at the beginning of the chunk. */
+	uint8_t *rrs;           /*!< Sequence of parsed records. */
+	size_t rrs_size;        /*!< Size of the parsed records. */
+	size_t rrs_max;         /*!< Allocated size for the parsed records. */
+	int ret;                /*!< Parsing result. */
+	bool done;              /*!< The chunk is parsed. */
+} parse_chunk_t;
+
+typedef struct {
+	parse_chunk_t *chunks;
+	size_t count;
+	size_t max;
+	pthread_mutex_t mx;     /*!< Protects the following parsing progress. */
+	pthread_cond_t cond;    /*!< Signals the parsing progress change. */
+	size_t next;            /*!< Next chunk to be parsed. */
+	size_t inserted;        /*!< Number of chunks inserted into the zone. */
+	size_t window;          /*!< Maximum number of parsed chunks waiting. */
+	bool stop;              /*!< Stop parsing of further chunks. */
+} parse_chunks_t;
+
+static size_t parsed_rr_rdata_offset(size_t owner_size)
+{
+	return PARSE_ALIGN(sizeof(parsed_rr_t) + owner_size, sizeof(uint16_t));
+}
+
+static size_t parsed_rr_size(size_t owner_size, size_t rdata_len)
+{
+	return PARSE_ALIGN(parsed_rr_rdata_offset(owner_size) + knot_rdata_size(rdata_len),
+	                   sizeof(uint32_t));
+}
+
+static void chunk_error(zs_scanner_t *s)
+{
+	parse_chunk_t *chunk = s->process.data;
+
+	/* The error is reported by sequential parsing. */
+	chunk->ret = KNOT_EPARSEFAIL;
+	s->state = ZS_STATE_STOP;
+}
+
+static void chunk_record(zs_scanner_t *s)
+{
+	parse_chunk_t *chunk = s->process.data;
+
+	size_t size = parsed_rr_size(s->r_owner_length, s->r_data_length);
+	if (chunk->rrs_size + size > chunk->rrs_max) {
+		size_t max = MAX(2 * chunk->rrs_max, chunk->size + size);
+		uint8_t *rrs = realloc(chunk->rrs, max);
+		if (rrs == NULL) {
+			chunk->ret = KNOT_ENOMEM;
+			s->state = ZS_STATE_STOP;
+			return;
+		}
+		chunk->rrs = rrs;
+		chunk->rrs_max = max;
+	}
+
+	uint8_t *pos = chunk->rrs + chunk->rrs_size;
+	parsed_rr_t *rr = (parsed_rr_t *)pos;
+	*rr = (parsed_rr_t) {
+		.ttl = s->r_ttl,
+		.type = s->r_type,
+		.rclass = s->r_class,
+		.owner_size = s->r_owner_length,
+		.rdata_len = s->r_data_length
+	};
+	memcpy(pos + sizeof(*rr), s->r_owner, s->r_owner_length);
+	knot_rdata_t *rdata = (knot_rdata_t *)(pos + parsed_rr_rdata_offset(rr->owner_size));
+	knot_rdata_init(rdata, s->r_data_length, s->r_data);
+
+	/* Convert RDATA dnames to lowercase before adding to zone. */
+	knot_rrset_t rrset;
+	knot_rrset_init(&rrset, pos + sizeof(*rr), rr->type, rr->rclass, rr->ttl);
+	rrset.rrs = (knot_rdataset_t) { 1, knot_rdata_size(rdata->len), rdata };
+	int ret = knot_rrset_rr_to_canonical(&rrset);
+	if (ret != KNOT_EOK) {
+		chunk->ret = ret;
+		s->state = ZS_STATE_STOP;
+		return;
+	}
+
+	chunk->rrs_size += size;
+}
+
+static void chunk_parse(parse_chunk_t *chunk)
+{
+	zs_scanner_t s;
+	if (zs_init(&s, chunk->origin, KNOT_CLASS_IN, chunk->default_ttl) != 0 ||
+	    zs_set_input_string(&s, chunk->start, chunk->size) != 0 ||
+	    zs_set_processing(&s, chunk_record, chunk_error, chunk) != 0 ||
+	    zs_parse_all(&s) != 0) {
+		if (chunk->ret == KNOT_EOK) {
+			chunk->ret = KNOT_EPARSEFAIL;
+		}
+	}
+	zs_deinit(&s);
+}
+
+static void *parse_thread(void *arg)
+{
+	parse_chunks_t *chunks = arg;
+
+	pthread_mutex_lock(&chunks->mx);
+	while (true) {
+		if (chunks->stop || chunks->next == chunks->count) {
+			break;
+		} else if (chunks->next >= chunks->inserted + chunks->window) {
+			pthread_cond_wait(&chunks->cond, &chunks->mx);
+			continue;
+		}
+
+		parse_chunk_t *chunk = &chunks->chunks[chunks->next++];
+		pthread_mutex_unlock(&chunks->mx);
+
+		chunk_parse(chunk);
+
+		pthread_mutex_lock(&chunks->mx);
+		chunk->done = true;
+		pthread_cond_broadcast(&chunks->cond);
+	}
+	pthread_mutex_unlock(&chunks->mx);
+
+	return NULL;
+}
+
+static int chunk_insert(zcreator_t *zc, parse_chunk_t *chunk)
+{
+	const uint8_t *pos = chunk->rrs;
+	const uint8_t *end = chunk->rrs + chunk->rrs_size;
+	while (pos < end) {
+		const parsed_rr_t *rr = (const parsed_rr_t *)pos;
+		knot_rdata_t *rdata = (knot_rdata_t *)(pos + parsed_rr_rdata_offset(rr->owner_size));
+
+		knot_rrset_t rrset;
+		knot_rrset_init(&rrset, (knot_dname_t *)(pos + sizeof(*rr)), rr->type,
+		                rr->rclass, rr->ttl);
+		rrset.rrs = (knot_rdataset_t) { 1, knot_rdata_size(rdata->len), rdata };
+
+		int ret = zcreator_step(zc, &rrset);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+
+		pos += parsed_rr_size(rr->owner_size, rr->rdata_len);
+	}
+
+	return KNOT_EOK;
+}
+
+static void chunks_free(parse_chunks_t *chunks)
+{
+	for (size_t i = 0; i < chunks->count; i++) {
+		free(chunks->chunks[i].origin);
+		free(chunks->chunks[i].rrs);
+	}
+	free(chunks->chunks);
+}
+
+static int chunks_add(parse_chunks_t *chunks, const char *start,
+                      const zs_scanner_t *directives)
+{
+	if (chunks->count == chunks->max) {
+		size_t max = MAX(2 * chunks->max, 16);
+		parse_chunk_t *new = realloc(chunks->chunks, max * sizeof(*new));
+		if (new == NULL) {
+			return KNOT_ENOMEM;
+		}
+		chunks->chunks = new;
+		chunks->max = max;
+	}
+
+	char *origin = knot_dname_to_str_alloc(directives->zone_origin);
+	if (origin == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	chunks->chunks[chunks->count++] = (parse_chunk_t) {
+		.start = start,
+		.origin = origin,
+		.default_ttl = directives->default_ttl
+	};
+
+	return KNOT_EOK;
+}
+
+static void directive_record(zs_scanner_t *s)
+{
+	*(int *)s->process.data = KNOT_ENOTSUP;
+	s->state = ZS_STATE_STOP;
+}
+
+static bool is_directive(const char *pos, const char *end, const char *name)
+{
+	size_t len = strlen(name);
+	return (size_t)(end - pos) > len && strncasecmp(pos, name, len) == 0 &&
+	       (pos[len] == ' ' || pos[len] == '\t');
+}
+
+static bool is_owner_start(char c)
+{
+	return strchr(" \t\r\n;$()\"", c) == NULL;
+}
+
+/*!
+ * \brief Split the zone file into chunks beginning with an explicit owner.
+ *
+ * The chunks are split only outside of parentheses, quoted strings, and
+ * comments. The $ORIGIN and $TTL directives are evaluated to get the parser
+ * state at the beginning of each chunk. Other directives aren't supported.
+ */
+static int split_chunks(zloader_t *loader, size_t chunk_size, parse_chunks_t *chunks)
+{
+	const char *start = loader->scanner.input.start;
+	const char *end = loader->scanner.input.end;
+
+	knot_dname_txt_storage_t origin;
+	if (knot_dname_to_str(origin, loader->creator->z->apex->owner, sizeof(origin)) == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	int ret = KNOT_EOK;
+	zs_scanner_t directives;
+	if (zs_init(&directives, origin, KNOT_CLASS_IN, 3600) != 0 ||
+	    zs_set_processing(&directives, directive_record, NULL, &ret) != 0) {
+		zs_deinit(&directives);
+		return KNOT_ENOMEM;
+	}
+
+	ret = chunks_add(chunks, start, &directives);
+	const char *chunk = start;
+	const char *record = start;
+	unsigned depth = 0;
+	bool quoted = false, comment = false;
+
+	for (const char *pos = start; pos < end && ret == KNOT_EOK; pos++) {
+		switch (*pos) {
+		case '\\':
+			if (!comment && pos + 1 < end) {
+				pos++;
+			}
+			continue;
+		case '"':
+			quoted ^= !comment;
+			continue;
+		case ';':
+			comment |= !quoted;
+			continue;
+		case '(':
+			depth += !quoted && !comment;
+			continue;
+		case ')':
+			depth -= (!quoted && !comment && depth > 0);
+			continue;
+		case '\n':
+			comment = false;
+			if (quoted || depth > 0) {
+				continue;
+			}
+			break;
+		default:
+			continue;
+		}
+
+		/* Record or directive ends with the newline. */
+		const char *next = pos + 1;
+		if (*record == '$') {
+			if (!is_directive(record, next, "$ORIGIN") &&
+			    !is_directive(record, next, "$TTL")) {
+				ret = KNOT_ENOTSUP;
+				break;
+			}
+			if (zs_set_input_string(&directives, record, next - record) != 0 ||
+			    zs_parse_all(&directives) != 0) {
+				ret = KNOT_ENOTSUP;
+				break;
+			}
+		}
+		record = next;
+
+		if ((size_t)(next - chunk) >= chunk_size && next < end && is_owner_start(*next)) {
+			chunks->chunks[chunks->count - 1].size = next - chunk;
+			ret = chunks_add(chunks, next, &directives);
+			chunk = next;
+		}
+	}
+
+	if (ret == KNOT_EOK) {
+		chunks->chunks[chunks->count - 1].size = end - chunk;
+	}
+
+	zs_deinit(&directives);
+
+	return ret;
+}
+
+/*!
+ * \brief Parse the zone file chunks in parallel, insert the records in order.
+ *
+ * \retval true if the zone file was parsed (zc->ret set on a record error).
+ * \retval false if the zone file must be parsed sequentially.
+ */
+static bool parse_parallel(zloader_t *loader)
+{
+	size_t size = loader->scanner.input.end - loader->scanner.input.start;
+	unsigned threads = loader->threads;
+	if (threads < 2 || size < 2 * PARSE_CHUNK_MIN) {
+		return false;
+	}
+
+	parse_chunks_t chunks = { .window = 2 * threads };
+	size_t chunk_size = MAX(size / (4 * threads), PARSE_CHUNK_MIN);
+	chunk_size = MIN(chunk_size, PARSE_CHUNK_MAX);
+	int ret = split_chunks(loader, chunk_size, &chunks);
+	if (ret != KNOT_EOK || chunks.count < 2) {
+		chunks_free(&chunks);
+		return false;
+	}
+
+	zcreator_t zc = {
+		.z = zone_contents_new(loader->creator->z->apex->owner, true),
+		.master = loader->creator->master
+	};
+	if (zc.z == NULL) {
+		chunks_free(&chunks);
+		return false;
+	}
+
+	pthread_mutex_init(&chunks.mx, NULL);
+	pthread_cond_init(&chunks.cond, NULL);
+
+	pthread_t thr[threads];
+	unsigned started = 0;
+	for (; started < threads; started++) {
+		if (pthread_create(&thr[started], NULL, parse_thread, &chunks) != 0) {
+			break;
+		}
+	}
+	if (started == 0) {
+		ret = KNOT_ENOMEM;
+	}
+
+	/* The records are inserted in the zone file order. */
+	for (size_t i = 0; ret == KNOT_EOK && zc.ret == KNOT_EOK && i < chunks.count; i++) {
+		parse_chunk_t *chunk = &chunks.chunks[i];
+
+		pthread_mutex_lock(&chunks.mx);
+		while (!chunk->done) {
+			pthread_cond_wait(&chunks.cond, &chunks.mx);
+		}
+		pthread_mutex_unlock(&chunks.mx);
+
+		ret = chunk->ret;
+		if (ret == KNOT_EOK) {
+			zc.ret = chunk_insert(&zc, chunk);
+		}
+		free(chunk->rrs);
+		chunk->rrs = NULL;
+
+		pthread_mutex_lock(&chunks.mx);
+		chunks.inserted = i + 1;
+		pthread_cond_broadcast(&chunks.cond);
+		pthread_mutex_unlock(&chunks.mx);
+	}
+
+	pthread_mutex_lock(&chunks.mx);
+	chunks.stop = true;
+	pthread_cond_broadcast(&chunks.cond);
+	pthread_mutex_unlock(&chunks.mx);
+
+	for (unsigned i = 0; i < started; i++) {
+		pthread_join(thr[i], NULL);
+	}
+
+	pthread_cond_destroy(&chunks.cond);
+	pthread_mutex_destroy(&chunks.mx);
+	chunks_free(&chunks);
+
+	/* Parsing errors are reported by sequential parsing. */
+	if (ret != KNOT_EOK) {
+		zone_contents_deep_free(zc.z);
+		return false;
+	}
+
+	zone_contents_deep_free(loader->creator->z);
+	*loader->creator = zc;
+
+	return true;
+}
+
 zone_contents_t *zonefile_load(zloader_t *loader)
 {
 	if (!loader) {
@@ -197,26 +640,35 @@ zone_contents_t *zonefile_load(zloader_t *loader)
 	}
 
 	zcreator_t *zc = loader->creator;
+	assert(zc);
+
+	struct stat source;
+	bool image = (loader->image != NULL && stat(loader->source, &source) == 0);
+	bool from_image = (image && load_image(loader, &source));
+
+	bool parsed = (from_image || parse_parallel(loader));
+
 	const knot_dname_t *zname = zc->z->apex->owner;
 
-	assert(zc);
-	int ret = zs_parse_all(&loader->scanner);
-	if (ret != 0 && loader->scanner.error.counter == 0) {
-		ERROR(zname, "failed to load zone, file '%s' (%s)",
-		      loader->source, zs_strerror(loader->scanner.error.code));
-		goto fail;
-	}
+	if (!from_image) {
+		int ret = parsed ? 0 : zs_parse_all(&loader->scanner);
+		if (ret != 0 && loader->scanner.error.counter == 0) {
+			ERROR(zname, "failed to load zone, file '%s' (%s)",
+			      loader->source, zs_strerror(loader->scanner.error.code));
+			goto fail;
+		}
 
-	if (zc->ret != KNOT_EOK) {
-		ERROR(zname, "failed to load zone, file '%s' (%s)",
-		      loader->source, knot_strerror(zc->ret));
-		goto fail;
-	}
+		if (zc->ret != KNOT_EOK) {
+			ERROR(zname, "failed to load zone, file '%s' (%s)",
+			      loader->source, knot_strerror(zc->ret));
+			goto fail;
+		}
 
-	if (loader->scanner.error.counter > 0) {
-		ERROR(zname, "failed to load zone, file '%s', %"PRIu64" errors",
-		      loader->source, loader->scanner.error.counter);
-		goto fail;
+		if (loader->scanner.error.counter > 0) {
+			ERROR(zname, "failed to load zone, file '%s', %"PRIu64" errors",
+			      loader->source, loader->scanner.error.counter);
+			goto fail;
+		}
 	}
 
 	if (!node_rrtype_exists(loader->creator->z->apex, KNOT_RRTYPE_SOA)) {
@@ -226,7 +678,11 @@ zone_contents_t *zonefile_load(zloader_t *loader)
 		goto fail;
 	}
 
-	ret = zone_adjust_contents(zc->z, adjust_cb_flags_and_nsec3, adjust_cb_nsec3_flags, true, NULL);
+	int ret = zone_adjust_contents(zc->z, adjust_cb_flags, adjust_cb_nsec3_flags, true, NULL);
+	if (ret == KNOT_EOK) {
+		ret = zone_adjust_contents_parallel(zc->z, adjust_cb_nsec3_pointer,
+		                                    loader->threads);
+	}
 	if (ret != KNOT_EOK) {
 		ERROR(zname, "failed to finalize zone contents (%s)",
 		      knot_strerror(ret));
@@ -234,7 +690,7 @@ zone_contents_t *zonefile_load(zloader_t *loader)
 	}
 
 	ret = sem_checks_process(zc->z, loader->semantic_checks,
-	                         loader->err_handler, loader->time);
+	                         loader->err_handler, loader->time, loader->threads);
 
 	if (ret != KNOT_EOK) {
 		ERROR(zname, "failed to load zone, file '%s' (%s)",
@@ -251,6 +707,15 @@ zone_contents_t *zonefile_load(zloader_t *loader)
 		goto fail;
 	}
 
+	/* Records from included files could change without notice. */
+	if (image && !from_image && !loader->included) {
+		ret = zone_image_write(loader->image, &source, zc->z);
+		if (ret != KNOT_EOK) {
+			WARNING(zname, "failed to write zone image '%s' (%s)",
+			        loader->image, knot_strerror(ret));
+		}
+	}
+
 	return zc->z;
 
 fail:
@@ -276,7 +741,7 @@ int zonefile_exists(const char *path, struct timespec *mtime)
 	return KNOT_EOK;
 }
 
-int zonefile_write(const char *path, zone_contents_t *zone)
+int zonefile_write(const char *path, zone_contents_t *zone, unsigned threads)
 {
 	if (!zone || !path) {
 		return KNOT_EINVAL;
@@ -294,8 +759,10 @@ int zonefile_write(const char *path, zone_contents_t *zone)
 		return ret;
 	}
 
-	ret = zone_dump_text(zone, file, true);
-	fclose(file);
+	ret = zone_dump_text(zone, file, true, threads);
+	if (fclose(file) != 0 && ret == KNOT_EOK) {
+		ret = KNOT_EFILE;
+	}
 	if (ret != KNOT_EOK) {
 		unlink(tmp_name);
 		free(tmp_name);
@@ -324,6 +791,7 @@ void zonefile_close(zloader_t *loader)
 
 	zs_deinit(&loader->scanner);
 	free(loader->source);
+	free(loader->image);
 	free(loader->creator);
 }
 
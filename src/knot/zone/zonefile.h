@@ -1,4 +1,4 @@
-/*  Copyright (C) 2018 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -41,6 +41,9 @@ typedef struct {
 	zcreator_t *creator;         /*!< Loader context. */
 	zs_scanner_t scanner;        /*!< Zone scanner. */
 	time_t time;                 /*!< time for zone check. */
+	unsigned threads;            /*!< Threads for checking and adjusting. */
+	char *image;                 /*!< Compiled zone image file (optional). */
+	bool included;               /*!< Some records come from included files. */
 } zloader_t;
 
 void err_handler_logger(sem_handler_t *handler, const zone_contents_t *zone,
@@ -64,6 +67,10 @@ int zonefile_open(zloader_t *loader, const char *source,
 /*!
  * \brief Loads zone from a zone file.
  *
+ * If the loader image is set, the zone is loaded from the image if it
+ * corresponds to the zone file. Otherwise the image is written after the zone
+ * file has been successfully parsed.
+ *
  * \param loader Zone loader instance.
  *
  * \retval Loaded zone contents on success.
@@ -83,8 +90,14 @@ int zonefile_exists(const char *path, struct timespec *mtime);
 
 /*!
  * \brief Write zone contents to zone file.
+ *
+ * \param path     Zone file path.
+ * \param zone     Zone contents.
+ * \param threads  Number of threads formatting the zone contents.
+ *
+ * \return KNOT_E*
  */
-int zonefile_write(const char *path, zone_contents_t *zone);
+int zonefile_write(const char *path, zone_contents_t *zone, unsigned threads);
 
 /*!
  * \brief Close zone file loader.
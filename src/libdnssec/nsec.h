@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -177,6 +177,23 @@ int dnssec_nsec3_hash(const dnssec_binary_t *data,
 		      const dnssec_nsec3_params_t *params,
 		      dnssec_binary_t *hash);
 
+/*!
+ * Compute NSEC3 hashes for multiple data at once.
+ *
+ * This is much faster than hashing the data one by one.
+ *
+ * \param[in]  data    Data to be hashed (usually domain names).
+ * \param[in]  count   Number of data items.
+ * \param[in]  params  NSEC3 parameters.
+ * \param[out] hashes  Computed hashes, one after another, each of length
+ *                     given by \ref dnssec_nsec3_hash_length.
+ *
+ * \return Error code, DNSSEC_EOK if successful.
+ */
+int dnssec_nsec3_hash_batch(const dnssec_binary_t *data, size_t count,
+			    const dnssec_nsec3_params_t *params,
+			    uint8_t *hashes);
+
 /*!
  * Get length of raw NSEC3 hash for a given algorithm.
  *
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2018 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -17,10 +17,13 @@
 #include <assert.h>
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
+#include <stdbool.h>
 #include <string.h>
 
+#include "contrib/macros.h"
 #include "libdnssec/error.h"
 #include "libdnssec/nsec.h"
+#include "libdnssec/nsec/sha1.h"
 #include "libdnssec/shared/shared.h"
 
 /*!
@@ -88,6 +91,17 @@ static gnutls_digest_algorithm_t algorithm_d2g(dnssec_nsec3_algorithm_t dnssec)
 	}
 }
 
+/*!
+ * Check if the built-in SHA-1 can be used for the input.
+ */
+static bool sha1_suitable(gnutls_digest_algorithm_t algorithm,
+			  const dnssec_binary_t *salt, const dnssec_binary_t *data)
+{
+	return algorithm == GNUTLS_DIG_SHA1 &&
+	       salt->size <= NSEC3_SHA1_MAX_SALT &&
+	       data->size <= NSEC3_SHA1_MAX_DATA;
+}
+
 /* -- public API ----------------------------------------------------------- */
 
 /*!
@@ -107,9 +121,69 @@ int dnssec_nsec3_hash(const dnssec_binary_t *data,
 		return DNSSEC_INVALID_NSEC3_ALGORITHM;
 	}
 
+	if (sha1_suitable(algorithm, &params->salt, data) && nsec3_sha1_faster(1)) {
+		int result = dnssec_binary_resize(hash, NSEC3_SHA1_SIZE);
+		if (result != DNSSEC_EOK) {
+			return result;
+		}
+		nsec3_sha1_batch(data, 1, &params->salt, params->iterations, hash->data);
+		return DNSSEC_EOK;
+	}
+
 	return nsec3_hash(algorithm, params->iterations, &params->salt, data, hash);
 }
 
+/*!
+ * Compute NSEC3 hashes for multiple data at once.
+ */
+_public_
+int dnssec_nsec3_hash_batch(const dnssec_binary_t *data, size_t count,
+			    const dnssec_nsec3_params_t *params,
+			    uint8_t *hashes)
+{
+	if (!data || !params || !hashes) {
+		return DNSSEC_EINVAL;
+	}
+
+	gnutls_digest_algorithm_t algorithm = algorithm_d2g(params->algorithm);
+	if (algorithm == GNUTLS_DIG_UNKNOWN) {
+		return DNSSEC_INVALID_NSEC3_ALGORITHM;
+	}
+
+	size_t hash_size = gnutls_hash_get_len(algorithm);
+	uint8_t *out = hashes;
+
+	for (size_t i = 0; i < count; ) {
+		size_t batch = 0;
+		while (i + batch < count &&
+		       sha1_suitable(algorithm, &params->salt, &data[i + batch])) {
+			batch++;
+		}
+		if (batch > 0 && nsec3_sha1_faster(batch)) {
+			nsec3_sha1_batch(data + i, batch, &params->salt,
+			                 params->iterations, out);
+			out += batch * hash_size;
+			i += batch;
+			continue;
+		}
+
+		// Unusually long data or salt, or no faster implementation.
+		for (size_t end = i + MAX(batch, 1); i < end; i++) {
+			dnssec_binary_t hash = { 0 };
+			int result = nsec3_hash(algorithm, params->iterations,
+			                        &params->salt, &data[i], &hash);
+			if (result != DNSSEC_EOK) {
+				return result;
+			}
+			memcpy(out, hash.data, hash_size);
+			dnssec_binary_free(&hash);
+			out += hash_size;
+		}
+	}
+
+	return DNSSEC_EOK;
+}
+
 /*!
  * Get length of raw NSEC3 hash for a given algorithm.
  */
@@ -0,0 +1,355 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#ifdef HAVE_X86_SIMD
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#include "libdnssec/nsec/sha1.h"
+
+#ifdef HAVE_X86_SIMD
+
+/*
+ * NSEC3 hashing hashes many short messages, mostly fitting into a single
+ * SHA-1 block. The generic digest API overhead would be dominant, so the
+ * messages are padded here and passed directly to the compression function.
+ */
+
+#define BLOCK_SIZE	64
+#define BLOCKS(len)	(((len) + 8) / BLOCK_SIZE + 1)
+
+/*! \brief Blocks of the first message (data and salt). */
+#define DATA_BLOCKS	BLOCKS(NSEC3_SHA1_MAX_DATA + NSEC3_SHA1_MAX_SALT)
+/*! \brief Blocks of the iteration message (previous hash and salt). */
+#define ITER_BLOCKS	BLOCKS(NSEC3_SHA1_SIZE + NSEC3_SHA1_MAX_SALT)
+
+static const uint32_t SHA1_INIT[5] = {
+	0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+};
+
+#define K0	0x5A827999
+#define K1	0x6ED9EBA1
+#define K2	0x8F1BBCDC
+#define K3	0xCA62C1D6
+
+static uint32_t load_be(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void store_be(uint8_t *p, uint32_t x)
+{
+	p[0] = x >> 24;
+	p[1] = x >> 16;
+	p[2] = x >> 8;
+	p[3] = x;
+}
+
+static void store_digest(uint8_t *out, const uint32_t state[5])
+{
+	for (int i = 0; i < 5; i++) {
+		store_be(out + 4 * i, state[i]);
+	}
+}
+
+/*!
+ * \brief Appends SHA-1 padding to the message.
+ *
+ * \return Number of blocks of the padded message.
+ */
+static size_t pad(uint8_t *msg, size_t len)
+{
+	size_t end = BLOCKS(len) * BLOCK_SIZE;
+	uint64_t bits = (uint64_t)len * 8;
+
+	msg[len] = 0x80;
+	memset(msg + len + 1, 0, end - len - 1 - 8);
+	for (int i = 1; i <= 8; i++) {
+		msg[end - i] = bits;
+		bits >>= 8;
+	}
+
+	return end / BLOCK_SIZE;
+}
+
+/*
+ * Four rounds using the SHA extensions. The message words of the group are
+ * computed from the previous four groups kept in the rotating registers.
+ */
+#define SHANI_ROUNDS(g, func) \
+	if (g >= 4) { \
+		msg[g % 4] = _mm_sha1msg2_epu32(_mm_xor_si128( \
+		             _mm_sha1msg1_epu32(msg[g % 4], msg[(g + 1) % 4]), \
+		             msg[(g + 2) % 4]), msg[(g + 3) % 4]); \
+	} \
+	e = (g == 0) ? _mm_add_epi32(e, msg[0]) : _mm_sha1nexte_epu32(prev, msg[g % 4]); \
+	prev = abcd; \
+	abcd = _mm_sha1rnds4_epu32(abcd, e, func);
+
+__attribute__((target("sha,sse4.1")))
+static void compress_shani(uint32_t state[5], const uint8_t *data, size_t blocks)
+{
+	const __m128i reverse = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+	__m128i e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+	for (; blocks > 0; blocks--, data += BLOCK_SIZE) {
+		__m128i abcd_save = abcd, e = e0, prev = abcd, msg[4];
+		for (int i = 0; i < 4; i++) {
+			msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data + i), reverse);
+		}
+
+		SHANI_ROUNDS(0, 0)  SHANI_ROUNDS(1, 0)  SHANI_ROUNDS(2, 0)  SHANI_ROUNDS(3, 0)
+		SHANI_ROUNDS(4, 0)  SHANI_ROUNDS(5, 1)  SHANI_ROUNDS(6, 1)  SHANI_ROUNDS(7, 1)
+		SHANI_ROUNDS(8, 1)  SHANI_ROUNDS(9, 1)  SHANI_ROUNDS(10, 2) SHANI_ROUNDS(11, 2)
+		SHANI_ROUNDS(12, 2) SHANI_ROUNDS(13, 2) SHANI_ROUNDS(14, 2) SHANI_ROUNDS(15, 3)
+		SHANI_ROUNDS(16, 3) SHANI_ROUNDS(17, 3) SHANI_ROUNDS(18, 3) SHANI_ROUNDS(19, 3)
+
+		e0 = _mm_sha1nexte_epu32(prev, e0);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+
+	_mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = _mm_extract_epi32(e0, 3);
+}
+
+/*
+ * Multi-buffer SHA-1, each 32-bit lane of AVX2 registers computes the hash
+ * of a different message.
+ */
+#define LANES	8
+
+#define X8_ROL(x, n)	_mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#define X8_XOR(x, y)	_mm256_xor_si256(x, y)
+#define X8_ADD(x, y)	_mm256_add_epi32(x, y)
+
+#define X8_ROUNDS(from, to, func, k) \
+	for (int t = from; t < to; t++) { \
+		if (t >= 16) { \
+			w[t & 15] = X8_ROL(X8_XOR(X8_XOR(w[(t + 13) & 15], w[(t + 8) & 15]), \
+			                          X8_XOR(w[(t + 2) & 15], w[t & 15])), 1); \
+		} \
+		__m256i tmp = X8_ADD(X8_ADD(X8_ROL(a, 5), func), \
+		                     X8_ADD(X8_ADD(e, _mm256_set1_epi32(k)), w[t & 15])); \
+		e = d; \
+		d = c; \
+		c = X8_ROL(b, 30); \
+		b = a; \
+		a = tmp; \
+	}
+
+#define F_CH	X8_XOR(d, _mm256_and_si256(b, X8_XOR(c, d)))
+#define F_PAR	X8_XOR(X8_XOR(b, c), d)
+#define F_MAJ	_mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)))
+
+/*! \brief Compresses one block of each lane, the message words are overwritten. */
+__attribute__((target("avx2")))
+static void compress_x8(__m256i state[5], __m256i w[16])
+{
+	__m256i a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+	X8_ROUNDS(0, 20, F_CH, K0)
+	X8_ROUNDS(20, 40, F_PAR, K1)
+	X8_ROUNDS(40, 60, F_MAJ, K2)
+	X8_ROUNDS(60, 80, F_PAR, K3)
+
+	state[0] = X8_ADD(state[0], a);
+	state[1] = X8_ADD(state[1], b);
+	state[2] = X8_ADD(state[2], c);
+	state[3] = X8_ADD(state[3], d);
+	state[4] = X8_ADD(state[4], e);
+}
+
+__attribute__((target("avx2")))
+static void init_x8(__m256i state[5])
+{
+	for (int i = 0; i < 5; i++) {
+		state[i] = _mm256_set1_epi32(SHA1_INIT[i]);
+	}
+}
+
+__attribute__((target("avx2")))
+static void hash_x8(const dnssec_binary_t *data, const dnssec_binary_t *salt,
+                    const uint8_t *iter_msg, size_t iter_blocks,
+                    unsigned iterations, uint8_t *out)
+{
+	uint8_t msg[LANES][DATA_BLOCKS * BLOCK_SIZE];
+	uint32_t blocks[LANES], max_blocks = 0;
+	for (int j = 0; j < LANES; j++) {
+		memcpy(msg[j], data[j].data, data[j].size);
+		memcpy(msg[j] + data[j].size, salt->data, salt->size);
+		blocks[j] = pad(msg[j], data[j].size + salt->size);
+		if (blocks[j] > max_blocks) {
+			max_blocks = blocks[j];
+		}
+	}
+
+	__m256i state[5], w[16];
+	init_x8(state);
+
+	// Lanes with shorter messages keep their state from the last block.
+	const __m256i lane_blocks = _mm256_loadu_si256((const __m256i *)blocks);
+	for (uint32_t b = 0; b < max_blocks; b++) {
+		uint32_t words[16][LANES];
+		for (int j = 0; j < LANES; j++) {
+			const uint8_t *block = msg[j] + BLOCK_SIZE * (b < blocks[j] ? b : 0);
+			for (int i = 0; i < 16; i++) {
+				words[i][j] = load_be(block + 4 * i);
+			}
+		}
+		for (int i = 0; i < 16; i++) {
+			w[i] = _mm256_loadu_si256((const __m256i *)words[i]);
+		}
+
+		__m256i prev[5];
+		memcpy(prev, state, sizeof(prev));
+		compress_x8(state, w);
+
+		__m256i done = _mm256_cmpgt_epi32(_mm256_set1_epi32(b + 1), lane_blocks);
+		for (int i = 0; i < 5; i++) {
+			state[i] = _mm256_blendv_epi8(state[i], prev[i], done);
+		}
+	}
+
+	// Iteration messages differ only in the leading previous hash.
+	__m256i tail[ITER_BLOCKS * 16];
+	for (size_t i = 5; i < iter_blocks * 16; i++) {
+		tail[i] = _mm256_set1_epi32(load_be(iter_msg + 4 * i));
+	}
+	for (unsigned it = 0; it < iterations; it++) {
+		memcpy(w, state, 5 * sizeof(__m256i));
+		memcpy(w + 5, tail + 5, 11 * sizeof(__m256i));
+		init_x8(state);
+		compress_x8(state, w);
+		for (size_t b = 1; b < iter_blocks; b++) {
+			memcpy(w, tail + 16 * b, sizeof(w));
+			compress_x8(state, w);
+		}
+	}
+
+	uint32_t digests[5][LANES];
+	for (int i = 0; i < 5; i++) {
+		_mm256_storeu_si256((__m256i *)digests[i], state[i]);
+	}
+	for (int j = 0; j < LANES; j++) {
+		uint32_t lane[5] = {
+			digests[0][j], digests[1][j], digests[2][j], digests[3][j], digests[4][j]
+		};
+		store_digest(out + j * NSEC3_SHA1_SIZE, lane);
+	}
+}
+
+static bool cpu_has_sha(void)
+{
+	static int has_sha = -1;
+
+	int ret = __atomic_load_n(&has_sha, __ATOMIC_RELAXED);
+	if (ret < 0) {
+		unsigned eax, ebx = 0, ecx, edx;
+		ret = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+		      (ebx & bit_SHA) && __builtin_cpu_supports("sse4.1");
+		__atomic_store_n(&has_sha, ret, __ATOMIC_RELAXED);
+	}
+
+	return ret;
+}
+__attribute__((target("sha,sse4.1")))
+static void hash_shani(const dnssec_binary_t *data, const dnssec_binary_t *salt,
+                       uint8_t *iter_msg, size_t iter_blocks,
+                       unsigned iterations, uint8_t *out)
+{
+	uint8_t msg[DATA_BLOCKS * BLOCK_SIZE];
+	memcpy(msg, data->data, data->size);
+	memcpy(msg + data->size, salt->data, salt->size);
+	size_t blocks = pad(msg, data->size + salt->size);
+
+	uint32_t state[5];
+	memcpy(state, SHA1_INIT, sizeof(state));
+	compress_shani(state, msg, blocks);
+
+	for (unsigned it = 0; it < iterations; it++) {
+		store_digest(iter_msg, state);
+		memcpy(state, SHA1_INIT, sizeof(state));
+		compress_shani(state, iter_msg, iter_blocks);
+	}
+
+	store_digest(out, state);
+}
+
+bool nsec3_sha1_faster(size_t count)
+{
+	// Multi-buffer hashing pays off only if the lanes are filled.
+	return cpu_has_sha() || (count >= LANES && __builtin_cpu_supports("avx2"));
+}
+
+void nsec3_sha1_batch(const dnssec_binary_t *data, size_t count,
+                      const dnssec_binary_t *salt, unsigned iterations,
+                      uint8_t *hashes)
+{
+	uint8_t iter_msg[ITER_BLOCKS * BLOCK_SIZE];
+	memcpy(iter_msg + NSEC3_SHA1_SIZE, salt->data, salt->size);
+	size_t iter_blocks = pad(iter_msg, NSEC3_SHA1_SIZE + salt->size);
+
+	// Multi-buffer hashing is faster than latency bound SHA extensions.
+	size_t i = 0;
+	if (__builtin_cpu_supports("avx2")) {
+		for (; i + LANES <= count; i += LANES) {
+			hash_x8(data + i, salt, iter_msg, iter_blocks, iterations,
+			        hashes + i * NSEC3_SHA1_SIZE);
+		}
+	}
+	if (i == count) {
+		return;
+	}
+
+	if (cpu_has_sha()) {
+		for (; i < count; i++) {
+			hash_shani(data + i, salt, iter_msg, iter_blocks, iterations,
+			           hashes + i * NSEC3_SHA1_SIZE);
+		}
+		return;
+	}
+
+	// Remaining lanes are filled with the last data.
+	dnssec_binary_t rest[LANES];
+	uint8_t out[LANES * NSEC3_SHA1_SIZE];
+	for (size_t j = 0; j < LANES; j++) {
+		rest[j] = data[(i + j < count) ? i + j : count - 1];
+	}
+	hash_x8(rest, salt, iter_msg, iter_blocks, iterations, out);
+	memcpy(hashes + i * NSEC3_SHA1_SIZE, out, (count - i) * NSEC3_SHA1_SIZE);
+}
+
+#else
+
+bool nsec3_sha1_faster(size_t count)
+{
+	return false;
+}
+
+void nsec3_sha1_batch(const dnssec_binary_t *data, size_t count,
+                      const dnssec_binary_t *salt, unsigned iterations,
+                      uint8_t *hashes)
+{
+	assert(0);
+}
+
+#endif
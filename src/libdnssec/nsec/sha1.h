@@ -0,0 +1,57 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libdnssec/binary.h"
+
+/*!
+ * Size of SHA-1 digest.
+ */
+#define NSEC3_SHA1_SIZE 20
+
+/*!
+ * Maximal size of hashed data (domain name) and of salt.
+ */
+#define NSEC3_SHA1_MAX_DATA 255
+#define NSEC3_SHA1_MAX_SALT 255
+
+/*!
+ * Check if the built-in SHA-1 is faster than the generic one on this CPU.
+ *
+ * \param count  Number of data items to be hashed at once.
+ */
+bool nsec3_sha1_faster(size_t count);
+
+/*!
+ * Compute SHA-1 NSEC3 hashes of multiple data at once.
+ *
+ * Uses SHA extensions or multi-buffer AVX2 implementation, it must be
+ * checked using \ref nsec3_sha1_faster that one of them is available.
+ *
+ * \param[in]  data        Data to be hashed, at most NSEC3_SHA1_MAX_DATA each.
+ * \param[in]  count       Number of data items.
+ * \param[in]  salt        Salt, at most NSEC3_SHA1_MAX_SALT long.
+ * \param[in]  iterations  Number of additional iterations.
+ * \param[out] hashes      Computed hashes, NSEC3_SHA1_SIZE bytes each.
+ */
+void nsec3_sha1_batch(const dnssec_binary_t *data, size_t count,
+                      const dnssec_binary_t *salt, unsigned iterations,
+                      uint8_t *hashes);
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -239,6 +239,12 @@ void knot_ctl_unbind(knot_ctl_t *ctx)
 
 _public_
 int knot_ctl_accept(knot_ctl_t *ctx)
+{
+	return knot_ctl_accept_wake(ctx, -1);
+}
+
+_public_
+int knot_ctl_accept_wake(knot_ctl_t *ctx, int wake_fd)
 {
 	if (ctx == NULL) {
 		return KNOT_EINVAL;
@@ -246,12 +252,18 @@ int knot_ctl_accept(knot_ctl_t *ctx)
 
 	knot_ctl_close(ctx);
 
-	// Control interface.
-	struct pollfd pfd = { .fd = ctx->listen_sock, .events = POLLIN };
-	int ret = poll(&pfd, 1, -1);
+	// Control interface and the optional wake-up descriptor (ignored if -1).
+	struct pollfd pfd[] = {
+		{ .fd = ctx->listen_sock, .events = POLLIN },
+		{ .fd = wake_fd, .events = POLLIN }
+	};
+	int ret = poll(pfd, 2, -1);
 	if (ret <= 0) {
 		return knot_map_errno();
 	}
+	if (pfd[0].revents == 0) {
+		return KNOT_EAGAIN;
+	}
 
 	int client = net_accept(ctx->listen_sock, NULL);
 	if (client < 0) {
@@ -265,6 +277,27 @@ int knot_ctl_accept(knot_ctl_t *ctx)
 	return KNOT_EOK;
 }
 
+_public_
+knot_ctl_t* knot_ctl_clone(knot_ctl_t *ctx)
+{
+	if (ctx == NULL || ctx->sock < 0) {
+		return NULL;
+	}
+
+	knot_ctl_t *res = knot_ctl_alloc();
+	if (res == NULL) {
+		return NULL;
+	}
+
+	res->timeout = ctx->timeout;
+	res->sock = ctx->sock;
+	ctx->sock = -1;
+
+	reset_buffers(ctx);
+
+	return res;
+}
+
 _public_
 int knot_ctl_connect(knot_ctl_t *ctx, const char *path)
 {
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -125,6 +125,34 @@ int knot_ctl_connect(knot_ctl_t *ctx, const char *path);
  */
 int knot_ctl_accept(knot_ctl_t *ctx);
 
+/*!
+ * Waits for an incoming connection or for data on the wake-up descriptor.
+ *
+ * \note Server operation.
+ *
+ * \param[in] ctx      Control context.
+ * \param[in] wake_fd  Descriptor interrupting the waiting if readable, or -1.
+ *
+ * \retval KNOT_EOK if a connection was accepted.
+ * \retval KNOT_EAGAIN if woken up by the descriptor.
+ * \retval KNOT_E* if error.
+ */
+int knot_ctl_accept_wake(knot_ctl_t *ctx, int wake_fd);
+
+/*!
+ * Allocates a new control context taking over the accepted connection.
+ *
+ * The original context keeps listening and can accept another connection
+ * while the new one is processed.
+ *
+ * \note Server operation.
+ *
+ * \param[in] ctx  Control context with an accepted connection.
+ *
+ * \return Control context or NULL.
+ */
+knot_ctl_t* knot_ctl_clone(knot_ctl_t *ctx);
+
 /*!
  * Closes the remote connections.
  *
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -36,19 +36,6 @@ static knot_rdata_t *rr_seek(const knot_rdataset_t *rrs, uint16_t pos)
 	return (knot_rdata_t *)raw;
 }
 
-static int find_rr_pos(const knot_rdataset_t *rrs, const knot_rdata_t *rr)
-{
-	knot_rdata_t *search_rr = rrs->rdata;
-	for (uint16_t i = 0; i < rrs->count; ++i) {
-		if (knot_rdata_cmp(rr, search_rr) == 0) {
-			return i;
-		}
-		search_rr = knot_rdataset_next(search_rr);
-	}
-
-	return KNOT_ENOENT;
-}
-
 static int add_rr_at(knot_rdataset_t *rrs, const knot_rdata_t *rr, knot_rdata_t *ins_pos,
                      knot_mm_t *mm)
 {
@@ -86,43 +73,6 @@ static int add_rr_at(knot_rdataset_t *rrs, const knot_rdata_t *rr, knot_rdata_t
 	return KNOT_EOK;
 }
 
-static int remove_rr_at(knot_rdataset_t *rrs, uint16_t pos, knot_mm_t *mm)
-{
-	assert(rrs);
-	assert(0 < rrs->count);
-	assert(pos < rrs->count);
-
-	knot_rdata_t *old_rr = rr_seek(rrs, pos);
-	knot_rdata_t *last_rr = rr_seek(rrs, rrs->count - 1);
-
-	size_t old_size = knot_rdata_size(old_rr->len);
-
-	// Move RDATA.
-	uint8_t *old_threshold = (uint8_t *)old_rr + old_size;
-	uint8_t *last_threshold = (uint8_t *)last_rr + knot_rdata_size(last_rr->len);
-	assert(old_threshold <= last_threshold);
-	memmove(old_rr, old_threshold, last_threshold - old_threshold);
-
-	if (rrs->count > 1) {
-		// Realloc RDATA.
-		knot_rdata_t *tmp = mm_realloc(mm, rrs->rdata, rrs->size - old_size,
-		                               rrs->size);
-		if (tmp == NULL) {
-			return KNOT_ENOMEM;
-		} else {
-			rrs->rdata = tmp;
-		}
-	} else {
-		// Free RDATA.
-		mm_free(mm, rrs->rdata);
-		rrs->rdata = NULL;
-	}
-	rrs->count--;
-	rrs->size -= old_size;
-
-	return KNOT_EOK;
-}
-
 _public_
 void knot_rdataset_clear(knot_rdataset_t *rrs, knot_mm_t *mm)
 {
@@ -246,6 +196,60 @@ bool knot_rdataset_member(const knot_rdataset_t *rrs, const knot_rdata_t *rr)
 	return false;
 }
 
+static int rdata_ptr_cmp(const void *a, const void *b)
+{
+	return knot_rdata_cmp(*(const knot_rdata_t **)a, *(const knot_rdata_t **)b);
+}
+
+_public_
+int knot_rdataset_from_array(knot_rdataset_t *rrs, const knot_rdata_t **rdata,
+                             uint16_t count, knot_mm_t *mm)
+{
+	if (rrs == NULL || (rdata == NULL && count > 0)) {
+		return KNOT_EINVAL;
+	}
+
+	knot_rdataset_init(rrs);
+
+	if (count == 0) {
+		return KNOT_EOK;
+	}
+
+	qsort(rdata, count, sizeof(*rdata), rdata_ptr_cmp);
+
+	// Drop duplicates and compute the total size.
+	uint16_t unique = 0;
+	size_t size = 0;
+	for (uint16_t i = 0; i < count; ++i) {
+		if (unique > 0 && knot_rdata_cmp(rdata[unique - 1], rdata[i]) == 0) {
+			continue;
+		}
+		rdata[unique++] = rdata[i];
+		size += knot_rdata_size(rdata[i]->len);
+	}
+
+	if (size > UINT32_MAX) {
+		return KNOT_ESPACE;
+	}
+
+	uint8_t *out = mm_alloc(mm, size);
+	if (out == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	rrs->rdata = (knot_rdata_t *)out;
+	rrs->count = unique;
+	rrs->size = size;
+
+	for (uint16_t i = 0; i < unique; ++i) {
+		size_t rr_size = knot_rdata_size(rdata[i]->len);
+		memcpy(out, rdata[i], rr_size);
+		out += rr_size;
+	}
+
+	return KNOT_EOK;
+}
+
 _public_
 int knot_rdataset_merge(knot_rdataset_t *rrs1, const knot_rdataset_t *rrs2,
                         knot_mm_t *mm)
@@ -254,15 +258,75 @@ int knot_rdataset_merge(knot_rdataset_t *rrs1, const knot_rdataset_t *rrs2,
 		return KNOT_EINVAL;
 	}
 
-	knot_rdata_t *rr2 = rrs2->rdata;
-	for (uint16_t i = 0; i < rrs2->count; ++i) {
-		int ret = knot_rdataset_add(rrs1, rr2, mm);
-		if (ret != KNOT_EOK) {
-			return ret;
+	// Count the missing RRs and find where the first of them belongs.
+	const knot_rdata_t *rr1 = rrs1->rdata;
+	const knot_rdata_t *rr2 = rrs2->rdata;
+	const knot_rdata_t *first_add = NULL;
+	size_t offset1 = 0, ins_offset = 0;
+	size_t add_count = 0, add_size = 0;
+	uint16_t i1 = 0, i2 = 0;
+	while (i2 < rrs2->count) {
+		int cmp = (i1 < rrs1->count) ? knot_rdata_cmp(rr1, rr2) : 1;
+		if (cmp <= 0) {
+			offset1 += knot_rdata_size(rr1->len);
+			rr1 = knot_rdataset_next((knot_rdata_t *)rr1);
+			i1++;
+			if (cmp < 0) {
+				continue;
+			}
+		} else {
+			if (add_count == 0) {
+				first_add = rr2;
+				ins_offset = offset1;
+			}
+			add_count++;
+			add_size += knot_rdata_size(rr2->len);
 		}
-		rr2 = knot_rdataset_next(rr2);
+		rr2 = knot_rdataset_next((knot_rdata_t *)rr2);
+		i2++;
+	}
+
+	if (add_count == 0) {
+		return KNOT_EOK;
+	} else if (rrs1->count + add_count > UINT16_MAX ||
+	           rrs1->size + add_size > UINT32_MAX) {
+		return KNOT_ESPACE;
+	}
+
+	uint8_t *data = mm_realloc(mm, rrs1->rdata, rrs1->size + add_size, rrs1->size);
+	if (data == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	// Open a gap for the new RRs and merge both sets into it.
+	uint8_t *out = data + ins_offset;
+	uint8_t *in1 = out + add_size;
+	uint8_t *end1 = data + rrs1->size + add_size;
+	memmove(in1, out, rrs1->size - ins_offset);
+
+	rr2 = first_add;
+	while (out < in1) {
+		int cmp = (in1 < end1) ? knot_rdata_cmp((knot_rdata_t *)in1, rr2) : 1;
+		if (cmp <= 0) {
+			size_t rr_size = knot_rdata_size(((knot_rdata_t *)in1)->len);
+			memmove(out, in1, rr_size);
+			out += rr_size;
+			in1 += rr_size;
+			if (cmp < 0) {
+				continue;
+			}
+		} else {
+			size_t rr_size = knot_rdata_size(rr2->len);
+			memcpy(out, rr2, rr_size);
+			out += rr_size;
+		}
+		rr2 = knot_rdataset_next((knot_rdata_t *)rr2);
 	}
 
+	rrs1->rdata = (knot_rdata_t *)data;
+	rrs1->count += add_count;
+	rrs1->size += add_size;
+
 	return KNOT_EOK;
 }
 
@@ -275,17 +339,45 @@ int knot_rdataset_intersect(const knot_rdataset_t *rrs1, const knot_rdataset_t *
 	}
 
 	knot_rdataset_init(out);
-	knot_rdata_t *rr1 = rrs1->rdata;
-	for (uint16_t i = 0; i < rrs1->count; ++i) {
-		if (knot_rdataset_member(rrs2, rr1)) {
-			// Add RR into output intersection RRSet.
-			int ret = knot_rdataset_add(out, rr1, mm);
-			if (ret != KNOT_EOK) {
-				knot_rdataset_clear(out, mm);
-				return ret;
+
+	// Two passes over both sets, the first one only computes the output size.
+	for (int pass = 0; pass < 2; pass++) {
+		uint8_t *pos = (uint8_t *)out->rdata;
+		const knot_rdata_t *rr1 = rrs1->rdata;
+		const knot_rdata_t *rr2 = rrs2->rdata;
+		uint16_t i1 = 0, i2 = 0;
+		while (i1 < rrs1->count && i2 < rrs2->count) {
+			int cmp = knot_rdata_cmp(rr1, rr2);
+			if (cmp == 0) {
+				size_t rr_size = knot_rdata_size(rr1->len);
+				if (pass == 0) {
+					out->count++;
+					out->size += rr_size;
+				} else {
+					memcpy(pos, rr1, rr_size);
+					pos += rr_size;
+				}
+			}
+			if (cmp <= 0) {
+				rr1 = knot_rdataset_next((knot_rdata_t *)rr1);
+				i1++;
+			}
+			if (cmp >= 0) {
+				rr2 = knot_rdataset_next((knot_rdata_t *)rr2);
+				i2++;
+			}
+		}
+
+		if (pass == 0) {
+			if (out->count == 0) {
+				return KNOT_EOK;
+			}
+			out->rdata = mm_alloc(mm, out->size);
+			if (out->rdata == NULL) {
+				knot_rdataset_init(out);
+				return KNOT_ENOMEM;
 			}
 		}
-		rr1 = knot_rdataset_next(rr1);
 	}
 
 	return KNOT_EOK;
@@ -305,16 +397,56 @@ int knot_rdataset_subtract(knot_rdataset_t *from, const knot_rdataset_t *what,
 		return KNOT_EOK;
 	}
 
-	knot_rdata_t *to_remove = what->rdata;
-	for (uint16_t i = 0; i < what->count; ++i) {
-		int pos_to_remove = find_rr_pos(from, to_remove);
-		if (pos_to_remove >= 0) {
-			int ret = remove_rr_at(from, pos_to_remove, mm);
-			if (ret != KNOT_EOK) {
-				return ret;
+	// Compact the remaining RRs in place.
+	uint8_t *rr = (uint8_t *)from->rdata;
+	uint8_t *end = rr + from->size;
+	const knot_rdata_t *rm = what->rdata;
+	uint8_t *out = NULL;
+	uint16_t i = 0, rm_count = 0;
+	size_t rm_size = 0;
+	while (rr < end) {
+		if (i == what->count) {
+			// Nothing more to remove, move the rest at once.
+			if (out != NULL) {
+				memmove(out, rr, end - rr);
 			}
+			break;
 		}
-		to_remove = knot_rdataset_next(to_remove);
+
+		size_t rr_size = knot_rdata_size(((knot_rdata_t *)rr)->len);
+		int cmp = knot_rdata_cmp((knot_rdata_t *)rr, rm);
+		if (cmp >= 0) {
+			rm = knot_rdataset_next((knot_rdata_t *)rm);
+			i++;
+			if (cmp > 0) {
+				continue;
+			}
+			if (out == NULL) {
+				out = rr;
+			}
+			rm_count++;
+			rm_size += rr_size;
+		} else if (out != NULL) {
+			memmove(out, rr, rr_size);
+			out += rr_size;
+		}
+		rr += rr_size;
+	}
+
+	if (rm_count == 0) {
+		return KNOT_EOK;
+	} else if (rm_count == from->count) {
+		knot_rdataset_clear(from, mm);
+		return KNOT_EOK;
+	}
+
+	from->count -= rm_count;
+	from->size -= rm_size;
+
+	// Shrinking failure is harmless, the original array is kept.
+	knot_rdata_t *tmp = mm_realloc(mm, from->rdata, from->size, from->size + rm_size);
+	if (tmp != NULL) {
+		from->rdata = tmp;
 	}
 
 	return KNOT_EOK;
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -112,6 +112,24 @@ knot_rdata_t *knot_rdataset_at(const knot_rdataset_t *rrs, uint16_t pos);
  */
 int knot_rdataset_add(knot_rdataset_t *rrs, const knot_rdata_t *rr, knot_mm_t *mm);
 
+/*!
+ * \brief Creates RRS structure from an array of RRs. All data are copied.
+ *
+ * The RRs don't have to be sorted and duplicates are skipped. The RRS data
+ * are allocated at once, which is cheaper than adding the RRs one by one.
+ *
+ * \note The input array is reordered.
+ *
+ * \param rrs    RRS structure to be initialized.
+ * \param rdata  Array of RRs.
+ * \param count  Number of RRs in the array.
+ * \param mm     Memory context.
+ *
+ * \return KNOT_E*
+ */
+int knot_rdataset_from_array(knot_rdataset_t *rrs, const knot_rdata_t **rdata,
+                             uint16_t count, knot_mm_t *mm);
+
 /*!
  * \brief RRS equality check.
  *
@@ -138,6 +156,8 @@ bool knot_rdataset_member(const knot_rdataset_t *rrs, const knot_rdata_t *rr);
  * \brief Merges two RRS into the first one. Second RRS is left intact.
  *        Canonical order is preserved.
  *
+ * The first RRS is reallocated at most once, the complexity is linear.
+ *
  * \param rrs1  Destination RRS (merge here).
  * \param rrs2  RRS to be merged (merge from).
  * \param mm    Memory context.
@@ -163,6 +183,8 @@ int knot_rdataset_intersect(const knot_rdataset_t *rrs1, const knot_rdataset_t *
 /*!
  * \brief Does set-like RRS subtraction. \a from RRS is changed.
  *
+ * The remaining RRs are compacted in place, the complexity is linear.
+ *
  * \param from  RRS to subtract from.
  * \param what  RRS to subtract.
  * \param mm    Memory context use to reallocated \a from data.
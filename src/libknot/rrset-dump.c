@@ -1901,23 +1901,13 @@ static int txt_dump_data(rrset_dump_params_t *p, uint16_t type)
 	}
 }
 
-_public_
-int knot_rrset_txt_dump_data(const knot_rrset_t      *rrset,
-                             const size_t            pos,
-                             char                    *dst,
-                             const size_t            maxlen,
-                             const knot_dump_style_t *style)
+static int rdata_txt_dump(const knot_rrset_t      *rrset,
+                          const knot_rdata_t      *rr_data,
+                          char                    *dst,
+                          const size_t            maxlen,
+                          const knot_dump_style_t *style)
 {
-	if (rrset == NULL || dst == NULL || style == NULL) {
-		return KNOT_EINVAL;
-	}
-
-	knot_rdata_t *rr_data = knot_rdataset_at(&rrset->rrs, pos);
-	if (rr_data == NULL) {
-		return KNOT_EINVAL; /* bad pos or rrset->rrs */
-	}
-
-	uint8_t *data = rr_data->data;
+	const uint8_t *data = rr_data->data;
 	uint16_t data_len = rr_data->len;
 
 	rrset_dump_params_t p = {
@@ -1950,6 +1940,25 @@ int knot_rrset_txt_dump_data(const knot_rrset_t      *rrset,
 	return ret;
 }
 
+_public_
+int knot_rrset_txt_dump_data(const knot_rrset_t      *rrset,
+                             const size_t            pos,
+                             char                    *dst,
+                             const size_t            maxlen,
+                             const knot_dump_style_t *style)
+{
+	if (rrset == NULL || dst == NULL || style == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	knot_rdata_t *rr_data = knot_rdataset_at(&rrset->rrs, pos);
+	if (rr_data == NULL) {
+		return KNOT_EINVAL; /* bad pos or rrset->rrs */
+	}
+
+	return rdata_txt_dump(rrset, rr_data, dst, maxlen, style);
+}
+
 _public_
 int knot_rrset_txt_dump_header(const knot_rrset_t      *rrset,
                                const uint32_t          ttl,
@@ -2055,8 +2064,7 @@ static int rrset_txt_dump(const knot_rrset_t      *rrset,
 		len += ret;
 
 		// Dump rdata as such.
-		ret = knot_rrset_txt_dump_data(rrset, i, dst + len,
-		                               maxlen - len, style);
+		ret = rdata_txt_dump(rrset, rr, dst + len, maxlen - len, style);
 		if (ret < 0) {
 			return KNOT_ESPACE;
 		}
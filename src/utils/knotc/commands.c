@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -558,7 +558,7 @@ static int zone_check(const knot_dname_t *dname, void *data)
 	cmd_args_t *args = data;
 
 	zone_contents_t *contents = NULL;
-	int ret = zone_load_contents(conf(), dname, &contents, args->force);
+	int ret = zone_load_contents(conf(), dname, &contents, false, args->force);
 	zone_contents_deep_free(contents);
 	return ret;
 }
@@ -17,6 +17,8 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -48,10 +50,16 @@
 
 #define PROGRAM_NAME "knotd"
 
+/*! \brief Number of concurrently processed control sessions. */
+#define CTL_THREADS 4
+
 /* Signal flags. */
 static volatile bool sig_req_stop = false;
 static volatile bool sig_req_reload = false;
 
+/* Self-pipe waking up the event loop waiting for a control connection. */
+static int wake_pipe[2] = { -1, -1 };
+
 /* \brief Signal started state to the init system. */
 static void init_signal_started(void)
 {
@@ -132,6 +140,17 @@ static const struct signal SIGNALS[] = {
 	{ 0 }
 };
 
+/*! \brief Wake up the event loop to check the request flags (async-signal-safe). */
+static void wake_event_loop(void)
+{
+	if (wake_pipe[1] >= 0) {
+		int err = errno;
+		uint8_t byte = 0;
+		(void)write(wake_pipe[1], &byte, sizeof(byte));
+		errno = err;
+	}
+}
+
 /*! \brief Server signal handler. */
 static void handle_signal(int signum)
 {
@@ -150,6 +169,8 @@ static void handle_signal(int signum)
 		/* ignore */
 		break;
 	}
+
+	wake_event_loop();
 }
 
 /*! \brief Setup signal handlers and blocking mask. */
@@ -208,6 +229,18 @@ static void drop_capabilities(void)
 #endif /* ENABLE_CAP_NG */
 }
 
+/*! \brief Stop request from a control session processed on another thread. */
+static void ctl_stop(void)
+{
+	sig_req_stop = true;
+	wake_event_loop();
+}
+
+static int ctl_reload(void *server)
+{
+	return server_reload(server);
+}
+
 /*! \brief Event loop listening for signals and remote commands. */
 static void event_loop(server_t *server, const char *socket)
 {
@@ -251,6 +284,24 @@ static void event_loop(server_t *server, const char *socket)
 	}
 	free(listen);
 
+	/* Requests from signals and control sessions wake up the accept below. */
+	if (pipe(wake_pipe) == 0) {
+		for (int i = 0; i < 2; i++) {
+			fcntl(wake_pipe[i], F_SETFL, O_NONBLOCK);
+			fcntl(wake_pipe[i], F_SETFD, FD_CLOEXEC);
+		}
+	} else {
+		log_warning("control, failed to create wake-up pipe (%s)",
+		            knot_strerror(knot_map_errno()));
+		wake_pipe[0] = wake_pipe[1] = -1;
+	}
+
+	/* Process control sessions concurrently if possible. */
+	ctl_pool_t *pool = ctl_pool_create(server, CTL_THREADS, ctl_stop);
+	if (pool == NULL) {
+		log_warning("control, failed to start concurrent processing");
+	}
+
 	enable_signals();
 
 	/* Run event loop. */
@@ -261,14 +312,30 @@ static void event_loop(server_t *server, const char *socket)
 		}
 		if (sig_req_reload) {
 			sig_req_reload = false;
-			server_reload(server);
+			if (pool != NULL) {
+				ctl_pool_exclusive(pool, ctl_reload, server);
+			} else {
+				server_reload(server);
+			}
 		}
 
 		// Update control timeout.
+		rcu_read_lock();
 		knot_ctl_set_timeout(ctl, conf()->cache.ctl_timeout);
+		rcu_read_unlock();
 
-		ret = knot_ctl_accept(ctl);
-		if (ret != KNOT_EOK) {
+		ret = knot_ctl_accept_wake(ctl, wake_pipe[0]);
+		if (ret == KNOT_EAGAIN) {
+			/* Woken up, drain the pipe and check the requests. */
+			uint8_t buf[64];
+			while (read(wake_pipe[0], buf, sizeof(buf)) > 0) {
+			}
+			continue;
+		} else if (ret != KNOT_EOK) {
+			continue;
+		}
+
+		if (pool != NULL && ctl_pool_assign(pool, ctl) == KNOT_EOK) {
 			continue;
 		}
 
@@ -279,6 +346,18 @@ static void event_loop(server_t *server, const char *socket)
 		}
 	}
 
+	/* Finish running control sessions. */
+	ctl_pool_free(pool);
+
+	/* Signals are handled only on this thread, so closing is safe here. */
+	for (int i = 0; i < 2; i++) {
+		if (wake_pipe[i] >= 0) {
+			int fd = wake_pipe[i];
+			wake_pipe[i] = -1;
+			close(fd);
+		}
+	}
+
 	/* Unbind the control socket. */
 	knot_ctl_unbind(ctl);
 	knot_ctl_free(ctl);
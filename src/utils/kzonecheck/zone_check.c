@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -17,6 +17,7 @@
 #include <stdio.h>
 #include <assert.h>
 
+#include "knot/server/dthreads.h"
 #include "knot/zone/contents.h"
 #include "knot/zone/zonefile.h"
 #include "utils/kzonecheck/zone_check.h"
@@ -77,6 +78,7 @@ int zone_check(const char *zone_file, const knot_dname_t *zone_name,
 	}
 	zl.err_handler = (sem_handler_t *)&stats;
 	zl.creator->master = true;
+	zl.threads = dt_optimal_size();
 
 	zone_contents_t *contents = zonefile_load(&zl);
 	zonefile_close(&zl);
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -21,6 +21,7 @@ typedef struct {
 	struct iovec iov[NBUFS];
 	uint8_t buf[NBUFS][KNOT_WIRE_MAX_PKTSIZE];
 	struct sockaddr_storage addr;
+	struct sockaddr_storage local;
 	bool afl_persistent;
 } udp_stdin_t;
 
@@ -33,8 +34,11 @@ static inline void next(udp_stdin_t *rq)
 	}
 }
 
-static void *udp_stdin_init(void)
+static void *udp_stdin_init(void *xdp_sock, unsigned batch)
 {
+	UNUSED(xdp_sock);
+	UNUSED(batch);
+
 	udp_stdin_t *rq = calloc(1, sizeof(udp_stdin_t));
 	if (rq == NULL) {
 		return NULL;
@@ -49,6 +53,7 @@ static void *udp_stdin_init(void)
 	a->sin_family = AF_INET;
 	a->sin_addr.s_addr = IN_LOOPBACKNET;
 	a->sin_port = 42;
+	memcpy(&rq->local, &rq->addr, sizeof(rq->local));
 
 	rq->afl_persistent = getenv("AFL_PERSISTENT") != NULL;
 
@@ -69,13 +74,14 @@ static int udp_stdin_recv(int fd, void *d)
 		next(rq);
 	}
 
-	return rq->iov[RX].iov_len;
+	return 1;
 }
 
 static int udp_stdin_handle(udp_context_t *ctx, void *d)
 {
 	udp_stdin_t *rq = (udp_stdin_t *)d;
-	udp_handle(ctx, STDIN_FILENO, &rq->addr, &rq->iov[RX], &rq->iov[TX]);
+	udp_msg_t msg = { &rq->addr, &rq->local, &rq->iov[RX], &rq->iov[TX] };
+	udp_handle(ctx, STDIN_FILENO, &msg, 1);
 	return 0;
 }
 
@@ -100,9 +106,9 @@ void udp_master_init_stdio(server_t *server) {
 
 	add_tail(server->ifaces, (node_t *)ifc);
 
-	_udp_init = udp_stdin_init;
-	_udp_recv = udp_stdin_recv;
-	_udp_handle = udp_stdin_handle;
-	_udp_send = udp_stdin_send;
-	_udp_deinit = udp_stdin_deinit;
+	sock_api.udp_init =   udp_stdin_init;
+	sock_api.udp_deinit = udp_stdin_deinit;
+	sock_api.udp_recv =   udp_stdin_recv;
+	sock_api.udp_handle = udp_stdin_handle;
+	sock_api.udp_send =   udp_stdin_send;
 }
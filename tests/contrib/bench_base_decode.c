@@ -0,0 +1,260 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * Measures the throughput of the Base64 and Base32hex decoders on the fields
+ * of a signed zone: RRSIG signatures and DNSKEY keys (Base64) and NSEC3 owner
+ * hashes (Base32hex). If a zone file is given, the fields are taken from it
+ * and the throughput of the zone scanner on the whole file is reported too.
+ * Otherwise the fields are generated with the sizes of an ECDSA P-256 signed
+ * zone with RSA-2048 KSK and SHA-1 NSEC3.
+ *
+ * Usage: bench_base_decode [signed zone file [origin]]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "contrib/base32hex.h"
+#include "contrib/base64.h"
+#include "contrib/time.h"
+#include "libknot/descriptor.h"
+#include "libzscanner/scanner.h"
+
+/*! \brief Minimal measuring time of each decoder. */
+#define MEASURE_NS	1e9
+/*! \brief Number of generated records. */
+#define GEN_COUNT	100000
+
+typedef struct {
+	uint8_t *data;
+	uint32_t *lens;
+	size_t size;
+	size_t max_size;
+	size_t count;
+	size_t max_count;
+} corpus_t;
+
+typedef int32_t (*decode_t)(const uint8_t *, const uint32_t, uint8_t *, const uint32_t);
+
+static double elapsed_ns(struct timespec *begin)
+{
+	struct timespec end = time_now();
+	return (end.tv_sec - begin->tv_sec) * 1e9 + (end.tv_nsec - begin->tv_nsec);
+}
+
+static bool corpus_reserve(corpus_t *corpus, size_t len)
+{
+	if (corpus->size + len > corpus->max_size) {
+		size_t max_size = 2 * (corpus->max_size + len);
+		uint8_t *data = realloc(corpus->data, max_size);
+		if (data == NULL) {
+			return false;
+		}
+		corpus->data = data;
+		corpus->max_size = max_size;
+	}
+	if (corpus->count == corpus->max_count) {
+		size_t max_count = 2 * corpus->max_count + 1024;
+		uint32_t *lens = realloc(corpus->lens, max_count * sizeof(*lens));
+		if (lens == NULL) {
+			return false;
+		}
+		corpus->lens = lens;
+		corpus->max_count = max_count;
+	}
+
+	return true;
+}
+
+static void corpus_add_text(corpus_t *corpus, const uint8_t *text, size_t len)
+{
+	if (corpus_reserve(corpus, len)) {
+		memcpy(corpus->data + corpus->size, text, len);
+		corpus->size += len;
+		corpus->lens[corpus->count++] = len;
+	}
+}
+
+static void corpus_add_base64(corpus_t *corpus, const uint8_t *bin, size_t len)
+{
+	size_t text_len = ((len + 2) / 3) * 4;
+	if (corpus_reserve(corpus, text_len)) {
+		int32_t ret = knot_base64_encode(bin, len, corpus->data + corpus->size,
+		                                 corpus->max_size - corpus->size);
+		if (ret > 0) {
+			corpus->size += ret;
+			corpus->lens[corpus->count++] = ret;
+		}
+	}
+}
+
+static void corpus_add_base32hex(corpus_t *corpus, const uint8_t *bin, size_t len)
+{
+	size_t text_len = ((len + 4) / 5) * 8;
+	if (corpus_reserve(corpus, text_len)) {
+		int32_t ret = knot_base32hex_encode(bin, len, corpus->data + corpus->size,
+		                                    corpus->max_size - corpus->size);
+		if (ret > 0) {
+			corpus->size += ret;
+			corpus->lens[corpus->count++] = ret;
+		}
+	}
+}
+
+static size_t dname_size(const uint8_t *name, const uint8_t *end)
+{
+	const uint8_t *pos = name;
+	while (pos < end && *pos != 0) {
+		pos += 1 + *pos;
+	}
+
+	return (pos < end) ? pos + 1 - name : end - name;
+}
+
+typedef struct {
+	corpus_t b64;
+	corpus_t b32;
+} zone_corpus_t;
+
+static void scan_record(zs_scanner_t *s)
+{
+	zone_corpus_t *corpus = s->process.data;
+	const uint8_t *rdata = s->r_data;
+	const uint8_t *end = s->r_data + s->r_data_length;
+
+	switch (s->r_type) {
+	case KNOT_RRTYPE_RRSIG:
+		if (s->r_data_length > 18) {
+			const uint8_t *sig = rdata + 18 + dname_size(rdata + 18, end);
+			corpus_add_base64(&corpus->b64, sig, end - sig);
+		}
+		break;
+	case KNOT_RRTYPE_DNSKEY:
+		if (s->r_data_length > 4) {
+			corpus_add_base64(&corpus->b64, rdata + 4, s->r_data_length - 4);
+		}
+		break;
+	case KNOT_RRTYPE_NSEC3:
+		// The first owner label is the Base32hex hash.
+		if (s->r_owner_length > 1) {
+			corpus_add_text(&corpus->b32, s->r_owner + 1, s->r_owner[0]);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static int load_zone(const char *file, const char *origin, zone_corpus_t *corpus)
+{
+	zs_scanner_t s;
+	if (zs_init(&s, origin, KNOT_CLASS_IN, 3600) != 0 ||
+	    zs_set_input_file(&s, file) != 0 ||
+	    zs_set_processing(&s, scan_record, NULL, corpus) != 0) {
+		fprintf(stderr, "failed to open zone file '%s'\n", file);
+		zs_deinit(&s);
+		return -1;
+	}
+
+	struct timespec begin = time_now();
+	int ret = zs_parse_all(&s);
+	double total = elapsed_ns(&begin);
+	zs_deinit(&s);
+	if (ret != 0) {
+		fprintf(stderr, "failed to parse zone file '%s'\n", file);
+		return -1;
+	}
+
+	struct stat st;
+	if (stat(file, &st) == 0) {
+		printf("%-10s %10s %12.1f\n", "scanner", "-", st.st_size / total * 1e3);
+	}
+
+	return 0;
+}
+
+static void generate(zone_corpus_t *corpus)
+{
+	uint8_t bin[260];
+	for (size_t i = 0; i < GEN_COUNT; i++) {
+		for (size_t j = 0; j < sizeof(bin); j++) {
+			bin[j] = rand();
+		}
+		// Two ECDSA P-256 signatures per NSEC3 record and its node, one NSEC3 hash.
+		corpus_add_base64(&corpus->b64, bin, 64);
+		corpus_add_base64(&corpus->b64, bin + 64, 64);
+		corpus_add_base32hex(&corpus->b32, bin + 128, 20);
+	}
+	// RSA-2048 DNSKEY and its signature.
+	corpus_add_base64(&corpus->b64, bin, 260);
+	corpus_add_base64(&corpus->b64, bin, 256);
+}
+
+static void bench(const char *name, const corpus_t *corpus, decode_t decode)
+{
+	if (corpus->count == 0) {
+		return;
+	}
+
+	uint8_t out[1024];
+	size_t rounds = 0;
+	double total = 0;
+	while (total < MEASURE_NS) {
+		struct timespec begin = time_now();
+		const uint8_t *in = corpus->data;
+		for (size_t i = 0; i < corpus->count; i++) {
+			if (decode(in, corpus->lens[i], out, sizeof(out)) < 0) {
+				fprintf(stderr, "%s: failed to decode field %zu\n", name, i);
+				return;
+			}
+			in += corpus->lens[i];
+		}
+		total += elapsed_ns(&begin);
+		rounds++;
+	}
+
+	printf("%-10s %10zu %12.1f\n", name, corpus->count,
+	       corpus->size * rounds / total * 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+	zone_corpus_t corpus = { { 0 } };
+
+	printf("%-10s %10s %12s\n", "decoder", "fields", "MB/s");
+
+	if (argc > 1) {
+		if (load_zone(argv[1], (argc > 2) ? argv[2] : ".", &corpus) != 0) {
+			return EXIT_FAILURE;
+		}
+	} else {
+		generate(&corpus);
+	}
+
+	bench("base64", &corpus.b64, knot_base64_decode);
+	bench("base32hex", &corpus.b32, knot_base32hex_decode);
+
+	free(corpus.b64.data);
+	free(corpus.b64.lens);
+	free(corpus.b32.data);
+	free(corpus.b32.lens);
+
+	return EXIT_SUCCESS;
+}
@@ -14,6 +14,7 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
@@ -28,7 +29,7 @@
 
 int main(int argc, char *argv[])
 {
-	plan(67);
+	plan(69);
 
 	int32_t  ret;
 	uint8_t  in[BUF_LEN], ref[BUF_LEN], out[BUF_LEN], out2[BUF_LEN], *out3;
@@ -263,5 +264,40 @@ int main(int argc, char *argv[])
 	ret = knot_base32hex_decode((uint8_t *)"$AAAAAAA", 8, out, BUF_LEN);
 	ok(ret == KNOT_BASE32HEX_ECHAR, "Bad data character dollar on position 1");
 
+	// Long data (vectorized decoding)
+	bool long_ok = true;
+	for (in_len = 0; in_len <= 150; in_len++) {
+		for (uint32_t i = 0; i < in_len; i++) {
+			in[i] = i * 37 + in_len;
+		}
+		int32_t len = knot_base32hex_encode(in, in_len, out, BUF_LEN);
+		ret = knot_base32hex_decode(out, len, out2, BUF_LEN);
+		if (ret != in_len || memcmp(out2, in, ret) != 0) {
+			long_ok = false;
+		}
+		// Upper case alphabet.
+		for (int32_t i = 0; i < len; i++) {
+			out[i] = toupper(out[i]);
+		}
+		ret = knot_base32hex_decode(out, len, out2, BUF_LEN);
+		if (ret != in_len || memcmp(out2, in, ret) != 0) {
+			long_ok = false;
+		}
+	}
+	ok(long_ok, "Long data - ENC -> DEC");
+
+	// Bad data character on each position of long data
+	bool bad_ok = true;
+	ref_len = knot_base32hex_encode(in, 150, ref, BUF_LEN);
+	for (uint32_t i = 0; i < ref_len; i++) {
+		memcpy(out, ref, ref_len);
+		out[i] = (i % 2) ? '$' : 0xC1;
+		ret = knot_base32hex_decode(out, ref_len, out2, BUF_LEN);
+		if (ret != KNOT_BASE32HEX_ECHAR) {
+			bad_ok = false;
+		}
+	}
+	ok(bad_ok, "Long data - bad data character on each position");
+
 	return 0;
 }
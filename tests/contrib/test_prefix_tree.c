@@ -0,0 +1,207 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <tap/basic.h>
+
+#include "contrib/prefix_tree.h"
+#include "contrib/sockaddr.h"
+#include "libknot/errcode.h"
+
+#define RANDOM_NETS	20
+#define RANDOM_ADDRS	10000
+
+static struct sockaddr_storage addr(int family, const char *str)
+{
+	struct sockaddr_storage ss = { 0 };
+	(void)sockaddr_set(&ss, family, str, 0);
+	return ss;
+}
+
+static bool match(const prefix_tree_t *tree, int family, const char *str)
+{
+	struct sockaddr_storage ss = addr(family, str);
+	return prefix_tree_match(tree, &ss);
+}
+
+static void test_basic(void)
+{
+	prefix_tree_t *tree = prefix_tree_new();
+	ok(tree != NULL, "create");
+
+	ok(!match(tree, AF_INET, "192.0.2.1"), "empty tree");
+
+	struct sockaddr_storage net = addr(AF_INET, "192.0.2.0");
+	ok(prefix_tree_add_net(tree, &net, 24, NULL, NULL) == KNOT_EOK, "add IPv4 network");
+	ok(match(tree, AF_INET, "192.0.2.0"), "network, first address");
+	ok(match(tree, AF_INET, "192.0.2.255"), "network, last address");
+	ok(!match(tree, AF_INET, "192.0.3.0"), "network, outside");
+	ok(!match(tree, AF_INET6, "c000:200::"), "network, other family");
+
+	struct sockaddr_storage single = addr(AF_INET6, "2001:db8::1");
+	ok(prefix_tree_add_net(tree, &single, 200, NULL, NULL) == KNOT_EOK, "add IPv6 address");
+	ok(match(tree, AF_INET6, "2001:db8::1"), "address");
+	ok(!match(tree, AF_INET6, "2001:db8::2"), "address, neighbor");
+
+	struct sockaddr_storage min = addr(AF_INET, "10.0.0.5");
+	struct sockaddr_storage max = addr(AF_INET, "10.0.1.3");
+	ok(prefix_tree_add_range(tree, &min, &max, NULL, NULL) == KNOT_EOK, "add IPv4 range");
+	ok(!match(tree, AF_INET, "10.0.0.4"), "range, before");
+	ok(match(tree, AF_INET, "10.0.0.5"), "range, first");
+	ok(match(tree, AF_INET, "10.0.0.255"), "range, middle");
+	ok(match(tree, AF_INET, "10.0.1.3"), "range, last");
+	ok(!match(tree, AF_INET, "10.0.1.4"), "range, after");
+
+	min = addr(AF_INET6, "::");
+	max = addr(AF_INET6, "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff");
+	ok(prefix_tree_add_range(tree, &min, &max, NULL, NULL) == KNOT_EOK, "add whole IPv6 range");
+	ok(match(tree, AF_INET6, "::1") && match(tree, AF_INET6, "2001:db8::2"),
+	   "whole range");
+
+	ok(prefix_tree_add_range(tree, &net, &min, NULL, NULL) == KNOT_EINVAL, "family mismatch");
+	struct sockaddr_storage unix_addr = { .ss_family = AF_UNIX };
+	ok(prefix_tree_add_net(tree, &unix_addr, 0, NULL, NULL) == KNOT_EINVAL, "unsupported family");
+	ok(!prefix_tree_match(tree, &unix_addr), "unsupported family, match");
+
+	prefix_tree_free(tree);
+}
+
+static int set_bit(uint32_t *value, void *ctx)
+{
+	*value |= *(uint32_t *)ctx;
+	return KNOT_EOK;
+}
+
+static int set_fail(uint32_t *value, void *ctx)
+{
+	return KNOT_ERROR;
+}
+
+static void get_bits(uint32_t value, void *ctx)
+{
+	*(uint32_t *)ctx |= value;
+}
+
+static uint32_t lookup(const prefix_tree_t *tree, int family, const char *str)
+{
+	struct sockaddr_storage ss = addr(family, str);
+	uint32_t bits = 0;
+	prefix_tree_lookup(tree, &ss, get_bits, &bits);
+	return bits;
+}
+
+static void test_values(void)
+{
+	prefix_tree_t *tree = prefix_tree_new();
+
+	uint32_t bit = 1;
+	struct sockaddr_storage net = addr(AF_INET, "10.0.0.0");
+	ok(prefix_tree_add_net(tree, &net, 8, set_bit, &bit) == KNOT_EOK, "values, add network");
+	bit = 2;
+	struct sockaddr_storage min = addr(AF_INET, "10.0.0.5");
+	struct sockaddr_storage max = addr(AF_INET, "10.0.1.3");
+	ok(prefix_tree_add_range(tree, &min, &max, set_bit, &bit) == KNOT_EOK, "values, add range");
+	bit = 4;
+	ok(prefix_tree_add_net(tree, &net, 8, set_bit, &bit) == KNOT_EOK, "values, add same network");
+
+	ok(lookup(tree, AF_INET, "10.0.0.4") == 5, "values, network only");
+	ok(lookup(tree, AF_INET, "10.0.0.5") == 7, "values, range first");
+	ok(lookup(tree, AF_INET, "10.0.1.3") == 7, "values, range last");
+	ok(lookup(tree, AF_INET, "11.0.0.0") == 0, "values, outside");
+	ok(prefix_tree_match(tree, &min), "values, match");
+
+	ok(prefix_tree_add_range(tree, &min, &max, set_fail, NULL) == KNOT_ERROR,
+	   "values, callback error");
+
+	prefix_tree_free(tree);
+}
+
+static void random_addr(struct sockaddr_storage *ss, int family)
+{
+	size_t len = (family == AF_INET) ? 4 : 16;
+	uint8_t raw[16];
+	for (size_t i = 0; i < len; i++) {
+		// Few distinct values to get overlaps.
+		raw[i] = (i < len - 2) ? (random() % 2) * 0xff : random() % 256;
+	}
+	sockaddr_set_raw(ss, family, raw, len);
+}
+
+static void test_random(int family, bool values)
+{
+	struct sockaddr_storage nets[RANDOM_NETS], maxs[RANDOM_NETS];
+	unsigned prefixes[RANDOM_NETS];
+	const char *name = (family == AF_INET) ? "IPv4" : "IPv6";
+	const char *mode = values ? "values" : "match";
+
+	prefix_tree_t *tree = prefix_tree_new();
+	bool added = (tree != NULL);
+	for (int i = 0; i < RANDOM_NETS; i++) {
+		uint32_t bit = 1 << i;
+		prefix_tree_set_t set = values ? set_bit : NULL;
+		random_addr(&nets[i], family);
+		if (i % 2 == 0) {
+			prefixes[i] = random() % ((family == AF_INET) ? 33 : 129);
+			maxs[i].ss_family = AF_UNSPEC;
+			added &= prefix_tree_add_net(tree, &nets[i], prefixes[i], set, &bit) == KNOT_EOK;
+		} else {
+			random_addr(&maxs[i], family);
+			added &= prefix_tree_add_range(tree, &nets[i], &maxs[i], set, &bit) == KNOT_EOK;
+		}
+	}
+	ok(added, "random %s %s, insert", name, mode);
+
+	int errors = 0;
+	for (int i = 0; i < RANDOM_ADDRS; i++) {
+		struct sockaddr_storage ss;
+		random_addr(&ss, family);
+
+		uint32_t expected = 0;
+		for (int j = 0; j < RANDOM_NETS; j++) {
+			bool match;
+			if (maxs[j].ss_family == AF_UNSPEC) {
+				match = sockaddr_net_match(&ss, &nets[j], prefixes[j]);
+			} else {
+				match = sockaddr_range_match(&ss, &nets[j], &maxs[j]);
+			}
+			expected |= match ? (1 << j) : 0;
+		}
+		if (values) {
+			uint32_t bits = 0;
+			prefix_tree_lookup(tree, &ss, get_bits, &bits);
+			errors += (bits != expected);
+		} else {
+			errors += (prefix_tree_match(tree, &ss) != (expected != 0));
+		}
+	}
+	ok(errors == 0, "random %s %s, same as linear scan", name, mode);
+
+	prefix_tree_free(tree);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	test_basic();
+	test_values();
+	test_random(AF_INET, false);
+	test_random(AF_INET6, false);
+	test_random(AF_INET, true);
+	test_random(AF_INET6, true);
+
+	return 0;
+}
@@ -162,6 +162,9 @@ static void test_range_match(void)
 	check_sockaddr_set(&t, AF_INET, "1.13.213.213", 0);
 	ret = sockaddr_range_match(&t, &min, &max);
 	ok(ret == true, "match: ipv4 middle range - middle");
+	check_sockaddr_set(&t, AF_INET, "1.14.0.0", 0);
+	ret = sockaddr_range_match(&t, &min, &max);
+	ok(ret == true, "match: ipv4 middle range - middle, zero suffix");
 	check_sockaddr_set(&t, AF_INET, "2.24.124.224", 0);
 	ret = sockaddr_range_match(&t, &min, &max);
 	ok(ret == true, "match: ipv4 middle range - max");
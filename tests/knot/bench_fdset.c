@@ -0,0 +1,139 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * Measures the cost of one wakeup (poll, event iteration, watchdog update)
+ * and of one sweep depending on the number of idle descriptors in the set.
+ *
+ * Usage: bench_fdset [max_idle_fds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "knot/common/fdset.h"
+#include "contrib/macros.h"
+#include "contrib/time.h"
+
+#define WAKEUPS 20000
+
+static enum fdset_sweep_state sweep_cb(fdset_t *set, int i, void *data)
+{
+	UNUSED(set);
+	UNUSED(i);
+	UNUSED(data);
+	return FDSET_KEEP;
+}
+
+static double elapsed_ns(struct timespec *begin)
+{
+	struct timespec end = time_now();
+	return (end.tv_sec - begin->tv_sec) * 1e9 + (end.tv_nsec - begin->tv_nsec);
+}
+
+static int bench(unsigned idle)
+{
+	fdset_t set;
+	fdset_init(&set, FDSET_INIT_SIZE);
+
+	/* Idle descriptors (with open peers) and a distant watchdog. */
+	int *fds = calloc(2 * idle, sizeof(int));
+	for (unsigned i = 0; i < idle; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[2 * i]) != 0) {
+			perror("socketpair");
+			return -1;
+		}
+		int idx = fdset_add(&set, fds[2 * i], POLLIN, NULL);
+		fdset_set_watchdog(&set, idx, 3600 + (i % 60));
+	}
+
+	/* One active descriptor. */
+	int active[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, active) != 0) {
+		perror("socketpair");
+		return -1;
+	}
+	fdset_add(&set, active[0], POLLIN, NULL);
+
+	struct timespec begin = time_now();
+	for (unsigned i = 0; i < WAKEUPS; i++) {
+		char byte = 0;
+		if (write(active[1], &byte, 1) != 1) {
+			return -1;
+		}
+		fdset_it_t it;
+		(void)fdset_poll(&set, &it, 0, -1);
+		for (; !fdset_it_is_done(&it); fdset_it_next(&it)) {
+			int fd = fdset_get_fd(&set, fdset_it_get_idx(&it));
+			if (read(fd, &byte, 1) != 1) {
+				return -1;
+			}
+			fdset_set_watchdog(&set, fdset_it_get_idx(&it), 10);
+		}
+		fdset_it_commit(&it);
+	}
+	double wakeup = elapsed_ns(&begin) / WAKEUPS;
+
+	/* Pretend the last sweep happened a second ago. */
+	set.swept -= 1;
+	begin = time_now();
+	(void)fdset_sweep(&set, sweep_cb, NULL);
+	double sweep = elapsed_ns(&begin);
+
+	printf("%10u %14.0f %14.0f\n", idle, wakeup, sweep);
+
+	close(active[0]);
+	close(active[1]);
+	for (unsigned i = 0; i < 2 * idle; i++) {
+		close(fds[i]);
+	}
+	free(fds);
+	fdset_clear(&set);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned max = (argc > 1) ? atoi(argv[1]) : 10000;
+
+	/* Each idle connection takes two descriptors. */
+	struct rlimit lim;
+	if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < 2 * max + 64) {
+		lim.rlim_cur = MIN(lim.rlim_max, 2 * max + 64);
+		(void)setrlimit(RLIMIT_NOFILE, &lim);
+		if (lim.rlim_cur < 2 * max + 64) {
+			max = (lim.rlim_cur - 64) / 2;
+		}
+	}
+
+#ifdef HAVE_EPOLL
+	printf("fdset backend: epoll\n");
+#else
+	printf("fdset backend: poll\n");
+#endif
+	printf("%10s %14s %14s\n", "idle fds", "wakeup [ns]", "sweep [ns]");
+	for (unsigned idle = 10; idle < 10 * max; idle *= 10) {
+		if (bench(MIN(idle, max)) != 0) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
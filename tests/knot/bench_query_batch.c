@@ -0,0 +1,239 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * Compares the query processing throughput of the per-packet path with
+ * the staged batch path (all queries parsed, then zones found for the whole
+ * batch, then answers produced) as used by the UDP handler.
+ *
+ * Usage: bench_query_batch [queries]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <urcu.h>
+
+#include "libknot/libknot.h"
+#include "knot/nameserver/process_query.h"
+#include "test_server.h"
+#include "contrib/macros.h"
+#include "contrib/sockaddr.h"
+#include "contrib/time.h"
+#include "contrib/ucw/mempool.h"
+
+#define NAMES     10000
+#define BATCH_MAX 32
+
+typedef struct {
+	uint8_t query[KNOT_WIRE_MIN_PKTSIZE];
+	size_t query_len;
+	uint8_t answer[KNOT_WIRE_MIN_PKTSIZE];
+} msg_t;
+
+static knotd_qdata_params_t params_init(server_t *server, struct sockaddr_storage *remote)
+{
+	knotd_qdata_params_t params = {
+		.remote = remote,
+		.flags = KNOTD_QUERY_FLAG_NO_AXFR | KNOTD_QUERY_FLAG_NO_IXFR |
+		         KNOTD_QUERY_FLAG_LIMIT_SIZE | KNOTD_QUERY_FLAG_LIMIT_ANY,
+		.server = server,
+	};
+	return params;
+}
+
+static bool state_active(int state)
+{
+	return (state == KNOT_STATE_PRODUCE || state == KNOT_STATE_FAIL);
+}
+
+static void handle_single(knot_layer_t *layer, knotd_qdata_params_t *params, msg_t *msg)
+{
+	knot_layer_begin(layer, params);
+
+	knot_pkt_t *query = knot_pkt_new(msg->query, msg->query_len, layer->mm);
+	knot_pkt_t *ans = knot_pkt_new(msg->answer, sizeof(msg->answer), layer->mm);
+
+	(void)knot_pkt_parse(query, 0);
+	knot_layer_consume(layer, query);
+	while (state_active(layer->state)) {
+		knot_layer_produce(layer, ans);
+	}
+
+	knot_layer_finish(layer);
+	mp_flush(layer->mm->ctx);
+}
+
+static void handle_batch(knot_layer_t *layers, knotd_qdata_params_t *params,
+                         msg_t *msgs, unsigned count)
+{
+	knot_pkt_t *ans[BATCH_MAX];
+
+	for (unsigned i = 0; i < count; i++) {
+		knot_layer_begin(&layers[i], params);
+
+		knot_pkt_t *query = knot_pkt_new(msgs[i].query, msgs[i].query_len, layers[i].mm);
+		ans[i] = knot_pkt_new(msgs[i].answer, sizeof(msgs[i].answer), layers[i].mm);
+
+		(void)knot_pkt_parse(query, 0);
+		knot_layer_consume(&layers[i], query);
+	}
+
+	rcu_read_lock();
+	for (unsigned i = 0; i < count; i++) {
+		if (layers[i].state == KNOT_STATE_PRODUCE) {
+			knot_layer_prepare(&layers[i], ans[i]);
+		}
+	}
+	for (unsigned i = 0; i < count; i++) {
+		while (state_active(layers[i].state)) {
+			knot_layer_produce(&layers[i], ans[i]);
+		}
+		knot_layer_finish(&layers[i]);
+	}
+	rcu_read_unlock();
+
+	mp_flush(layers[0].mm->ctx);
+}
+
+static double elapsed_ns(struct timespec *begin)
+{
+	struct timespec end = time_now();
+	return (end.tv_sec - begin->tv_sec) * 1e9 + (end.tv_nsec - begin->tv_nsec);
+}
+
+static int add_names(server_t *server)
+{
+	zone_t *root = knot_zonedb_find(server->zone_db, ROOT_DNAME);
+	if (root == NULL) {
+		return KNOT_ENOENT;
+	}
+
+	knot_mm_t mm;
+	mm_ctx_mempool(&mm, MM_DEFAULT_BLKSIZE);
+
+	for (unsigned i = 0; i < NAMES; i++) {
+		char name[32];
+		(void)snprintf(name, sizeof(name), "name%u.", i);
+		knot_dname_t *owner = knot_dname_from_str(NULL, name, 0);
+
+		knot_rrset_t *rr = knot_rrset_new(owner, KNOT_RRTYPE_A, KNOT_CLASS_IN, 3600, &mm);
+		uint8_t addr[] = { 192, 0, 2, i % 256 };
+		knot_rrset_add_rdata(rr, addr, sizeof(addr), &mm);
+
+		zone_node_t *node = NULL;
+		int ret = zone_contents_add_rr(root->contents, rr, &node);
+		knot_rrset_free(rr, &mm);
+		free(owner);
+		if (ret != KNOT_EOK) {
+			mp_delete(mm.ctx);
+			return ret;
+		}
+	}
+
+	mp_delete(mm.ctx);
+
+	return zone_adjust_full(root->contents, 1);
+}
+
+static msg_t *make_queries(unsigned count)
+{
+	msg_t *msgs = calloc(count, sizeof(*msgs));
+	if (msgs == NULL) {
+		return NULL;
+	}
+
+	for (unsigned i = 0; i < count; i++) {
+		/* Every fourth name doesn't exist. */
+		char name[32];
+		unsigned idx = (i * 7919) % NAMES;
+		(void)snprintf(name, sizeof(name), "%s%u.", (i % 4 == 0) ? "none" : "name", idx);
+		knot_dname_t *qname = knot_dname_from_str(NULL, name, 0);
+
+		knot_pkt_t *pkt = knot_pkt_new(NULL, sizeof(msgs[i].query), NULL);
+		knot_wire_set_id(pkt->wire, i);
+		(void)knot_pkt_put_question(pkt, qname, KNOT_CLASS_IN, KNOT_RRTYPE_A);
+		memcpy(msgs[i].query, pkt->wire, pkt->size);
+		msgs[i].query_len = pkt->size;
+
+		knot_pkt_free(pkt);
+		free(qname);
+	}
+
+	return msgs;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned queries = (argc > 1) ? atoi(argv[1]) : 1000000;
+	if (queries == 0) {
+		return EXIT_FAILURE;
+	}
+
+	knot_mm_t mm;
+	mm_ctx_mempool(&mm, 16 * MM_DEFAULT_BLKSIZE);
+
+	server_t server;
+	if (create_fake_server(&server, &mm) != KNOT_EOK || add_names(&server) != KNOT_EOK) {
+		fprintf(stderr, "failed to create the server\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Keep the working set of queries small enough to stay cached. */
+	unsigned nmsgs = MIN(queries, 4096);
+	msg_t *msgs = make_queries(nmsgs);
+	if (msgs == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	struct sockaddr_storage remote;
+	(void)sockaddr_set(&remote, AF_INET, "127.0.0.1", 53);
+	knotd_qdata_params_t params = params_init(&server, &remote);
+
+	knot_layer_t layers[BATCH_MAX];
+	for (unsigned i = 0; i < BATCH_MAX; i++) {
+		knot_layer_init(&layers[i], &mm, process_query_layer());
+	}
+
+	printf("%-10s %6s %12s\n", "path", "batch", "[ns/query]");
+
+	/* Per-packet path. */
+	struct timespec begin = time_now();
+	for (unsigned i = 0; i < queries; i++) {
+		handle_single(&layers[0], &params, &msgs[i % nmsgs]);
+	}
+	printf("%-10s %6u %12.0f\n", "single", 1, elapsed_ns(&begin) / queries);
+
+	/* Batch path. */
+	static const unsigned sizes[] = { 1, 4, 10, 16, 32 };
+	for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		begin = time_now();
+		for (unsigned done = 0, pos = 0; done < queries; ) {
+			unsigned count = MIN(sizes[s], nmsgs - pos);
+			handle_batch(layers, &params, &msgs[pos], count);
+			pos = (pos + count) % nmsgs;
+			done += count;
+		}
+		printf("%-10s %6u %12.0f\n", "batched", sizes[s], elapsed_ns(&begin) / queries);
+	}
+
+	free(msgs);
+	server_deinit(&server);
+	conf_free(conf());
+	mp_delete(mm.ctx);
+
+	return EXIT_SUCCESS;
+}
@@ -15,6 +15,7 @@
  */
 
 #include <assert.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <tap/basic.h>
@@ -57,10 +58,70 @@ void check_update(conf_t *conf, knot_rrset_t *authority, knot_tsig_key_t *key,
 	                       zone_name, parsed);
 	ok(ret == allowed, "%s", desc);
 
+	acl_t *compiled = acl_compile(conf, zone_name);
+	ret = acl_match(compiled, ACL_ACTION_UPDATE, &addr, key, parsed);
+	ok(ret == allowed, "%s, compiled", desc);
+	acl_free(compiled);
+
 	knot_pkt_free(parsed);
 	knot_pkt_free(query);
 }
 
+static void test_acl_compiled(const knot_dname_t *zone_name, knot_tsig_key_t *key0,
+                              knot_tsig_key_t *key1, knot_tsig_key_t *key2,
+                              knot_tsig_key_t *key3)
+{
+	static const char *addrs[] = {
+		"2001::1", "2001::2", "240.0.0.0", "240.0.0.1", "240.0.0.2",
+		"240.0.0.3", "240.0.0.255", "240.0.1.0", "192.168.1.1",
+		"192.168.1.2", "1.1.1.1", "100.0.0.0", "100.0.0.5", "100.0.0.6",
+		"99.255.255.255", "::", "::5", "::6", "::ffff:240.0.0.1",
+		"10.0.0.6", "10.0.0.7", "10.0.255.255", "10.1.2.3", "10.1.2.4",
+		"2001:db8::1", "2001:db8:7fff::", "2001:db8:8000::"
+	};
+	knot_tsig_key_t key_alg = { DNSSEC_TSIG_HMAC_SHA256, key1->name };
+	knot_tsig_key_t *keys[] = { key0, key1, key2, key3, &key_alg };
+
+	acl_t *acl = acl_compile(conf(), zone_name);
+	ok(acl != NULL, "compile zone ACL");
+
+	unsigned mismatches = 0;
+	for (int i = 0; i < sizeof(addrs) / sizeof(addrs[0]); i++) {
+		struct sockaddr_storage addr;
+		int family = strchr(addrs[i], ':') != NULL ? AF_INET6 : AF_INET;
+		(void)sockaddr_set(&addr, family, addrs[i], 0);
+
+		for (int k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+			for (int a = ACL_ACTION_NONE; a <= ACL_ACTION_UPDATE; a++) {
+				knot_tsig_key_t tsig1 = *keys[k], tsig2 = *keys[k];
+				conf_val_t val = conf_zone_get(conf(), C_ACL, zone_name);
+				bool ref = acl_allowed(conf(), &val, a, &addr, &tsig1,
+				                       zone_name, NULL);
+				bool res = acl_match(acl, a, &addr, &tsig2, NULL);
+				if (ref != res || (ref && (tsig1.secret.size != tsig2.secret.size ||
+				    memcmp(tsig1.secret.data, tsig2.secret.data,
+				           tsig1.secret.size) != 0))) {
+					diag("mismatch for %s, key %i, action %i, %i %i", addrs[i], k, a, ref, res);
+					mismatches++;
+				}
+			}
+		}
+	}
+	is_int(0, mismatches, "compiled ACL matches the configuration");
+
+	acl_free(acl);
+
+	/* Empty ACL. */
+	knot_dname_t *other = knot_dname_from_str_alloc("other.zone");
+	acl = acl_compile(conf(), other);
+	struct sockaddr_storage addr;
+	(void)sockaddr_set(&addr, AF_INET, "1.1.1.1", 0);
+	ok(acl != NULL && !acl_match(acl, ACL_ACTION_NONE, &addr, key0, NULL),
+	   "compiled empty ACL");
+	acl_free(acl);
+	knot_dname_free(other, NULL);
+}
+
 static void test_acl_allowed(void)
 {
 	int ret;
@@ -114,6 +175,9 @@ static void test_acl_allowed(void)
 		"  - id: acl_range_addr\n"
 		"    address: [ 100.0.0.0-100.0.0.5, ::0-::5 ]\n"
 		"    action: [ transfer ]\n"
+		"  - id: acl_wide_range\n"
+		"    address: [ 10.0.0.7-10.1.2.3, 2001:db8::/33 ]\n"
+		"    action: [ notify ]\n"
 		"  - id: acl_update_key\n"
 		"    key: "KEY1"\n"
 		"    update-owner: key\n"
@@ -130,7 +194,7 @@ static void test_acl_allowed(void)
 		"  - domain: "ZONE"\n"
 		"    acl: [ acl_key_addr, acl_deny, acl_no_action_deny ]\n"
 		"    acl: [ acl_multi_addr, acl_multi_key ]\n"
-		"    acl: [ acl_range_addr ]\n"
+		"    acl: [ acl_range_addr, acl_wide_range ]\n"
 		"  - domain: "KEY1"\n"
 		"    acl: acl_update_key\n"
 		"  - domain: "KEY2"\n"
@@ -264,6 +328,8 @@ static void test_acl_allowed(void)
 	knot_dname_free(aa_key2_name, NULL);
 	knot_rdataset_clear(&aaA.rrs, NULL);
 
+	test_acl_compiled(zone_name, &key0, &key1, &key2, &key3);
+
 	conf_free(conf());
 	knot_dname_free(zone_name, NULL);
 	knot_dname_free(key1_name, NULL);
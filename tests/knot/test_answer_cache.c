@@ -0,0 +1,157 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <tap/basic.h>
+#include <string.h>
+
+#include "knot/nameserver/answer_cache.h"
+#include "libknot/libknot.h"
+
+static knot_pkt_t *make_query(const char *name, uint16_t qtype, uint16_t id, bool rd)
+{
+	knot_dname_t *qname = knot_dname_from_str_alloc(name);
+	knot_pkt_t *query = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	knot_pkt_put_question(query, qname, KNOT_CLASS_IN, qtype);
+	knot_wire_set_id(query->wire, id);
+	if (rd) {
+		knot_wire_set_rd(query->wire);
+	}
+	knot_dname_free(qname, NULL);
+
+	return query;
+}
+
+static knot_pkt_t *make_answer(const knot_pkt_t *query, uint8_t last_octet)
+{
+	knot_pkt_t *resp = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	knot_pkt_init_response(resp, query);
+	knot_pkt_begin(resp, KNOT_ANSWER);
+
+	knot_rrset_t *rr = knot_rrset_new(knot_pkt_qname(query), KNOT_RRTYPE_A,
+	                                  KNOT_CLASS_IN, 3600, &resp->mm);
+	uint8_t addr[] = { 192, 0, 2, last_octet };
+	knot_rrset_add_rdata(rr, addr, sizeof(addr), &resp->mm);
+	knot_pkt_put(resp, KNOT_COMPR_HINT_QNAME, rr, KNOT_PF_FREE);
+	knot_wire_set_aa(resp->wire);
+
+	return resp;
+}
+
+static int get(answer_cache_t *cache, const zone_contents_t *contents,
+               const knot_pkt_t *query, knot_pkt_t *resp, uint16_t *rcode)
+{
+	knot_pkt_init_response(resp, query);
+	resp->max_size = KNOT_WIRE_MAX_PKTSIZE;
+	return answer_cache_get(cache, 0, contents, query, resp, true, rcode);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ok(answer_cache_new(0, 1) == NULL, "new: disabled cache");
+
+	answer_cache_t *cache = answer_cache_new(100, 2);
+	ok(cache != NULL, "new: cache");
+
+	/* Only the contents address is used. */
+	int dummy[2];
+	const zone_contents_t *contents = (const zone_contents_t *)&dummy[0];
+	const zone_contents_t *other = (const zone_contents_t *)&dummy[1];
+	uint16_t rcode = 0;
+
+	knot_pkt_t *query = make_query("www.example.com.", KNOT_RRTYPE_A, 1, true);
+	knot_pkt_t *resp = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	knot_pkt_t *answer = make_answer(query, 1);
+
+	is_int(KNOT_ENOENT, get(cache, contents, query, resp, &rcode), "get: empty cache");
+
+	answer_cache_put(cache, contents, query, answer, true, KNOT_RCODE_NOERROR);
+	is_int(KNOT_EOK, get(cache, contents, query, resp, &rcode), "get: stored answer");
+	ok(resp->size == answer->size &&
+	   memcmp(resp->wire, answer->wire, answer->size) == 0, "get: same wire");
+	is_int(KNOT_RCODE_NOERROR, rcode, "get: RCODE");
+
+	/* Same question, different ID and flags. */
+	knot_pkt_t *query2 = make_query("www.example.com.", KNOT_RRTYPE_A, 2, false);
+	knot_wire_set_cd(query2->wire);
+	is_int(KNOT_EOK, get(cache, contents, query2, resp, &rcode), "get: other ID");
+	ok(knot_wire_get_id(resp->wire) == 2 && !knot_wire_get_rd(resp->wire) &&
+	   !knot_wire_get_cd(resp->wire), "get: patched ID, RD, and CD");
+	ok(memcmp(resp->wire + 4, answer->wire + 4, answer->size - 4) == 0,
+	   "get: rest of the wire");
+
+	/* Different key parts. */
+	knot_pkt_t *query3 = make_query("www.example.com.", KNOT_RRTYPE_AAAA, 1, true);
+	is_int(KNOT_ENOENT, get(cache, contents, query3, resp, &rcode), "get: other QTYPE");
+	knot_pkt_init_response(resp, query);
+	is_int(KNOT_ENOENT, answer_cache_get(cache, 0, contents, query, resp, false, &rcode),
+	       "get: other size limit");
+	knot_pkt_init_response(resp, query);
+	resp->max_size = 1232;
+	is_int(KNOT_ENOENT, answer_cache_get(cache, 0, contents, query, resp, true, &rcode),
+	       "get: other maximal size");
+	is_int(KNOT_ENOENT, get(cache, other, query, resp, &rcode), "get: other contents");
+
+	/* Reserved space must fit. */
+	answer->max_size = answer->size + 10;
+	answer_cache_put(cache, contents, query, answer, true, KNOT_RCODE_NOERROR);
+	knot_pkt_init_response(resp, query);
+	resp->max_size = answer->size + 10;
+	is_int(KNOT_EOK, answer_cache_get(cache, 0, contents, query, resp, true, &rcode),
+	       "get: answer fits");
+	knot_pkt_init_response(resp, query);
+	resp->max_size = answer->size + 10;
+	knot_pkt_reserve(resp, 11);
+	is_int(KNOT_ENOENT, answer_cache_get(cache, 0, contents, query, resp, true, &rcode),
+	       "get: no space for reserved data");
+	answer->max_size = KNOT_WIRE_MAX_PKTSIZE;
+
+	/* Truncated answers aren't stored. */
+	knot_pkt_t *query4 = make_query("tc.example.com.", KNOT_RRTYPE_A, 1, true);
+	knot_pkt_t *answer4 = make_answer(query4, 4);
+	knot_wire_set_tc(answer4->wire);
+	answer_cache_put(cache, contents, query4, answer4, true, KNOT_RCODE_NOERROR);
+	is_int(KNOT_ENOENT, get(cache, contents, query4, resp, &rcode), "put: truncated answer");
+
+	/* Overwrite, RCODE. */
+	knot_pkt_t *answer5 = make_answer(query, 5);
+	answer_cache_put(cache, contents, query, answer5, true, KNOT_RCODE_NXDOMAIN);
+	is_int(KNOT_EOK, get(cache, contents, query, resp, &rcode), "get: overwritten answer");
+	ok(memcmp(resp->wire, answer5->wire, answer5->size) == 0, "get: new wire");
+	is_int(KNOT_RCODE_NXDOMAIN, rcode, "get: new RCODE");
+
+	/* Invalidation. */
+	answer_cache_invalidate(cache);
+	is_int(KNOT_ENOENT, get(cache, contents, query, resp, &rcode), "get: after invalidation");
+
+	/* Counters. */
+	is_int(4, answer_cache_hits(cache), "hits");
+	is_int(8, answer_cache_misses(cache), "misses");
+	is_int(0, answer_cache_hits(NULL), "hits: no cache");
+
+	knot_pkt_free(query);
+	knot_pkt_free(query2);
+	knot_pkt_free(query3);
+	knot_pkt_free(query4);
+	knot_pkt_free(resp);
+	knot_pkt_free(answer);
+	knot_pkt_free(answer4);
+	knot_pkt_free(answer5);
+	answer_cache_free(cache);
+
+	return 0;
+}
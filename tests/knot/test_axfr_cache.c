@@ -0,0 +1,171 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <tap/basic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "knot/nameserver/axfr_cache.h"
+#include "libknot/libknot.h"
+
+#define ZONE   "example.com."
+#define NODES  2000
+
+static void add_rr(zone_contents_t *contents, const char *owner, uint16_t type,
+                   const uint8_t *rdata, uint16_t rdlen)
+{
+	knot_dname_t *name = knot_dname_from_str_alloc(owner);
+	knot_rrset_t *rr = knot_rrset_new(name, type, KNOT_CLASS_IN, 3600, NULL);
+	knot_rrset_add_rdata(rr, rdata, rdlen, NULL);
+	zone_node_t *node = NULL;
+	zone_contents_add_rr(contents, rr, &node);
+	knot_rrset_free(rr, NULL);
+	knot_dname_free(name, NULL);
+}
+
+static zone_contents_t *make_contents(uint32_t serial)
+{
+	knot_dname_t *apex = knot_dname_from_str_alloc(ZONE);
+	zone_contents_t *contents = zone_contents_new(apex, false);
+	knot_dname_free(apex, NULL);
+
+	uint8_t soa[128] = { 0 };
+	knot_dname_t *mname = knot_dname_from_str_alloc("ns." ZONE);
+	knot_dname_t *rname = knot_dname_from_str_alloc("admin." ZONE);
+	uint8_t *pos = soa;
+	pos += knot_dname_to_wire(pos, mname, sizeof(soa));
+	pos += knot_dname_to_wire(pos, rname, sizeof(soa) - (pos - soa));
+	knot_wire_write_u32(pos, serial);
+	pos += 5 * sizeof(uint32_t);
+	add_rr(contents, ZONE, KNOT_RRTYPE_SOA, soa, pos - soa);
+	knot_dname_free(mname, NULL);
+	knot_dname_free(rname, NULL);
+
+	uint8_t txt[201] = { 200 };
+	memset(txt + 1, 'x', sizeof(txt) - 1);
+	for (int i = 0; i < NODES; i++) {
+		char owner[64];
+		(void)snprintf(owner, sizeof(owner), "n%i." ZONE, i);
+		add_rr(contents, owner, KNOT_RRTYPE_TXT, txt, sizeof(txt));
+	}
+
+	return contents;
+}
+
+static knot_pkt_t *make_response(const char *name, uint16_t max_size)
+{
+	knot_dname_t *qname = knot_dname_from_str_alloc(name);
+	knot_pkt_t *pkt = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	knot_pkt_put_question(pkt, qname, KNOT_CLASS_IN, KNOT_RRTYPE_AXFR);
+	knot_dname_free(qname, NULL);
+	pkt->max_size = max_size;
+
+	return pkt;
+}
+
+static void test_stream(const axfr_snapshot_t *snap, uint32_t serial)
+{
+	unsigned count = axfr_snapshot_messages(snap);
+	unsigned rrs = 0;
+	bool soa_first = false, soa_last = false, parsed = true;
+
+	for (unsigned i = 0; i < count; i++) {
+		knot_pkt_t *pkt = make_response("EXAMPLE.com.", KNOT_WIRE_MAX_PKTSIZE);
+		knot_pkt_reserve(pkt, AXFR_SNAPSHOT_RESERVE);
+		int ret = axfr_snapshot_write(snap, i, pkt);
+
+		knot_pkt_t *parse = knot_pkt_new(pkt->wire, pkt->size, NULL);
+		if (ret != KNOT_EOK || knot_pkt_parse(parse, 0) != KNOT_EOK) {
+			parsed = false;
+		} else {
+			const knot_pktsection_t *answer = knot_pkt_section(parse, KNOT_ANSWER);
+			const knot_rrset_t *first = knot_pkt_rr(answer, 0);
+			const knot_rrset_t *last = knot_pkt_rr(answer, answer->count - 1);
+			if (i == 0) {
+				soa_first = (first->type == KNOT_RRTYPE_SOA &&
+				             knot_soa_serial(first->rrs.rdata) == serial);
+			}
+			if (i == count - 1) {
+				soa_last = (last->type == KNOT_RRTYPE_SOA);
+			}
+			rrs += answer->count;
+		}
+
+		knot_pkt_free(parse);
+		knot_pkt_free(pkt);
+	}
+
+	ok(count > 1, "snapshot: multiple messages");
+	ok(parsed, "snapshot: messages parsed");
+	ok(soa_first && soa_last, "snapshot: SOA first and last");
+	is_int(NODES + 2, rrs, "snapshot: all records");
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	axfr_cache_t *cache = axfr_cache_new();
+	ok(cache != NULL, "new: cache");
+
+	zone_contents_t *contents = make_contents(1);
+	zone_contents_t *other = make_contents(2);
+
+	axfr_snapshot_t *snap = NULL, *snap2 = NULL, *snap3 = NULL;
+	is_int(KNOT_EINVAL, axfr_cache_get(cache, NULL, &snap), "get: no contents");
+	is_int(KNOT_EOK, axfr_cache_get(cache, contents, &snap), "get: build");
+	test_stream(snap, 1);
+
+	is_int(KNOT_EOK, axfr_cache_get(cache, contents, &snap2), "get: cached");
+	ok(snap == snap2, "get: shared snapshot");
+	axfr_snapshot_release(snap2);
+
+	/* Question different from the zone name. */
+	knot_pkt_t *pkt = make_response("www." ZONE, KNOT_WIRE_MAX_PKTSIZE);
+	is_int(KNOT_EINVAL, axfr_snapshot_write(snap, 0, pkt), "write: other question");
+	knot_pkt_free(pkt);
+
+	pkt = make_response(ZONE, 512);
+	is_int(KNOT_ESPACE, axfr_snapshot_write(snap, 0, pkt), "write: small response");
+	knot_pkt_free(pkt);
+
+	pkt = make_response(ZONE, KNOT_WIRE_MAX_PKTSIZE);
+	is_int(KNOT_EINVAL, axfr_snapshot_write(snap, axfr_snapshot_messages(snap), pkt),
+	       "write: no such message");
+	knot_pkt_free(pkt);
+
+	/* New contents replace the snapshot. */
+	is_int(KNOT_EOK, axfr_cache_get(cache, other, &snap2), "get: other contents");
+	ok(snap2 != snap, "get: new snapshot");
+	test_stream(snap2, 2);
+
+	axfr_cache_invalidate(cache);
+	is_int(KNOT_EOK, axfr_cache_get(cache, other, &snap3), "get: after invalidation");
+	ok(snap3 != snap2, "get: rebuilt snapshot");
+
+	/* Snapshots outlive the cache. */
+	axfr_cache_free(cache);
+	ok(axfr_snapshot_size(snap) > 0 && axfr_snapshot_size(snap3) > 0,
+	   "free: snapshots kept");
+
+	axfr_snapshot_release(snap);
+	axfr_snapshot_release(snap2);
+	axfr_snapshot_release(snap3);
+	zone_contents_deep_free(contents);
+	zone_contents_deep_free(other);
+
+	return 0;
+}
@@ -911,6 +911,8 @@ static void test_conf_io_list(void)
 	      "server.udp-workers\n"
 	      "server.tcp-workers\n"
 	      "server.background-workers\n"
+	      "server.udp-batch-size\n"
+	      "server.udp-busy-poll\n"
 	      "server.udp-max-payload\n"
 	      "server.udp-max-payload-ipv4\n"
 	      "server.udp-max-payload-ipv6\n"
@@ -933,6 +935,8 @@ static const yp_item_t desc_server[] = {
 	{ C_UDP_WORKERS,	  YP_TINT,  YP_VNONE },
 	{ C_TCP_WORKERS,	  YP_TINT,  YP_VNONE },
 	{ C_BG_WORKERS,		  YP_TINT,  YP_VNONE },
+	{ C_UDP_BATCH_SIZE,       YP_TINT,  YP_VNONE },
+	{ C_UDP_BUSY_POLL,        YP_TINT,  YP_VNONE },
 	{ C_UDP_MAX_PAYLOAD,      YP_TINT,  YP_VNONE },
 	{ C_UDP_MAX_PAYLOAD_IPV4, YP_TINT,  YP_VNONE },
 	{ C_UDP_MAX_PAYLOAD_IPV6, YP_TINT,  YP_VNONE },
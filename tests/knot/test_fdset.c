@@ -1,4 +1,4 @@
-/*  Copyright (C) 2011 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -79,9 +79,112 @@ void* thr_action(void *arg)
 	return NULL;
 }
 
+static int sweep_count;
+
+static enum fdset_sweep_state sweep_cb(fdset_t *set, int i, void *data)
+{
+	int keep_fd = *(int *)data;
+	sweep_count++;
+	return (fdset_get_fd(set, i) == keep_fd) ? FDSET_KEEP : FDSET_SWEEP;
+}
+
+static void test_iterator(void)
+{
+	fdset_t set;
+	fdset_init(&set, 2);
+
+	int fds[3][2];
+	for (int i = 0; i < 3; i++) {
+		if (pipe(fds[i]) != 0) {
+			bail("pipe() failed");
+		}
+		fdset_add(&set, fds[i][0], POLLIN, &fds[i]);
+	}
+	ok(set.n == 3, "fdset: resize on add");
+
+	/* Make the first and the last fd readable. */
+	char pattern = WRITE_PATTERN;
+	ok(write(fds[0][1], &pattern, 1) == 1 && write(fds[2][1], &pattern, 1) == 1,
+	   "fdset: write to pipes");
+
+	/* Ignored fds below offset. */
+	fdset_it_t it;
+	int nfds = fdset_poll(&set, &it, 1, 0);
+	is_int(1, nfds, "fdset: poll with offset");
+	ok(!fdset_it_is_done(&it) && fdset_it_get_idx(&it) == 2, "fdset: event above offset");
+
+	/* Iterate all events, remove the first fd. */
+	nfds = fdset_poll(&set, &it, 0, 0);
+	is_int(2, nfds, "fdset: poll events");
+	unsigned seen = 0;
+	for (; !fdset_it_is_done(&it); fdset_it_next(&it)) {
+		unsigned idx = fdset_it_get_idx(&it);
+		seen |= 1 << idx;
+		ok(fdset_it_is_pollin(&it) && !fdset_it_is_error(&it) &&
+		   fdset_get_ctx(&set, idx) == &fds[idx],
+		   "fdset: event on index %u", idx);
+		if (idx == 0) {
+			fdset_it_remove(&it);
+		}
+	}
+	fdset_it_commit(&it);
+	ok(seen == 5, "fdset: all events iterated");
+	ok(set.n == 2 && fdset_get_fd(&set, 0) == fds[2][0] &&
+	   fdset_get_ctx(&set, 0) == &fds[2], "fdset: last fd moved on removal");
+
+	/* Watched events change. */
+	fdset_set_events(&set, 1, POLLOUT);
+	nfds = fdset_poll(&set, &it, 0, 0);
+	ok(nfds == 1 && fdset_it_get_idx(&it) == 0, "fdset: watched events changed");
+
+	for (int i = 0; i < 3; i++) {
+		close(fds[i][0]);
+		close(fds[i][1]);
+	}
+	fdset_clear(&set);
+}
+
+static void test_sweep(void)
+{
+	fdset_t set;
+	fdset_init(&set, FDSET_INIT_SIZE);
+
+	/* Pretend the last sweep happened a while ago. */
+	set.swept -= 2;
+
+	int fds[4], wfds[4];
+	for (int i = 0; i < 4; i++) {
+		int p[2];
+		if (pipe(p) != 0) {
+			bail("pipe() failed");
+		}
+		fds[i] = p[0];
+		wfds[i] = p[1];
+		fdset_add(&set, fds[i], POLLIN, NULL);
+	}
+	fdset_set_watchdog(&set, 0, 0);    // Expired.
+	fdset_set_watchdog(&set, 1, 1000); // Not expired.
+	fdset_set_watchdog(&set, 2, 0);    // Expired, but kept.
+	fdset_set_watchdog(&set, 3, -1);   // Disabled.
+	fdset_set_watchdog(&set, 1, 0);    // Expired after update.
+	fdset_set_watchdog(&set, 1, FDSET_WHEEL_SIZE); // Next wheel turn.
+
+	sweep_count = 0;
+	int ret = fdset_sweep(&set, sweep_cb, &fds[2]);
+	is_int(1, ret, "fdset: sweep removed expired fd");
+	is_int(2, sweep_count, "fdset: sweep visited expired fds only");
+	ok(set.n == 3 && fdset_get_fd(&set, 0) == fds[3], "fdset: sweep moved last fd");
+
+	for (int i = 0; i < 4; i++) {
+		close(fds[i]);
+		close(wfds[i]);
+	}
+	fdset_clear(&set);
+}
+
 int main(int argc, char *argv[])
 {
-	plan(12);
+	plan_lazy();
 
 	/* 1. Create fdset. */
 	fdset_t set;
@@ -107,19 +210,21 @@ int main(int argc, char *argv[])
 	pthread_create(&t, 0, thr_action, &fds[1]);
 
 	/* 4. Watch fdset. */
-	int nfds = poll(set.pfd, set.n, 60 * 1000);
+	fdset_it_t it;
+	int nfds = fdset_poll(&set, &it, 0, 60 * 1000);
 	gettimeofday(&te, 0);
 	size_t diff = timeval_diff(&ts, &te);
 
 	ok(nfds > 0, "fdset: poll returned %d events in %zu ms", nfds, diff);
 
 	/* 5. Prepare event set. */
-	ok(set.pfd[0].revents & POLLIN, "fdset: pipe is active");
+	ok(fdset_it_get_idx(&it) == 0 && fdset_it_is_pollin(&it), "fdset: pipe is active");
 
 	/* 6. Receive data. */
 	char buf = 0x00;
-	ret = read(set.pfd[0].fd, &buf, WRITE_PATTERN_LEN);
+	ret = read(fdset_get_fd(&set, 0), &buf, WRITE_PATTERN_LEN);
 	ok(ret >= 0 && buf == WRITE_PATTERN, "fdset: contains valid data");
+	fdset_it_commit(&it);
 
 	/* 7-9. Remove from event set. */
 	ret = fdset_remove(&set, 0);
@@ -127,7 +232,7 @@ int main(int argc, char *argv[])
 	close(fds[0]);
 	close(fds[1]);
 	ret = fdset_remove(&set, 0);
-	close(tmpfds[1]);
+	close(tmpfds[0]);
 	close(tmpfds[1]);
 	is_int(0, ret, "fdset: remove from fdset works (2)");
 	ret = fdset_remove(&set, 0);
@@ -148,5 +253,9 @@ int main(int argc, char *argv[])
 	/* Cleanup. */
 	pthread_join(t, 0);
 
+	/* Iteration with removals and timer wheel sweeping. */
+	test_iterator();
+	test_sweep();
+
 	return 0;
 }
@@ -56,6 +56,7 @@ int main(int argc, char *argv[])
 		}
 	}
 	is_int(KNOT_EOK, ret, "query_plan: planned all steps");
+	ok(query_plan_alters_answer(plan), "query_plan: alters answer");
 
 	/* Execute the plan. */
 	int state = 0, next_state = 0;
@@ -79,6 +80,14 @@ int main(int argc, char *argv[])
 	}
 	ok(state == KNOTD_STAGES, "query_plan: executed all callbacks");
 
+	/* Only the steps around query processing. */
+	struct query_plan *plan_ends = query_plan_create();
+	query_plan_step(plan_ends, KNOTD_STAGE_BEGIN, state_visit, state_map);
+	query_plan_step(plan_ends, KNOTD_STAGE_END, state_visit, state_map);
+	ok(!query_plan_alters_answer(plan_ends), "query_plan: doesn't alter answer");
+	ok(!query_plan_alters_answer(NULL), "query_plan: no plan");
+	query_plan_free(plan_ends);
+
 fatal:
 	/* Free the query plan. */
 	query_plan_free(plan);
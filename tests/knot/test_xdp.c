@@ -0,0 +1,120 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <tap/basic.h>
+
+#include "libknot/errcode.h"
+#include "knot/server/xdp-socket.h"
+
+#define PAYLOAD "\x12\x34\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x01\x00\x01"
+
+/*! \brief One's complement sum check (zero result means valid checksum). */
+static uint16_t csum(const uint8_t *data, size_t len, uint32_t sum)
+{
+	for (size_t i = 0; i + 1 < len; i += 2) {
+		sum += (data[i] << 8) | data[i + 1];
+	}
+	if (len & 1) {
+		sum += data[len - 1] << 8;
+	}
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+	return ~sum & 0xffff;
+}
+
+static void set_addr(struct sockaddr_storage *ss, int family, const char *addr,
+                     uint16_t port)
+{
+	memset(ss, 0, sizeof(*ss));
+	ss->ss_family = family;
+	if (family == AF_INET) {
+		struct sockaddr_in *sin = (struct sockaddr_in *)ss;
+		inet_pton(family, addr, &sin->sin_addr);
+		sin->sin_port = htons(port);
+	} else {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)ss;
+		inet_pton(family, addr, &sin6->sin6_addr);
+		sin6->sin6_port = htons(port);
+	}
+}
+
+static void test_roundtrip(int family, const char *from, const char *to)
+{
+	const char *name = (family == AF_INET) ? "IPv4" : "IPv6";
+
+	uint8_t frame[256] = { 0 };
+	xdp_msg_t msg = { .eth_from = { 1, 2, 3, 4, 5, 6 }, .eth_to = { 6, 5, 4, 3, 2, 1 } };
+	set_addr(&msg.ip_from, family, from, 53);
+	set_addr(&msg.ip_to, family, to, 40000);
+
+	size_t hdr_len = xdp_headers_size(&msg);
+	ok(hdr_len == (family == AF_INET ? 42 : 62), "%s: headers size", name);
+
+	msg.payload.iov_base = frame + hdr_len;
+	msg.payload.iov_len = sizeof(PAYLOAD) - 1;
+	memcpy(msg.payload.iov_base, PAYLOAD, msg.payload.iov_len);
+
+	size_t len = xdp_write_headers(&msg);
+	ok(len == hdr_len + msg.payload.iov_len, "%s: frame length", name);
+	ok(memcmp(frame, msg.eth_to, 6) == 0 && memcmp(frame + 6, msg.eth_from, 6) == 0,
+	   "%s: MAC addresses", name);
+
+	/* Verify checksums. */
+	const uint8_t *ip = frame + 14;
+	size_t udp_len = len - hdr_len + 8;
+	const uint8_t *udp = frame + hdr_len - 8;
+	uint32_t pseudo = 17 + udp_len;
+	if (family == AF_INET) {
+		ok(csum(ip, 20, 0) == 0, "%s: IP header checksum", name);
+		pseudo = 0xffff - csum(ip + 12, 8, pseudo);
+	} else {
+		pseudo = 0xffff - csum(ip + 8, 32, pseudo);
+	}
+	ok(csum(udp, udp_len, pseudo) == 0, "%s: UDP checksum", name);
+
+	/* Parse it back. */
+	xdp_msg_t parsed;
+	int ret = xdp_parse_frame(frame, len, &parsed);
+	is_int(KNOT_EOK, ret, "%s: parse frame", name);
+	ok(memcmp(&parsed.ip_from, &msg.ip_from, sizeof(msg.ip_from)) == 0 &&
+	   memcmp(&parsed.ip_to, &msg.ip_to, sizeof(msg.ip_to)) == 0,
+	   "%s: parsed addresses", name);
+	ok(memcmp(parsed.eth_from, msg.eth_from, 6) == 0 &&
+	   memcmp(parsed.eth_to, msg.eth_to, 6) == 0, "%s: parsed MACs", name);
+	ok(parsed.payload.iov_base == msg.payload.iov_base &&
+	   parsed.payload.iov_len == msg.payload.iov_len, "%s: parsed payload", name);
+
+	/* Truncated frame. */
+	ret = xdp_parse_frame(frame, len - msg.payload.iov_len - 1, &parsed);
+	is_int(KNOT_EMALF, ret, "%s: truncated frame", name);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	test_roundtrip(AF_INET, "192.0.2.1", "198.51.100.7");
+	test_roundtrip(AF_INET6, "2001:db8::1", "2001:db8::dead:beef");
+
+	uint8_t arp[64] = { [12] = 0x08, [13] = 0x06 };
+	xdp_msg_t msg;
+	is_int(KNOT_ENOTSUP, xdp_parse_frame(arp, sizeof(arp), &msg), "non-IP frame");
+
+	return 0;
+}
@@ -14,6 +14,8 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <tap/basic.h>
 
@@ -76,6 +78,147 @@ static int ztree_node_counter(zone_node_t *node, void *data)
 	return KNOT_EOK;
 }
 
+static int ztree_node_mark(zone_node_t *node, void *data)
+{
+	(void)data;
+	node->children++;
+	return KNOT_EOK;
+}
+
+static int ztree_node_fail(zone_node_t *node, void *data)
+{
+	return (node == data) ? KNOT_ERROR : KNOT_EOK;
+}
+
+static int ztree_node_same_thread(zone_node_t *node, void *data)
+{
+	(void)node;
+	pthread_t *thread = data;
+	return pthread_equal(*thread, pthread_self()) ? KNOT_EOK : KNOT_ERROR;
+}
+
+typedef struct {
+	zone_tree_t *tree;
+	pthread_mutex_t mx;
+	bool started;
+	int ret;
+} nested_apply_t;
+
+static int ztree_node_nested(zone_node_t *node, void *data)
+{
+	(void)node;
+	nested_apply_t *nested = data;
+
+	pthread_mutex_lock(&nested->mx);
+	bool first = !nested->started;
+	nested->started = true;
+	pthread_mutex_unlock(&nested->mx);
+
+	if (first) {
+		pthread_t self = pthread_self();
+		nested->ret = zone_tree_parallel_apply(nested->tree, ztree_node_same_thread,
+		                                       &self, 2);
+	}
+	return KNOT_EOK;
+}
+
+typedef struct {
+	zone_node_t **order;
+	size_t nodes;
+} chunks_ctx_t;
+
+static int ztree_chunk_order(zone_node_t **nodes, size_t count, size_t first,
+                             void *ctx)
+{
+	chunks_ctx_t *chunks = ctx;
+	for (size_t i = 0; i < count; i++) {
+		chunks->order[first + i] = nodes[i];
+	}
+	chunks->nodes += count;
+	return KNOT_EOK;
+}
+
+static int ztree_chunk_fail(zone_node_t **nodes, size_t count, size_t first,
+                            void *ctx)
+{
+	(void)nodes;
+	(void)count;
+	(void)ctx;
+	return (first > 0) ? KNOT_ERROR : KNOT_EOK;
+}
+
+static void test_parallel_chunks(zone_tree_t *t, unsigned count)
+{
+	zone_node_t **order = calloc(count, sizeof(*order));
+	chunks_ctx_t ctx[4] = { { 0 } };
+	void *ctxs[4];
+	for (unsigned i = 0; i < 4; i++) {
+		ctx[i].order = order;
+		ctxs[i] = &ctx[i];
+	}
+
+	int ret = zone_tree_parallel_chunks(t, ztree_chunk_order, ctxs, 4);
+	size_t total = 0;
+	for (unsigned i = 0; i < 4; i++) {
+		total += ctx[i].nodes;
+	}
+	ok(ret == KNOT_EOK && total == count, "ztree: parallel chunks, thread contexts");
+
+	zone_tree_it_t it = { 0 };
+	unsigned in_order = 0;
+	(void)zone_tree_it_begin(t, &it);
+	for (unsigned i = 0; i < count && !zone_tree_it_finished(&it); i++) {
+		in_order += (order[i] == zone_tree_it_val(&it));
+		zone_tree_it_next(&it);
+	}
+	zone_tree_it_free(&it);
+	ok(in_order == count, "ztree: parallel chunks, node positions");
+
+	ret = zone_tree_parallel_chunks(t, ztree_chunk_fail, ctxs, 4);
+	ok(ret == KNOT_ERROR, "ztree: parallel chunks error");
+
+	free(order);
+}
+
+static void test_parallel_apply(void)
+{
+	const unsigned count = 40000;
+	zone_tree_t *t = zone_tree_create(false);
+	zone_node_t *nodes = calloc(count, sizeof(*nodes));
+
+	for (unsigned i = 0; i < count; i++) {
+		char name[32];
+		(void)snprintf(name, sizeof(name), "n%u.", i);
+		nodes[i].owner = knot_dname_from_str_alloc(name);
+		zone_node_t *node = &nodes[i];
+		(void)zone_tree_insert(t, &node);
+	}
+
+	int ret = zone_tree_parallel_apply(t, ztree_node_mark, NULL, 4);
+	unsigned once = 0;
+	for (unsigned i = 0; i < count; i++) {
+		once += (nodes[i].children == 1);
+	}
+	ok(ret == KNOT_EOK && once == count, "ztree: parallel traversal");
+
+	ret = zone_tree_parallel_apply(t, ztree_node_fail, &nodes[count / 2], 4);
+	ok(ret == KNOT_ERROR, "ztree: parallel traversal error");
+
+	nested_apply_t nested = { .tree = t, .ret = KNOT_ERROR };
+	pthread_mutex_init(&nested.mx, NULL);
+	ret = zone_tree_parallel_apply(t, ztree_node_nested, &nested, 2);
+	pthread_mutex_destroy(&nested.mx);
+	ok(ret == KNOT_EOK && nested.ret == KNOT_EOK, "ztree: parallel traversal thread limit");
+
+	test_parallel_chunks(t, count);
+
+	for (unsigned i = 0; i < count; i++) {
+		knot_dname_free(nodes[i].owner, NULL);
+	}
+	free(nodes);
+	zone_tree_free(&t);
+}
+
 int main(int argc, char *argv[])
 {
 	plan_lazy();
@@ -129,7 +272,29 @@ int main(int argc, char *argv[])
 	ret = zone_tree_sub_apply(t, (const knot_dname_t *)"\x02""ac", true, ztree_node_counter, &counter);
 	ok(ret == KNOT_EOK && counter == 1, "ztree: subtree iteration excluding root");
 
+	/* 7. iteration from a name */
+	zone_tree_it_t it = { 0 };
+	ret = zone_tree_it_from_begin(t, NAME[1], &it);
+	ok(ret == KNOT_EOK && !zone_tree_it_finished(&it) &&
+	   zone_tree_it_val(&it) == NODEE + 1, "ztree: iteration from existing name");
+	zone_tree_it_free(&it);
+	tmp_dn = knot_dname_from_str_alloc("b.");
+	ret = zone_tree_it_from_begin(t, tmp_dn, &it);
+	knot_dname_free(tmp_dn, NULL);
+	ok(ret == KNOT_EOK && !zone_tree_it_finished(&it) &&
+	   zone_tree_it_val(&it) == NODEE + 3, "ztree: iteration from missing name");
+	zone_tree_it_free(&it);
+	tmp_dn = knot_dname_from_str_alloc("zz.");
+	ret = zone_tree_it_from_begin(t, tmp_dn, &it);
+	knot_dname_free(tmp_dn, NULL);
+	ok(ret == KNOT_EOK && zone_tree_it_finished(&it), "ztree: iteration from last name");
+	zone_tree_it_free(&it);
+
 	zone_tree_free(&t);
 	ztree_free_data();
+
+	/* 8. parallel apply */
+	test_parallel_apply();
+
 	return 0;
 }
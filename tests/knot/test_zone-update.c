@@ -35,6 +35,9 @@ static const char *add_str   = "test. 600 IN TXT \"test2\"\n";
 static const char *del_str   = "test. 600 IN TXT \"test\"\n";
 static const char *node_str1 = "node.test. 601 IN TXT \"abc\"\n";
 static const char *node_str2 = "node.test. 601 IN TXT \"def\"\n";
+static const char *deleg_str = "sub.test. 600 IN NS ns.sub.test.\n";
+static const char *glue_str  = "ns.sub.test. 600 IN A 192.0.2.1\n";
+static const char *wild_str  = "*.test. 600 IN TXT \"wild\"\n";
 
 knot_rrset_t rrset;
 
@@ -104,9 +107,31 @@ static int test_node_unified(zone_node_t *n1, void *v)
 		ok((n1->flags ^ n2->flags) == NODE_FLAGS_SECOND, "binode %s has correct flags", n1->owner);
 	}
 	ok(n1->children == n2->children, "binode %s has equal children count", n1->owner);
+	ok(binode_first(n1->cut) == binode_first(n2->cut) &&
+	   binode_first(n1->wildcard_child) == binode_first(n2->wildcard_child),
+	   "binode %s has equal hints", n1->owner);
 	return KNOT_EOK;
 }
 
+static void test_zone_hints(const zone_contents_t *contents, const char *msg)
+{
+	knot_dname_t *sub_name = knot_dname_from_str_alloc("sub.test.");
+	knot_dname_t *glue_name = knot_dname_from_str_alloc("ns.sub.test.");
+	knot_dname_t *wild_name = knot_dname_from_str_alloc("*.test.");
+	const zone_node_t *sub = zone_contents_find_node(contents, sub_name);
+	const zone_node_t *glue = zone_contents_find_node(contents, glue_name);
+	const zone_node_t *wild = zone_contents_find_node(contents, wild_name);
+
+	ok(sub != NULL && node_cut(sub) == sub, "%s: delegation point cut", msg);
+	ok(glue != NULL && node_cut(glue) == sub, "%s: non-authoritative node cut", msg);
+	ok(node_cut(contents->apex) == NULL, "%s: authoritative node cut", msg);
+	ok(wild != NULL && node_wildcard_child(contents->apex) == wild, "%s: wildcard child", msg);
+
+	knot_dname_free(sub_name, NULL);
+	knot_dname_free(glue_name, NULL);
+	knot_dname_free(wild_name, NULL);
+}
+
 static void test_zone_unified(zone_t *z)
 {
 	knot_sem_wait(&z->cow_lock);
@@ -181,6 +206,18 @@ void test_full(zone_t *zone, zs_scanner_t *sc)
 	ok(ret == KNOT_EOK && !node, "full zone update: node removal");
 	knot_dname_free(rem_node_name, NULL);
 
+	/* Add a delegation and a wildcard for the lookup hints */
+	const char *hint_strs[] = { deleg_str, glue_str, wild_str };
+	for (size_t i = 0; i < sizeof(hint_strs) / sizeof(*hint_strs); i++) {
+		if (zs_set_input_string(sc, hint_strs[i], strlen(hint_strs[i])) != 0 ||
+		    zs_parse_all(sc) != 0) {
+			assert(0);
+		}
+		ret = zone_update_add(&update, &rrset);
+		assert(ret == KNOT_EOK);
+		knot_rdataset_clear(&rrset.rrs, NULL);
+	}
+
 	/* Re-add a node for later incremental functionality test */
 	if (zs_set_input_string(sc, node_str1, strlen(node_str1)) != 0 ||
 	    zs_parse_all(sc) != 0) {
@@ -256,6 +293,18 @@ void test_incremental(zone_t *zone, zs_scanner_t *sc)
 	   "incremental zone update: node removal");
 	knot_dname_free(rem_node_name, NULL);
 
+	/* Add a delegation and a wildcard for the lookup hints */
+	const char *hint_strs[] = { deleg_str, glue_str, wild_str };
+	for (size_t i = 0; i < sizeof(hint_strs) / sizeof(*hint_strs); i++) {
+		if (zs_set_input_string(sc, hint_strs[i], strlen(hint_strs[i])) != 0 ||
+		    zs_parse_all(sc) != 0) {
+			assert(0);
+		}
+		ret = zone_update_add(&update, &rrset);
+		assert(ret == KNOT_EOK);
+		knot_rdataset_clear(&rrset.rrs, NULL);
+	}
+
 	/* Re-add a node for later incremental functionality test */
 	if (zs_set_input_string(sc, node_str1, strlen(node_str1)) != 0 ||
 	    zs_parse_all(sc) != 0) {
@@ -272,17 +321,19 @@ void test_incremental(zone_t *zone, zs_scanner_t *sc)
 	ok(ret == KNOT_EOK && rrset_present, "incremental zone update: commit");
 
 	test_zone_unified(zone);
+	test_zone_hints(zone->contents, "incremental zone update");
 
 	knot_rdataset_clear(&rrset.rrs, NULL);
 
 	size_t zone_size1 = zone->contents->size;
 	uint32_t zone_max_ttl1 = zone->contents->max_ttl;
-	ret = zone_adjust_full(zone->contents);
+	ret = zone_adjust_full(zone->contents, 1);
 	ok(ret == KNOT_EOK, "zone adjust full shall work");
 	size_t zone_size2 = zone->contents->size;
 	uint32_t zone_max_ttl2 = zone->contents->max_ttl;
 	ok(zone_size1 == zone_size2, "zone size measured the same incremental vs full (%zu, %zu)", zone_size1, zone_size2);
 	ok(zone_max_ttl1 == zone_max_ttl2, "zone max TTL measured the same incremental vs full (%u, %u)", zone_max_ttl1, zone_max_ttl2);
+	test_zone_hints(zone->contents, "zone adjust full");
 	// TODO test more things after re-adjust, search for non-unified bi-nodes
 }
 
@@ -0,0 +1,196 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <tap/basic.h>
+#include <tap/files.h>
+
+#include "contrib/string.h"
+#include "knot/updates/changesets.h"
+#include "knot/zone/zone-diff.h"
+#include "knot/zone/zone-image.h"
+#include "knot/zone/zonefile.h"
+#include "libknot/libknot.h"
+
+#define ZONE "example.com."
+
+static const char *zone_text =
+	"$ORIGIN " ZONE "\n"
+	"$TTL 3600\n"
+	"@	SOA	ns admin 1 3600 900 604800 300\n"
+	"@	NS	ns\n"
+	"@	MX	10 mail\n"
+	"ns	A	192.0.2.1\n"
+	"ns	AAAA	2001:db8::1\n"
+	"mail	A	192.0.2.2\n"
+	"mail	A	192.0.2.3\n"
+	"www	CNAME	@\n"
+	"*.wild	TXT	\"wildcard\"\n"
+	"sub	NS	ns.sub\n"
+	"ns.sub	A	192.0.2.4\n";
+
+static int write_file(const char *path, const char *text)
+{
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return KNOT_EFILE;
+	}
+	fputs(text, file);
+	fclose(file);
+
+	return KNOT_EOK;
+}
+
+static zone_contents_t *load(const char *zonefile, const char *image, bool *included)
+{
+	knot_dname_t *origin = knot_dname_from_str_alloc(ZONE);
+	sem_handler_t handler = { .cb = err_handler_logger };
+
+	zloader_t zl;
+	zone_contents_t *contents = NULL;
+	if (zonefile_open(&zl, zonefile, origin, false, time(NULL)) == KNOT_EOK) {
+		zl.err_handler = &handler;
+		zl.creator->master = true;
+		zl.image = (image != NULL) ? strdup(image) : NULL;
+		contents = zonefile_load(&zl);
+		if (included != NULL) {
+			*included = zl.included;
+		}
+		zonefile_close(&zl);
+	}
+
+	knot_dname_free(origin, NULL);
+
+	return contents;
+}
+
+static bool same_contents(const zone_contents_t *a, const zone_contents_t *b)
+{
+	changeset_t ch;
+	if (a == NULL || b == NULL || changeset_init(&ch, a->apex->owner) != KNOT_EOK) {
+		return false;
+	}
+
+	int ret = zone_contents_diff(a, b, &ch, false);
+	changeset_clear(&ch);
+
+	return ret == KNOT_ENODIFF;
+}
+
+static void corrupt_magic(const char *path)
+{
+	FILE *file = fopen(path, "r+");
+	if (file != NULL) {
+		fputs("GARBAGE!", file);
+		fclose(file);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	char *dir = test_mkdtemp();
+	if (dir == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	char *zonefile = sprintf_alloc("%s/" ZONE "zone", dir);
+	char *image = sprintf_alloc("%s/" ZONE "image", dir);
+	char *include = sprintf_alloc("%s/include.zone", dir);
+	knot_dname_t *origin = knot_dname_from_str_alloc(ZONE);
+
+	ok(write_file(zonefile, zone_text) == KNOT_EOK, "write zone file");
+
+	/* Parse the zone file and write the image. */
+	zone_contents_t *parsed = load(zonefile, image, NULL);
+	ok(parsed != NULL, "parse zone file");
+	ok(access(image, F_OK) == 0, "image written");
+
+	struct stat st;
+	stat(zonefile, &st);
+
+	zone_contents_t *loaded = NULL;
+	is_int(KNOT_EOK, zone_image_load(image, &st, origin, &loaded), "load image");
+	ok(same_contents(parsed, loaded), "image contents equal");
+	zone_contents_deep_free(loaded);
+
+	/* Load through the zone loader. */
+	loaded = load(zonefile, image, NULL);
+	ok(same_contents(parsed, loaded), "loader uses image");
+	ok(loaded != NULL && node_rrtype_exists(loaded->apex, KNOT_RRTYPE_SOA) &&
+	   (loaded->apex->flags & NODE_FLAGS_APEX), "loaded contents adjusted");
+	zone_contents_deep_free(loaded);
+
+	/* Image of other zone file version or other zone. */
+	struct timespec mtime = st.st_mtim;
+	st.st_mtim.tv_sec++;
+	is_int(KNOT_ENOENT, zone_image_load(image, &st, origin, &loaded), "outdated image");
+	st.st_mtim = mtime;
+	knot_dname_t *other = knot_dname_from_str_alloc("example.org.");
+	is_int(KNOT_ENOENT, zone_image_load(image, &st, other, &loaded), "other zone image");
+	knot_dname_free(other, NULL);
+	is_int(KNOT_ENOENT, zone_image_load(include, &st, origin, &loaded), "no image");
+
+	/* Corrupted images. */
+	struct stat img_st;
+	stat(image, &img_st);
+	ok(truncate(image, img_st.st_size - 10) == 0, "truncate image");
+	is_int(KNOT_EMALF, zone_image_load(image, &st, origin, &loaded), "truncated image");
+	ok(loaded == NULL, "no contents from truncated image");
+	corrupt_magic(image);
+	is_int(KNOT_ENOTSUP, zone_image_load(image, &st, origin, &loaded), "foreign image");
+
+	/* Fallback to parsing and image rewrite. */
+	loaded = load(zonefile, image, NULL);
+	ok(same_contents(parsed, loaded), "parse with corrupted image");
+	zone_contents_deep_free(loaded);
+	is_int(KNOT_EOK, zone_image_load(image, &st, origin, &loaded), "image rewritten");
+	zone_contents_deep_free(loaded);
+
+	/* Zone file with an include isn't compiled. */
+	unlink(image);
+	char *text = sprintf_alloc("%s$INCLUDE %s\n", zone_text, include);
+	ok(write_file(include, "extra A 192.0.2.5\n") == KNOT_EOK &&
+	   write_file(zonefile, text) == KNOT_EOK, "write zone file with include");
+	free(text);
+	bool included = false;
+	loaded = load(zonefile, image, &included);
+	ok(loaded != NULL && included, "parse zone file with include");
+	ok(access(image, F_OK) != 0, "no image with include");
+	zone_contents_deep_free(loaded);
+
+	/* Direct write. */
+	stat(zonefile, &st);
+	is_int(KNOT_EOK, zone_image_write(image, &st, parsed), "write image");
+	is_int(KNOT_EOK, zone_image_load(image, &st, origin, &loaded), "load written image");
+	ok(same_contents(parsed, loaded), "written image contents equal");
+	zone_contents_deep_free(loaded);
+
+	zone_contents_deep_free(parsed);
+	knot_dname_free(origin, NULL);
+	free(zonefile);
+	free(image);
+	free(include);
+	test_rm_rf(dir);
+	free(dir);
+
+	return 0;
+}
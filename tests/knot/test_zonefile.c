@@ -0,0 +1,175 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap/basic.h>
+#include <tap/files.h>
+
+#include "contrib/string.h"
+#include "knot/updates/changesets.h"
+#include "knot/zone/zone-diff.h"
+#include "knot/zone/zone-dump.h"
+#include "knot/zone/zonefile.h"
+#include "libknot/libknot.h"
+
+#define ZONE    "example.com."
+#define BLOCKS  20000 // Enough for several chunks.
+
+static bool write_zone(const char *path, const char *tail)
+{
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	fprintf(file, "$ORIGIN " ZONE "\n$TTL 300\n"
+	              "@ SOA ns admin ( 1 ; serial \"(\n 3600 900 604800 300 )\n"
+	              "@ NS ns\nns A 192.0.2.1\n");
+	for (int i = 0; i < BLOCKS; i++) {
+		switch (i % 5) {
+		case 0:
+			fprintf(file, "$ORIGIN Sub%i." ZONE "\n", i);
+			break;
+		case 1:
+			fprintf(file, "$ttl %i ; new default\n", 100 + i);
+			break;
+		}
+		fprintf(file, "n%i TXT \"a;b(c\" \"q\\\"(\" ; comment ( \"\n", i);
+		fprintf(file, "  A 192.0.2.%i\n", i % 250);
+		fprintf(file, "m%i 60 IN MX ( 10\n  Mail%i.EXAMPLE.com. ) ; )\n", i, i);
+		fprintf(file, "e\\;%i TXT ( \"multi\"\n  \"line\" )\n\n", i);
+	}
+	fputs(tail, file);
+	fclose(file);
+
+	return true;
+}
+
+static zone_contents_t *load(const char *path, unsigned threads)
+{
+	knot_dname_t *origin = knot_dname_from_str_alloc(ZONE);
+	sem_handler_t handler = { .cb = err_handler_logger };
+
+	zloader_t zl;
+	zone_contents_t *contents = NULL;
+	if (zonefile_open(&zl, path, origin, false, time(NULL)) == KNOT_EOK) {
+		zl.err_handler = &handler;
+		zl.creator->master = true;
+		zl.threads = threads;
+		contents = zonefile_load(&zl);
+		zonefile_close(&zl);
+	}
+
+	knot_dname_free(origin, NULL);
+
+	return contents;
+}
+
+static char *dump(zone_contents_t *contents, unsigned threads)
+{
+	char *text = NULL;
+	size_t size = 0;
+	FILE *file = open_memstream(&text, &size);
+	if (file == NULL) {
+		return NULL;
+	}
+
+	int ret = zone_dump_text(contents, file, false, threads);
+	fclose(file);
+	if (ret != KNOT_EOK) {
+		free(text);
+		return NULL;
+	}
+
+	return text;
+}
+
+static bool same_contents(const zone_contents_t *a, const zone_contents_t *b)
+{
+	changeset_t ch;
+	if (a == NULL || b == NULL || changeset_init(&ch, a->apex->owner) != KNOT_EOK) {
+		return false;
+	}
+
+	int ret = zone_contents_diff(a, b, &ch, false);
+	changeset_clear(&ch);
+
+	return ret == KNOT_ENODIFF;
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	char *dir = test_mkdtemp();
+	if (dir == NULL) {
+		return EXIT_FAILURE;
+	}
+	char *path = sprintf_alloc("%s/" ZONE "zone", dir);
+
+	ok(write_zone(path, ""), "write zone file");
+	zone_contents_t *seq = load(path, 1);
+	ok(seq != NULL, "sequential parsing");
+	zone_contents_t *par = load(path, 4);
+	ok(par != NULL, "parallel parsing");
+	ok(same_contents(seq, par), "same zone contents");
+	zone_contents_deep_free(par);
+
+	/* Parallel dump. */
+	char *seq_text = dump(seq, 1);
+	char *par_text = dump(seq, 4);
+	ok(seq_text != NULL && par_text != NULL && strcmp(seq_text, par_text) == 0,
+	   "same sequential and parallel dump");
+	free(seq_text);
+	free(par_text);
+	char *dump_path = sprintf_alloc("%s/dump.zone", dir);
+	ok(zonefile_write(dump_path, seq, 4) == KNOT_EOK, "write dumped zone file");
+	par = load(dump_path, 1);
+	ok(same_contents(seq, par), "same dumped zone contents");
+	zone_contents_deep_free(par);
+	free(dump_path);
+
+	/* Record errors are reported in order by sequential parsing. */
+	ok(write_zone(path, "bad A 192.0.2.256\n"), "write invalid zone file");
+	ok(load(path, 4) == NULL, "parallel parsing, invalid zone");
+
+	/* Unsupported directive. */
+	char *include = sprintf_alloc("%s/include.zone", dir);
+	FILE *file = fopen(include, "w");
+	ok(file != NULL, "write included file");
+	if (file != NULL) {
+		fprintf(file, "included A 192.0.2.2\n");
+		fclose(file);
+	}
+	char *tail = sprintf_alloc("$INCLUDE %s " ZONE "\n", include);
+	ok(write_zone(path, tail), "write zone file with include");
+	par = load(path, 4);
+	ok(par != NULL && zone_contents_find_node(par, (uint8_t *)"\x08""included"
+	                                                 "\x07""example""\x03""com") != NULL,
+	   "parsing with include");
+	zone_contents_deep_free(par);
+
+	zone_contents_deep_free(seq);
+	free(tail);
+	free(include);
+	free(path);
+	test_rm_rf(dir);
+	free(dir);
+
+	return 0;
+}
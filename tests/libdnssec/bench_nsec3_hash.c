@@ -0,0 +1,137 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * Compares NSEC3 hashing of names one at a time using dnssec_nsec3_hash()
+ * with hashing of the same names using dnssec_nsec3_hash_batch().
+ *
+ * Usage: bench_nsec3_hash [max_names]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libdnssec/error.h"
+#include "libdnssec/nsec.h"
+#include "contrib/time.h"
+
+/*! \brief Names are generated and hashed in chunks to limit memory usage. */
+#define CHUNK	65536
+#define NAME_MAX_SIZE	32
+
+static double elapsed_ns(struct timespec *begin)
+{
+	struct timespec end = time_now();
+	return (end.tv_sec - begin->tv_sec) * 1e9 + (end.tv_nsec - begin->tv_nsec);
+}
+
+static void make_names(uint8_t *buf, dnssec_binary_t *names, size_t first, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		uint8_t *name = buf + i * NAME_MAX_SIZE;
+		int len = snprintf((char *)name + 1, 16, "host%zu", first + i);
+		name[0] = len;
+		memcpy(name + 1 + len, "\x07""example""\x03""com", 13);
+		names[i].data = name;
+		names[i].size = 1 + len + 13;
+	}
+}
+
+static int hash_each(const dnssec_binary_t *names, size_t count,
+                     const dnssec_nsec3_params_t *params, uint8_t *hashes)
+{
+	dnssec_binary_t hash = { 0 };
+	for (size_t i = 0; i < count; i++) {
+		int ret = dnssec_nsec3_hash(&names[i], params, &hash);
+		if (ret != DNSSEC_EOK) {
+			dnssec_binary_free(&hash);
+			return ret;
+		}
+		memcpy(hashes + i * hash.size, hash.data, hash.size);
+	}
+	dnssec_binary_free(&hash);
+
+	return DNSSEC_EOK;
+}
+
+static void bench(size_t count, uint16_t iterations, bool each)
+{
+	const dnssec_nsec3_params_t params = {
+		.algorithm = DNSSEC_NSEC3_ALGORITHM_SHA1,
+		.iterations = iterations,
+		.salt = { .size = 8, .data = (uint8_t *)"\xde\xad\xbe\xef\x01\x02\x03\x04" }
+	};
+
+	uint8_t *buf = malloc(CHUNK * NAME_MAX_SIZE);
+	dnssec_binary_t *names = malloc(CHUNK * sizeof(*names));
+	uint8_t *hashes = malloc(CHUNK * dnssec_nsec3_hash_length(params.algorithm));
+	if (buf == NULL || names == NULL || hashes == NULL) {
+		free(buf);
+		free(names);
+		free(hashes);
+		return;
+	}
+
+	double total = 0;
+	int ret = DNSSEC_EOK;
+	for (size_t first = 0; first < count && ret == DNSSEC_EOK; first += CHUNK) {
+		size_t chunk = (count - first < CHUNK) ? count - first : CHUNK;
+		make_names(buf, names, first, chunk);
+
+		struct timespec begin = time_now();
+		ret = each ? hash_each(names, chunk, &params, hashes) :
+		             dnssec_nsec3_hash_batch(names, chunk, &params, hashes);
+		total += elapsed_ns(&begin);
+	}
+
+	if (ret != DNSSEC_EOK) {
+		fprintf(stderr, "failed (%s)\n", dnssec_strerror(ret));
+	} else {
+		printf("%-8s %9zu %10u %12.3f %12.1f\n", each ? "each" : "batch",
+		       count, iterations, total / 1e9, total / count);
+	}
+
+	free(buf);
+	free(names);
+	free(hashes);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t max = (argc > 1) ? atol(argv[1]) : 10000000;
+	if (max == 0) {
+		return EXIT_FAILURE;
+	}
+
+	printf("%-8s %9s %10s %12s %12s\n", "mode", "names", "iterations",
+	       "total [s]", "name [ns]");
+
+	static const size_t sizes[] = { 1000000, 10000000 };
+	static const uint16_t iterations[] = { 0, 10 };
+	for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if (sizes[i] > max) {
+			break;
+		}
+		for (unsigned j = 0; j < sizeof(iterations) / sizeof(iterations[0]); j++) {
+			bench(sizes[i], iterations[j], true);
+			bench(sizes[i], iterations[j], false);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
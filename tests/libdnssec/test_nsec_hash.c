@@ -1,4 +1,4 @@
-/*  Copyright (C) 2018 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -14,6 +14,8 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <gnutls/crypto.h>
+#include <stdlib.h>
 #include <string.h>
 #include <tap/basic.h>
 
@@ -84,6 +86,71 @@ static void test_hashing(void)
 	dnssec_binary_free(&hash);
 }
 
+static void reference_hash(const dnssec_binary_t *data,
+			   const dnssec_nsec3_params_t *params, uint8_t *hash)
+{
+	uint8_t buf[1024];
+	memcpy(buf, data->data, data->size);
+	memcpy(buf + data->size, params->salt.data, params->salt.size);
+	gnutls_hash_fast(GNUTLS_DIG_SHA1, buf, data->size + params->salt.size, hash);
+
+	for (unsigned i = 0; i < params->iterations; i++) {
+		memcpy(buf, hash, 20);
+		memcpy(buf + 20, params->salt.data, params->salt.size);
+		gnutls_hash_fast(GNUTLS_DIG_SHA1, buf, 20 + params->salt.size, hash);
+	}
+}
+
+static void test_batch(void)
+{
+	// Data of various lengths, including overlong ones not being domain names.
+	enum { COUNT = 45 };
+	uint8_t buffer[COUNT][300];
+	dnssec_binary_t data[COUNT];
+	srand(42);
+	for (int i = 0; i < COUNT; i++) {
+		for (int j = 0; j < sizeof(buffer[i]); j++) {
+			buffer[i][j] = rand();
+		}
+		data[i].data = buffer[i];
+		data[i].size = (i == 20) ? 300 : (i < 16) ? i + 40 : rand() % 256;
+	}
+
+	const struct {
+		size_t salt_size;
+		uint16_t iterations;
+	} cases[] = { { 0, 0 }, { 4, 1 }, { 14, 7 }, { 40, 2 }, { 255, 3 }, { 300, 1 } };
+
+	uint8_t salt[300];
+	memset(salt, 0xa5, sizeof(salt));
+
+	for (int c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		const dnssec_nsec3_params_t params = {
+			.algorithm = DNSSEC_NSEC3_ALGORITHM_SHA1,
+			.iterations = cases[c].iterations,
+			.salt = { .size = cases[c].salt_size, .data = salt }
+		};
+
+		uint8_t hashes[COUNT][20];
+		int result = dnssec_nsec3_hash_batch(data, COUNT, &params, hashes[0]);
+
+		bool match = true;
+		for (int i = 0; i < COUNT; i++) {
+			uint8_t expected[20];
+			reference_hash(&data[i], &params, expected);
+			match = match && memcmp(hashes[i], expected, 20) == 0;
+		}
+		ok(result == DNSSEC_EOK && match,
+		   "dnssec_nsec3_hash_batch(), salt %zu, iterations %u",
+		   cases[c].salt_size, cases[c].iterations);
+	}
+
+	const dnssec_nsec3_params_t unknown = { .algorithm = 2 };
+	uint8_t hash[20];
+	ok(dnssec_nsec3_hash_batch(data, 1, &unknown, hash) == DNSSEC_INVALID_NSEC3_ALGORITHM,
+	   "dnssec_nsec3_hash_batch(), unknown algorithm");
+}
+
 static void test_clear(void)
 {
 	const dnssec_nsec3_params_t empty = { 0 };
@@ -108,6 +175,7 @@ int main(void)
 	test_length();
 	test_parsing();
 	test_hashing();
+	test_batch();
 	test_clear();
 
 	return 0;
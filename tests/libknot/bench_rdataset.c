@@ -0,0 +1,229 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * Compares the rdataset set operations with the same operations done
+ * one RR at a time using knot_rdataset_add() and knot_rdataset_member().
+ *
+ * Usage: bench_rdataset [max_rrs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libknot/libknot.h"
+#include "contrib/time.h"
+#include "contrib/wire_ctx.h"
+
+typedef struct {
+	knot_rdataset_t a;        /*!< Values 2 * i. */
+	knot_rdataset_t b;        /*!< Values 8 * i + i % 2, a half of them in 'a'. */
+	const knot_rdata_t **rrs; /*!< RRs of 'a' in random order. */
+	uint8_t *buf;
+} sets_t;
+
+static double elapsed_ns(struct timespec *begin)
+{
+	struct timespec end = time_now();
+	return (end.tv_sec - begin->tv_sec) * 1e9 + (end.tv_nsec - begin->tv_nsec);
+}
+
+static int sets_init(sets_t *sets, unsigned count)
+{
+	memset(sets, 0, sizeof(*sets));
+
+	unsigned count_b = count / 8 + 1;
+	sets->buf = malloc((count + count_b) * knot_rdata_size(4));
+	sets->rrs = malloc(count * sizeof(*sets->rrs));
+	if (sets->buf == NULL || sets->rrs == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	const size_t rr_size = knot_rdata_size(4);
+	uint8_t *rr_a = sets->buf;
+	uint8_t *rr_b = sets->buf + count * rr_size;
+	for (unsigned i = 0; i < count; i++) {
+		uint8_t val[4];
+		wire_ctx_t wire = wire_ctx_init(val, sizeof(val));
+		wire_ctx_write_u32(&wire, 2 * i);
+		knot_rdata_t *rr = (knot_rdata_t *)(rr_a + i * rr_size);
+		knot_rdata_init(rr, sizeof(val), val);
+		sets->rrs[i] = rr;
+	}
+	for (unsigned i = 0; i < count_b; i++) {
+		uint8_t val[4];
+		wire_ctx_t wire = wire_ctx_init(val, sizeof(val));
+		wire_ctx_write_u32(&wire, 8 * i + i % 2);
+		knot_rdata_init((knot_rdata_t *)(rr_b + i * rr_size), sizeof(val), val);
+	}
+
+	for (unsigned i = count; i > 1; i--) {
+		unsigned j = random() % i;
+		const knot_rdata_t *tmp = sets->rrs[i - 1];
+		sets->rrs[i - 1] = sets->rrs[j];
+		sets->rrs[j] = tmp;
+	}
+
+	/* The RRs are sorted and of the same size, the sets can be used directly. */
+	sets->a = (knot_rdataset_t){ count, count * rr_size, (knot_rdata_t *)rr_a };
+	sets->b = (knot_rdataset_t){ count_b, count_b * rr_size, (knot_rdata_t *)rr_b };
+
+	return KNOT_EOK;
+}
+
+static void sets_deinit(sets_t *sets)
+{
+	free(sets->rrs);
+	free(sets->buf);
+}
+
+static int add_each(knot_rdataset_t *rrs, const knot_rdata_t **rdata, unsigned count)
+{
+	for (unsigned i = 0; i < count; i++) {
+		int ret = knot_rdataset_add(rrs, rdata[i], NULL);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+	return KNOT_EOK;
+}
+
+static int merge_each(knot_rdataset_t *rrs1, const knot_rdataset_t *rrs2)
+{
+	knot_rdata_t *rr = rrs2->rdata;
+	for (uint16_t i = 0; i < rrs2->count; i++) {
+		int ret = knot_rdataset_add(rrs1, rr, NULL);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+		rr = knot_rdataset_next(rr);
+	}
+	return KNOT_EOK;
+}
+
+static int intersect_each(const knot_rdataset_t *rrs1, const knot_rdataset_t *rrs2,
+                          knot_rdataset_t *out)
+{
+	knot_rdataset_init(out);
+	knot_rdata_t *rr = rrs1->rdata;
+	for (uint16_t i = 0; i < rrs1->count; i++) {
+		if (knot_rdataset_member(rrs2, rr)) {
+			int ret = knot_rdataset_add(out, rr, NULL);
+			if (ret != KNOT_EOK) {
+				return ret;
+			}
+		}
+		rr = knot_rdataset_next(rr);
+	}
+	return KNOT_EOK;
+}
+
+static int subtract_each(knot_rdataset_t *from, const knot_rdataset_t *what)
+{
+	knot_rdata_t *rr = what->rdata;
+	for (uint16_t i = 0; i < what->count; i++) {
+		int ret = knot_rdataset_remove(from, rr, NULL);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+		rr = knot_rdataset_next(rr);
+	}
+	return KNOT_EOK;
+}
+
+static void bench(unsigned count, bool each)
+{
+	sets_t sets;
+	if (sets_init(&sets, count) != KNOT_EOK) {
+		sets_deinit(&sets);
+		return;
+	}
+
+	/* Keep the total work roughly the same for all set sizes. */
+	unsigned rounds = each ? 1 + 10000 / count : 1 + 1000000 / count;
+	double build = 0, merge = 0, inter = 0, sub = 0;
+	int ret = KNOT_EOK;
+
+	for (unsigned r = 0; r < rounds && ret == KNOT_EOK; r++) {
+		knot_rdataset_t out, tmp;
+		knot_rdataset_init(&out);
+		knot_rdataset_init(&tmp);
+
+		struct timespec begin = time_now();
+		ret = each ? add_each(&out, sets.rrs, count) :
+		             knot_rdataset_from_array(&out, sets.rrs, count, NULL);
+		build += elapsed_ns(&begin);
+		knot_rdataset_clear(&out, NULL);
+
+		if (ret == KNOT_EOK) {
+			ret = knot_rdataset_copy(&out, &sets.a, NULL);
+		}
+		if (ret == KNOT_EOK) {
+			begin = time_now();
+			ret = each ? merge_each(&out, &sets.b) :
+			             knot_rdataset_merge(&out, &sets.b, NULL);
+			merge += elapsed_ns(&begin);
+		}
+		if (ret == KNOT_EOK) {
+			begin = time_now();
+			ret = each ? subtract_each(&out, &sets.b) :
+			             knot_rdataset_subtract(&out, &sets.b, NULL);
+			sub += elapsed_ns(&begin);
+		}
+		knot_rdataset_clear(&out, NULL);
+
+		if (ret == KNOT_EOK) {
+			begin = time_now();
+			ret = each ? intersect_each(&sets.a, &sets.b, &tmp) :
+			             knot_rdataset_intersect(&sets.a, &sets.b, &tmp, NULL);
+			inter += elapsed_ns(&begin);
+		}
+		knot_rdataset_clear(&tmp, NULL);
+	}
+
+	if (ret != KNOT_EOK) {
+		fprintf(stderr, "failed (%s)\n", knot_strerror(ret));
+	} else {
+		printf("%-8s %6u %12.0f %12.0f %14.0f %15.0f\n", each ? "each" : "bulk",
+		       count, build / rounds, merge / rounds,
+		       sub / rounds, inter / rounds);
+	}
+
+	sets_deinit(&sets);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned max = (argc > 1) ? atoi(argv[1]) : 60000;
+	if (max == 0 || max > 60000) {
+		return EXIT_FAILURE;
+	}
+
+	printf("%-8s %6s %12s %12s %14s %15s\n", "mode", "RRs", "build [ns]",
+	       "merge [ns]", "subtract [ns]", "intersect [ns]");
+
+	static const unsigned sizes[] = { 10, 1000, 60000 };
+	for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if (sizes[i] > max) {
+			break;
+		}
+		bench(sizes[i], true);
+		bench(sizes[i], false);
+	}
+
+	return EXIT_SUCCESS;
+}
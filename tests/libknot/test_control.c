@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -112,9 +112,20 @@ static void ctl_server(const char *socket, size_t argc, knot_ctl_data_t *argv)
 	int ret = knot_ctl_bind(ctl, socket);
 	is_int(KNOT_EOK, ret, "Bind control socket");
 
+	int wake[2];
+	ok(pipe(wake) == 0 && write(wake[1], "", 1) == 1, "Write to wake-up pipe");
+	ret = knot_ctl_accept_wake(ctl, wake[0]);
+	is_int(KNOT_EAGAIN, ret, "Wake up waiting for a connection");
+	close(wake[0]);
+	close(wake[1]);
+
 	ret = knot_ctl_accept(ctl);
 	is_int(KNOT_EOK, ret, "Accept a connection");
 
+	knot_ctl_t *listener = ctl;
+	ctl = knot_ctl_clone(listener);
+	ok(ctl != NULL, "Clone accepted connection");
+
 	diag("BEGIN: Server <- Client");
 
 	size_t count = 0;
@@ -169,8 +180,10 @@ static void ctl_server(const char *socket, size_t argc, knot_ctl_data_t *argv)
 	diag("END: Server -> Client");
 
 	knot_ctl_close(ctl);
-	knot_ctl_unbind(ctl);
 	knot_ctl_free(ctl);
+
+	knot_ctl_unbind(listener);
+	knot_ctl_free(listener);
 }
 
 static void test_client_server_client(void)
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2019 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -16,6 +16,7 @@
 
 #include <assert.h>
 #include <tap/basic.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "libknot/rdataset.c"
@@ -37,6 +38,119 @@ static size_t rdataset_size(const knot_rdataset_t *rrs)
 	return (uint8_t *)last + knot_rdata_size(last->len) - (uint8_t *)rrs->rdata;
 }
 
+// Fills the buffer with count RRs with data i * step + offset, in random order.
+static knot_rdata_t **random_rrs(uint8_t *buf, size_t count, unsigned step,
+                                 unsigned offset)
+{
+	knot_rdata_t **rrs = malloc(count * sizeof(*rrs));
+	assert(rrs);
+	for (size_t i = 0; i < count; i++) {
+		rrs[i] = (knot_rdata_t *)(buf + i * knot_rdata_size(2));
+		uint16_t val = i * step + offset;
+		knot_rdata_init(rrs[i], 2, (uint8_t *)&val);
+	}
+	for (size_t i = count; i > 1; i--) {
+		size_t j = random() % i;
+		knot_rdata_t *tmp = rrs[i - 1];
+		rrs[i - 1] = rrs[j];
+		rrs[j] = tmp;
+	}
+	return rrs;
+}
+
+static void rrs_from_add(knot_rdataset_t *rrs, knot_rdata_t **rdata, size_t count)
+{
+	knot_rdataset_init(rrs);
+	for (size_t i = 0; i < count; i++) {
+		int ret = knot_rdataset_add(rrs, rdata[i], NULL);
+		assert(ret == KNOT_EOK);
+		(void)ret;
+	}
+}
+
+static bool rrs_sorted(const knot_rdataset_t *rrs)
+{
+	knot_rdata_t *rr = rrs->rdata;
+	for (uint16_t i = 1; i < rrs->count; i++) {
+		knot_rdata_t *next = knot_rdataset_next(rr);
+		if (knot_rdata_cmp(rr, next) >= 0) {
+			return false;
+		}
+		rr = next;
+	}
+	return rrs->size == rdataset_size(rrs);
+}
+
+static void test_bulk(size_t count)
+{
+	uint8_t *buf1 = malloc(count * knot_rdata_size(2));
+	uint8_t *buf2 = malloc(count * knot_rdata_size(2));
+	assert(buf1 && buf2);
+	knot_rdata_t **rr1 = random_rrs(buf1, count, 2, 0);
+	knot_rdata_t **rr2 = random_rrs(buf2, count, 3, 1);
+
+	// Reference results computed one RR at a time.
+	knot_rdataset_t set1, set2, ref_merge, ref_inter, ref_sub;
+	rrs_from_add(&set1, rr1, count);
+	rrs_from_add(&set2, rr2, count);
+	knot_rdataset_init(&ref_inter);
+	knot_rdataset_init(&ref_sub);
+	int ret = knot_rdataset_copy(&ref_merge, &set1, NULL);
+	assert(ret == KNOT_EOK);
+	for (size_t i = 0; i < count; i++) {
+		ret = knot_rdataset_add(&ref_merge, rr2[i], NULL);
+		assert(ret == KNOT_EOK);
+		if (knot_rdataset_member(&set2, rr1[i])) {
+			ret = knot_rdataset_add(&ref_inter, rr1[i], NULL);
+		} else {
+			ret = knot_rdataset_add(&ref_sub, rr1[i], NULL);
+		}
+		assert(ret == KNOT_EOK);
+	}
+
+	knot_rdataset_t built;
+	ret = knot_rdataset_from_array(&built, (const knot_rdata_t **)rr1, count, NULL);
+	ok(ret == KNOT_EOK && knot_rdataset_eq(&built, &set1) && rrs_sorted(&built),
+	   "rdataset: from array, %zu RRs", count);
+	knot_rdataset_clear(&built, NULL);
+
+	knot_rdataset_t merged;
+	ret = knot_rdataset_copy(&merged, &set1, NULL);
+	assert(ret == KNOT_EOK);
+	ret = knot_rdataset_merge(&merged, &set2, NULL);
+	ok(ret == KNOT_EOK && knot_rdataset_eq(&merged, &ref_merge) && rrs_sorted(&merged),
+	   "rdataset: merge, %zu RRs", count);
+
+	ret = knot_rdataset_merge(&merged, &set1, NULL);
+	ok(ret == KNOT_EOK && knot_rdataset_eq(&merged, &ref_merge),
+	   "rdataset: merge subset, %zu RRs", count);
+
+	knot_rdataset_t inter;
+	ret = knot_rdataset_intersect(&set1, &set2, &inter, NULL);
+	ok(ret == KNOT_EOK && knot_rdataset_eq(&inter, &ref_inter) && rrs_sorted(&inter),
+	   "rdataset: intersect, %zu RRs", count);
+
+	ret = knot_rdataset_subtract(&merged, &set2, NULL);
+	ok(ret == KNOT_EOK && knot_rdataset_eq(&merged, &ref_sub) && rrs_sorted(&merged),
+	   "rdataset: subtract, %zu RRs", count);
+
+	ret = knot_rdataset_subtract(&merged, &set1, NULL);
+	ok(ret == KNOT_EOK && merged.count == 0 && merged.rdata == NULL,
+	   "rdataset: subtract superset, %zu RRs", count);
+
+	knot_rdataset_clear(&inter, NULL);
+	knot_rdataset_clear(&merged, NULL);
+	knot_rdataset_clear(&ref_sub, NULL);
+	knot_rdataset_clear(&ref_inter, NULL);
+	knot_rdataset_clear(&ref_merge, NULL);
+	knot_rdataset_clear(&set2, NULL);
+	knot_rdataset_clear(&set1, NULL);
+	free(rr2);
+	free(rr1);
+	free(buf2);
+	free(buf1);
+}
+
 int main(int argc, char *argv[])
 {
 	plan_lazy();
@@ -195,6 +309,22 @@ int main(int argc, char *argv[])
 	              rdataset.rdata == NULL;
 	ok(subtract_ok, "rdataset: subtract last.");
 
+	// Test from array
+	ok(knot_rdataset_from_array(NULL, NULL, 0, NULL) == KNOT_EINVAL,
+	   "rdataset: from array NULL.");
+	const knot_rdata_t *array[] = { rdata_gt, rdata_lo, rdata_gt };
+	ret = knot_rdataset_from_array(&copy, array, 3, NULL);
+	ok(ret == KNOT_EOK && copy.count == 2 && copy.size == rdataset_size(&copy) &&
+	   knot_rdata_cmp(knot_rdataset_at(&copy, 0), rdata_lo) == 0 &&
+	   knot_rdata_cmp(knot_rdataset_at(&copy, 1), rdata_gt) == 0,
+	   "rdataset: from array with duplicate.");
+	knot_rdataset_clear(&copy, NULL);
+
+	// Test operations on larger sets against one-by-one results
+	test_bulk(10);
+	test_bulk(500);
+	test_bulk(3000);
+
 	knot_rdataset_clear(&copy, NULL);
 	knot_rdataset_clear(&rdataset, NULL);
 	knot_rdataset_clear(&rdataset_lo, NULL);
@@ -1,4 +1,4 @@
-/*  Copyright (C) 2018 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -20,6 +20,7 @@
 #include "libknot/packet/rrset-wire.h"
 #include "libknot/descriptor.h"
 #include "libknot/errcode.h"
+#include "libknot/rrset.h"
 
 // Wire initializers
 
@@ -246,6 +247,36 @@ static void test_canonization(void)
 	check_canon(wire, size, pos, true, low_qname, low_dname);
 }
 
+static void test_rotation(void)
+{
+	#define ROT_COUNT 5
+	#define ROT_RR_SIZE (1 + 2 + 2 + 4 + 2 + 4) // Root owner, A record.
+
+	knot_rrset_t *rrset = knot_rrset_new((const knot_dname_t *)"", KNOT_RRTYPE_A,
+	                                     KNOT_CLASS_IN, 3600, NULL);
+	assert(rrset);
+	for (uint8_t i = 0; i < ROT_COUNT; i++) {
+		uint8_t addr[] = { 192, 0, 2, i };
+		int ret = knot_rrset_add_rdata(rrset, addr, sizeof(addr), NULL);
+		assert(ret == KNOT_EOK);
+		(void)ret;
+	}
+
+	for (uint16_t rotate = 0; rotate <= ROT_COUNT; rotate++) {
+		uint8_t wire[ROT_COUNT * ROT_RR_SIZE];
+		int ret = knot_rrset_to_wire_extra(rrset, wire, sizeof(wire), rotate,
+		                                   NULL, 0);
+		bool match = (ret == sizeof(wire));
+		for (uint16_t i = 0; match && i < ROT_COUNT; i++) {
+			uint8_t last = wire[(i + 1) * ROT_RR_SIZE - 1];
+			match = (last == (rotate + i) % ROT_COUNT);
+		}
+		ok(match, "rrset wire: rotation by %u", rotate);
+	}
+
+	knot_rrset_free(rrset, NULL);
+}
+
 int main(int argc, char *argv[])
 {
 	plan_lazy();
@@ -260,5 +291,8 @@ int main(int argc, char *argv[])
 	diag("Test canonization");
 	test_canonization();
 
+	diag("Test rotation");
+	test_rotation();
+
 	return 0;
 }
@@ -0,0 +1,142 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * Measures the RRL table throughput with N threads querying either from
+ * the same /24 subnet (all threads hit one bucket, as during a reflection
+ * attack) or from distinct random subnets.
+ *
+ * Usage: bench_rrl [max_threads] [queries_per_thread]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libdnssec/crypto.h"
+#include "libdnssec/random.h"
+#include "libknot/libknot.h"
+#include "contrib/sockaddr.h"
+#include "contrib/time.h"
+#include "knot/modules/rrl/functions.c"
+
+#define RRL_SIZE 393241
+#define RRL_RATE 100
+
+typedef struct {
+	rrl_table_t *rrl;
+	rrl_req_t *req;
+	const knot_dname_t *zone;
+	unsigned queries;
+	bool same_subnet;
+	unsigned limited;
+} bench_ctx_t;
+
+static void *bench_thread(void *arg)
+{
+	bench_ctx_t *ctx = arg;
+
+	struct sockaddr_storage addr;
+	sockaddr_set(&addr, AF_INET, "192.0.2.0", 0);
+	struct sockaddr_in *addr4 = (struct sockaddr_in *)&addr;
+	uint32_t seed = dnssec_random_uint32_t();
+
+	for (unsigned i = 0; i < ctx->queries; i++) {
+		seed = seed * 1103515245 + 12345;
+		if (ctx->same_subnet) {
+			((uint8_t *)&addr4->sin_addr)[3] = seed >> 24;
+		} else {
+			addr4->sin_addr.s_addr = seed;
+		}
+		if (rrl_query(ctx->rrl, &addr, ctx->req, ctx->zone, NULL) != KNOT_EOK) {
+			ctx->limited++;
+		}
+	}
+
+	return NULL;
+}
+
+static double bench(unsigned threads, unsigned queries, bool same_subnet,
+                    rrl_req_t *req, const knot_dname_t *zone)
+{
+	rrl_table_t *rrl = rrl_create(RRL_SIZE, RRL_RATE);
+	if (rrl == NULL) {
+		return -1;
+	}
+
+	pthread_t thr[threads];
+	bench_ctx_t ctx[threads];
+
+	struct timespec begin = time_now();
+	for (unsigned i = 0; i < threads; i++) {
+		ctx[i] = (bench_ctx_t) {
+			.rrl = rrl,
+			.req = req,
+			.zone = zone,
+			.queries = queries,
+			.same_subnet = same_subnet
+		};
+		pthread_create(&thr[i], NULL, bench_thread, &ctx[i]);
+	}
+	for (unsigned i = 0; i < threads; i++) {
+		pthread_join(thr[i], NULL);
+	}
+	struct timespec end = time_now();
+
+	rrl_destroy(rrl);
+
+	double elapsed = time_diff_ms(&begin, &end) / 1000;
+	return threads * queries / elapsed / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned max_threads = (argc > 1) ? atoi(argv[1]) : 8;
+	unsigned queries = (argc > 2) ? atoi(argv[2]) : 1000000;
+
+	dnssec_crypto_init();
+
+	/* Positive answer to a query. */
+	knot_pkt_t *query = knot_pkt_new(NULL, 512, NULL);
+	knot_dname_t *qname = knot_dname_from_str_alloc("www.example.com.");
+	knot_pkt_put_question(query, qname, KNOT_CLASS_IN, KNOT_RRTYPE_A);
+	knot_dname_free(qname, NULL);
+
+	uint8_t resp[512];
+	memcpy(resp, query->wire, query->size);
+	knot_wire_flags_set_qr(resp);
+	knot_wire_set_ancount(resp, 1);
+
+	rrl_req_t req = {
+		.wire = resp,
+		.len = query->size,
+		.query = query
+	};
+	knot_dname_t *zone = knot_dname_from_str_alloc("example.com.");
+
+	printf("%8s %18s %18s\n", "threads", "same /24 [Mqps]", "random [Mqps]");
+	for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+		double same = bench(threads, queries, true, &req, zone);
+		double random = bench(threads, queries, false, &req, zone);
+		printf("%8u %18.2f %18.2f\n", threads, same, random);
+	}
+
+	knot_dname_free(zone, NULL);
+	knot_pkt_free(query);
+	dnssec_crypto_cleanup();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <tap/basic.h>
+
+#include "libdnssec/crypto.h"
+#include "knot/modules/geoip/geoip.c"
+
+#define THREADS		2
+#define RANDOM_ADDRS	2000
+
+static const struct {
+	const char *addr;
+	uint8_t prefix;
+} NETS[] = {
+	{ "10.0.0.0",     8 },
+	{ "10.1.0.0",    16 },
+	{ "10.1.2.0",    24 },
+	{ "192.168.1.0", 24 },
+	{ "2001:db8::",  32 },
+	{ "2001:db8:1::", 48 },
+};
+
+#define NET_COUNT (sizeof(NETS) / sizeof(NETS[0]))
+
+static struct sockaddr_storage addr(const char *str)
+{
+	struct sockaddr_storage ss = { 0 };
+	int family = (strchr(str, ':') != NULL) ? AF_INET6 : AF_INET;
+	(void)sockaddr_set(&ss, family, str, 0);
+	return ss;
+}
+
+static void random_addr(struct sockaddr_storage *ss)
+{
+	// Mostly addresses around the views, some of them outside.
+	static const char *bases[] = { "10.1.2.0", "192.168.1.0", "172.16.0.0", "2001:db8:1::" };
+	*ss = addr(bases[random() % 4]);
+
+	size_t len = 0;
+	uint8_t *raw = (uint8_t *)sockaddr_raw(ss, &len);
+	raw[len - 1] = random();
+	raw[len - 2] ^= random() % 4;
+	raw[1] ^= random() % 2;
+}
+
+static void init_ctx(geoip_ctx_t *ctx, geo_trie_val_t *data,
+                     geo_view_t *views, struct sockaddr_storage *subnets)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->mode = MODE_SUBNET;
+	ctx->geo_trie = trie_create(NULL);
+
+	memset(data, 0, sizeof(*data));
+	data->views = views;
+	for (size_t i = 0; i < NET_COUNT; i++) {
+		memset(&views[i], 0, sizeof(views[i]));
+		subnets[i] = addr(NETS[i].addr);
+		views[i].subnet = &subnets[i];
+		views[i].subnet_prefix = NETS[i].prefix;
+		data->count++;
+	}
+	*trie_get_ins(ctx->geo_trie, (const uint8_t *)"a", 1) = data;
+
+	geo_sort_and_link(ctx);
+}
+
+/*! \brief Check the cached selection against the uncached one. */
+static void test_equal(geoip_ctx_t *ctx, geo_trie_val_t *data)
+{
+	int errors = 0, hits = 0, misses = 0, repeated_hits = 0;
+	for (int i = 0; i < RANDOM_ADDRS; i++) {
+		struct sockaddr_storage ss;
+		random_addr(&ss);
+
+		uint16_t expected_netmask = 0;
+		const geo_view_t *expected = select_view(ctx, data, &ss, &expected_netmask);
+
+		// The repeated lookup is answered from the cache.
+		for (int j = 0; j < 2; j++) {
+			uint16_t netmask = 0;
+			int ctr = -1;
+			const geo_view_t *view = get_view(ctx, i % THREADS, data, &ss,
+			                                  &netmask, &ctr);
+			errors += (view != expected || netmask != expected_netmask);
+			hits += (ctr == VIEW_CACHE_HIT);
+			misses += (ctr == VIEW_CACHE_MISS);
+			repeated_hits += (j == 1 && ctr == VIEW_CACHE_HIT);
+		}
+	}
+	ok(errors == 0, "view cache: same views as without the cache");
+	ok(repeated_hits == RANDOM_ADDRS && misses > 0 && hits + misses == 2 * RANDOM_ADDRS,
+	   "view cache: hit and miss counters");
+}
+
+static int cached(geoip_ctx_t *ctx, geo_trie_val_t *data, const char *str,
+                  const geo_view_t **view)
+{
+	struct sockaddr_storage ss = addr(str);
+	uint16_t netmask = 0;
+	int ctr = -1;
+	*view = get_view(ctx, 0, data, &ss, &netmask, &ctr);
+	return ctr;
+}
+
+static void test_lru(geoip_ctx_t *ctx, geo_trie_val_t *data)
+{
+	// A single set of CACHE_WAYS entries.
+	free_view_caches(ctx);
+	ok(init_view_caches(ctx, 1, CACHE_WAYS) == KNOT_EOK && ctx->caches[0].mask == 0,
+	   "view cache: single set");
+
+	const char *addrs[] = { "10.0.0.1", "10.1.0.1", "10.1.2.1", "192.168.1.1", "2001:db8::1" };
+	const geo_view_t *view;
+	int misses = 0;
+	for (int i = 0; i < CACHE_WAYS; i++) {
+		misses += (cached(ctx, data, addrs[i], &view) == VIEW_CACHE_MISS);
+	}
+	ok(misses == CACHE_WAYS, "view cache: first lookups miss");
+
+	// Make the first entry the most recent, the second one is the least recent.
+	ok(cached(ctx, data, addrs[0], &view) == VIEW_CACHE_HIT, "view cache: hit");
+	ok(cached(ctx, data, addrs[CACHE_WAYS], &view) == VIEW_CACHE_MISS, "view cache: new entry");
+	ok(cached(ctx, data, addrs[0], &view) == VIEW_CACHE_HIT, "view cache: recent entry kept");
+	ok(cached(ctx, data, addrs[1], &view) == VIEW_CACHE_MISS, "view cache: LRU entry evicted");
+
+	// No suitable view is cached too.
+	ok(cached(ctx, data, "172.16.0.1", &view) == VIEW_CACHE_MISS && view == NULL,
+	   "view cache: no view, miss");
+	ok(cached(ctx, data, "172.16.0.1", &view) == VIEW_CACHE_HIT && view == NULL,
+	   "view cache: no view, hit");
+}
+
+static void test_uncached(geoip_ctx_t *ctx, geo_trie_val_t *data)
+{
+	struct sockaddr_storage ss = addr("10.1.2.3");
+	uint16_t netmask = 0;
+	int ctr = -1;
+	const geo_view_t *view = get_view(ctx, ctx->cache_count, data, &ss, &netmask, &ctr);
+	ok(ctr == -1 && view != NULL && view->subnet_prefix == 24 && netmask == 24,
+	   "view cache: thread without cache");
+
+	ctx->mode = MODE_WEIGHTED;
+	data->total_weight = 1;
+	(void)get_view(ctx, 0, data, &ss, &netmask, &ctr);
+	ok(ctr == -1, "view cache: weighted mode not cached");
+	ctx->mode = MODE_SUBNET;
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	dnssec_crypto_init();
+
+	geoip_ctx_t ctx;
+	geo_trie_val_t data;
+	geo_view_t views[NET_COUNT];
+	struct sockaddr_storage subnets[NET_COUNT];
+	init_ctx(&ctx, &data, views, subnets);
+
+	// Several sets, so that the entries are spread.
+	ok(init_view_caches(&ctx, THREADS, 64) == KNOT_EOK, "view cache: init");
+	test_equal(&ctx, &data);
+	test_uncached(&ctx, &data);
+	test_lru(&ctx, &data);
+
+	free_view_caches(&ctx);
+	trie_free(ctx.geo_trie);
+
+	dnssec_crypto_cleanup();
+
+	return 0;
+}
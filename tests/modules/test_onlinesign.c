@@ -1,4 +1,4 @@
-/*  Copyright (C) 2018 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -16,11 +16,14 @@
 
 #include <tap/basic.h>
 #include <assert.h>
+#include <string.h>
 
 #include "knot/modules/onlinesign/nsec_next.h"
+#include "knot/modules/onlinesign/rrsig_cache.h"
 #include "libknot/consts.h"
 #include "libknot/dname.h"
 #include "libknot/errcode.h"
+#include "libknot/rrset.h"
 
 /*!
  * \brief Assert that a domain name in a static buffer is valid.
@@ -58,6 +61,72 @@ static void _test_nsec_next(const char *msg,
 	_test_nsec_next(msg, input, apex, expected); \
 }
 
+static knot_rrset_t *make_rrset(uint16_t type, const char *rdata)
+{
+	knot_rrset_t *rrset = knot_rrset_new((uint8_t *)"\x03""www""\x07""example""\x03""com",
+	                                     type, KNOT_CLASS_IN, 3600, NULL);
+	if (rrset != NULL &&
+	    knot_rrset_add_rdata(rrset, (uint8_t *)rdata, strlen(rdata), NULL) != KNOT_EOK) {
+		knot_rrset_free(rrset, NULL);
+		return NULL;
+	}
+
+	return rrset;
+}
+
+static bool cache_get(rrsig_cache_t *cache, const knot_rrset_t *covered,
+                      knot_time_t now, const knot_rrset_t *expected)
+{
+	knot_rrset_t *rrsig = knot_rrset_new(covered->owner, KNOT_RRTYPE_RRSIG,
+	                                     KNOT_CLASS_IN, covered->ttl, NULL);
+	if (rrsig == NULL) {
+		return false;
+	}
+
+	bool found = rrsig_cache_get(cache, covered, now, rrsig, NULL) == KNOT_EOK &&
+	             knot_rdataset_eq(&rrsig->rrs, &expected->rrs);
+	knot_rrset_free(rrsig, NULL);
+
+	return found;
+}
+
+static void test_rrsig_cache(void)
+{
+	rrsig_cache_t *cache = rrsig_cache_new(100);
+	ok(cache != NULL, "rrsig_cache, create");
+	ok(rrsig_cache_new(0) == NULL, "rrsig_cache, zero size");
+
+	knot_rrset_t *a = make_rrset(KNOT_RRTYPE_A, "\xc0\x01\x02\x01");
+	knot_rrset_t *a2 = make_rrset(KNOT_RRTYPE_A, "\xc0\x01\x02\x02");
+	knot_rrset_t *aaaa = make_rrset(KNOT_RRTYPE_AAAA, "\xc0\x01\x02\x01");
+	knot_rrset_t *sig = make_rrset(KNOT_RRTYPE_RRSIG, "signature");
+	assert(a && a2 && aaaa && sig);
+
+	ok(!cache_get(cache, a, 10, sig), "rrsig_cache, empty");
+	rrsig_cache_put(cache, a, sig, 20, rrsig_cache_gen(cache));
+	ok(cache_get(cache, a, 10, sig), "rrsig_cache, hit");
+	ok(!cache_get(cache, a, 20, sig), "rrsig_cache, refresh");
+	ok(!cache_get(cache, a2, 10, sig), "rrsig_cache, different rdata");
+	ok(!cache_get(cache, aaaa, 10, sig), "rrsig_cache, different type");
+	a->ttl = 60;
+	ok(!cache_get(cache, a, 10, sig), "rrsig_cache, different TTL");
+	a->ttl = 3600;
+
+	uint64_t gen = rrsig_cache_gen(cache);
+	rrsig_cache_invalidate(cache);
+	ok(!cache_get(cache, a, 10, sig), "rrsig_cache, invalidated");
+	rrsig_cache_put(cache, a, sig, 20, gen);
+	ok(!cache_get(cache, a, 10, sig), "rrsig_cache, stale generation not stored");
+	rrsig_cache_put(cache, a, sig, 20, rrsig_cache_gen(cache));
+	ok(cache_get(cache, a, 10, sig), "rrsig_cache, hit after invalidation");
+
+	knot_rrset_free(a, NULL);
+	knot_rrset_free(a2, NULL);
+	knot_rrset_free(aaaa, NULL);
+	knot_rrset_free(sig, NULL);
+	rrsig_cache_free(cache);
+}
+
 int main(int argc, char *argv[])
 {
 	plan_lazy();
@@ -199,5 +268,7 @@ int main(int argc, char *argv[])
 		APEX
 	);
 
+	test_rrsig_cache();
+
 	return 0;
 }
@@ -14,6 +14,7 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
 #include <tap/basic.h>
 
 #include "libdnssec/crypto.h"
@@ -28,17 +29,7 @@
 #define RRL_SIZE 196613
 #define RRL_THREADS 8
 #define RRL_INSERTS (RRL_SIZE/(5*RRL_THREADS)) /* lf = 1/5 */
-
-/* Disabled as default as it depends on random input.
- * Table may be consistent even if some collision occur (and they may occur).
- * Note: Disabled due to reported problems when running on VMs due to time
- * flow inconsistencies. Should work alright on a host machine.
- */
-#ifdef ENABLE_TIMED_TESTS
-struct bucketmap {
-	unsigned i;
-	uint64_t x;
-};
+#define RRL_SAME_QUERIES 5 /* Per thread, all within the capacity. */
 
 /*! \brief Unit runnable. */
 struct runnable_data {
@@ -49,44 +40,68 @@ struct runnable_data {
 	knot_dname_t *zone;
 };
 
-static void* rrl_runnable(void *arg)
+static void *rrl_runnable_same(void *arg)
 {
 	struct runnable_data *d = (struct runnable_data *)arg;
-	struct sockaddr_storage addr;
-	memcpy(&addr, d->addr, sizeof(struct sockaddr_storage));
-	int lock = -1;
-	uint32_t now = time(NULL);
-	struct bucketmap *m = malloc(RRL_INSERTS * sizeof(struct bucketmap));
-	for (unsigned i = 0; i < RRL_INSERTS; ++i) {
-		m[i].i = dnssec_random_uint32_t();
-		((struct sockaddr_in *) &addr)->sin_addr.s_addr = m[i].i;
-		rrl_item_t *b = rrl_hash(d->rrl, &addr, d->rq, d->zone, now, &lock);
-		rrl_unlock(d->rrl, lock);
-		m[i].x = b->netblk;
-	}
-	for (unsigned i = 0; i < RRL_INSERTS; ++i) {
-		((struct sockaddr_in *) &addr)->sin_addr.s_addr = m[i].i;
-		rrl_item_t *b = rrl_hash(d->rrl, &addr, d->rq, d->zone, now, &lock);
-		rrl_unlock(d->rrl, lock);
-		if (b->netblk != m[i].x) {
+	for (unsigned i = 0; i < RRL_SAME_QUERIES; ++i) {
+		if (rrl_query(d->rrl, d->addr, d->rq, d->zone, NULL) != KNOT_EOK) {
 			d->passed = 0;
 		}
 	}
-	free(m);
 	return NULL;
 }
 
-static void rrl_hopscotch(struct runnable_data* rd)
+static void rrl_threads(struct runnable_data *rd, void *(*runnable)(void *))
 {
 	rd->passed = 1;
 	pthread_t thr[RRL_THREADS];
 	for (unsigned i = 0; i < RRL_THREADS; ++i) {
-		pthread_create(thr + i, NULL, &rrl_runnable, rd);
+		pthread_create(thr + i, NULL, runnable, rd);
 	}
 	for (unsigned i = 0; i < RRL_THREADS; ++i) {
 		pthread_join(thr[i], NULL);
 	}
 }
+
+/* Disabled as default as it depends on random input.
+ * Table may be consistent even if some collision occur (and they may occur).
+ * Note: Disabled due to reported problems when running on VMs due to time
+ * flow inconsistencies. Should work alright on a host machine.
+ */
+#ifdef ENABLE_TIMED_TESTS
+static bool rrl_found(struct runnable_data *d, struct sockaddr_storage *addr, uint32_t now)
+{
+	uint8_t buf[RRL_CLSBLK_MAXLEN];
+	int len = rrl_classify(buf, sizeof(buf), addr, d->rq, d->zone);
+	uint64_t hash = SipHash24(&d->rrl->key, buf, len);
+
+	uint64_t word;
+	rrl_item_t bucket;
+	(void)rrl_lookup(d->rrl, hash, now, &word, &bucket);
+	return (word >> BKT_TAG_SHIFT) == bucket.tag;
+}
+
+static void *rrl_runnable(void *arg)
+{
+	struct runnable_data *d = (struct runnable_data *)arg;
+	struct sockaddr_storage addr;
+	memcpy(&addr, d->addr, sizeof(struct sockaddr_storage));
+	uint32_t now = time_now().tv_sec;
+	uint32_t *m = malloc(RRL_INSERTS * sizeof(uint32_t));
+	for (unsigned i = 0; i < RRL_INSERTS; ++i) {
+		m[i] = dnssec_random_uint32_t();
+		((struct sockaddr_in *) &addr)->sin_addr.s_addr = m[i];
+		(void)rrl_query(d->rrl, &addr, d->rq, d->zone, NULL);
+	}
+	for (unsigned i = 0; i < RRL_INSERTS; ++i) {
+		((struct sockaddr_in *) &addr)->sin_addr.s_addr = m[i];
+		if (!rrl_found(d, &addr, now)) {
+			d->passed = 0;
+		}
+	}
+	free(m);
+	return NULL;
+}
 #endif
 
 int main(int argc, char *argv[])
@@ -153,6 +168,15 @@ int main(int argc, char *argv[])
 	rrl_classify(buf, sizeof(buf), &addr6, &rq, qname);
 	is_int(0, memcmp(buf, expectedv6, sizeof(expectedv6)), "rrl: IPv6 hash input buffer");
 
+	/* 4. Parallel requests from one subnet. */
+	struct sockaddr_storage addr_same;
+	sockaddr_set(&addr_same, AF_INET, "10.20.30.40", 0);
+	struct runnable_data rd = {
+		1, rrl, &addr_same, &rq, zone
+	};
+	rrl_threads(&rd, rrl_runnable_same);
+	ok(rd.passed, "rrl: parallel requests within the limit");
+
 #ifdef ENABLE_TIMED_TESTS
 	/* 5. limited request */
 	ret = rrl_query(rrl, &addr, &rq, zone, NULL);
@@ -162,11 +186,13 @@ int main(int argc, char *argv[])
 	ret = rrl_query(rrl, &addr6, &rq, zone, NULL);
 	is_int(KNOT_ELIMIT, ret, "rrl: throttled IPv6 request");
 
-	/* 8. hopscotch test */
-	struct runnable_data rd = {
-		1, rrl, &addr, &rq, zone
-	};
-	rrl_hopscotch(&rd);
+	/* 7. no lost updates from parallel requests */
+	ret = rrl_query(rrl, &addr_same, &rq, zone, NULL);
+	is_int(KNOT_ELIMIT, ret, "rrl: parallel requests accounted");
+
+	/* 8. table consistency test */
+	rd.addr = &addr;
+	rrl_threads(&rd, rrl_runnable);
 	ok(rd.passed, "rrl: hashtable is ~ consistent");
 #endif
 